@@ -1,11 +1,12 @@
 #pragma once
 
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
 #ifndef SERVER_BUILD
 #include "SDL.h"
-#endif SERVER_BUILD
+#endif // SERVER_BUILD
 
 #if defined(_MSC_VER)
 #include <intrin.h>
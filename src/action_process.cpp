@@ -32,12 +32,7 @@ namespace process
 	void action::update(engine& eng, double t, const entity_list& elist)
 	{
 		using namespace component;
-		static component_id mask = genmask(Component::INPUT) | genmask(Component::POSITION);
-		for(auto& e : elist) {
-			if((e->mask & mask) == mask) {
-				auto& inp = e->inp;
-				auto& pos = e->pos;
-			}
-		}
+		eng.for_each<Component::INPUT, Component::POSITION>([](const component_set_ptr& e, component::input& inp, point& pos) {
+		});
 	}
 }
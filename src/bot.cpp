@@ -14,8 +14,6 @@
    limitations under the License.
 */
 
-#include <limits>
-
 #include "asserts.hpp"
 #include "bot.hpp"
 #include "creature.hpp"
@@ -25,6 +23,7 @@
 #include "message_format.pb.h"
 #include "profile_timer.hpp"
 #include "random.hpp"
+#include "reachability.hpp"
 #include "units.hpp"
 
 namespace ai
@@ -72,8 +71,10 @@ namespace ai
 	}
 
 	bot::bot(team_ptr team, const std::string& name, uuid::uuid u)
-		: player(team, PlayerType::AI, name, u)
+		: player(team, PlayerType::AI, name, u),
+		  search_(std::make_shared<parallel_search>())
 	{
+		limits_.time_budget = default_time_budget;
 	}
 
 	game::Update* bot::process(const game::state& gs, double time)
@@ -90,78 +91,24 @@ namespace ai
 		}
 
 		LOG_DEBUG("Running bot for " << u);
-
-		// Find available moves for current unit.
-		auto g = hex::create_cost_graph(gs, u->get_position(), u->get_move());
-		auto possible_moves = hex::find_available_moves(g, u->get_position(), u->get_move());
-
-		// Calculate the closest enemy and move towards them
-		game::unit_ptr closest_enemy = nullptr;
-		int closest_distance = std::numeric_limits<int>::max();
-		for(auto& enemy : gs.get_entities()) {
-			// XXX we should come up with a faster access for the team id, maybe add it directly as a member of component_set_ptr
-			if(enemy->get_owner()->team() != u->get_owner()->team()) {
-				if(closest_enemy == nullptr) {
-					closest_enemy = enemy;
-					closest_distance = hex::logical::distance(u->get_position(), enemy->get_position());
-				} else {
-					int d = hex::logical::distance(u->get_position(), enemy->get_position());
-					if(d < closest_distance) {
-						closest_enemy = enemy;
-						closest_distance = d;
-					}
-				}
-			}
-		}
-		// Found an enemy, try and get as close as possible.
-		point dest;
-		bool got_location = false;
-		hex::result_path rp;
-		if(closest_enemy && closest_distance > u->get_range()) {
-			auto surrounds = gs.get_map()->get_surrounding_positions(closest_enemy->get_position());
-			for(auto& p : possible_moves) {
-				for(auto& sp : surrounds) {
-					if(p.loc == sp) {
-						// We found a match.
-						got_location = true;
-						dest = sp;
-						break;
-					}
-				}
-			}
-
-			// Did we find a location of enemy within our list of possible moves?
-			if(got_location) {
-				rp = hex::find_path(g, u->get_position(), dest);
-			} else {
-				// Nope. Then we need to find the tile that is closest and move there.
-				int closest_d = std::numeric_limits<int>::max();
-				point closest_pos;
-				for(auto& p : possible_moves) {
-					int d = hex::logical::distance(p.loc, closest_enemy->get_position());
-					if(d < closest_d) {
-						closest_d = d;
-						closest_pos = p.loc;
-					}
-				}
-				rp = hex::find_path(g, u->get_position(), closest_pos);
-				got_location = true;
-			}
+		// Games too big for a snapshot fall back to the greedy play.
+		if((limits_.time_budget > 0 || limits_.max_iterations > 0) && game::snapshot::fits(gs)) {
+			return play_search(gs, u);
 		}
+		return play_greedy(gs, u);
+	}
 
-		ASSERT_LOG(got_location || closest_distance <= u->get_range(), "Programmer error: No location for destination.");
-
-		// Choose random destination
-		//int x = generator::get_uniform_int<int>(0, static_cast<int>(possible_moves.size()));
-		//auto rp = hex::find_path(g, e->pos.gs_pos, possible_moves[x].loc);
-
-		// Random move unit.
+	game::Update* bot::play_greedy(const game::state& gs, const game::unit_ptr& u)
+	{
+		// Move towards the nearest enemy, unless one is already in range.
+		reachability reach(gs);
 		game::Update* up = gs.create_update();
-		// No need to move if there is a unit next to us.
-		if(closest_distance > u->get_range()) {
-			gs.unit_move(up, u, rp);
+		point dest;
+		if(reach.enemy_distance(u->get_owner()->team(), u->get_position()) > u->get_range()
+			&& reach.find_closest_to_enemy(u, &dest)) {
+			gs.unit_move(up, u, reach.find_path(u, dest));
 		}
-		
+
 		// See if there is anything in attack range.
 		//while(e->stat->attacks_this_turn > 0) {
 			std::vector<game::unit_ptr> attackable;
@@ -184,6 +131,35 @@ namespace ai
 		return up;
 	}
 
+	game::Update* bot::play_search(const game::state& gs, const game::unit_ptr& u)
+	{
+		const game::snapshot snap(gs);
+		const turn_action turn = search_->find_turn(snap, limits_);
+		LOG_DEBUG("Bot searched " << search_->get_iterations() << " iterations, carrying on from "
+			<< search_->get_reused_visits() << " in a tree of " << search_->get_tree_size()
+			<< ", " << search_->get_table_hits() << " scores from the transposition table");
+
+		// Snapshot unit indices are positions in the list of entities.
+		std::vector<game::unit_ptr> targets;
+		for(int n = 0; n != turn.target_count; ++n) {
+			targets.emplace_back(gs.get_entities()[turn.targets[n]]);
+		}
+
+		game::Update* up = gs.create_update();
+		if(turn.dest != u->get_position()) {
+			reachability reach(gs);
+			auto path = reach.find_path(u, turn.dest);
+			if(!path.empty()) {
+				gs.unit_move(up, u, path);
+			}
+		}
+		if(!targets.empty()) {
+			gs.unit_attack(up, u, targets);
+		}
+		gs.end_turn(up);
+		return up;
+	}
+
 	player_ptr bot::clone()
 	{
 		return std::shared_ptr<bot>(new bot(*this));
@@ -16,8 +16,12 @@
 
 #pragma once
 
+#include <memory>
+
+#include "bot_search.hpp"
 #include "network_server.hpp"
 #include "player.hpp"
+#include "units_fwd.hpp"
 
 namespace ai
 {
@@ -29,6 +33,18 @@ namespace ai
 		explicit bot(team_ptr team, const std::string& name, uuid::uuid u=uuid::generate());
 		game::Update* process(const game::state& gs, double time) override;
 		player_ptr clone() override;
+
+		// How long to search for each turn. With no limits the bot plays greedily, moving
+		// towards the nearest enemy and attacking whatever is in range.
+		const search_limits& get_search_limits() const { return limits_; }
+		void set_search_limits(const search_limits& limits) { limits_ = limits; }
 	private:
+		game::Update* play_greedy(const game::state& gs, const game::unit_ptr& u);
+		game::Update* play_search(const game::state& gs, const game::unit_ptr& u);
+
+		search_limits limits_;
+		// Shared with clones of the bot, so the search tree is kept from turn to turn even
+		// though bots are run against copies of the game state.
+		std::shared_ptr<parallel_search> search_;
 	};
 }
@@ -0,0 +1,699 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <functional>
+
+#include "asserts.hpp"
+#include "bot_search.hpp"
+#include "game_state.hpp"
+#include "hex_logical_tiles.hpp"
+#include "node_utils.hpp"
+#include "thread_pool.hpp"
+#include "unit_test.hpp"
+#include "units.hpp"
+
+namespace ai
+{
+	namespace
+	{
+		// Most turns considered for a unit, the rest are pruned.
+		const int max_turns_considered = 8;
+		// Number of unit turns played greedily before a position is scored.
+		const int max_rollout_turns = 12;
+		// Nodes stop being added once the tree is this big, though the search carries on.
+		const size_t max_tree_nodes = 1 << 18;
+		// UCT exploration constant, scores are from zero to one.
+		const float exploration = 0.5f;
+		// Entries in the transposition tables, 16 bytes each.
+		const size_t table_size = 1 << 16;
+		// Scores are packed into the table as 16 bit fractions, so only this many teams fit.
+		const int max_table_teams = 4;
+
+		const uint8_t TILE_ENEMY = 1;
+		const uint8_t TILE_ZOC = 2;
+
+		bool same_turn(const turn_action& a, const turn_action& b)
+		{
+			return a.dest == b.dest && a.target_count == b.target_count
+				&& std::equal(a.targets, a.targets + a.target_count, b.targets);
+		}
+
+		// The most visited turn is the one the search is most sure of. With no visits at all
+		// this is the first, which the heuristic rated best.
+		turn_action pick_turn(const game::snapshot& snap, const std::vector<std::pair<turn_action, int>>& visits)
+		{
+			if(visits.empty()) {
+				// Nowhere to go and nothing to attack.
+				turn_action stay;
+				stay.dest = snap.get_position(snap.get_current_unit());
+				stay.cost = 0;
+				stay.target_count = 0;
+				return stay;
+			}
+			auto best = visits.begin();
+			for(auto it = visits.begin(); it != visits.end(); ++it) {
+				if(it->second > best->second) {
+					best = it;
+				}
+			}
+			return best->first;
+		}
+
+		uint64_t pack_scores(const float* scores, int team_count)
+		{
+			uint64_t data = 0;
+			for(int t = 0; t != team_count; ++t) {
+				const float s = std::min(1.0f, std::max(0.0f, scores[t]));
+				data |= static_cast<uint64_t>(s * 65535.0f + 0.5f) << (t * 16);
+			}
+			return data;
+		}
+
+		void unpack_scores(uint64_t data, int team_count, float* scores)
+		{
+			for(int t = 0; t != team_count; ++t) {
+				scores[t] = static_cast<float>((data >> (t * 16)) & 0xffff) / 65535.0f;
+			}
+		}
+	}
+
+	search::search()
+		: last_choice_(-1),
+		  iterations_(0),
+		  reused_visits_(0),
+		  table_hits_(0),
+		  table_(nullptr),
+		  generation_(0)
+	{
+	}
+
+	turn_action search::find_turn(const game::snapshot& snap, const search_limits& limits)
+	{
+		think(snap, limits, clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(limits.time_budget)));
+		std::vector<std::pair<turn_action, int>> visits;
+		get_root_visits(&visits);
+		const turn_action turn = pick_turn(snap, visits);
+		set_choice(turn);
+		return turn;
+	}
+
+	void search::think(const game::snapshot& snap, const search_limits& limits, const clock::time_point& deadline, transposition_table* table)
+	{
+		ASSERT_LOG(snap.get_current_unit() >= 0, "No unit to search for a turn for.");
+		ASSERT_LOG(limits.time_budget > 0 || limits.max_iterations > 0, "Search needs either a time or an iteration limit.");
+		if(table == nullptr) {
+			if(own_table_ == nullptr) {
+				own_table_.reset(new transposition_table(table_size));
+			}
+			table = own_table_.get();
+		}
+		table_ = snap.get_team_count() <= max_table_teams ? table : nullptr;
+		rng_ = generator::stream(limits.seed);
+		iterations_ = 0;
+		table_hits_ = 0;
+		if(!reuse_tree(snap)) {
+			reset_tree(snap);
+		}
+		reused_visits_ = nodes_[0].visits;
+
+		while(limits.max_iterations <= 0 || iterations_ < limits.max_iterations) {
+			if(limits.time_budget > 0 && clock::now() >= deadline) {
+				break;
+			}
+			run_iteration(snap);
+			++iterations_;
+		}
+		if(!nodes_[0].expanded) {
+			expand(0, snap);
+		}
+	}
+
+	void search::get_root_visits(std::vector<std::pair<turn_action, int>>* out) const
+	{
+		out->clear();
+		const node& root = nodes_[0];
+		for(int c = root.first_child; c < root.first_child + root.child_count; ++c) {
+			out->emplace_back(nodes_[c].action, nodes_[c].visits);
+		}
+	}
+
+	void search::set_choice(const turn_action& action)
+	{
+		last_choice_ = -1;
+		const node& root = nodes_[0];
+		for(int c = root.first_child; c < root.first_child + root.child_count; ++c) {
+			if(same_turn(nodes_[c].action, action)) {
+				last_choice_ = c;
+				break;
+			}
+		}
+	}
+
+	bool search::reuse_tree(const game::snapshot& snap)
+	{
+		if(nodes_.empty()) {
+			return false;
+		}
+		const uint64_t hash = snap.get_hash();
+		const int unit = snap.get_current_unit();
+		auto matches = [&](int n) {
+			return nodes_[n].visits > 0 && nodes_[n].hash == hash && nodes_[n].unit == unit;
+		};
+
+		// Either the same position is being searched again, or it's one that follows from
+		// the turn chosen last time.
+		int found = matches(0) ? 0 : -1;
+		std::vector<int> pending;
+		if(found < 0 && last_choice_ >= 0) {
+			pending.emplace_back(last_choice_);
+		}
+		for(size_t i = 0; i != pending.size() && found < 0; ++i) {
+			const node& nd = nodes_[pending[i]];
+			if(matches(pending[i])) {
+				found = pending[i];
+			}
+			for(int c = nd.first_child; c < nd.first_child + nd.child_count; ++c) {
+				pending.emplace_back(c);
+			}
+		}
+		if(found < 0) {
+			return false;
+		}
+
+		// Copy the subtree to a new list, breadth first, which keeps the children of each
+		// node next to each other.
+		std::vector<node> kept;
+		kept.emplace_back(nodes_[found]);
+		kept.back().parent = -1;
+		for(size_t i = 0; i != kept.size(); ++i) {
+			if(kept[i].expanded) {
+				const int first = kept[i].first_child;
+				const int count = kept[i].child_count;
+				kept[i].first_child = static_cast<int>(kept.size());
+				for(int c = first; c != first + count; ++c) {
+					kept.emplace_back(nodes_[c]);
+					kept.back().parent = static_cast<int>(i);
+				}
+			}
+		}
+		nodes_.swap(kept);
+		last_choice_ = -1;
+		return true;
+	}
+
+	void search::reset_tree(const game::snapshot& snap)
+	{
+		nodes_.clear();
+		node root;
+		root.parent = -1;
+		root.first_child = -1;
+		root.child_count = 0;
+		root.visits = 0;
+		root.value = 0;
+		root.team = -1;
+		root.unit = static_cast<int8_t>(snap.get_current_unit());
+		root.expanded = false;
+		root.hash = snap.get_hash();
+		nodes_.emplace_back(root);
+		last_choice_ = -1;
+	}
+
+	void search::run_iteration(const game::snapshot& root)
+	{
+		game::snapshot snap(root);
+		int n = 0;
+		while(!snap.is_finished()) {
+			// Critical strikes may have changed the order of play since the node was made,
+			// in which case its children are for a different unit.
+			if(nodes_[n].unit != snap.get_current_unit()) {
+				break;
+			}
+			if(!nodes_[n].expanded) {
+				if(nodes_.size() + max_turns_considered > max_tree_nodes) {
+					break;
+				}
+				expand(n, snap);
+				if(nodes_[n].child_count == 0) {
+					break;
+				}
+			}
+			n = select_child(n);
+			apply_turn(snap, nodes_[n].action);
+			if(nodes_[n].visits == 0) {
+				nodes_[n].unit = static_cast<int8_t>(snap.get_current_unit());
+				nodes_[n].hash = snap.get_hash();
+				break;
+			}
+		}
+
+		float scores[game::snapshot::max_teams];
+		uint64_t data;
+		if(table_ != nullptr && table_->probe(snap.get_hash(), &data)) {
+			unpack_scores(data, snap.get_team_count(), scores);
+			++table_hits_;
+		} else {
+			const uint64_t hash = snap.get_hash();
+			rollout(snap);
+			score(snap, scores);
+			if(table_ != nullptr) {
+				table_->store(hash, pack_scores(scores, snap.get_team_count()));
+			}
+		}
+		for(; n >= 0; n = nodes_[n].parent) {
+			node& nd = nodes_[n];
+			++nd.visits;
+			if(nd.team >= 0) {
+				nd.value += scores[nd.team];
+			}
+		}
+	}
+
+	void search::expand(int n, const game::snapshot& snap)
+	{
+		generate_turns(snap, &turns_);
+		const int8_t team = static_cast<int8_t>(snap.get_team(snap.get_current_unit()));
+		nodes_[n].first_child = static_cast<int>(nodes_.size());
+		nodes_[n].child_count = static_cast<int>(turns_.size());
+		nodes_[n].expanded = true;
+		for(auto& t : turns_) {
+			node child;
+			child.action = t;
+			child.parent = n;
+			child.first_child = -1;
+			child.child_count = 0;
+			child.visits = 0;
+			child.value = 0;
+			child.team = team;
+			child.unit = -1;
+			child.expanded = false;
+			child.hash = 0;
+			nodes_.emplace_back(child);
+		}
+	}
+
+	int search::select_child(int n) const
+	{
+		const node& nd = nodes_[n];
+		const float log_visits = std::log(static_cast<float>(std::max(1, nd.visits)));
+		int best = -1;
+		float best_score = -FLT_MAX;
+		for(int c = nd.first_child; c != nd.first_child + nd.child_count; ++c) {
+			const node& child = nodes_[c];
+			if(child.visits == 0) {
+				// Children are in heuristic order, so try the best looking ones first.
+				return c;
+			}
+			const float s = child.value / child.visits + exploration * std::sqrt(log_visits / child.visits);
+			if(s > best_score) {
+				best_score = s;
+				best = c;
+			}
+		}
+		return best;
+	}
+
+	void search::apply_turn(game::snapshot& snap, const turn_action& action)
+	{
+		const int u = snap.get_current_unit();
+		game::snapshot::undo rec;
+		if(action.dest != snap.get_position(u) && snap.unit_at(action.dest) < 0) {
+			snap.make_move(u, action.dest, action.cost, &rec);
+		}
+		for(int n = 0; n != action.target_count; ++n) {
+			const int t = action.targets[n];
+			if(snap.is_attackable(u, t)) {
+				snap.make_attack(u, t, rng_.uniform_real(0.0f, 1.0f) < snap.get_critical_strike(u), &rec);
+			}
+		}
+		snap.make_end_turn(&rec);
+	}
+
+	void search::rollout(game::snapshot& snap)
+	{
+		for(int n = 0; n != max_rollout_turns && !snap.is_finished(); ++n) {
+			generate_turns(snap, &turns_);
+			if(turns_.empty()) {
+				game::snapshot::undo rec;
+				snap.make_end_turn(&rec);
+			} else {
+				apply_turn(snap, turns_.front());
+			}
+		}
+	}
+
+	void search::score(const game::snapshot& snap, float* scores) const
+	{
+		float total = 0;
+		std::fill(scores, scores + game::snapshot::max_teams, 0.0f);
+		for(int n = 0; n != snap.get_active_count(); ++n) {
+			const int u = snap.get_active_unit(n);
+			const float value = static_cast<float>(snap.get_health(u)) * std::max(1, snap.get_attack(u));
+			scores[snap.get_team(u)] += value;
+			total += value;
+		}
+		for(int t = 0; t != snap.get_team_count(); ++t) {
+			scores[t] = total > 0 ? scores[t] / total : 1.0f / snap.get_team_count();
+		}
+	}
+
+	void search::find_moves(const game::snapshot& snap)
+	{
+		const int u = snap.get_current_unit();
+		const int team = snap.get_team(u);
+		const auto& costs = snap.get_map().get_cost_grid(snap.get_movement_type(u));
+		if(visited_.size() != costs.size()) {
+			visited_.assign(costs.size(), 0);
+			distance_.resize(costs.size());
+			flags_.resize(costs.size());
+			generation_ = 0;
+		}
+		++generation_;
+		reached_.clear();
+		open_.clear();
+
+		auto touch = [&](int ndx, const point& p) {
+			if(visited_[ndx] != generation_) {
+				visited_[ndx] = generation_;
+				distance_[ndx] = FLT_MAX;
+				flags_[ndx] = (snap.is_enemy_at(p, team) ? TILE_ENEMY : 0) | (snap.is_enemy_zoc(p, team) ? TILE_ZOC : 0);
+			}
+		};
+
+		// The same rules as hex::find_available_moves(), enemy units block movement and a unit
+		// can't move from one tile under enemy ZoC to another.
+		const float max_cost = snap.get_move(u);
+		const point& src = snap.get_position(u);
+		const int src_ndx = costs.index(src);
+		touch(src_ndx, src);
+		distance_[src_ndx] = 0;
+		open_.emplace_back(0.0f, src_ndx);
+		typedef std::greater<std::pair<float, int>> cheapest_first;
+		while(!open_.empty()) {
+			std::pop_heap(open_.begin(), open_.end(), cheapest_first());
+			const auto top = open_.back();
+			open_.pop_back();
+			if(top.first > distance_[top.second]) {
+				continue;
+			}
+			reached_.emplace_back(top.second);
+			const point p = costs.location(top.second);
+			const bool src_zoc = (flags_[top.second] & TILE_ZOC) != 0;
+			for(auto np : hex::neighbours(p)) {
+				if(!costs.contains(np)) {
+					continue;
+				}
+				const int ndx = costs.index(np);
+				touch(ndx, np);
+				if((flags_[ndx] & TILE_ENEMY) || (src_zoc && (flags_[ndx] & TILE_ZOC))) {
+					continue;
+				}
+				const float d = top.first + hex::logical::to_cost(costs[ndx]);
+				if(d < max_cost && d < distance_[ndx]) {
+					distance_[ndx] = d;
+					open_.emplace_back(d, ndx);
+					std::push_heap(open_.begin(), open_.end(), cheapest_first());
+				}
+			}
+		}
+	}
+
+	void search::generate_turns(const game::snapshot& snap, std::vector<turn_action>* out)
+	{
+		out->clear();
+		const int u = snap.get_current_unit();
+		if(u < 0) {
+			return;
+		}
+		find_moves(snap);
+		const auto& costs = snap.get_map().get_cost_grid(snap.get_movement_type(u));
+		const int team = snap.get_team(u);
+		const int range = snap.get_range(u);
+		const int max_targets = std::min(max_turn_targets, snap.get_max_units_attackable(u));
+		const int attacks = snap.get_attacks_this_turn(u);
+
+		candidates_.clear();
+		std::pair<int, int> in_range[game::snapshot::max_units];
+		for(int ndx : reached_) {
+			const point p = costs.location(ndx);
+			const int occupant = snap.unit_at(p);
+			if(occupant >= 0 && occupant != u) {
+				continue;
+			}
+			int nearest = INT_MAX;
+			int in_range_count = 0;
+			for(int n = 0; n != snap.get_active_count(); ++n) {
+				const int e = snap.get_active_unit(n);
+				if(snap.get_team(e) == team) {
+					continue;
+				}
+				const point& ep = snap.get_position(e);
+				const int d = hex::logical::distance(p, ep);
+				nearest = std::min(nearest, d);
+				if(d > range || attacks <= 0) {
+					continue;
+				}
+				// Same line of sight rule as state::is_attackable(), though with the unit
+				// having moved to p.
+				if(d > 1 && !hex::logical::for_each_between(p, ep, [&snap, u](const point& bp) {
+					const int o = snap.unit_at(bp);
+					return o < 0 || o == u;
+				})) {
+					continue;
+				}
+				in_range[in_range_count++] = std::make_pair(snap.get_health(e), e);
+			}
+			// Weakest first, since killing units is what matters most.
+			std::sort(in_range, in_range + in_range_count);
+
+			turn_action t;
+			t.dest = p;
+			t.cost = distance_[ndx];
+			t.target_count = std::min(in_range_count, max_targets);
+			int damage = 0;
+			int kills = 0;
+			for(int n = 0; n != t.target_count; ++n) {
+				const int e = in_range[n].second;
+				t.targets[n] = static_cast<int8_t>(e);
+				if(n < attacks) {
+					const int dmg = snap.get_damage(u, e, false);
+					damage += std::min(dmg, snap.get_health(e));
+					kills += dmg >= snap.get_health(e) ? 1 : 0;
+				}
+			}
+			const float score = 100.0f * kills + damage - (nearest == INT_MAX ? 0 : nearest) - t.cost * 0.01f;
+			candidates_.emplace_back(score, t);
+		}
+
+		std::stable_sort(candidates_.begin(), candidates_.end(), [](const std::pair<float, turn_action>& a, const std::pair<float, turn_action>& b) {
+			return a.first > b.first;
+		});
+		const size_t count = std::min(candidates_.size(), static_cast<size_t>(max_turns_considered));
+		for(size_t n = 0; n != count; ++n) {
+			out->emplace_back(candidates_[n].second);
+		}
+	}
+
+	turn_action parallel_search::find_turn(const game::snapshot& snap, const search_limits& limits)
+	{
+		const int threads = std::max(1, limits.threads);
+		while(static_cast<int>(trees_.size()) < threads) {
+			trees_.emplace_back(new search());
+		}
+		trees_.resize(threads);
+
+		const auto deadline = search::clock::now() + std::chrono::duration_cast<search::clock::duration>(std::chrono::duration<double>(limits.time_budget));
+		transposition_table* table = nullptr;
+		if(limits.time_budget > 0) {
+			if(shared_table_ == nullptr) {
+				shared_table_.reset(new transposition_table(table_size));
+			}
+			table = shared_table_.get();
+		}
+		if(threads == 1) {
+			trees_[0]->think(snap, limits, deadline, table);
+		} else {
+			std::vector<threading::pool::job> jobs;
+			for(int n = 0; n != threads; ++n) {
+				search_limits tree_limits = limits;
+				// The first tree is seeded the same as a single search would be.
+				tree_limits.seed = limits.seed + n * 0x9e3779b9u;
+				search* tree = trees_[n].get();
+				jobs.emplace_back([tree, &snap, tree_limits, deadline, table]() {
+					tree->think(snap, tree_limits, deadline, table);
+				});
+			}
+			threading::get_shared_pool().run(jobs);
+		}
+
+		// Every tree has the same turns at the root, in the same order, unless a tree was
+		// carried on from a different position last time, so they are matched up by value.
+		std::vector<std::pair<turn_action, int>> totals;
+		std::vector<std::pair<turn_action, int>> visits;
+		trees_[0]->get_root_visits(&totals);
+		for(int n = 1; n != threads; ++n) {
+			trees_[n]->get_root_visits(&visits);
+			for(auto& v : visits) {
+				for(auto& t : totals) {
+					if(same_turn(t.first, v.first)) {
+						t.second += v.second;
+						break;
+					}
+				}
+			}
+		}
+		const turn_action turn = pick_turn(snap, totals);
+		for(auto& tree : trees_) {
+			tree->set_choice(turn);
+		}
+		return turn;
+	}
+
+	int parallel_search::get_iterations() const
+	{
+		int total = 0;
+		for(auto& tree : trees_) {
+			total += tree->get_iterations();
+		}
+		return total;
+	}
+
+	int parallel_search::get_reused_visits() const
+	{
+		int total = 0;
+		for(auto& tree : trees_) {
+			total += tree->get_reused_visits();
+		}
+		return total;
+	}
+
+	int parallel_search::get_tree_size() const
+	{
+		int total = 0;
+		for(auto& tree : trees_) {
+			total += tree->get_tree_size();
+		}
+		return total;
+	}
+
+	int parallel_search::get_table_hits() const
+	{
+		int total = 0;
+		for(auto& tree : trees_) {
+			total += tree->get_table_hits();
+		}
+		return total;
+	}
+}
+
+UNIT_TEST(bot_search)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+	node_builder mb;
+	mb.add("width", 8);
+	for(int n = 0; n != 64; ++n) {
+		mb.add("tiles", "flat");
+	}
+
+	game::state gs;
+	gs.set_map(hex::logical::map::factory(mb.build()));
+	auto p1 = std::make_shared<player>(gs.create_team_instance("a"), PlayerType::NORMAL, "p1");
+	auto p2 = std::make_shared<player>(gs.create_team_instance("b"), PlayerType::NORMAL, "p2");
+	gs.add_player(p1);
+	gs.add_player(p2);
+	auto hunter = std::make_shared<game::unit>("hunter", nullptr, p1);
+	hunter->set_position(0, 0);
+	hunter->set_attack(8);
+	hunter->set_health(10);
+	hunter->set_move(5.0f);
+	hunter->set_critical_strike(0);
+	hunter->set_initiative(1.0f);
+	auto weak = std::make_shared<game::unit>("weak", nullptr, p2);
+	weak->set_position(3, 1);
+	weak->set_attack(2);
+	weak->set_health(5);
+	weak->set_initiative(2.0f);
+	auto strong = std::make_shared<game::unit>("strong", nullptr, p2);
+	strong->set_position(7, 7);
+	strong->set_attack(20);
+	strong->set_health(50);
+	strong->set_initiative(3.0f);
+	for(auto& u : { hunter, weak, strong }) {
+		gs.add_unit(u);
+	}
+	const game::snapshot snap(gs);
+	const int w = snap.unit_at(point(3, 1));
+
+	// The heuristic puts killing the weak unit first.
+	ai::search s;
+	std::vector<ai::turn_action> turns;
+	s.generate_turns(snap, &turns);
+	CHECK_EQ(turns.empty(), false);
+	CHECK_LE(turns.size(), 8u);
+	CHECK_EQ(turns.front().target_count, 1);
+	CHECK_EQ(turns.front().targets[0], w);
+
+	ai::search_limits limits;
+	limits.max_iterations = 200;
+	limits.seed = 1;
+	auto turn = s.find_turn(snap, limits);
+	CHECK_EQ(s.get_iterations(), 200);
+	CHECK_EQ(s.get_reused_visits(), 0);
+	CHECK_EQ(hex::logical::distance(turn.dest, point(3, 1)), 1);
+	CHECK_EQ(turn.target_count, 1);
+	CHECK_EQ(turn.targets[0], w);
+
+	// The same seed gives the same result.
+	ai::search s2;
+	auto turn2 = s2.find_turn(snap, limits);
+	CHECK_EQ(turn2.dest, turn.dest);
+	CHECK_EQ(s2.get_tree_size(), s.get_tree_size());
+
+	// Searching the same position again carries on with the tree.
+	s.find_turn(snap, limits);
+	CHECK_EQ(s.get_reused_visits(), 200);
+	CHECK_GT(s.get_table_hits(), 0);
+
+	// As does searching a position that follows from the chosen turn.
+	game::snapshot next(snap);
+	game::snapshot::undo rec;
+	next.make_move(next.get_current_unit(), turn.dest, turn.cost, &rec);
+	next.make_attack(next.get_current_unit(), w, false, &rec);
+	next.make_end_turn(&rec);
+	CHECK_EQ(next.is_alive(w), false);
+	s.find_turn(next, limits);
+	CHECK_GT(s.get_reused_visits(), 0);
+
+	// A single tree in parallel is the same as a plain search, several trees on the pool give
+	// the same answer every time.
+	ai::parallel_search ps1;
+	CHECK_EQ(ps1.find_turn(snap, limits).dest, turn.dest);
+	CHECK_EQ(ps1.get_tree_size(), s2.get_tree_size());
+	limits.threads = 3;
+	ai::parallel_search ps2, ps3;
+	auto pturn = ps2.find_turn(snap, limits);
+	CHECK_EQ(ps2.get_iterations(), 600);
+	CHECK_EQ(ps3.find_turn(snap, limits).dest, pturn.dest);
+	CHECK_EQ(ps3.get_tree_size(), ps2.get_tree_size());
+	CHECK_EQ(pturn.target_count, 1);
+	CHECK_EQ(pturn.targets[0], w);
+}
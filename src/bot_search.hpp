@@ -0,0 +1,182 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "game_snapshot.hpp"
+#include "geometry.hpp"
+#include "random.hpp"
+#include "transposition_table.hpp"
+
+namespace ai
+{
+	// How long bots think about a turn by default, in seconds.
+	const double default_time_budget = 0.5;
+
+	// Most units a turn can attack, the same as the cap on max_units_attackable for creatures.
+	const int max_turn_targets = 10;
+
+	// Limits on how long the search for a turn runs. Zero means no limit, if neither is set
+	// bots don't search at all and play greedily instead.
+	struct search_limits
+	{
+		search_limits() : time_budget(0), max_iterations(0), seed(0), threads(1) {}
+		// In seconds.
+		double time_budget;
+		// Per search tree.
+		int max_iterations;
+		// Seed for the searches own random numbers, used to decide critical strikes. With the
+		// same seed and an iteration limit rather than a time limit the result is repeatable.
+		unsigned seed;
+		// Number of search trees grown in parallel, on the shared thread pool.
+		int threads;
+	};
+
+	// One unit's turn, the tile it moves to (which may be where it is) and the units it
+	// attacks from there, by snapshot unit index.
+	struct turn_action
+	{
+		point dest;
+		float cost;
+		int target_count;
+		int8_t targets[max_turn_targets];
+	};
+
+	// Anytime Monte Carlo tree search over the turns of the units, in initiative order.
+	//
+	// Each level of the tree is one units turn, the children of a node are the turns the unit
+	// to move could take, cut down to the most promising few by a quick heuristic. Critical
+	// strikes are rolled as the tree is descended rather than being nodes of their own, so
+	// the state at a node can vary between visits. Positions are scored by each teams share
+	// of the remaining health times attack of all units, after a short greedy rollout.
+	//
+	// The tree is kept between calls. If the position being searched is one that was reached
+	// in the tree under the turn chosen last time, the search carries on from there.
+	//
+	// Scores are cached in a transposition table by position hash, so a position reached by
+	// more than one order of turns, or again on a later turn, is only rolled out once.
+	class search
+	{
+	public:
+		typedef std::chrono::steady_clock clock;
+
+		search();
+
+		// Best turn for the current unit of the snapshot found within the limits. The turn
+		// with the best heuristic score is returned if there is no time to search at all.
+		turn_action find_turn(const game::snapshot& snap, const search_limits& limits);
+
+		// The parts of find_turn(), for when the results of several searches are combined.
+		// think() grows the tree until the deadline, if the limits have a time budget, or
+		// the iteration limit. Scores are cached in table if one is given, which may be shared
+		// with other searches running at the same time, otherwise in a table of the searches
+		// own. get_root_visits() gives each turn for the current unit along
+		// with how often it was tried, in the same order as generate_turns(). Then the turn
+		// that was taken is noted with set_choice() so the tree can be reused next time.
+		void think(const game::snapshot& snap, const search_limits& limits, const clock::time_point& deadline, transposition_table* table = nullptr);
+		void get_root_visits(std::vector<std::pair<turn_action, int>>* out) const;
+		void set_choice(const turn_action& action);
+
+		// Statistics for the last call to find_turn().
+		int get_iterations() const { return iterations_; }
+		int get_reused_visits() const { return reused_visits_; }
+		int get_tree_size() const { return static_cast<int>(nodes_.size()); }
+		// Iterations whose score came from the transposition table.
+		int get_table_hits() const { return table_hits_; }
+
+		// The turns considered for the current unit of the snapshot, best first.
+		void generate_turns(const game::snapshot& snap, std::vector<turn_action>* out);
+	private:
+		struct node
+		{
+			turn_action action;
+			int parent;
+			int first_child;
+			int child_count;
+			int visits;
+			// Total score of the visits, for the team that took the action.
+			float value;
+			// Team that took the action and the unit to move after it. The unit is -1 until
+			// the node is first visited.
+			int8_t team;
+			int8_t unit;
+			bool expanded;
+			uint64_t hash;
+		};
+
+		bool reuse_tree(const game::snapshot& snap);
+		void reset_tree(const game::snapshot& snap);
+		void run_iteration(const game::snapshot& root);
+		void expand(int n, const game::snapshot& snap);
+		int select_child(int n) const;
+		void apply_turn(game::snapshot& snap, const turn_action& action);
+		void rollout(game::snapshot& snap);
+		void score(const game::snapshot& snap, float* scores) const;
+
+		// Cheapest cost to each tile the current unit can move to.
+		void find_moves(const game::snapshot& snap);
+
+		std::vector<node> nodes_;
+		// Child chosen last time, the root for the next search if the position matches.
+		int last_choice_;
+		generator::stream rng_;
+		int iterations_;
+		int reused_visits_;
+		int table_hits_;
+		// Only made if no table is passed to think().
+		std::unique_ptr<transposition_table> own_table_;
+		transposition_table* table_;
+
+		// Scratch space for find_moves(), indexed by tile and marked with a generation so
+		// that it doesn't need clearing.
+		std::vector<uint32_t> visited_;
+		std::vector<float> distance_;
+		std::vector<uint8_t> flags_;
+		std::vector<int> reached_;
+		std::vector<std::pair<float, int>> open_;
+		uint32_t generation_;
+		std::vector<std::pair<float, turn_action>> candidates_;
+		std::vector<turn_action> turns_;
+	};
+
+	// Root parallel search. Separate trees with differently seeded critical strikes are grown
+	// at the same time, on the shared thread pool, and their visit counts for the turns at
+	// the root are added together to choose the turn. The trees are combined in a fixed order
+	// so that with a seed and an iteration limit the result doesn't depend on timing.
+	//
+	// When searching against the clock the trees share one transposition table, so each can
+	// use the scores the others have found. With only an iteration limit every tree keeps to
+	// its own table, since what a tree finds in a shared one would depend on timing.
+	class parallel_search
+	{
+	public:
+		turn_action find_turn(const game::snapshot& snap, const search_limits& limits);
+
+		// Totals over all the trees, for the last call to find_turn().
+		int get_iterations() const;
+		int get_reused_visits() const;
+		int get_tree_size() const;
+		int get_table_hits() const;
+	private:
+		std::vector<std::unique_ptr<search>> trees_;
+		std::unique_ptr<transposition_table> shared_table_;
+	};
+}
@@ -36,23 +36,20 @@ namespace process
 	{
 		using namespace component;
 		static component_id collision_mask = genmask(Component::POSITION) | genmask(Component::COLLISION);
-		// O(n^2) collision testing is for the pro's :-/
-		// XXX Please make quad-tree or kd-tree for O(nlogn)
-		for(auto& e1 : elist) {
-			if((e1->mask & collision_mask) == collision_mask) {
-				auto& e1pos = e1->pos;
-				// XXX replace elist_ below with a call to eng.entities_in_area(r)
-				// where r = active area for entities on map.
-				for(auto& e2 : elist) {
-					if(e1 == e2) {
-						continue;
-					}
-					if((e2->mask & collision_mask) == collision_mask) {
-						// entity - entity collision
-					}
+		// Only the entities near e1 are tested, found using the engines spatial index.
+		entity_list nearby;
+		eng.for_each_with(collision_mask, [&](const component_set_ptr& e1) {
+			nearby.clear();
+			eng.entities_in_area(eng.get_entity_area(e1), &nearby);
+			for(auto& e2 : nearby) {
+				if(e1 == e2) {
+					continue;
+				}
+				if((e2->mask & collision_mask) == collision_mask) {
+					// entity - entity collision
 				}
 			}
-		}
+		});
 	}
 
 	em_collision::em_collision()
@@ -23,16 +23,26 @@ namespace component
 	component_set::component_set(int z) 
 		: mask(component_id(0)), 
 		  zorder(z),
-		  pos(),
-		  lifetime(0)
+		  lifetime(0),
+		  store_index(-1),
+		  archetype(-1),
+		  archetype_index(-1),
+		  pos_column(nullptr),
+		  unstored_pos(),
+		  unit_handle(registry::invalid_handle)
 	{
 	}
 
 	component_set::component_set(const component_set& cs)
 		: mask(cs.mask),
 		  zorder(cs.zorder),
-		  pos(cs.pos),
-		  lifetime(0)
+		  lifetime(0),
+		  store_index(-1),
+		  archetype(-1),
+		  archetype_index(-1),
+		  pos_column(nullptr),
+		  unstored_pos(cs.pos()),
+		  unit_handle(registry::invalid_handle)
 	{
 		if(cs.spr != nullptr) {
 			spr = cs.spr->clone();
@@ -28,6 +28,7 @@
 #include "hex_pathfinding.hpp"
 #include "node.hpp"
 #include "player.hpp"
+#include "registry.hpp"
 #include "texture.hpp"
 #include "units_fwd.hpp"
 #include "widget.hpp"
@@ -145,8 +146,11 @@ namespace component
 		std::shared_ptr<component_set> clone() { return std::shared_ptr<component_set>(new component_set(*this)); }
 		component_id mask;
 		int zorder;
-		// Since pos is frequently accessed, it's better for pos to be a member declaration.
-		point pos;
+		// Since pos is frequently accessed, it's better for pos to be a member declaration. While
+		// the entity is in an entity_store the position is kept by value in the position column
+		// of its archetype, so the reference mustn't be held while other entities are added.
+		point& pos() { return pos_column != nullptr ? (*pos_column)[archetype_index] : unstored_pos; }
+		const point& pos() const { return pos_column != nullptr ? (*pos_column)[archetype_index] : unstored_pos; }
 		game::unit_ptr stat;
 		std::shared_ptr<sprite> spr;
 		std::shared_ptr<input> inp;
@@ -154,6 +158,16 @@ namespace component
 		// If lifetime is set then decrementing it to zero or below will trigger removal of the entity
 		// Should be set in seconds. So to make something last 400 milliseconds we set it to 0.4.
 		double lifetime;
+		// Where the entity is kept in the engines entity_store, these are maintained by the store.
+		int store_index;
+		int archetype;
+		int archetype_index;
+		// The position column holding pos() while in the store, nullptr when unstored_pos holds it.
+		std::vector<point>* pos_column;
+		point unstored_pos;
+		// Handle in the engines table of unit entities, registry::invalid_handle if the entity
+		// isn't in it. Maintained by the engine.
+		registry::handle unit_handle;
 		void operator=(const component_set&) = delete;
 	};
 	
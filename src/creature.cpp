@@ -23,7 +23,7 @@
 
 namespace creature
 {
-	creature::creature(const node& n) 
+	creature::creature(const node& n, const std::string& type)
 		: initiative_(5), 
 		  movement_(5.0f), 
 		  movement_type_(MovementType::NORMAL) ,
@@ -36,6 +36,7 @@ namespace creature
 		ASSERT_LOG(n.is_map(), "Creature definitions must be maps");
 		ASSERT_LOG(n.has_key("name"), "Must supply a 'name' attribute for the creature.");
 		name_ = n["name"].as_string();
+		type_ = type.empty() ? name_ : type;
 				
 		ASSERT_LOG(n.has_key("stats"), "'stats component found must supply a 'stats' attribute for the creature " << name_);
 		const node& stats = n["stats"];
@@ -73,10 +74,7 @@ namespace creature
 		ASSERT_LOG(initiative_ >= 1 && initiative_ <= 100, "initiative value not in valid range: 1 <= " << initiative_ << " <= 100");
 
 		if(stats.has_key("movement_type")) {
-			const std::string& mt = stats["movement_type"].as_string();
-			if(mt == "normal") {
-				movement_type_ = MovementType::NORMAL;
-			} // XXX
+			movement_type_ = ::creature::get_movement_type(stats["movement_type"].as_string());
 		}
 
 		if(stats.has_key("range")) {
@@ -110,11 +108,11 @@ namespace creature
 		return it->second;
 	}
 
-	game::unit_ptr creature::create_instance(const game::state& gs, const player_ptr& owner, const point& pos)
+	game::unit_ptr creature::create_instance(game::state& gs, const player_ptr& owner, const point& pos)
 	{
 		auto u = std::make_shared<game::unit>(name_, shared_from_this(), owner);
-		u->set_health(generator::get_uniform_int(health_min_, health_max_));
-		u->set_attack(generator::get_uniform_int(attack_min_, attack_max_));
+		u->set_health(gs.get_random().uniform_int(health_min_, health_max_));
+		u->set_attack(gs.get_random().uniform_int(attack_min_, attack_max_));
 		u->set_armour(armour_);
 		u->set_range(static_cast<int>(range_));
 		u->set_move(movement_);
@@ -171,12 +169,38 @@ namespace creature
 			static creature_cache res;
 			return res;
 		}
+
+		// Indexed by MovementType.
+		const char* const movement_type_names[] = 
+		{
+			"normal",
+			"flying",
+		};
+		static_assert(sizeof(movement_type_names)/sizeof(movement_type_names[0]) == static_cast<int>(MovementType::MAX_MOVEMENT_TYPES), 
+			"Number of movement type names doesn't match the number of movement types.");
+	}
+
+	MovementType get_movement_type(const std::string& name)
+	{
+		for(int n = 0; n != static_cast<int>(MovementType::MAX_MOVEMENT_TYPES); ++n) {
+			if(name == movement_type_names[n]) {
+				return static_cast<MovementType>(n);
+			}
+		}
+		ASSERT_LOG(false, "Unknown movement type: " << name);
+		return MovementType::NORMAL;
+	}
+
+	const char* get_movement_type_name(MovementType mt)
+	{
+		ASSERT_LOG(mt < MovementType::MAX_MOVEMENT_TYPES, "Invalid movement type: " << static_cast<int>(mt));
+		return movement_type_names[static_cast<int>(mt)];
 	}
 
 	void loader(const node& n)
 	{
 		for(auto& cr : n.as_map()) {
-			get_creature_cache()[cr.first.as_string()] = std::make_shared<creature>(cr.second);
+			get_creature_cache()[cr.first.as_string()] = std::make_shared<creature>(cr.second, cr.first.as_string());
 		}
 	}
 
@@ -187,7 +211,13 @@ namespace creature
 		return it->second->create_instance(gs, owner, pos);
 	}*/
 
-	game::unit_ptr spawn(const game::state& gs, const std::string& type, const player_ptr& owner, const point& pos)
+	const_creature_ptr get_creature(const std::string& type)
+	{
+		auto it = get_creature_cache().find(type);
+		return it == get_creature_cache().end() ? nullptr : it->second;
+	}
+
+	game::unit_ptr spawn(game::state& gs, const std::string& type, const player_ptr& owner, const point& pos)
 	{
 		auto it = get_creature_cache().find(type);
 		ASSERT_LOG(it != get_creature_cache().end(), "Couldn't find a definition for creature of type '" << type << "' in the cache.");
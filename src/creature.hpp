@@ -17,6 +17,7 @@
 #pragma once
 
 #include <map>
+#include <string>
 
 #include "creature_fwd.hpp"
 #include "game_state.hpp"
@@ -25,19 +26,19 @@
 
 namespace creature
 {
-	enum class MovementType
-	{
-		NORMAL,
-	};
-
 	class creature : public std::enable_shared_from_this<creature>
 	{
 	public:
-		creature(const node& n);
-		game::unit_ptr create_instance(const game::state& gs, const player_ptr& owner, const point& pos);
+		// type is the name the creature is known by in the data files, it defaults to the
+		// displayable name.
+		explicit creature(const node& n, const std::string& type=std::string());
+		// Rolls for the stats are made with the game states random numbers.
+		game::unit_ptr create_instance(game::state& gs, const player_ptr& owner, const point& pos);
 
+		const std::string& get_type_name() const { return type_; }
 		int get_initiative() const { return initiative_; }
 		float get_movement() const { return movement_; }
+		MovementType get_movement_type() const { return movement_type_; }
 
 		int get_max_units_attackable() const { return max_units_attackable_; }
 		int get_attacks_per_turn() const { return attacks_per_turn_; }
@@ -53,6 +54,7 @@ namespace creature
 	private:
 		// Displayable name
 		std::string name_;
+		std::string type_;
 		int health_min_;
 		int health_max_;
 		int attack_min_;
@@ -79,5 +81,12 @@ namespace creature
 
 	void loader(const node& n);
 
-	game::unit_ptr spawn(const game::state& gs, const std::string& type, const player_ptr& owner, const point& pos);
+	// Converts the name of a movement type as used in the data files, asserts if unknown.
+	MovementType get_movement_type(const std::string& name);
+	const char* get_movement_type_name(MovementType mt);
+
+	// Creature loaded with the given type, nullptr if there isn't one.
+	const_creature_ptr get_creature(const std::string& type);
+
+	game::unit_ptr spawn(game::state& gs, const std::string& type, const player_ptr& owner, const point& pos);
 }
@@ -20,6 +20,14 @@
 
 namespace creature
 {
+	// How a creature moves across the map, tiles may have a different cost for each type.
+	enum class MovementType
+	{
+		NORMAL,
+		FLYING,
+		MAX_MOVEMENT_TYPES,
+	};
+
 	class creature;
 	typedef std::shared_ptr<creature> creature_ptr;
 	typedef std::shared_ptr<const creature> const_creature_ptr;
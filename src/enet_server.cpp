@@ -14,11 +14,13 @@
    limitations under the License.
 */
 
+#include <algorithm>
 #include <csignal>
 #include <memory>
 
 #include "asserts.hpp"
 #include "enet_server.hpp"
+#include "random.hpp"
 
 namespace enet
 {
@@ -41,15 +43,122 @@ namespace enet
 		server_running = false;
 	}
 
-	server::server(int port)
+	packet_pool::packet_pool()
+		: in_use_(0)
+	{
+	}
+
+	packet_pool::~packet_pool()
+	{
+		if(in_use_ != 0) {
+			LOG_ERROR("Packet pool destroyed with " << in_use_ << " packets still in use.");
+		}
+		for(auto b : free_) {
+			delete b;
+		}
+	}
+
+	ENetPacket* packet_pool::create(const google::protobuf::MessageLite& msg, enet_uint32 flags)
+	{
+		buffer* b = nullptr;
+		if(free_.empty()) {
+			b = new buffer;
+			b->pool = this;
+		} else {
+			b = free_.back();
+			free_.pop_back();
+		}
+		// The buffers capacity only ever grows, so this rarely allocates.
+		const int size = msg.ByteSize();
+		b->data.resize(size);
+		msg.SerializeWithCachedSizesToArray(b->data.data());
+		ENetPacket* packet = enet_packet_create(b->data.data(), size, flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+		ASSERT_LOG(packet != nullptr, "Unable to create packet of " << size << " bytes.");
+		packet->userData = b;
+		packet->freeCallback = &packet_pool::free_packet;
+		++in_use_;
+		return packet;
+	}
+
+	void packet_pool::free_packet(ENetPacket* packet)
+	{
+		buffer* b = static_cast<buffer*>(packet->userData);
+		--b->pool->in_use_;
+		b->pool->free_.emplace_back(b);
+	}
+
+	wakeup_socket::wakeup_socket()
+		: socket_(ENET_SOCKET_NULL),
+		  pending_(false)
+	{
+		address_.host = ENET_HOST_ANY;
+		address_.port = 0;
+	}
+
+	wakeup_socket::~wakeup_socket()
+	{
+		if(socket_ != ENET_SOCKET_NULL) {
+			enet_socket_destroy(socket_);
+		}
+	}
+
+	void wakeup_socket::open()
+	{
+		ASSERT_LOG(socket_ == ENET_SOCKET_NULL, "Wakeup socket was already opened.");
+		socket_ = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+		ASSERT_LOG(socket_ != ENET_SOCKET_NULL, "Unable to create the wakeup socket.");
+		enet_address_set_host(&address_, "127.0.0.1");
+		address_.port = 0;
+		ASSERT_LOG(enet_socket_bind(socket_, &address_) == 0, "Unable to bind the wakeup socket.");
+		// Find out which port we were given, that's where notify() sends to.
+		ASSERT_LOG(enet_socket_get_address(socket_, &address_) == 0, "Unable to get the address of the wakeup socket.");
+		enet_socket_set_option(socket_, ENET_SOCKOPT_NONBLOCK, 1);
+	}
+
+	void wakeup_socket::notify()
+	{
+		// One byte is enough to wake the servicing thread, until it has drained it.
+		if(pending_.exchange(true)) {
+			return;
+		}
+		enet_uint8 data = 0;
+		ENetBuffer buf;
+		buf.data = &data;
+		buf.dataLength = 1;
+		enet_socket_send(socket_, &address_, &buf, 1);
+	}
+
+	void wakeup_socket::drain()
+	{
+		// Cleared first, so that a notify() from now on sends another byte.
+		pending_ = false;
+		enet_uint8 data[16];
+		ENetBuffer buf;
+		buf.data = data;
+		buf.dataLength = sizeof(data);
+		ENetAddress from;
+		while(enet_socket_receive(socket_, &from, &buf, 1) > 0) {
+		}
+	}
+
+	server::server(int port, const node& scenario, int max_peers, int num_workers, int num_bots, double bot_time, int bot_threads, const std::string& journal_dir)
 		: port_(port),
-		  running_(false)
+		  max_peers_(max_peers),
+		  num_bots_(num_bots),
+		  running_(false),
+		  scenario_(scenario),
+		  journal_dir_(journal_dir),
+		  scheduler_(num_workers, [this]() { wakeup_.notify(); }),
+		  next_match_id_(1)
 	{
 		ASSERT_LOG(enet_initialize() == 0, "An error occurred while initializing ENet.");
+		bot_limits_.time_budget = bot_time;
+		bot_limits_.threads = bot_threads;
 	}
 
 	server::~server()
 	{
+		host_.reset();
 		enet_deinitialize();
 	}
 
@@ -60,52 +169,203 @@ namespace enet
 		stop_server();
 	}
 
+	int server::find_open_match(int match_id)
+	{
+		auto is_open = [](const match_info& mi) {
+			return !mi.started && mi.players < mi.max_players;
+		};
+		auto it = matches_.find(match_id);
+		if(it != matches_.end() && is_open(it->second)) {
+			return it->first;
+		}
+		for(auto& mi : matches_) {
+			if(is_open(mi.second)) {
+				return mi.first;
+			}
+		}
+		const int id = next_match_id_++;
+		auto m = std::make_shared<game::match>(id, scenario_, generator::derive_seed(generator::get_seed(), id));
+		match_info& mi = matches_[m->id()];
+		mi.max_players = m->get_max_players();
+		if(!journal_dir_.empty()) {
+			// The seed is in the name so restarting the server doesn't overwrite old journals.
+			m->set_journal_path(journal_dir_ + "/match-" + std::to_string(id) + "-" + std::to_string(m->seed()) + ".journal");
+		}
+		scheduler_.add_match(m);
+		LOG_INFO("Created match " << m->id());
+
+		// Always leave room for at least one client.
+		const int bots = std::min(num_bots_, mi.max_players - 1);
+		for(int n = 0; n < bots; ++n) {
+			const std::string name = "bot" + std::to_string(n + 1);
+			const ai::search_limits limits = bot_limits_;
+			scheduler_.post(m->id(), [name, limits](game::match& m, std::vector<game::Update*>* out) {
+				m.add_bot(name, limits);
+			});
+			++mi.players;
+		}
+		return m->id();
+	}
+
+	void server::broadcast(int match_id, const game::Update& up)
+	{
+		auto it = matches_.find(match_id);
+		if(it == matches_.end()) {
+			return;
+		}
+		// One packet is shared by all the peers, enet reference counts it.
+		ENetPacket* packet = packets_.create(up);
+		for(int peer_id : it->second.peers) {
+			auto pit = peers_.find(peer_id);
+			if(pit != peers_.end()) {
+				enet_peer_send(pit->second, 0, packet);
+			}
+		}
+		if(packet->referenceCount == 0) {
+			enet_packet_destroy(packet);
+		}
+	}
+
+	void server::handle_update(int peer_id, game::Update* up)
+	{
+		auto owned = update_pool_.make_shared(up);
+		auto pit = peer_matches_.find(peer_id);
+		if(pit == peer_matches_.end()) {
+			if(up->player_size() == 0 || up->player(0).action() != game::Update_Player_Action_JOIN) {
+				LOG_WARN("Peer " << peer_id << " sent update " << up->id() << " before joining a match.");
+				return;
+			}
+			uuid::uuid player_id;
+			if(!uuid::read(up->player(0).uuid(), &player_id)) {
+				LOG_WARN("Peer " << peer_id << " sent a join with a bad player uuid: " << up->player(0).uuid());
+				return;
+			}
+			const int match_id = find_open_match(up->has_match_id() ? up->match_id() : -1);
+			match_info& mi = matches_[match_id];
+			if(std::find(mi.player_ids.begin(), mi.player_ids.end(), player_id) != mi.player_ids.end()) {
+				LOG_WARN("Peer " << peer_id << " couldn't join match " << match_id << ", the player has already joined.");
+				return;
+			}
+			peer_info& pi = peer_matches_[peer_id];
+			pi.match_id = match_id;
+			pi.player_id = player_id;
+			mi.peers.emplace_back(peer_id);
+			mi.player_ids.emplace_back(player_id);
+			mi.started = ++mi.players >= mi.max_players;
+
+			const game::Update_Player player = up->player(0);
+			scheduler_.post(match_id, [player](game::match& m, std::vector<game::Update*>* out) {
+				if(m.join(player) && m.is_full()) {
+					m.start(out);
+				}
+			});
+			return;
+		}
+
+		if(up->has_quit() && up->quit()) {
+			handle_disconnect(peer_id);
+			return;
+		}
+
+		ASSERT_LOG(matches_.find(pit->second.match_id) != matches_.end(), 
+			"Peer " << peer_id << " is in match " << pit->second.match_id << " which doesn't exist.");
+		scheduler_.post_update(pit->second.match_id, pit->second.player_id, owned);
+	}
+
+	void server::handle_disconnect(int peer_id)
+	{
+		auto pit = peer_matches_.find(peer_id);
+		if(pit == peer_matches_.end()) {
+			return;
+		}
+		auto mit = matches_.find(pit->second.match_id);
+		if(mit != matches_.end()) {
+			auto& mp = mit->second.peers;
+			mp.erase(std::remove(mp.begin(), mp.end(), peer_id), mp.end());
+			if(mp.empty()) {
+				LOG_INFO("Match " << mit->first << " has no players left, removing it.");
+				scheduler_.remove_match(mit->first);
+				matches_.erase(mit);
+			} else {
+				const uuid::uuid player_id = pit->second.player_id;
+				scheduler_.post(mit->first, [player_id](game::match& m, std::vector<game::Update*>* out) {
+					m.leave(player_id);
+				});
+				auto& ids = mit->second.player_ids;
+				ids.erase(std::remove(ids.begin(), ids.end(), player_id), ids.end());
+				--mit->second.players;
+			}
+		}
+		peer_matches_.erase(pit);
+	}
+
+	void server::send_results()
+	{
+		game::match_scheduler::result r;
+		while(scheduler_.read_result(&r)) {
+			std::unique_ptr<game::Update> up(r.up);
+			broadcast(r.match_id, *up);
+		}
+	}
+
 	void server::run()
 	{
 		ENetAddress address = { ENET_HOST_ANY, static_cast<unsigned short>(port_) };
-		// up to 32 clients, 2 channels, any amount incoming bandwidth, any amount of outgoing bandwidth.
-		std::shared_ptr<ENetHost> e_server(enet_host_create (&address, 32, 2, 0, 0), enet_host_destroy);
-		ASSERT_LOG(e_server != nullptr, "An error occurred while trying to create an ENet server host.");
+		// up to max_peers_ clients, 2 channels, any amount incoming bandwidth, any amount of outgoing bandwidth.
+		host_.reset(enet_host_create(&address, max_peers_, 2, 0, 0), enet_host_destroy);
+		ASSERT_LOG(host_ != nullptr, "An error occurred while trying to create an ENet server host.");
 
 		signal(SIGTERM, signal_handler);
 		signal(SIGINT, signal_handler);
 
+		// The workers wake us as soon as they have replies, so this is only how long to
+		// wait before checking whether we've been asked to stop, and servicing ENet's own
+		// timers (resends and pings) which run on a coarser scale anyway.
+		const enet_uint32 service_timeout = 250;
+		wakeup_.open();
+
 		ENetEvent ev;
-		game::Update up;
 		static int peer_cnt = 0;
 		running_ = true;
 		while(is_server_running()) {
-			if(enet_host_service (e_server.get(), &ev, 0) > 0) {
+			// Wait for either network traffic or replies from the workers.
+			ENetSocketSet readable;
+			ENET_SOCKETSET_EMPTY(readable);
+			ENET_SOCKETSET_ADD(readable, host_->socket);
+			ENET_SOCKETSET_ADD(readable, wakeup_.get());
+			if(enet_socketset_select(std::max(host_->socket, wakeup_.get()), &readable, nullptr, service_timeout) > 0
+				&& ENET_SOCKETSET_CHECK(readable, wakeup_.get())) {
+				wakeup_.drain();
+			}
+			int res = enet_host_service(host_.get(), &ev, 0);
+			while(res > 0) {
 				switch(ev.type) {
 					case ENET_EVENT_TYPE_CONNECT: {
 						std::cerr << "A new client connected from " << ev.peer->address.host << ":" << ev.peer->address.port << "\n";
 						peers_[peer_cnt] = ev.peer;
-						ev.peer->data = reinterpret_cast<void*>(peer_cnt);
+						ev.peer->data = reinterpret_cast<void*>(static_cast<intptr_t>(peer_cnt));
 						peer_cnt++;
 						break;
 					}
 					case ENET_EVENT_TYPE_RECEIVE: {
-						std::string pkt(reinterpret_cast<char*>(ev.packet->data), ev.packet->dataLength);
-						up.Clear();
-						up.ParseFromString(pkt);
-						std::cerr 
-							<< "A packet of length " 
-							<< ev.packet->dataLength 
-							<< " containing " 
-							<< up.id()
-							<< " was received from " 
-							<< reinterpret_cast<intptr_t>(ev.peer->data) 
-							<< " on channel " 
-							<< ev.channelID
-							<< "\n";
+						const int peer_value = static_cast<int>(reinterpret_cast<intptr_t>(ev.peer->data));
+						// Parsed straight out of the packet, into a recycled message.
+						game::Update* up = update_pool_.acquire();
+						if(up->ParseFromArray(ev.packet->data, static_cast<int>(ev.packet->dataLength))) {
+							handle_update(peer_value, up);
+						} else {
+							LOG_WARN("Unable to parse packet of length " << ev.packet->dataLength << " from " << peer_value);
+							update_pool_.release(up);
+						}
 						enet_packet_destroy(ev.packet);
 						break;
 					}
 					case ENET_EVENT_TYPE_DISCONNECT: {
-						int peer_value = reinterpret_cast<intptr_t>(ev.peer->data);
+						int peer_value = static_cast<int>(reinterpret_cast<intptr_t>(ev.peer->data));
 						auto it = peers_.find(peer_value);
 						if(it != peers_.end()) {
 							std::cerr << peer_value << " disconnected.\n";
+							handle_disconnect(peer_value);
 							peers_.erase(it);
 							ev.peer->data = nullptr;
 						}
@@ -113,14 +373,24 @@ namespace enet
 					}
 					default: break;
 				}
+				// Handle anything else that arrived without blocking again.
+				res = enet_host_check_events(host_.get(), &ev);
+			}
+			if(res < 0) {
+				// Happens if the wait is interrupted by a signal.
+				LOG_DEBUG("enet_host_service returned an error.");
 			}
+			send_results();
+			// Replies are queued on the peers while handling events, send them now rather
+			// than waiting for the next call to enet_host_service.
+			enet_host_flush(host_.get());
 		}
 
 		for(auto p : peers_) {
 			enet_peer_disconnect(p.second, 0);
 			ENetEvent ev;
 			bool disconnect_ok = false;
-			while(enet_host_service(e_server.get(), &ev, 0) > 0) {
+			while(enet_host_service(host_.get(), &ev, 0) > 0) {
 				switch(ev.type) {
 					case ENET_EVENT_TYPE_RECEIVE: 
 						enet_packet_destroy(ev.packet);
@@ -136,6 +406,11 @@ namespace enet
 			}
 		}
 		peers_.clear();
+		peer_matches_.clear();
+		for(auto& mi : matches_) {
+			scheduler_.remove_match(mi.first);
+		}
+		matches_.clear();
 	}
 
 	client::client(const std::string& address, int port, int down_bw, int up_bw)
@@ -221,10 +496,13 @@ namespace enet
 					break;
 				case ENET_EVENT_TYPE_RECEIVE: {
 					std::cerr << "Got message " << ev.packet->dataLength << " bytes long\n";
-					std::string pkt(reinterpret_cast<char*>(ev.packet->data), ev.packet->dataLength);
 					game::Update* up = new game::Update();
-					up->ParseFromString(pkt);
-					rcv_q_.push(up);
+					if(up->ParseFromArray(ev.packet->data, static_cast<int>(ev.packet->dataLength))) {
+						rcv_q_.push(up);
+					} else {
+						LOG_WARN("Unable to parse packet of length " << ev.packet->dataLength);
+						delete up;
+					}
 					enet_packet_destroy(ev.packet);
 					break;
 				}
@@ -236,15 +514,17 @@ namespace enet
 				}
 			}
 
-			// XXX check send queue and send messages here
-			if(!send_q_.empty() && connected) {
-				game::Update* msg;
-				if(send_q_.wait_and_pop(msg)) {
-					static std::string message;
-					msg->SerializeToString(&message);
-					ENetPacket *packet = enet_packet_create(message.c_str(), message.size(), ENET_PACKET_FLAG_RELIABLE);
-					enet_peer_send(peer_, 0, packet);
-					delete msg;
+			if(connected) {
+				game::Update* msgs[32];
+				size_t count;
+				while((count = send_q_.try_pop_n(msgs, 32)) != 0) {
+					for(size_t n = 0; n != count; ++n) {
+						ENetPacket* packet = packets_.create(*msgs[n]);
+						if(enet_peer_send(peer_, 0, packet) < 0) {
+							enet_packet_destroy(packet);
+						}
+						delete msgs[n];
+					}
 				}
 			}
 		}
@@ -16,7 +16,7 @@
 
 #pragma once
 
-#include <deque>
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
@@ -25,30 +25,134 @@
 
 #include <enet/enet.h>
 
+#include "match.hpp"
+#include "match_scheduler.hpp"
 #include "message_format.pb.h"
 #include "mutex.hpp"
 #include "queue.hpp"
 #include "threads.hpp"
+#include "update_pool.hpp"
 
 namespace enet
 {
+	// Buffers that outgoing packets are serialized into. Packets are created with
+	// ENET_PACKET_FLAG_NO_ALLOCATE pointing at a buffer from the pool, which is returned
+	// when enet destroys the packet. Must only be used by the thread servicing the host and
+	// must outlive the host.
+	class packet_pool
+	{
+	public:
+		packet_pool();
+		~packet_pool();
+		ENetPacket* create(const google::protobuf::MessageLite& msg, enet_uint32 flags=ENET_PACKET_FLAG_RELIABLE);
+	private:
+		struct buffer
+		{
+			packet_pool* pool;
+			std::vector<enet_uint8> data;
+		};
+		std::vector<buffer*> free_;
+		int in_use_;
+
+		static void free_packet(ENetPacket* packet);
+
+		packet_pool(const packet_pool&) = delete;
+		void operator=(const packet_pool&) = delete;
+	};
+
+	// Lets other threads wake the thread servicing a host. enet_host_service can only wait
+	// on the host's own socket, so the servicing thread instead waits on both the host's 
+	// socket and this loopback socket, which other threads send a byte to.
+	class wakeup_socket
+	{
+	public:
+		wakeup_socket();
+		~wakeup_socket();
+		// Must be called after enet_initialize() and before notify() is.
+		void open();
+		// Safe to call from any thread. Wakes the servicing thread if it isn't already
+		// due to wake.
+		void notify();
+		// Called by the servicing thread after it wakes, before it looks for the work it was
+		// woken for.
+		void drain();
+		ENetSocket get() const { return socket_; }
+	private:
+		ENetSocket socket_;
+		ENetAddress address_;
+		std::atomic<bool> pending_;
+
+		wakeup_socket(const wakeup_socket&) = delete;
+		void operator=(const wakeup_socket&) = delete;
+	};
+
+	// Dedicated server, hosting any number of matches of the given scenario. The first
+	// message from a client must be a player join message, which places the client in
+	// a match. After that everything the client sends is applied to that match.
+	//
+	// The network is serviced on the thread calling run(), the matches themselves are run
+	// on a pool of workers (see game::match_scheduler). Each new match is given num_bots
+	// server controlled players before any clients join it, which get bot_time seconds to
+	// think about each of their turns using bot_threads threads. If journal_dir is given
+	// each match is recorded to a journal there (see game::journal).
 	class server
 	{
 	public:
-		explicit server(int port);
+		explicit server(int port, const node& scenario, int max_peers=256, int num_workers=0, int num_bots=0, double bot_time=ai::default_time_budget, int bot_threads=1, const std::string& journal_dir=std::string());
 		~server();
 		void run();
 	private:
 		int port_;
+		int max_peers_;
+		int num_bots_;
+		ai::search_limits bot_limits_;
 		bool running_;
+		node scenario_;
+		std::string journal_dir_;
 
-		std::deque<game::Update*> send_q_;
-		std::deque<game::Update*> recv_q_;
+		// N.B. The pools are declared first as the scheduler and the host release things
+		// back to them when they are destroyed, and the workers wake the network thread
+		// until the scheduler is destroyed.
+		network::update_pool update_pool_;
+		packet_pool packets_;
+		wakeup_socket wakeup_;
+		game::match_scheduler scheduler_;
+
+		std::shared_ptr<ENetHost> host_;
 
 		static void signal_handler(int signal_number);
 
+		// Takes ownership of up.
+		void handle_update(int peer_id, game::Update* up);
+		void handle_disconnect(int peer_id);
+		void send_results();
+		int find_open_match(int match_id);
+		void broadcast(int match_id, const game::Update& up);
+
 		std::map<int, ENetPeer*> peers_;
 
+		struct peer_info
+		{
+			int match_id;
+			uuid::uuid player_id;
+		};
+		// Which match each peer is playing in.
+		std::map<int, peer_info> peer_matches_;
+
+		// The matches are only touched by the workers, so the network thread keeps its own
+		// record of who is in each match.
+		struct match_info
+		{
+			match_info() : players(0), max_players(0), started(false) {}
+			std::vector<int> peers;
+			std::vector<uuid::uuid> player_ids;
+			int players;
+			int max_players;
+			bool started;
+		};
+		std::map<int, match_info> matches_;
+		int next_match_id_;
+
 		server() = delete;
 		server(const server&) = delete;
 		void operator=(const server&) = delete;
@@ -77,6 +181,7 @@ namespace enet
 			CONNECTED,
 		};
 
+		packet_pool packets_;
 		ENetHost* client_;
 		ENetPeer* peer_;
 
@@ -87,8 +192,8 @@ namespace enet
 		threading::Mutex mutex_;
 		std::unique_ptr<threading::Thread> thread_;
 
-		queue::queue<game::Update*> send_q_;
-		queue::queue<game::Update*> rcv_q_;
+		queue::spsc_queue<game::Update*> send_q_;
+		queue::spsc_queue<game::Update*> rcv_q_;
 
 		client() = delete;
 		client(const client&) = delete;
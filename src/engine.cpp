@@ -15,6 +15,7 @@
 */
 
 #include <algorithm>
+#include <unordered_map>
 
 #include "asserts.hpp"
 #include "component.hpp"
@@ -41,6 +42,7 @@ engine::engine(game::state& game_state, graphics::window_manager& wm)
 	  state_(EngineState::PLAY),
 	  camera_scale_(2),
 	  wm_(wm),
+	  index_(rect(), point()),
 	  particles_(wm.get_renderer())
 {
 }
@@ -51,16 +53,70 @@ engine::~engine()
 
 component_set_ptr engine::add_entity(component_set_ptr e)
 {
-	entity_list_.emplace_back(e);
-	std::stable_sort(entity_list_.begin(), entity_list_.end());
+	entities_.add(e);
+	index_.add(e);
+	if((e->mask & genmask(Component::STATS)) == genmask(Component::STATS)) {
+		e->unit_handle = unit_entities_.set(e->stat->get_uuid(), e);
+	}
 	return e;
 }
 
 void engine::remove_entity(component_set_ptr e1)
 {
-	entity_list_.erase(std::remove_if(entity_list_.begin(), entity_list_.end(), [&e1](component_set_ptr e2) {
-		return e1 == e2; 
-	}), entity_list_.end());
+	index_.remove(e1);
+	entities_.remove(e1);
+	// Another entity for the same unit may have replaced it since.
+	auto e = unit_entities_.get(e1->unit_handle);
+	if(e != nullptr && *e == e1) {
+		unit_entities_.erase(e1->unit_handle);
+	}
+	e1->unit_handle = registry::invalid_handle;
+}
+
+component_set_ptr engine::add_unit_entity(const game::unit_ptr& u)
+{
+	component_set_ptr cs = std::make_shared<component::component_set>(10);
+	cs->mask = genmask(Component::POSITION) | genmask(Component::SPRITE) | genmask(Component::STATS) | genmask(Component::INPUT);
+	cs->stat = u;
+	cs->pos() = u->get_position();
+	// XXX If we get around to putting some animations in, then this would be a good place 
+	// to transform the creature::AnimationInfo into something nicer to go into cs->spr.
+	auto& ai = u->get_type()->get_animation_info("idle");
+	cs->spr = std::make_shared<component::sprite>(ai.image_, ai.area_);
+	cs->inp = std::make_shared<component::input>();
+	cs->inp->mouse_area = ai.area_;
+	return add_entity(cs);
+}
+
+void engine::rebuild_unit_entities()
+{
+	static component_id stat_mask = genmask(Component::STATS);
+	entity_list old;
+	entities_.for_each_with(stat_mask, [&old](const component_set_ptr& e) {
+		old.emplace_back(e);
+	});
+	// Sprites are kept for units which are still around, rather than loading them again.
+	std::unordered_map<uuid::uuid, component_set_ptr, uuid::hash> by_uuid;
+	for(auto& e : old) {
+		by_uuid[e->stat->get_uuid()] = e;
+		remove_entity(e);
+	}
+	for(auto& u : game_state_.get_entities()) {
+		auto it = by_uuid.find(u->get_uuid());
+		if(it == by_uuid.end()) {
+			add_unit_entity(u);
+			continue;
+		}
+		component_set_ptr cs = std::make_shared<component::component_set>(10);
+		cs->mask = it->second->mask;
+		cs->stat = u;
+		cs->pos() = u->get_position();
+		cs->spr = it->second->spr;
+		cs->inp = std::make_shared<component::input>();
+		cs->inp->mouse_area = it->second->inp->mouse_area;
+		add_entity(cs);
+	}
+	LOG_INFO("Rebuilt " << game_state_.get_entities().size() << " unit entities from the full game state.");
 }
 
 void engine::add_process(process::process_ptr s)
@@ -187,15 +243,11 @@ void engine::process_events()
 				break;
 		}
 		if(!claimed) {
-			for(auto& e : entity_list_) {
-				static component_id gui_mask = genmask(Component::GUI);
-				if((e->mask & gui_mask) == gui_mask) {
-					auto& g = e->gui;
-					for(auto& w : g->widgets) {
-						claimed = w->process_events(&evt, claimed);
-					}
+			entities_.for_each<Component::GUI>([&](const component_set_ptr& e, component::gui_component& g) {
+				for(auto& w : g.widgets) {
+					claimed = w->process_events(&evt, claimed);
 				}
-			}
+			});
 			for(auto& s : process_list_) {
 				if(s->process_event(evt)) {
 					break;
@@ -210,14 +262,15 @@ void engine::entity_health_check()
 	static component_id stat_mask 
 		= genmask(Component::STATS) 
 		| genmask(Component::POSITION);
-	entity_list_.erase(std::remove_if(entity_list_.begin(), entity_list_.end(), [&](component_set_ptr e) {
-		if((e->mask & stat_mask) == stat_mask) {
-			if(e->stat->get_health() <= 0) {
-				return true;
-			}
+	entity_list dead;
+	entities_.for_each_with(stat_mask, [&dead](const component_set_ptr& e) {
+		if(e->stat->get_health() <= 0) {
+			dead.emplace_back(e);
 		}
-		return false;
-	}), entity_list_.end());
+	});
+	for(auto& e : dead) {
+		remove_entity(e);
+	}
 }
 
 bool engine::update(double time)
@@ -228,8 +281,11 @@ bool engine::update(double time)
 		return state_ == EngineState::PAUSE ? true : false;
 	}
 
+	// Pick up any entities moved since the last update, i.e. by animations.
+	index_.refresh();
+
 	for(auto& p : process_list_) {
-		p->update(*this, time, entity_list_);
+		p->update(*this, time, entities_.get_entities());
 	}
 
 	for(auto& w : widgets_) {
@@ -243,28 +299,44 @@ bool engine::update(double time)
 	entity_health_check();
 
 	// Entity lifetime check
-	entity_list_.erase(std::remove_if(entity_list_.begin(), entity_list_.end(), [&](component_set_ptr e) {
+	entity_list expired;
+	for(auto& e : entities_.get_entities()) {
 		if(e->lifetime > DBL_EPSILON) {
 			e->lifetime -= time;
 			if(e->lifetime < DBL_EPSILON) {
-				return true;
+				expired.emplace_back(e);
 			}
 		}
-		return false;
-	}), entity_list_.end());
+	}
+	for(auto& e : expired) {
+		remove_entity(e);
+	}
 
 	return true;
 }
 
+entity_list engine::entities_in_area(const rect& r) const
+{
+	entity_list res;
+	index_.entities_in_area(r, &res);
+	return res;
+}
+
+void engine::entities_in_area(const rect& r, entity_list* res) const
+{
+	index_.entities_in_area(r, res);
+}
+
+component_set_ptr engine::entity_at(const point& p, const component_id& mask) const
+{
+	return index_.entity_at(p, mask);
+}
+
 component_set_ptr engine::get_entity_for_unit_uuid(const uuid::uuid& id) const
 {
-	// This is a linear search through entities. Should see if there is a more efficient
-	// way of doing it if performace is a bottleneck.
-	auto it = std::find_if(entity_list_.begin(), entity_list_.end(), [&id](const component_set_ptr& cs) {
-		return ((cs->mask & genmask(Component::STATS)) == genmask(Component::STATS) && cs->stat->get_uuid() == id) ? true : false;
-	});
-	ASSERT_LOG(it != entity_list_.end(), "Unable to find entity with unit id: " << id);
-	return *it;
+	auto e = unit_entities_.get(id);
+	ASSERT_LOG(e != nullptr, "Unable to find entity with unit id: " << id);
+	return *e;
 }
 
 // Handle the engine side of game::state updates
@@ -272,8 +344,14 @@ void engine::process_update(game::Update* up)
 {
 	using namespace game;
 
+	if(up->has_full_state() && up->full_state()) {
+		// The game state was replaced, so the entities still show the old units. Players
+		// are kept, so active_player_ is still good.
+		rebuild_unit_entities();
+	}
+
 	auto& fe = game_state_.get_entities().front();
-	if(up->has_game_start() && up->game_start()) {
+	if((up->has_game_start() && up->game_start()) || (up->has_full_state() && up->full_state())) {
 		if(fe->get_owner() == active_player_) {
 			auto& inp = get_entity_for_unit_uuid(fe->get_uuid())->inp;
 			inp->gen_moves = true;
@@ -313,7 +391,7 @@ void engine::process_update(game::Update* up)
 	}
 
 	for(auto& units : up->units()) {
-		auto e = get_entity_for_unit_uuid(uuid::read(units.uuid()));
+		auto e = get_entity_for_unit_uuid(game_state_.get_unit_uuid(units));
 
 		switch(units.type()) {
 			case Update_Unit_MessageType_CANONICAL_STATE:
@@ -321,9 +399,9 @@ void engine::process_update(game::Update* up)
 			case Update_Unit_MessageType_SUMMON:
 				break;
 			case Update_Unit_MessageType_MOVE: {
-				if(e->pos != e->stat->get_position()) {
+				if(e->pos() != e->stat->get_position()) {
 					// XXX schedule a movement animation, which we fake for now.
-					e->pos = e->stat->get_position();
+					e->pos() = e->stat->get_position();
 				}
 				/// XXX clear any pathing related stuff, or at least signal engine to do it in the input process.
 				//if(e->inp) {
@@ -340,11 +418,9 @@ void engine::process_update(game::Update* up)
 			}
 			case Update_Unit_MessageType_ATTACK: {
 				// clear attack targets
-				for(auto& ge : entity_list_) {
-					if((ge->mask & genmask(Component::INPUT)) == genmask(Component::INPUT)) {
-						ge->inp->is_attack_target = false;
-					}
-				}
+				entities_.for_each<Component::INPUT>([](const component_set_ptr& ge, component::input& inp) {
+					inp.is_attack_target = false;
+				});
 
 				std::stringstream ss;
 				bool was_critical = false;
@@ -365,27 +441,27 @@ void engine::process_update(game::Update* up)
 					ss << "Missed";
 				}
 				auto msg = create_entity_from_string(ss.str());
-				msg->pos = hex::hex_map::get_pixel_pos_from_tile_pos(e->stat->get_position());
-				msg->pos += point((get_tile_size().x - msg->spr->tex.width())/2, 0);
+				msg->pos() = hex::hex_map::get_pixel_pos_from_tile_pos(e->stat->get_position());
+				msg->pos() += point((get_tile_size().x - msg->spr->tex.width())/2, 0);
 				msg->lifetime = 3.5;
-				auto start_point = msg->pos;
+				auto start_point = msg->pos();
 				auto end_point   = start_point - point(0,40);
 				add_animated_property("damage", 
 					std::make_shared<property::animate<double, point>>([start_point, end_point](double t, double d){ 
 						return easing::between::ease_out_quad(t, start_point, end_point, d); 
-					}, [msg](const point& v){ msg->pos = v; }, 2.0));
+					}, [msg](const point& v){ msg->pos() = v; }, 2.0));
 
 				if(was_critical) {
 					auto cmsg = create_entity_from_string("Critical");
-					cmsg->pos = hex::hex_map::get_pixel_pos_from_tile_pos(e->stat->get_position());
-					cmsg->pos += point((get_tile_size().x - cmsg->spr->tex.width())/2, 25);
+					cmsg->pos() = hex::hex_map::get_pixel_pos_from_tile_pos(e->stat->get_position());
+					cmsg->pos() += point((get_tile_size().x - cmsg->spr->tex.width())/2, 25);
 					cmsg->lifetime = 3.5;
-					auto start_point = cmsg->pos;
+					auto start_point = cmsg->pos();
 					auto end_point   = start_point - point(0,msg->spr->tex.height());
 					add_animated_property("critical", 
 						std::make_shared<property::animate<double, point>>([start_point, end_point](double t, double d){ 
 							return easing::between::ease_out_quad(t, start_point, end_point, d); 
-						}, [cmsg](const point& v){ cmsg->pos = v; }, 2.5));
+						}, [cmsg](const point& v){ cmsg->pos() = v; }, 2.5));
 					}
 				break;
 			}
@@ -456,13 +532,10 @@ component_set_ptr engine::create_entity_from_string(const std::string& s)
 
 void engine::end_turn()
 {
-	static component_id input_mask = genmask(Component::INPUT);
-	for(auto& e : entity_list_) {
-		if((e->mask & input_mask) == input_mask) {
-			// clear out a bunch of stuff from the input component
-			e->inp->clear();
-		}
-	}
+	entities_.for_each<Component::INPUT>([](const component_set_ptr& e, component::input& inp) {
+		// clear out a bunch of stuff from the input component
+		inp.clear();
+	});
 
 	auto netclient = get_netclient().lock();
 	ASSERT_LOG(netclient != nullptr, "Network client has gone away.");
@@ -477,6 +550,13 @@ void engine::set_extents(const rect& extents)
 		extents.y(), 
 		(extents.w() * 3 * tile_size_.x)/4 + tile_size_.x/4,
 		extents.h() * tile_size_.y + tile_size_.y/2);
+	index_.set_bounds(extents_);
+}
+
+void engine::set_tile_size(const point& p)
+{
+	tile_size_ = p;
+	index_.set_tile_size(p);
 }
 
 const rect& engine::get_extents() const 
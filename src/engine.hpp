@@ -17,6 +17,7 @@
 #pragma once
 
 #include "engine_fwd.hpp"
+#include "entity_store.hpp"
 #include "game_state.hpp"
 #include "geometry.hpp"
 #include "hex_fwd.hpp"
@@ -25,7 +26,8 @@
 #include "process.hpp"
 #include "profile_timer.hpp"
 #include "property_animate.hpp"
-#include "quadtree.hpp"
+#include "registry.hpp"
+#include "spatial_index.hpp"
 #include "widget.hpp"
 #include "wm.hpp"
 
@@ -48,6 +50,11 @@ public:
 	
 	component_set_ptr add_entity(component_set_ptr e);
 	void remove_entity(component_set_ptr e);
+	// Makes the entity that displays a unit of the game state and adds it.
+	component_set_ptr add_unit_entity(const game::unit_ptr& u);
+	// Replaces the entities of all the units with ones for the units now in the game state,
+	// after it has been loaded from a full state update.
+	void rebuild_unit_entities();
 
 	void add_process(process::process_ptr s);
 	void remove_process(process::process_ptr s);
@@ -78,10 +85,24 @@ public:
 
 	particle::particle_system_manager& get_particles() { return particles_; }
 
-	const entity_list& get_entities() const { return entity_list_; }
+	// All the entities, in no particular order.
+	const entity_list& get_entities() const { return entities_.get_entities(); }
+	// Typed iteration over the entities having the components Cs, see component::entity_store.
+	template<Component... Cs, typename F>
+	void for_each(F fn) { entities_.for_each<Cs...>(fn); }
+	template<typename F>
+	void for_each_with(const component_id& mask, F fn) { entities_.for_each_with(mask, fn); }
+
+	// Spatial queries, in pixel co-ordinates. Entity positions are re-indexed once per update, 
+	// before the processes are run. Results are in z-order.
+	entity_list entities_in_area(const rect& r) const;
+	void entities_in_area(const rect& r, entity_list* res) const;
+	// Top-most entity under p having all the components in mask, or nullptr.
+	component_set_ptr entity_at(const point& p, const component_id& mask=component_id()) const;
+	rect get_entity_area(const component_set_ptr& e) const { return index_.get_area(e); }
 
 	const point& get_tile_size() const { return tile_size_; }
-	void set_tile_size(const point& p) { tile_size_ = p; }
+	void set_tile_size(const point& p);
 
 	hex::hex_map_ptr get_map() const { return map_; }
 	void set_map(hex::hex_map_ptr map) { map_ = map; }
@@ -112,7 +133,10 @@ private:
 	point camera_;
 	unsigned camera_scale_;
 	graphics::window_manager& wm_;
-	entity_list entity_list_;
+	component::entity_store entities_;
+	// Entities with stats, by the uuid of their unit.
+	registry::table<component_set_ptr> unit_entities_;
+	spatial_index index_;
 	std::vector<process::process_ptr> process_list_;
 	point tile_size_;
 	rect extents_;
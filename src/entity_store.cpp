@@ -0,0 +1,213 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "asserts.hpp"
+#include "entity_store.hpp"
+#include "unit_test.hpp"
+#include "units.hpp"
+
+namespace component
+{
+	void entity_store::archetype::push_back(const component_set_ptr& e)
+	{
+		e->archetype_index = static_cast<int>(entities.size());
+		entities.emplace_back(e);
+		if((mask & genmask(Component::POSITION)) == genmask(Component::POSITION)) {
+			pos.emplace_back(e->unstored_pos);
+			e->pos_column = &pos;
+		}
+		if((mask & genmask(Component::SPRITE)) == genmask(Component::SPRITE)) {
+			ASSERT_LOG(e->spr != nullptr, "Entity has a sprite in its mask but no sprite component.");
+			spr.emplace_back(component_type<Component::SPRITE>::get(*e));
+		}
+		if((mask & genmask(Component::STATS)) == genmask(Component::STATS)) {
+			ASSERT_LOG(e->stat != nullptr, "Entity has stats in its mask but no stats component.");
+			stat.emplace_back(component_type<Component::STATS>::get(*e));
+		}
+		if((mask & genmask(Component::INPUT)) == genmask(Component::INPUT)) {
+			ASSERT_LOG(e->inp != nullptr, "Entity has input in its mask but no input component.");
+			inp.emplace_back(component_type<Component::INPUT>::get(*e));
+		}
+		if((mask & genmask(Component::GUI)) == genmask(Component::GUI)) {
+			ASSERT_LOG(e->gui != nullptr, "Entity has gui in its mask but no gui component.");
+			gui.emplace_back(component_type<Component::GUI>::get(*e));
+		}
+	}
+
+	namespace 
+	{
+		template<typename T>
+		void swap_remove_column(std::vector<T>& v, int index)
+		{
+			if(v.empty()) {
+				return;
+			}
+			v[index] = v.back();
+			v.pop_back();
+		}
+	}
+
+	void entity_store::archetype::release(int index)
+	{
+		auto& e = entities[index];
+		if(e->pos_column != nullptr) {
+			e->unstored_pos = pos[index];
+			e->pos_column = nullptr;
+		}
+	}
+
+	void entity_store::archetype::swap_remove(int index)
+	{
+		release(index);
+		if(index != static_cast<int>(entities.size()) - 1) {
+			entities.back()->archetype_index = index;
+		}
+		swap_remove_column(entities, index);
+		swap_remove_column(pos, index);
+		swap_remove_column(spr, index);
+		swap_remove_column(stat, index);
+		swap_remove_column(inp, index);
+		swap_remove_column(gui, index);
+	}
+
+	entity_store::entity_store()
+	{
+	}
+
+	void entity_store::add(const component_set_ptr& e)
+	{
+		ASSERT_LOG(e->store_index < 0, "Entity was already added to an entity store: " << e);
+		auto it = archetype_lookup_.find(e->mask.to_ullong());
+		if(it == archetype_lookup_.end()) {
+			it = archetype_lookup_.insert(std::make_pair(e->mask.to_ullong(), static_cast<int>(archetypes_.size()))).first;
+			archetypes_.emplace_back(new archetype(e->mask));
+		}
+		e->archetype = it->second;
+		archetypes_[it->second]->push_back(e);
+		e->store_index = static_cast<int>(entities_.size());
+		entities_.emplace_back(e);
+	}
+
+	void entity_store::remove(const component_set_ptr& e)
+	{
+		if(e->store_index < 0) {
+			return;
+		}
+		ASSERT_LOG(e->store_index < static_cast<int>(entities_.size()) && entities_[e->store_index] == e, 
+			"Entity isn't in this entity store: " << e);
+		archetypes_[e->archetype]->swap_remove(e->archetype_index);
+		if(e->store_index != static_cast<int>(entities_.size()) - 1) {
+			entities_.back()->store_index = e->store_index;
+			entities_[e->store_index] = entities_.back();
+		}
+		entities_.pop_back();
+		e->store_index = e->archetype = e->archetype_index = -1;
+	}
+
+	void entity_store::clear()
+	{
+		for(auto& e : entities_) {
+			archetypes_[e->archetype]->release(e->archetype_index);
+			e->store_index = e->archetype = e->archetype_index = -1;
+		}
+		entities_.clear();
+		archetypes_.clear();
+		archetype_lookup_.clear();
+	}
+}
+
+UNIT_TEST(entity_store)
+{
+	using namespace component;
+	entity_store store;
+	entity_list ents;
+	for(int n = 0; n != 30; ++n) {
+		auto e = std::make_shared<component_set>(n);
+		e->mask = genmask(Component::POSITION);
+		if(n % 3 == 0) {
+			e->mask |= genmask(Component::INPUT);
+			e->inp = std::make_shared<input>();
+		}
+		if(n % 5 == 0) {
+			e->mask |= genmask(Component::COLLISION);
+		}
+		e->pos() = point(n, 0);
+		store.add(e);
+		ents.emplace_back(e);
+	}
+	CHECK_EQ(store.size(), 30u);
+
+	int count = 0;
+	int sum = 0;
+	store.for_each<Component::POSITION, Component::INPUT>([&](const component_set_ptr& e, point& pos, input& inp) {
+		CHECK_EQ(&pos, &e->pos());
+		CHECK_EQ(&inp, e->inp.get());
+		++count;
+		sum += pos.x;
+	});
+	CHECK_EQ(count, 10);
+	CHECK_EQ(sum, 135);
+
+	// Positions are stored by value, next to each other.
+	store.for_each<Component::POSITION>([&](const component_set_ptr& e, point& pos) {
+		CHECK_EQ(&pos, e->pos_column->data() + e->archetype_index);
+		pos.y = pos.x * 2;
+	});
+	for(auto& e : ents) {
+		CHECK_EQ(e->pos().y, e->pos().x * 2);
+	}
+
+	// Remove everything with an x divisible by 6, the rest should still be found.
+	for(int n = 0; n < 30; n += 6) {
+		store.remove(ents[n]);
+	}
+	store.remove(ents[0]);
+	CHECK_EQ(store.size(), 25u);
+	// Removed entities take their position with them, the rest keep theirs.
+	for(auto& e : ents) {
+		CHECK_EQ(e->pos().y, e->pos().x * 2);
+	}
+	ents[6]->pos() = point(100, 100);
+	CHECK_EQ(ents[6]->unstored_pos, point(100, 100));
+	count = 0;
+	sum = 0;
+	store.for_each<Component::INPUT>([&](const component_set_ptr& e, input& inp) {
+		CHECK_EQ(e->pos().x % 6, 3);
+		++count;
+		sum += e->pos().x;
+	});
+	CHECK_EQ(count, 5);
+	CHECK_EQ(sum, 75);
+
+	count = 0;
+	store.for_each_with(genmask(Component::POSITION) | genmask(Component::COLLISION), [&](const component_set_ptr& e) {
+		CHECK_EQ(e->pos().x % 5, 0);
+		++count;
+	});
+	// 5, 10, 15, 20, 25 are left.
+	CHECK_EQ(count, 5);
+	for(auto& e : store.get_entities()) {
+		CHECK_EQ(store.get_entities()[e->store_index].get(), e.get());
+	}
+
+	store.clear();
+	for(int n = 0; n != 30; ++n) {
+		CHECK_EQ(ents[n]->pos_column == nullptr, true);
+		if(n != 6) {
+			CHECK_EQ(ents[n]->pos(), point(n, n * 2));
+		}
+	}
+}
@@ -0,0 +1,161 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "component.hpp"
+
+namespace component
+{
+	// Maps the data carrying components to their type and the column type used to store them. 
+	// Positions are plain data, so they are stored by value and the entity refers to its slot in 
+	// the column. The other components are shared with the rest of the game, e.g. stats are the 
+	// game state's units, so the columns point at them. Tag only components have no data, so 
+	// they can only be used as part of a mask.
+	template<Component C> struct component_type;
+	template<> struct component_type<Component::POSITION> 
+	{ 
+		typedef point type; 
+		typedef std::vector<point> column;
+	};
+	template<> struct component_type<Component::SPRITE> 
+	{ 
+		typedef sprite type; 
+		typedef std::vector<sprite*> column;
+		static type* get(component_set& e) { return e.spr.get(); } 
+	};
+	template<> struct component_type<Component::STATS> 
+	{ 
+		typedef game::unit type; 
+		typedef std::vector<game::unit*> column;
+		static type* get(component_set& e) { return e.stat.get(); } 
+	};
+	template<> struct component_type<Component::INPUT> 
+	{ 
+		typedef input type; 
+		typedef std::vector<input*> column;
+		static type* get(component_set& e) { return e.inp.get(); } 
+	};
+	template<> struct component_type<Component::GUI> 
+	{ 
+		typedef gui_component type; 
+		typedef std::vector<gui_component*> column;
+		static type* get(component_set& e) { return e.gui.get(); } 
+	};
+
+	// Stores entities grouped by archetype, that is by the set of components they have. Each 
+	// archetype keeps its entities in parallel arrays, one per component, so iterating over the
+	// entities having some components only visits the archetypes that have all of them and
+	// doesn't need to test masks or chase through the component_set for each one. Positions are
+	// kept in the arrays themselves, so iterating over them is a walk through contiguous memory.
+	//
+	// Adding and removing an entity are O(1), removal swaps the last entity of the archetype into
+	// the hole so the order of iteration isn't stable. An entities mask and components must be
+	// set up before it is added and not changed while it is in the store. Entities must not be
+	// removed from inside for_each.
+	class entity_store
+	{
+	public:
+		entity_store();
+
+		void add(const component_set_ptr& e);
+		void remove(const component_set_ptr& e);
+		void clear();
+
+		// Every entity in the store, in no particular order.
+		const entity_list& get_entities() const { return entities_; }
+		size_t size() const { return entities_.size(); }
+
+		// Calls fn(e, c...) for every entity having all the components Cs, where each c is a 
+		// reference to the component, i.e. for_each<Component::POSITION, Component::SPRITE> calls 
+		// fn(const component_set_ptr&, point&, sprite&).
+		template<Component... Cs, typename F>
+		void for_each(F fn) {
+			const component_id mask = make_mask<Cs...>();
+			for(size_t a = 0; a != archetypes_.size(); ++a) {
+				archetype& arch = *archetypes_[a];
+				if((arch.mask & mask) != mask) {
+					continue;
+				}
+				for(size_t n = 0; n != arch.entities.size(); ++n) {
+					fn(arch.entities[n], item(arch.template column<Cs>(), n)...);
+				}
+			}
+		}
+
+		// Calls fn(e) for every entity having all the components in mask, which can include tag 
+		// components.
+		template<typename F>
+		void for_each_with(const component_id& mask, F fn) {
+			for(size_t a = 0; a != archetypes_.size(); ++a) {
+				archetype& arch = *archetypes_[a];
+				if((arch.mask & mask) != mask) {
+					continue;
+				}
+				for(size_t n = 0; n != arch.entities.size(); ++n) {
+					fn(arch.entities[n]);
+				}
+			}
+		}
+	private:
+		struct archetype
+		{
+			explicit archetype(const component_id& m) : mask(m) {}
+			component_id mask;
+			entity_list entities;
+			// Columns for the data carrying components, empty if the component isn't in mask.
+			std::vector<point> pos;
+			std::vector<sprite*> spr;
+			std::vector<game::unit*> stat;
+			std::vector<input*> inp;
+			std::vector<gui_component*> gui;
+
+			template<Component C> typename component_type<C>::column& column();
+			void push_back(const component_set_ptr& e);
+			void swap_remove(int index);
+			// Hands the position back to the entity, when it leaves the store.
+			void release(int index);
+		};
+
+		template<typename T>
+		static T& item(std::vector<T*>& col, size_t n) { return *col[n]; }
+		template<typename T>
+		static T& item(std::vector<T>& col, size_t n) { return col[n]; }
+
+		template<Component C>
+		static component_id make_mask() { return genmask(C); }
+		template<Component C1, Component C2, Component... Cs>
+		static component_id make_mask() { return genmask(C1) | make_mask<C2, Cs...>(); }
+
+		entity_list entities_;
+		std::vector<std::unique_ptr<archetype>> archetypes_;
+		// Maps a mask to its index in archetypes_.
+		std::unordered_map<unsigned long long, int> archetype_lookup_;
+
+		entity_store(const entity_store&) = delete;
+		void operator=(const entity_store&) = delete;
+	};
+
+	template<> inline std::vector<point>& entity_store::archetype::column<Component::POSITION>() { return pos; }
+	template<> inline std::vector<sprite*>& entity_store::archetype::column<Component::SPRITE>() { return spr; }
+	template<> inline std::vector<game::unit*>& entity_store::archetype::column<Component::STATS>() { return stat; }
+	template<> inline std::vector<input*>& entity_store::archetype::column<Component::INPUT>() { return inp; }
+	template<> inline std::vector<gui_component*>& entity_store::archetype::column<Component::GUI>() { return gui; }
+}
@@ -0,0 +1,524 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <algorithm>
+#include <cfloat>
+
+#include "asserts.hpp"
+#include "creature.hpp"
+#include "formatter.hpp"
+#include "game_snapshot.hpp"
+#include "game_state.hpp"
+#include "hex_logical_tiles.hpp"
+#include "node_utils.hpp"
+#include "unit_test.hpp"
+#include "units.hpp"
+#include "zobrist.hpp"
+
+namespace game
+{
+	bool snapshot::fits(const state& gs)
+	{
+		const unit_list& units = gs.get_entities();
+		if(units.size() > static_cast<size_t>(max_units)) {
+			return false;
+		}
+		uuid::uuid teams[max_teams];
+		int team_count = 0;
+		for(auto& e : units) {
+			const uuid::uuid& team_id = e->get_owner()->team()->id();
+			if(std::find(teams, teams + team_count, team_id) != teams + team_count) {
+				continue;
+			}
+			if(team_count == max_teams) {
+				return false;
+			}
+			teams[team_count++] = team_id;
+		}
+		return true;
+	}
+
+	snapshot::snapshot(const state& gs)
+		: map_(gs.get_map().get()),
+		  initiative_counter_(gs.get_initiative_counter()),
+		  unit_count_(0),
+		  active_count_(0),
+		  team_count_(0),
+		  hash_(0)
+	{
+		ASSERT_LOG(map_ != nullptr, "Can't take a snapshot of a state without a map.");
+		const unit_list& units = gs.get_entities();
+		ASSERT_LOG(units.size() <= static_cast<size_t>(max_units), "Too many units for a snapshot: " << units.size() << " > " << max_units);
+		for(auto& e : units) {
+			const int u = unit_count_++;
+			const uuid::uuid& team_id = e->get_owner()->team()->id();
+			int t = 0;
+			while(t != team_count_ && team_uuids_[t] != team_id) {
+				++t;
+			}
+			if(t == team_count_) {
+				ASSERT_LOG(team_count_ < max_teams, "Too many teams for a snapshot, max is " << max_teams);
+				team_uuids_[team_count_++] = team_id;
+			}
+
+			order_[active_count_++] = static_cast<int8_t>(u);
+			handle_[u] = e->get_handle();
+			key_[u] = zobrist::unit_key(e->get_uuid());
+			alive_[u] = 1;
+			team_[u] = static_cast<int8_t>(t);
+			movement_type_[u] = static_cast<uint8_t>(e->get_movement_type());
+			pos_[u] = e->get_position();
+			health_[u] = e->get_health();
+			attack_[u] = e->get_attack();
+			armour_[u] = e->get_armour();
+			range_[u] = e->get_range();
+			move_[u] = e->get_move();
+			initiative_[u] = e->get_initiative();
+			critical_strike_[u] = e->get_critical_strike();
+			attacks_this_turn_[u] = e->get_attacks_this_turn();
+
+			auto& type = e->get_type();
+			if(type != nullptr) {
+				max_units_attackable_[u] = type->get_max_units_attackable();
+				movement_[u] = type->get_movement();
+				attacks_per_turn_[u] = type->get_attacks_per_turn();
+				// Worked out the same way as unit::complete_turn() so the results match exactly.
+				initiative_step_[u] = 100.0f / type->get_initiative();
+			} else {
+				max_units_attackable_[u] = 1;
+				movement_[u] = move_[u];
+				attacks_per_turn_[u] = attacks_this_turn_[u];
+				initiative_step_[u] = 100.0f / 5;
+			}
+			hash_ ^= unit_hash(u);
+		}
+	}
+
+	void snapshot::write_to(state& gs) const
+	{
+		for(int u = 0; u != unit_count_; ++u) {
+			if(!alive_[u]) {
+				auto e = gs.handles_.get_unit(handle_[u]);
+				if(e != nullptr) {
+					gs.remove_unit(e);
+				}
+			}
+		}
+
+		unit_list units;
+		units.reserve(active_count_);
+		for(int n = 0; n != active_count_; ++n) {
+			const int u = order_[n];
+			auto e = gs.handles_.get_unit(handle_[u]);
+			ASSERT_LOG(e != nullptr, "Unit with handle " << handle_[u] << " from the snapshot isn't in the state.");
+			gs.toggle_hash(e);
+			if(e->get_position() != pos_[u]) {
+				gs.occupancy_.move(e, e->get_position(), pos_[u]);
+				e->set_position(pos_[u]);
+			}
+			e->set_health(health_[u]);
+			e->set_attack(attack_[u]);
+			e->set_armour(armour_[u]);
+			e->set_range(range_[u]);
+			e->set_move(move_[u]);
+			e->set_initiative(initiative_[u]);
+			e->set_critical_strike(critical_strike_[u]);
+			e->set_attacks_this_turn(attacks_this_turn_[u]);
+			gs.toggle_hash(e);
+			units.emplace_back(e);
+		}
+		ASSERT_LOG(units.size() == gs.units_.size(), "State has units that aren't in the snapshot: " << gs.units_.size() << " != " << units.size());
+		gs.units_.swap(units);
+		gs.initiative_counter_ = initiative_counter_;
+	}
+
+	int snapshot::unit_at(const point& p) const
+	{
+		for(int n = 0; n != active_count_; ++n) {
+			if(pos_[order_[n]] == p) {
+				return order_[n];
+			}
+		}
+		return -1;
+	}
+
+	bool snapshot::is_enemy_at(const point& p, int t) const
+	{
+		for(int n = 0; n != active_count_; ++n) {
+			const int u = order_[n];
+			if(team_[u] != t && pos_[u] == p) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool snapshot::is_enemy_zoc(const point& p, int t) const
+	{
+		bool zoc = false;
+		for(int n = 0; n != active_count_; ++n) {
+			const int u = order_[n];
+			if(team_[u] != t) {
+				const int d = hex::logical::distance(pos_[u], p);
+				if(d == 0) {
+					return false;
+				}
+				zoc |= d == 1;
+			}
+		}
+		return zoc;
+	}
+
+	bool snapshot::is_attackable(int aggressor, int target) const
+	{
+		if(aggressor == target || team_[aggressor] == team_[target] || !alive_[target]) {
+			return false;
+		}
+		const int d = hex::logical::distance(pos_[aggressor], pos_[target]);
+		if(d > range_[aggressor]) {
+			return false;
+		}
+		if(d > 1) {
+			return hex::logical::for_each_between(pos_[aggressor], pos_[target], [this](const point& p) {
+				return unit_at(p) < 0;
+			});
+		}
+		return true;
+	}
+
+	int snapshot::get_damage(int aggressor, int target, bool critical) const
+	{
+		if(attack_[aggressor] <= armour_[target]) {
+			return 0;
+		}
+		return (attack_[aggressor] - armour_[target]) * (critical ? 2 : 1);
+	}
+
+	float snapshot::get_path_cost(int u, const std::vector<point>& path) const
+	{
+		auto& costs = map_->get_cost_grid(get_movement_type(u));
+		float cost(0);
+		for(auto p = path.begin() + 1; p < path.end(); ++p) {
+			cost += hex::logical::to_cost(costs[*p]);
+		}
+		return cost;
+	}
+
+	void snapshot::make_move(int u, const point& dst, float cost, undo* rec)
+	{
+		rec->type = undo::kind::MOVE;
+		rec->unit = static_cast<int8_t>(u);
+		rec->pos = pos_[u];
+		rec->move = move_[u];
+
+		hash_ ^= unit_hash(u);
+		move_[u] -= cost;
+		if(move_[u] < FLT_EPSILON) {
+			move_[u] = 0;
+		}
+		pos_[u] = dst;
+		hash_ ^= unit_hash(u);
+	}
+
+	void snapshot::make_attack(int u, int target, bool critical, undo* rec)
+	{
+		rec->type = undo::kind::ATTACK;
+		rec->unit = static_cast<int8_t>(u);
+		rec->target = static_cast<int8_t>(target);
+		rec->order_pos = -1;
+		rec->health = health_[target];
+		rec->attacks_this_turn = attacks_this_turn_[u];
+		if(attacks_this_turn_[u] <= 0) {
+			return;
+		}
+
+		hash_ ^= unit_hash(u) ^ unit_hash(target);
+		health_[target] -= get_damage(u, target, critical);
+		--attacks_this_turn_[u];
+		hash_ ^= unit_hash(u);
+		if(health_[target] > 0) {
+			hash_ ^= unit_hash(target);
+		} else {
+			int pos = 0;
+			while(order_[pos] != target) {
+				++pos;
+			}
+			rec->order_pos = static_cast<int8_t>(pos);
+			remove_from_order(pos);
+			alive_[target] = 0;
+		}
+	}
+
+	void snapshot::make_end_turn(undo* rec)
+	{
+		rec->type = undo::kind::END_TURN;
+		rec->unit = -1;
+		if(active_count_ == 0) {
+			return;
+		}
+		const int u = order_[0];
+		rec->unit = static_cast<int8_t>(u);
+		rec->move = move_[u];
+		rec->attacks_this_turn = attacks_this_turn_[u];
+		rec->initiative = initiative_[u];
+		rec->initiative_counter = initiative_counter_;
+
+		hash_ ^= unit_hash(u);
+		move_[u] = movement_[u];
+		attacks_this_turn_[u] = attacks_per_turn_[u];
+		initiative_[u] += initiative_step_[u];
+		hash_ ^= unit_hash(u);
+
+		// The rest of the units are still in order, so this puts the unit where the stable
+		// sort in state::end_unit_turn() would, before any with the same initiative.
+		remove_from_order(0);
+		int pos = 0;
+		while(pos != active_count_ && initiative_[order_[pos]] < initiative_[u]) {
+			++pos;
+		}
+		insert_into_order(pos, u);
+		rec->order_pos = static_cast<int8_t>(pos);
+		initiative_counter_ = initiative_[order_[0]];
+	}
+
+	void snapshot::unmake(const undo& rec)
+	{
+		const int u = rec.unit;
+		switch(rec.type) {
+			case undo::kind::MOVE:
+				hash_ ^= unit_hash(u);
+				pos_[u] = rec.pos;
+				move_[u] = rec.move;
+				hash_ ^= unit_hash(u);
+				break;
+			case undo::kind::ATTACK:
+				// A killed target isn't in the hash.
+				hash_ ^= unit_hash(u);
+				if(rec.order_pos < 0) {
+					hash_ ^= unit_hash(rec.target);
+				}
+				health_[rec.target] = rec.health;
+				attacks_this_turn_[u] = rec.attacks_this_turn;
+				if(rec.order_pos >= 0) {
+					alive_[rec.target] = 1;
+					insert_into_order(rec.order_pos, rec.target);
+				}
+				hash_ ^= unit_hash(u) ^ unit_hash(rec.target);
+				break;
+			case undo::kind::END_TURN:
+				if(u < 0) {
+					break;
+				}
+				remove_from_order(rec.order_pos);
+				insert_into_order(0, u);
+				hash_ ^= unit_hash(u);
+				move_[u] = rec.move;
+				attacks_this_turn_[u] = rec.attacks_this_turn;
+				initiative_[u] = rec.initiative;
+				hash_ ^= unit_hash(u);
+				initiative_counter_ = rec.initiative_counter;
+				break;
+		}
+	}
+
+	int snapshot::get_winning_team() const
+	{
+		if(active_count_ == 0) {
+			return -1;
+		}
+		const int t = team_[order_[0]];
+		for(int n = 1; n != active_count_; ++n) {
+			if(team_[order_[n]] != t) {
+				return -1;
+			}
+		}
+		return t;
+	}
+
+	void snapshot::remove_from_order(int pos)
+	{
+		--active_count_;
+		for(int n = pos; n != active_count_; ++n) {
+			order_[n] = order_[n + 1];
+		}
+	}
+
+	void snapshot::insert_into_order(int pos, int u)
+	{
+		for(int n = active_count_; n != pos; --n) {
+			order_[n] = order_[n - 1];
+		}
+		order_[pos] = static_cast<int8_t>(u);
+		++active_count_;
+	}
+
+	uint64_t snapshot::unit_hash(int u) const
+	{
+		return zobrist::unit_hash(key_[u], pos_[u], health_[u], move_[u], initiative_[u], attacks_this_turn_[u]);
+	}
+}
+
+UNIT_TEST(game_snapshot)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+	node_builder mb;
+	mb.add("width", 6);
+	for(int n = 0; n != 36; ++n) {
+		mb.add("tiles", "flat");
+	}
+
+	node_builder idle;
+	idle.add("image", "none.png");
+	for(int n = 0; n != 4; ++n) {
+		idle.add("area", n / 2);
+	}
+	node_builder anims;
+	anims.add("idle", idle.build());
+	auto fast = std::make_shared<creature::creature>(node_builder()
+		.add("name", "fast")
+		.add("stats", node_builder().add("health", 10).add("attack", 8).add("initiative", 10).build())
+		.add("animations", anims.build()).build());
+	auto slow = std::make_shared<creature::creature>(node_builder()
+		.add("name", "slow")
+		.add("stats", node_builder().add("health", 20).add("attack", 5).add("armour", 2).add("initiative", 4).build())
+		.add("animations", anims.build()).build());
+
+	game::state gs;
+	gs.set_map(hex::logical::map::factory(mb.build()));
+	auto p1 = std::make_shared<player>(gs.create_team_instance("a"), PlayerType::NORMAL, "p1");
+	auto p2 = std::make_shared<player>(gs.create_team_instance("b"), PlayerType::NORMAL, "p2");
+	gs.add_player(p1);
+	gs.add_player(p2);
+	// N.B. Made by hand rather than with creature::create_instance() which would use the
+	// random number generator before it is seeded.
+	auto u1 = std::make_shared<game::unit>("fast", fast, p1);
+	u1->set_position(0, 0);
+	u1->set_attack(8);
+	u1->set_health(10);
+	u1->set_move(5.0f);
+	u1->set_initiative(10.0f);
+	auto u2 = std::make_shared<game::unit>("slow", slow, p2);
+	u2->set_position(3, 0);
+	u2->set_armour(2);
+	u2->set_health(6);
+	u2->set_initiative(25.0f);
+	auto u3 = std::make_shared<game::unit>("slow", slow, p2);
+	u3->set_position(5, 5);
+	u3->set_initiative(25.0f);
+	for(auto& u : { u1, u2, u3 }) {
+		gs.add_unit(u);
+	}
+
+	game::snapshot snap(gs);
+	CHECK_EQ(snap.get_unit_count(), 3);
+	CHECK_EQ(snap.get_team_count(), 2);
+	CHECK_EQ(snap.get_winning_team(), -1);
+	const int a = snap.get_current_unit();
+	const int b = snap.unit_at(point(3, 0));
+	CHECK_EQ(snap.get_handle(a), u1->get_handle());
+	CHECK_EQ(snap.get_team(a) != snap.get_team(b), true);
+	CHECK_EQ(snap.is_attackable(a, b), false);
+	CHECK_EQ(gs.get_hash(), gs.compute_hash());
+	CHECK_EQ(snap.get_hash(), gs.get_hash());
+	const uint64_t start_hash = snap.get_hash();
+
+	game::snapshot::undo moved, attacked, ended;
+	const std::vector<point> path = { point(0, 0), point(1, 0), point(2, 0) };
+	snap.make_move(a, path.back(), snap.get_path_cost(a, path), &moved);
+	CHECK_EQ(snap.get_move(a), 3.0f);
+	CHECK_EQ(snap.is_attackable(a, b), true);
+	CHECK_EQ(snap.get_damage(a, b, true), 12);
+	snap.make_attack(a, b, false, &attacked);
+	CHECK_EQ(snap.is_alive(b), false);
+	CHECK_EQ(snap.get_active_count(), 2);
+	CHECK_EQ(snap.get_winning_team(), -1);
+	snap.make_end_turn(&ended);
+	CHECK_EQ(snap.get_current_unit(), a);
+	CHECK_EQ(snap.get_initiative(a), 20.0f);
+	CHECK_EQ(snap.get_move(a), 5.0f);
+
+	// Undoing gets back to where we started and a copy is independent of the original.
+	game::snapshot copy(snap);
+	snap.unmake(ended);
+	snap.unmake(attacked);
+	snap.unmake(moved);
+	CHECK_EQ(snap.get_position(a), point(0, 0));
+	CHECK_EQ(snap.get_health(b), 6);
+	CHECK_EQ(snap.get_active_count(), 3);
+	CHECK_EQ(snap.get_active_unit(1), b);
+	CHECK_EQ(snap.get_initiative_counter(), gs.get_initiative_counter());
+	CHECK_EQ(copy.get_active_count(), 2);
+	CHECK_EQ(snap.get_hash(), start_hash);
+	CHECK_NE(copy.get_hash(), start_hash);
+
+	// The state is left the same as if the server had done the same move.
+	game::state server(gs);
+	game::state client(gs);
+	std::unique_ptr<game::Update> up(client.create_update());
+	client.unit_move(up.get(), client.get_entities().front(), path);
+	client.end_turn(up.get());
+	std::unique_ptr<game::Update> reply(server.validate_and_apply(up.get()));
+	snap.make_move(a, path.back(), snap.get_path_cost(a, path), &moved);
+	snap.make_end_turn(&ended);
+	game::state written(gs);
+	snap.write_to(written);
+	CHECK_EQ(server.get_entities().size(), written.get_entities().size());
+	for(size_t n = 0; n != written.get_entities().size(); ++n) {
+		auto& su = server.get_entities()[n];
+		auto& wu = written.get_entities()[n];
+		CHECK_EQ(su->get_uuid() == wu->get_uuid(), true);
+		CHECK_EQ(su->get_position(), wu->get_position());
+		CHECK_EQ(su->get_move(), wu->get_move());
+		CHECK_EQ(su->get_initiative(), wu->get_initiative());
+	}
+	CHECK_EQ(server.get_initiative_counter(), written.get_initiative_counter());
+	CHECK_EQ(server.get_hash(), server.compute_hash());
+	CHECK_EQ(written.get_hash(), written.compute_hash());
+	CHECK_EQ(server.get_hash(), snap.get_hash());
+
+	// Killed units are removed from the state.
+	copy.write_to(gs);
+	CHECK_EQ(gs.get_entities().size(), 2);
+	CHECK_EQ(u1->get_position(), point(2, 0));
+	CHECK_EQ(gs.get_occupancy().unit_at(point(2, 0)).get(), u1.get());
+	CHECK_EQ(gs.get_occupancy().is_occupied(point(3, 0)), false);
+	CHECK_EQ(gs.get_hash(), copy.get_hash());
+	CHECK_EQ(gs.get_hash(), gs.compute_hash());
+
+	// States with too many teams or units can't be snapshotted, so bots play them greedily.
+	CHECK_EQ(game::snapshot::fits(gs), true);
+	game::state crowded;
+	crowded.set_map(gs.get_map());
+	for(int n = 0; n != game::snapshot::max_teams + 1; ++n) {
+		auto p = std::make_shared<player>(crowded.create_team_instance(formatter() << "t" << n), PlayerType::NORMAL, "p");
+		crowded.add_player(p);
+		auto u = std::make_shared<game::unit>("fast", fast, p);
+		u->set_position(n % 6, n / 6);
+		crowded.add_unit(u);
+		CHECK_EQ(game::snapshot::fits(crowded), n < game::snapshot::max_teams);
+	}
+	game::state army;
+	army.set_map(gs.get_map());
+	army.add_player(p1);
+	for(int n = 0; n != game::snapshot::max_units + 1; ++n) {
+		auto u = std::make_shared<game::unit>("fast", fast, p1);
+		u->set_position(n % 6, n / 6 % 6);
+		army.add_unit(u);
+		CHECK_EQ(game::snapshot::fits(army), n < game::snapshot::max_units);
+	}
+}
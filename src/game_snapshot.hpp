@@ -0,0 +1,170 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "creature_fwd.hpp"
+#include "geometry.hpp"
+#include "hex_logical_fwd.hpp"
+#include "uuid.hpp"
+
+namespace game
+{
+	class state;
+
+	// Compact copy of the parts of a game::state that change during play, for bots and
+	// analysis tools that need to try out thousands of moves a turn.
+	//
+	// It's plain data, unit stats are kept in parallel arrays indexed by a small unit index
+	// and teams are small indices as well, so copying one is a memcpy rather than cloning
+	// every player and unit. Moves are made in place and undone using the record they fill
+	// in, which must be done in the reverse order they were made.
+	//
+	// The map is referenced rather than copied, so it must outlive the snapshot.
+	class snapshot
+	{
+	public:
+		static const int max_units = 64;
+		static const int max_teams = 8;
+		// Whether the state is small enough to take a snapshot of, i.e. it has no more than
+		// max_units units belonging to no more than max_teams teams.
+		static bool fits(const state& gs);
+
+		// What's needed to undo a move, filled in by the make_*() functions.
+		struct undo
+		{
+			enum class kind : uint8_t { MOVE, ATTACK, END_TURN };
+			kind type;
+			int8_t unit;
+			int8_t target;
+			// Position in the initiative order the unit was moved to at the end of its turn,
+			// or the target was removed from if it was killed, otherwise -1.
+			int8_t order_pos;
+			point pos;
+			float move;
+			int health;
+			int attacks_this_turn;
+			float initiative;
+			float initiative_counter;
+		};
+
+		explicit snapshot(const state& gs);
+
+		// Update the state to match the snapshot. Units that have died are removed. The
+		// state must be the one the snapshot was taken from, or a copy of it.
+		void write_to(state& gs) const;
+
+		const hex::logical::map& get_map() const { return *map_; }
+		float get_initiative_counter() const { return initiative_counter_; }
+
+		// Number of units when the snapshot was taken, including ones that have since died.
+		int get_unit_count() const { return unit_count_; }
+		// Units still alive, in initiative order. The unit at the front is the one whose turn
+		// it is, -1 if there aren't any units.
+		int get_active_count() const { return active_count_; }
+		int get_active_unit(int n) const { return order_[n]; }
+		int get_current_unit() const { return active_count_ > 0 ? order_[0] : -1; }
+
+		bool is_alive(int u) const { return alive_[u] != 0; }
+		int get_handle(int u) const { return handle_[u]; }
+		int get_team(int u) const { return team_[u]; }
+		const uuid::uuid& get_team_uuid(int t) const { return team_uuids_[t]; }
+		int get_team_count() const { return team_count_; }
+		const point& get_position(int u) const { return pos_[u]; }
+		int get_health(int u) const { return health_[u]; }
+		int get_attack(int u) const { return attack_[u]; }
+		int get_armour(int u) const { return armour_[u]; }
+		int get_range(int u) const { return range_[u]; }
+		float get_move(int u) const { return move_[u]; }
+		float get_initiative(int u) const { return initiative_[u]; }
+		float get_critical_strike(int u) const { return critical_strike_[u]; }
+		int get_attacks_this_turn(int u) const { return attacks_this_turn_[u]; }
+		int get_max_units_attackable(int u) const { return max_units_attackable_[u]; }
+		creature::MovementType get_movement_type(int u) const { return static_cast<creature::MovementType>(movement_type_[u]); }
+
+		// Living unit on the tile, -1 if there isn't one.
+		int unit_at(const point& p) const;
+		// Is there a living unit not on team t on the tile.
+		bool is_enemy_at(const point& p, int t) const;
+		// Is the tile next to a living unit not on team t. Tiles holding such a unit aren't
+		// considered to be under ZoC, the same as game::occupancy.
+		bool is_enemy_zoc(const point& p, int t) const;
+		// Same rules as state::is_attackable().
+		bool is_attackable(int aggressor, int target) const;
+		// Damage an attack would do, the same as state::combat() works out.
+		int get_damage(int aggressor, int target, bool critical) const;
+		// Cost of moving the unit along the path, not counting the first tile.
+		float get_path_cost(int u, const std::vector<point>& path) const;
+
+		// Move the unit to dst, using up cost movement points. This does what the server
+		// does for a validated move, it isn't checked here.
+		void make_move(int u, const point& dst, float cost, undo* rec);
+		// Attack the target, as state::combat() does, but with the critical strike decided by
+		// the caller. A target that is killed is removed from the initiative order.
+		void make_attack(int u, int target, bool critical, undo* rec);
+		// End the turn of the current unit, as state::end_unit_turn() does.
+		void make_end_turn(undo* rec);
+		void unmake(const undo& rec);
+
+		// Zobrist hash of the living units positions and stats, kept up to date by the
+		// make_*() and unmake() functions. The same as state::get_hash() for the same position.
+		uint64_t get_hash() const { return hash_; }
+
+		// Team index of the only team with units left. -1 if there is more than one team
+		// left, or none.
+		int get_winning_team() const;
+		bool is_finished() const { return active_count_ == 0 || get_winning_team() >= 0; }
+	private:
+		void remove_from_order(int pos);
+		void insert_into_order(int pos, int u);
+		uint64_t unit_hash(int u) const;
+
+		const hex::logical::map* map_;
+		float initiative_counter_;
+		int unit_count_;
+		int active_count_;
+		int team_count_;
+		uint64_t hash_;
+		uuid::uuid team_uuids_[max_teams];
+		// Living units, sorted by initiative.
+		int8_t order_[max_units];
+
+		// Per unit, by unit index.
+		int handle_[max_units];
+		// zobrist::unit_key() of the units uuid.
+		uint64_t key_[max_units];
+		uint8_t alive_[max_units];
+		int8_t team_[max_units];
+		uint8_t movement_type_[max_units];
+		point pos_[max_units];
+		int health_[max_units];
+		int attack_[max_units];
+		int armour_[max_units];
+		int range_[max_units];
+		float move_[max_units];
+		float initiative_[max_units];
+		float critical_strike_[max_units];
+		int attacks_this_turn_[max_units];
+		int max_units_attackable_[max_units];
+		// Values from the unit's creature, used at the end of its turn.
+		float movement_[max_units];
+		int attacks_per_turn_[max_units];
+		float initiative_step_[max_units];
+	};
+}
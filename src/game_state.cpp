@@ -19,8 +19,10 @@
 #include "formatter.hpp"
 #include "game_state.hpp"
 #include "hex_logical_tiles.hpp"
+#include "node_utils.hpp"
 #include "profile_timer.hpp"
 #include "random.hpp"
+#include "unit_test.hpp"
 #include "units.hpp"
 #include "uuid.hpp"
 
@@ -28,25 +30,31 @@ namespace game
 {
 	state::state()
 		: initiative_counter_(0.0f),
-		  update_counter_(0)
+		  update_counter_(0),
+		  hash_(0)
 	{
 	}
 
 	state::state(const state& obj)
 		: initiative_counter_(obj.initiative_counter_),
 		  update_counter_(obj.update_counter_),
-		  map_(obj.map_->clone())
+		  hash_(obj.hash_),
+		  rng_(obj.rng_),
+		  map_(obj.map_->clone()),
+		  handles_(obj.handles_)
 	{
-		for(auto& p : obj.players_) {
-			players_[p.first] = p.second->clone();
-		}
+		obj.players_.for_each([this](const uuid::uuid& id, const player_ptr& p) {
+			players_.set(id, p->clone());
+		});
 		for(auto& u : obj.units_) {
 			auto owner = u->get_owner();
 			ASSERT_LOG(owner != nullptr, "Couldn't lock owner of " << u);
-			auto it = players_.find(owner->get_uuid());
-			ASSERT_LOG(it != players_.end(), "Couldn't find owner for " << u);
-			units_.emplace_back(u->clone(it->second));
+			auto p = players_.get(owner->get_uuid());
+			ASSERT_LOG(p != nullptr, "Couldn't find owner for " << u);
+			units_.emplace_back(u->clone(*p));
 		}
+		occupancy_.reset(map_, units_);
+		handles_.relink(units_);
 	}
 
 	state::~state()
@@ -56,6 +64,7 @@ namespace game
 	void state::set_map(hex::logical::map_ptr map)
 	{
 		map_ = map;
+		occupancy_.reset(map_, units_);
 	}
 
 	unit_ptr state::create_unit_instance(const std::string& type, const player_ptr& pid, const point& pos)
@@ -65,15 +74,59 @@ namespace game
 
 	void state::add_unit(unit_ptr e)
 	{
-		units_.emplace_back(e);
-		std::stable_sort(units_.begin(), units_.end(), initiative_compare);
+		// After any units with the same initiative, the same as appending and stable sorting.
+		auto it = std::upper_bound(units_.begin(), units_.end(), e, initiative_compare);
+		units_.insert(it, e);
+		occupancy_.add(e);
+		handles_.bind(e);
+		toggle_hash(e);
 	}
 
 	void state::remove_unit(unit_ptr e1)
 	{
-		units_.erase(std::remove_if(units_.begin(), units_.end(), [&e1](unit_ptr e2) {
-			return e1 == e2; 
-		}), units_.end());
+		// Units are sorted by initiative, so only those with the same initiative need looking
+		// at, unless the order has been set to something else by an update.
+		auto range = std::equal_range(units_.begin(), units_.end(), e1, initiative_compare);
+		auto it = std::find(range.first, range.second, e1);
+		if(it == range.second) {
+			it = std::find(units_.begin(), units_.end(), e1);
+			if(it == units_.end()) {
+				return;
+			}
+		}
+		occupancy_.remove(*it);
+		handles_.unbind(*it);
+		toggle_hash(*it);
+		units_.erase(it);
+	}
+
+	uint64_t state::compute_hash() const
+	{
+		uint64_t hash = 0;
+		for(auto& u : units_) {
+			hash ^= u->get_hash();
+		}
+		return hash;
+	}
+
+	void state::move_in_order(const unit_ptr& u, int pos)
+	{
+		auto it = std::find_if(units_.begin(), units_.end(), [&u](const unit_ptr& e) { return e.get() == u.get(); });
+		if(u == nullptr || it == units_.end() || pos < 0 || pos >= static_cast<int>(units_.size())) {
+			LOG_WARN("Ignoring bad move in the initiative order to " << pos);
+			return;
+		}
+		auto dst = units_.begin() + pos;
+		if(dst > it) {
+			std::rotate(it, it + 1, dst + 1);
+		} else {
+			std::rotate(dst, it, it + 1);
+		}
+	}
+
+	void state::toggle_hash(const unit_ptr& u) const
+	{
+		hash_ ^= u->get_hash();
 	}
 
 	void state::end_unit_turn(Update* up)
@@ -82,64 +135,71 @@ namespace game
 		if(units_.size() > 0) {
 			auto& old_unit = units_.front();
 			auto ou = up->add_units();
-			ou->set_uuid(uuid::write(old_unit->get_uuid()));
+			set_unit_id(ou, old_unit);
 			Update_UnitStats* uus = new Update_UnitStats();
+			toggle_hash(old_unit);
 			old_unit->complete_turn(uus);
-			ou->set_allocated_stats(uus);
+			toggle_hash(old_unit);
+			attach_turn_stats(ou, old_unit, uus);
 
-			std::stable_sort(units_.begin(), units_.end(), initiative_compare);
+			// The rest of the units are still in order, so the unit just needs moving back to
+			// before any with the same initiative, which is where a stable sort would put it.
+			auto it = std::lower_bound(units_.begin() + 1, units_.end(), units_.front(), initiative_compare);
+			const int pos = static_cast<int>(it - units_.begin()) - 1;
+			std::rotate(units_.begin(), units_.begin() + 1, it);
 			initiative_counter_ = units_.front()->get_initiative();
 
 			up->set_initiative_counter(initiative_counter_);
-			for(auto& u : units_) {
-				auto order = up->add_ordering();
-				*order = uuid::write(u->get_uuid());
-			}
+			up->add_ordering_moves(units_[pos]->get_handle());
+			up->add_ordering_moves(pos);
 
 			auto& new_unit = units_.front();
 			auto nu = up->add_units();
-			nu->set_uuid(uuid::write(new_unit->get_uuid()));
+			set_unit_id(nu, new_unit);
 			Update_UnitStats* nus = new Update_UnitStats();
+			toggle_hash(new_unit);
 			new_unit->start_turn(nus);
-			nu->set_allocated_stats(nus);
+			toggle_hash(new_unit);
+			attach_turn_stats(nu, new_unit, nus);
 		}
 	}
 
 	void state::add_player(player_ptr p)
 	{
-		players_[p->get_uuid()] = p;
+		players_.set(p->get_uuid(), p);
 	}
 
 	void state::remove_player(player_ptr p)
 	{
-		auto it = players_.find(p->get_uuid());
-		ASSERT_LOG(it != players_.end(), "Attempted to remove player " << p->name() << " failed, player doesn't exist.");
-		players_.erase(it);
+		const bool removed = players_.erase(p->get_uuid());
+		ASSERT_LOG(removed, "Attempted to remove player " << p->name() << " failed, player doesn't exist.");
 	}
 
 	void state::replace_player(player_ptr to_be_replaced, player_ptr replacement)
 	{
-		auto it = players_.find(to_be_replaced->get_uuid());
-		ASSERT_LOG(it != players_.end(), "Attempted to remove player " << to_be_replaced->name() << " failed, player doesn't exist.");
+		auto old = players_.get(to_be_replaced->get_uuid());
+		ASSERT_LOG(old != nullptr, "Attempted to remove player " << to_be_replaced->name() << " failed, player doesn't exist.");
 
 		// need to change the player in all entities.
 		for(auto& u : units_) {
 			auto owner = u->get_owner();
-			if(owner == it->second) {
+			if(owner == *old) {
+				occupancy_.remove(u);
 				u->set_owner(replacement);
+				occupancy_.add(u);
 			}
 		}
 
-		// remove player from list and add replacement.
-		players_.erase(it);
-		players_[replacement->get_uuid()] = replacement;
+		// remove player from list and add replacement, which takes over its slot.
+		players_.erase(to_be_replaced->get_uuid());
+		players_.set(replacement->get_uuid(), replacement);
 	}
 
 	player_ptr state::get_player(const uuid::uuid& n)
 	{
-		auto it = players_.find(n);
-		ASSERT_LOG(it != players_.end(), "Requested player " << uuid::write(n) << " not found.");
-		return players_[n];
+		auto p = players_.get(n);
+		ASSERT_LOG(p != nullptr, "Requested player " << uuid::write(n) << " not found.");
+		return *p;
 	}
 
 	player_ptr state::get_current_player() const
@@ -152,9 +212,9 @@ namespace game
 	std::vector<player_ptr> state::get_players()
 	{
 		std::vector<player_ptr> res;
-		for(auto& p : players_) {
-			res.emplace_back(p.second);
-		}
+		players_.for_each([&res](const uuid::uuid& id, const player_ptr& p) {
+			res.emplace_back(p);
+		});
 		return res;
 	}
 
@@ -181,33 +241,36 @@ namespace game
 	{
 		// Generate a message to be sent to the server
 		Update_Unit *unit = up->add_units();
-		unit->set_uuid(uuid::write(u->get_uuid()));
+		set_unit_id(unit, u);
 		unit->set_type(Update_Unit_MessageType::Update_Unit_MessageType_MOVE);
+		write_path(unit, path);
 		float cost(0);
+		auto& costs = map_->get_cost_grid(u->get_movement_type());
 		for(auto& p : path) {
-			Update_Location* loc = unit->add_path();
-			loc->set_x(p.x);
-			loc->set_y(p.y);
-			cost -= map_->get_tile_at(p)->get_cost();
+			cost -= hex::logical::to_cost(costs.at(p));
 		}
 		// Set the game state position.
+		toggle_hash(u);
+		occupancy_.move(u, u->get_position(), path.back());
 		u->set_position(path.back());
 		u->set_move(u->get_move() - cost);
+		toggle_hash(u);
 		return *this;
 	}
 
 	const state& state::unit_attack(Update* up, const unit_ptr& e, const std::vector<unit_ptr>& targets) const 
 	{
 		Update_Unit *unit = up->add_units();
-		unit->set_uuid(uuid::write(e->get_uuid()));
+		set_unit_id(unit, e);
 		unit->set_type(Update_Unit_MessageType::Update_Unit_MessageType_ATTACK);
 		for(auto& t : targets) {
-			std::string* str = unit->add_target_uuids();
-			*str = uuid::write(t->get_uuid());
+			unit->add_target_handles(t->get_handle());
 		}
 		// N.B. adjusting the game state stuff in the engine is slightly hackish. But when the
 		// server responds with an actual update this should be corrected.
+		toggle_hash(e);
 		e->dec_attacks_this_turn();
+		toggle_hash(e);
 		return *this;
 	}
 
@@ -220,15 +283,21 @@ namespace game
 			return nup;
 		}
 
-		if(up->id() < update_counter_) {
-			// XXX we should resend the complete state as this update seems old.
-			//res.emplace_back(generate_complete());
-			LOG_WARN("Got old update: " << up->id() << " : " << update_counter_);
-			return nullptr;
+		if(up->id() < update_counter_ || (up->has_full_state() && up->full_state())) {
+			// The client has missed something, or asked for the state outright, so bring it
+			// back in step.
+			if(!up->full_state()) {
+				LOG_WARN("Got old update: " << up->id() << " : " << update_counter_);
+			}
+			auto nup = create_update();
+			write_full_state(nup);
+			return nup;
 		}
 
 		// Create a new update to be sent
 		auto nup = create_update();
+		// Set if the client had made changes we didn't accept, so needs the state resent.
+		bool needs_full_state = false;
 
 		for(auto& players : up->player()) {
 			// XXX deal with stuff
@@ -246,52 +315,87 @@ namespace game
 					LOG_ERROR("The server should never receive a player update message from the clients");
 					break;
 				default: 
-					ASSERT_LOG(false, "Unrecognised player.action() value: " << players.action());
+					LOG_WARN("Unrecognised player.action() value: " << players.action());
 			}
 		}
 
 		for(auto& units : up->units()) {
 			// Create a new unit based on this current one.
 			Update_Unit* uu = nup->add_units();
-			uu->set_uuid(units.uuid());
+			if(units.has_handle()) {
+				uu->set_handle(units.handle());
+			} else {
+				uu->set_uuid(units.uuid());
+			}
 			uu->set_type(Update_Unit_MessageType_PASS);
 
 			switch(units.type())
 			{
 				case Update_Unit_MessageType_CANONICAL_STATE:
 					// we should never ever recieve this message from a client!
-					ASSERT_LOG(false, "Got unit 'STATE' message from client. This is an error in the client code.");
+					LOG_WARN("Got unit 'STATE' message from client. This is an error in the client code.");
+					needs_full_state = true;
 					break;
 				case Update_Unit_MessageType_SUMMON:
 					break;
 				case Update_Unit_MessageType_MOVE: {
 					// Validate that the unit has enough move to afford going along the given path.
-					auto e = get_unit_by_uuid(uuid::read(units.uuid()));
-					if(validate_move(e, units.path())) {
+					auto e = find_unit(units);
+					const std::vector<point> path = read_path(units);
+					if(e == nullptr) {
+						set_validation_fail_reason("No such unit to move.");
+					} else if(path.empty()) {
+						set_validation_fail_reason(formatter() << "No path given to move " << e << " along.");
+					}
+					if(e != nullptr && !path.empty() && validate_move(e, path)) {
 						// send path to clients
 						uu->set_type(Update_Unit_MessageType::Update_Unit_MessageType_MOVE);
-						// XXX see if there is a better way of moving the path using protobufs
-						for(auto& p : units.path()) {
-							Update_Location* loc = uu->add_path();
-							loc->set_x(p.x());
-							loc->set_y(p.y());
+						if(units.packed_path_size() > 0) {
+							uu->mutable_packed_path()->CopyFrom(units.packed_path());
+						} else {
+							write_path(uu, path);
 						}
 						// Make sure we set the units actual movement.
 						Update_UnitStats* uus = new Update_UnitStats();
 						uus->set_move(e->get_move());
-						uu->set_allocated_stats(uus);
+						attach_stats(uu, e, uus);
 					} else {
 						// The path provided has a cost which is more than the number of move left.
-						// XXX Re-send the complete game state.
+						// The client has already moved the unit, so put it back.
 						// nup->set_fail_reason(fail_reason_);
 						LOG_WARN("Failed to validate move: " << fail_reason_);
+						needs_full_state = true;
 					}
 					break;
 				}
 				case Update_Unit_MessageType_ATTACK: {
-					auto aggressor = get_unit_by_uuid(uuid::read(units.uuid()));
+					auto aggressor = find_unit(units);
+					if(aggressor == nullptr || aggressor.get() != units_.front().get()) {
+						LOG_WARN("Attack wasn't made by the current unit.");
+						needs_full_state = true;
+						break;
+					}
+					std::vector<unit_ptr> targets;
+					for(int handle : units.target_handles()) {
+						auto t = handles_.get_unit(handle);
+						if(t == nullptr) {
+							LOG_WARN("Couldn't find target unit with handle: " << handle);
+							needs_full_state = true;
+							continue;
+						}
+						targets.emplace_back(t);
+					}
 					for(auto& target_id : units.target_uuids()) {
-						auto t = get_unit_by_uuid(uuid::read(target_id));
+						uuid::uuid id;
+						auto t = uuid::read(target_id, &id) ? handles_.find(id) : nullptr;
+						if(t == nullptr) {
+							LOG_WARN("Couldn't find target unit with uuid: " << target_id);
+							needs_full_state = true;
+							continue;
+						}
+						targets.emplace_back(t);
+					}
+					for(auto& t : targets) {
 						if(is_attackable(aggressor, t)) {
 							combat(nup, uu, aggressor, t);
 						} else {
@@ -306,7 +410,8 @@ namespace game
 				case Update_Unit_MessageType_PASS:
 					break;
 				default: 
-					ASSERT_LOG(false, "Unrecognised units.type() value: " << units.type());
+					LOG_WARN("Unrecognised units.type() value: " << units.type());
+					needs_full_state = true;
 			}
 		}
 
@@ -337,16 +442,190 @@ namespace game
 				nup->set_game_win_state(Update_GameWinState_WON);
 			}
 		}
+		if(needs_full_state) {
+			// The state covers everything else, only the end of turn and the result are kept.
+			nup->clear_units();
+			nup->clear_player();
+			nup->clear_initiative_counter();
+			nup->clear_ordering_moves();
+			write_full_state(nup);
+		}
 		return nup;
 	}
 
 	unit_ptr state::get_unit_by_uuid(const uuid::uuid& id)
 	{
-		auto it = std::find_if(units_.begin(), units_.end(), [&id](unit_ptr u){
-			return u->get_uuid() == id;
+		auto u = handles_.find(id);
+		ASSERT_LOG(u != nullptr, "Couldn't find unit with uuid: " << uuid::write(id));
+		return u;
+	}
+
+	unit_ptr state::find_unit(const Update_Unit& uu) const
+	{
+		if(uu.has_handle()) {
+			return handles_.get_unit(uu.handle());
+		}
+		uuid::uuid id;
+		return uuid::read(uu.uuid(), &id) ? handles_.find(id) : nullptr;
+	}
+
+	unit_ptr state::get_unit(const Update_Unit& uu)
+	{
+		if(uu.has_handle()) {
+			auto u = handles_.get_unit(uu.handle());
+			ASSERT_LOG(u != nullptr, "Couldn't find unit with handle: " << uu.handle());
+			return u;
+		}
+		return get_unit_by_uuid(uuid::read(uu.uuid()));
+	}
+
+	uuid::uuid state::get_unit_uuid(const Update_Unit& uu) const
+	{
+		if(uu.has_handle()) {
+			return handles_.get_uuid(uu.handle());
+		}
+		return uuid::read(uu.uuid());
+	}
+
+	void state::write_unit_handles(Update* up) const
+	{
+		for(auto& u : units_) {
+			auto uh = up->add_unit_handles();
+			uh->set_uuid(uuid::write(u->get_uuid()));
+			uh->set_handle(u->get_handle());
+		}
+	}
+
+	void state::write_canonical_state(Update* up, bool with_random) const
+	{
+		up->set_id(update_counter_);
+		up->set_initiative_counter(initiative_counter_);
+		if(with_random) {
+			up->set_random_seed(rng_.get_key());
+			up->set_random_position(rng_.get_position());
+		}
+		players_.for_each([up](const uuid::uuid& id, const player_ptr& p) {
+			Update_Player* upp = up->add_player();
+			upp->set_uuid(uuid::write(id));
+			upp->set_action(Update_Player_Action_CANONICAL_STATE);
+			upp->set_name(p->name());
+			upp->set_team_uuid(uuid::write(p->team()->id()));
+			upp->set_team_name(p->team()->get_team_name());
+			Update_PlayerInfo* pi = upp->mutable_player_info();
+			pi->set_gold(p->get_gold());
 		});
-		ASSERT_LOG(it != units_.end(), "Couldn't find unit with uuid: " << uuid::write(id));
-		return *it;
+		// Every handle handed out, so the dead units can still be looked up and new units
+		// get the same handles as on the server.
+		for(int h = 0; h != handles_.size(); ++h) {
+			auto uh = up->add_unit_handles();
+			uh->set_uuid(uuid::write(handles_.get_uuid(h)));
+			uh->set_handle(h);
+		}
+		// Units are written in initiative order.
+		for(auto& u : units_) {
+			Update_Unit* uu = up->add_units();
+			uu->set_type(Update_Unit_MessageType_CANONICAL_STATE);
+			uu->set_handle(u->get_handle());
+			uu->set_uuid(uuid::write(u->get_uuid()));
+			if(u->get_type() != nullptr) {
+				uu->set_name(u->get_type()->get_type_name());
+			}
+			uu->set_owner_uuid(uuid::write(u->get_owner()->get_uuid()));
+			Update_UnitStats* stats = uu->mutable_stats();
+			stats->set_health(u->get_health());
+			stats->set_attack(u->get_attack());
+			stats->set_armour(u->get_armour());
+			stats->set_move(u->get_move());
+			stats->set_initiative(u->get_initiative());
+			stats->set_name(u->get_name());
+			stats->set_range(u->get_range());
+			stats->set_critical_strike(u->get_critical_strike());
+			stats->set_attacks_this_turn(u->get_attacks_this_turn());
+			write_path(uu, std::vector<point>(1, u->get_position()));
+		}
+	}
+
+	void state::load_canonical_state(const Update& up)
+	{
+		ASSERT_LOG(map_ != nullptr, "The map must be set before loading a full state.");
+		update_counter_ = up.id();
+		initiative_counter_ = up.initiative_counter();
+		if(up.has_random_seed()) {
+			rng_ = generator::stream(up.random_seed());
+			rng_.set_position(up.random_position());
+		}
+
+		registry::table<player_ptr> old_players;
+		std::swap(old_players, players_);
+		for(auto& upp : up.player()) {
+			const uuid::uuid id = uuid::read(upp.uuid());
+			const uuid::uuid team_id = uuid::read(upp.team_uuid());
+			auto t = teams_.get(team_id);
+			if(t == nullptr) {
+				teams_.set(team_id, std::make_shared<team>(upp.team_name(), team_id));
+				t = teams_.get(team_id);
+			}
+			auto old = old_players.get(id);
+			player_ptr p = old != nullptr ? *old : std::make_shared<player>(*t, PlayerType::NORMAL, upp.name(), id);
+			if(upp.has_player_info() && upp.player_info().has_gold()) {
+				p->set_gold(upp.player_info().gold());
+			}
+			players_.set(id, p);
+		}
+
+		units_.clear();
+		handles_.clear();
+		for(auto& uh : up.unit_handles()) {
+			handles_.reserve(uh.handle(), uuid::read(uh.uuid()));
+		}
+		for(auto& uu : up.units()) {
+			auto owner = players_.get(uuid::read(uu.owner_uuid()));
+			ASSERT_LOG(owner != nullptr, "Couldn't find owner " << uu.owner_uuid() << " of unit " << uu.uuid());
+			const std::vector<point> path = read_path(uu);
+			ASSERT_LOG(!path.empty(), "No position for unit " << uu.uuid());
+			auto u = std::make_shared<unit>(uu.stats().name(), creature::get_creature(uu.name()), *owner, uuid::read(uu.uuid()));
+			u->set_position(path.front());
+			units_.emplace_back(u);
+			set_unit_stats(u, uu.stats());
+			handles_.bind(u, uu.handle());
+		}
+		occupancy_.reset(map_, units_);
+		hash_ = compute_hash();
+	}
+
+	void state::write_full_state(Update* up, bool compress) const
+	{
+		up->set_full_state(true);
+		if(!compress) {
+			ASSERT_LOG(up->units_size() == 0 && up->player_size() == 0 && up->unit_handles_size() == 0,
+				"An uncompressed full state can't be added to update " << up->id() << " which already has units or players.");
+			write_canonical_state(up);
+			return;
+		}
+		Update full;
+		write_canonical_state(&full);
+		full.set_full_state(true);
+		compress_update(full, up);
+	}
+
+	void state::attach_stats(Update_Unit* uu, const unit_ptr& u, Update_UnitStats* stats)
+	{
+		handles_.strip_unchanged(u, stats);
+		if(stats->ByteSize() == 0) {
+			delete stats;
+			return;
+		}
+		uu->set_allocated_stats(stats);
+	}
+
+	void state::attach_turn_stats(Update_Unit* uu, const unit_ptr& u, Update_UnitStats* stats)
+	{
+		handles_.record(u, *stats);
+		if(stats->ByteSize() == 0) {
+			delete stats;
+			return;
+		}
+		uu->set_allocated_stats(stats);
 	}
 
 	void state::set_validation_fail_reason(const std::string& reason)
@@ -354,7 +633,7 @@ namespace game
 		fail_reason_ = reason;
 	}
 
-	bool state::validate_move(const unit_ptr& u, const ::google::protobuf::RepeatedPtrField<Update_Location>& path)
+	bool state::validate_move(const unit_ptr& u, const std::vector<point>& path)
 	{
 		profile::manager pman("state::validate_move");
 		// check that it is the turn of e to move/action.
@@ -365,56 +644,41 @@ namespace game
 
 		LOG_DEBUG("Validate move: " << u);
 
-		std::set<point> enemy_locations;
-		std::set<point> zoc_locations;
-		// Create sets of enemy locations and tiles under zoc
-		auto e1_owner = u->get_owner();
-		for(auto entity : units_) {
-			auto pos = entity->get_position();
-			auto e2_owner = entity->get_owner();
-			if(e1_owner->team() != e2_owner->team()) {
-				enemy_locations.emplace(pos);
-				for(auto& p : map_->get_surrounding_positions(pos)) {
-					zoc_locations.emplace(p);
-				}
-			}
+		const auto& team = u->get_owner()->team();
+		auto& costs = map_->get_cost_grid(u->get_movement_type());
+		float cost(0);
+		if(path.front() != u->get_position()) {
+			set_validation_fail_reason(formatter() << "Path starts at " << path.front() << " rather than at " << u);
+			return false;
 		}
-		// remove enemy locations from zoc
-		for(auto& p : enemy_locations) {
-			auto it = zoc_locations.find(p);
-			if(it != zoc_locations.end()) {
-				zoc_locations.erase(it);
+		for(auto p = path.begin() + 1; p != path.end(); ++p) {
+			const point& pp = *p;
+			if(!costs.contains(pp) || hex::logical::distance(*(p - 1), pp) != 1) {
+				set_validation_fail_reason(formatter() << "Path goes to " << pp << " which isn't a neighbouring tile on the map.");
+				return false;
 			}
-		}
-		float cost(0);
-		auto p = path.begin();
-		bool last_tile_zoc = zoc_locations.find(point(p->x(), p->y())) != zoc_locations.end();
-		++p;
-		for(; p != path.end(); ++p) {
-			point pp(p->x(), p->y());
-			auto tile = map_->get_tile_at(p->x(), p->y());
-			ASSERT_LOG(tile != nullptr, "No tile exists at point: " << pp);
-			cost += tile->get_cost();
-			//LOG_DEBUG("tile" << pp << ": " << tile->name() << " : " << tile->get_cost());
-
-			auto it = enemy_locations.find(pp);
-			if(it != enemy_locations.end()) {
+			cost += hex::logical::to_cost(costs[pp]);
+
+			if(occupancy_.is_enemy_at(pp, team)) {
 				set_validation_fail_reason(formatter() << "Enemy unit exists in given path at " << pp);
 				return false;
 			}
 			// check that if we pass into a ZoC tile then we stop, i.e. no ZoC tiles mid-path.
-			auto zit = zoc_locations.find(pp);
-			if(zit != zoc_locations.end() && (pp.x != path.rbegin()->x() && pp.y != path.rbegin()->y())) {
+			if(occupancy_.is_enemy_zoc(pp, team) && (pp.x != path.back().x && pp.y != path.back().y)) {
 				set_validation_fail_reason(formatter() << "ZOC tile at " << pp << " was in middle of path.");
 				return false;
 			}
 		}
 		if(u->get_move() >= cost) {
+			toggle_hash(u);
 			u->set_move(u->get_move() - cost);
 			if(u->get_move() < FLT_EPSILON) {
 				u->set_move(0);
 			}
-			u->set_position(path.rbegin()->x(), path.rbegin()->y());
+			const point& dst = path.back();
+			occupancy_.move(u, u->get_position(), dst);
+			u->set_position(dst);
+			toggle_hash(u);
 			return true;
 		}
 		set_validation_fail_reason(formatter() << "Unit didn't have enough movement left. " << u->get_move() << " : " << cost);
@@ -444,19 +708,16 @@ namespace game
 			// Find the direct line between the two units
 			// make sure that there are no other entities in the way, unless the unit has the
 			// "strike-through" ability.
-			auto line = hex::logical::line(aggressor->get_position(), e->get_position());
-			// remove first and last elements from the line.
-			line.pop_back();
-			line.erase(line.begin());
-			for(auto& p : line) {
-				for(auto& en : units_) {
-					// XXX The commented out code allows you to attack through your own team members.
-					// It may be annoying to not allow this, in practice.
-					if(p == en->get_position() /*&& en->get_owner()->team() != aggressor->get_owner()->team()*/) {
-						LOG_INFO(aggressor << " could not attack target " << e << " unit in path " << en);
-						return false;
-					}
-				}
+			// XXX Using occupancy_.is_enemy_at() here instead would allow you to attack through
+			// your own team members. It may be annoying to not allow this, in practice.
+			point blocked;
+			const bool clear = hex::logical::for_each_between(aggressor->get_position(), e->get_position(), [this, &blocked](const point& p) {
+				blocked = p;
+				return !occupancy_.is_occupied(p);
+			});
+			if(!clear) {
+				LOG_INFO(aggressor << " could not attack target " << e << " unit in path " << occupancy_.unit_at(blocked));
+				return false;
 			}
 		}
 
@@ -466,15 +727,53 @@ namespace game
 
 	void state::apply(Update* up)
 	{
+		if(up->has_full_state() && up->full_state()) {
+			// Everything else in the update is covered by the state.
+			if(!up->has_compressed_state()) {
+				load_canonical_state(*up);
+			} else {
+				Update full;
+				ASSERT_LOG(decompress_update(*up, &full), "Bad full state in update " << up->id());
+				load_canonical_state(full);
+			}
+			return;
+		}
+
 		// client side update
 		update_counter_ = up->id();
 		if(up->has_fail_reason()) {
 			LOG_WARN("Server failed last command. Reason: " << up->fail_reason());
 		}
 
+		// Use the servers unit handles from here on.
+		if(up->unit_handles_size() > 0) {
+			// Units are found by uuid through the handles, so look them all up first.
+			std::vector<unit_ptr> units;
+			for(auto& uh : up->unit_handles()) {
+				units.emplace_back(handles_.find(uuid::read(uh.uuid())));
+			}
+			handles_.clear();
+			for(int n = 0; n != up->unit_handles_size(); ++n) {
+				const Update_UnitHandle& uh = up->unit_handles(n);
+				if(units[n] != nullptr) {
+					handles_.bind(units[n], uh.handle());
+				} else {
+					handles_.reserve(uh.handle(), uuid::read(uh.uuid()));
+				}
+			}
+			for(auto& u : units_) {
+				handles_.bind(u);
+			}
+		}
+
 		for(auto& players : up->player()) {
 			// XXX deal with stuff
-			auto p = get_player_by_uuid(uuid::read(players.uuid()));
+			uuid::uuid id;
+			auto p = uuid::read(players.uuid(), &id) ? players_.get(id) : nullptr;
+			if(p == nullptr) {
+				LOG_WARN("Update " << up->id() << " is for player " << players.uuid() << " who isn't in the game.");
+				continue;
+			}
 			switch(players.action())
 			{
 				case Update_Player_Action_CANONICAL_STATE:
@@ -487,7 +786,7 @@ namespace game
 					ASSERT_LOG(players.has_player_info(), "Client received player update message with no attached player_info");
 					const Update_PlayerInfo& pi = players.player_info();
 					if(pi.has_gold()) {
-						p->set_gold(pi.gold());
+						(*p)->set_gold(pi.gold());
 					}
 					break;
 				}
@@ -497,7 +796,7 @@ namespace game
 		}
 
 		for(auto& units : up->units()) {
-			auto e = get_unit_by_uuid(uuid::read(units.uuid()));
+			auto e = get_unit(units);
 			if(units.has_stats()) {
 				set_unit_stats(e, units.stats());
 			}
@@ -509,16 +808,21 @@ namespace game
 				case Update_Unit_MessageType_SUMMON:
 					break;
 				case Update_Unit_MessageType_MOVE: {
-					auto p = units.path().end() - 1;
-					auto start_p = point(units.path().begin()->x(), units.path().begin()->y());
-					LOG_INFO("moving " << e << " from " << start_p << " to position " << point(p->x(), p->y()));
-					e->set_position(p->x(), p->y());
+					const std::vector<point> path = read_path(units);
+					ASSERT_LOG(!path.empty(), "Move message for " << e << " has no path.");
+					const point& start_p = path.front();
+					const point& end_p = path.back();
+					LOG_INFO("moving " << e << " from " << start_p << " to position " << end_p);
+					toggle_hash(e);
+					occupancy_.move(e, e->get_position(), end_p);
+					e->set_position(end_p);
+					toggle_hash(e);
 					break;
 				}
 				case Update_Unit_MessageType_ATTACK: {
 					// Attack message type means we need to look at the stat values and update
-					// If the unit has no health left it's considered dead.
-					ASSERT_LOG(units.has_stats(), "No stats block attached to attack");
+					// If the unit has no health left it's considered dead. There are no stats if
+					// the attack did no damage.
 					break;
 				}
 				case Update_Unit_MessageType_SPELL: {
@@ -540,19 +844,27 @@ namespace game
 			initiative_counter_ = up->initiative_counter();
 		}
 
-		// If we get sent a list of unit uuid's then we correct ours.
-		if(up->ordering().size() > 0) {
-			auto unit_list = units_;
+		// If we get sent a list of unit handles or uuid's then we correct ours.
+		if(up->ordering_handles_size() > 0) {
+			units_.clear();
+			for(int handle : up->ordering_handles()) {
+				auto u = handles_.get_unit(handle);
+				if(u != nullptr) {
+					units_.emplace_back(u);
+				}
+			}
+		} else if(up->ordering().size() > 0) {
 			units_.clear();
 			for(auto& order : up->ordering()) {
-				const uuid::uuid id = uuid::read(order);
-				for(auto u : unit_list) {
-					if(u->get_uuid() == id) {
-						units_.emplace_back(u);
-					}
+				auto u = handles_.find(uuid::read(order));
+				if(u != nullptr) {
+					units_.emplace_back(u);
 				}
 			}
 		}
+		for(int n = 0; n + 1 < up->ordering_moves_size(); n += 2) {
+			move_in_order(handles_.get_unit(up->ordering_moves(n)), up->ordering_moves(n + 1));
+		}
 
 		if(up->has_end_turn() && up->end_turn()) {
 			// do any client side end turn nescessary
@@ -568,10 +880,12 @@ namespace game
 		}
 		Update_AttackInfo* uai = nullptr;
 		if(aggressor->get_attack() > target->get_armour()) {
-			const bool was_critical = generator::get_uniform_real<float>(0.0f,1.0f) < aggressor->get_critical_strike();
+			const bool was_critical = rng_.uniform_real(0.0f, 1.0f) < aggressor->get_critical_strike();
 			// XXX We need to note that a critical strike occurred with an animation of some sort.
 			const int damage = (aggressor->get_attack() - target->get_armour()) * (was_critical ? 2 : 1);
+			toggle_hash(target);
 			target->set_health(target->get_health() - damage);
+			toggle_hash(target);
 			LOG_INFO(target << " takes " << damage << (was_critical ? " critical" : "") << " damage. ");
 			if(target->get_health() < 0) {
 				LOG_INFO(target << " dies due to a fatal wound.");
@@ -584,10 +898,10 @@ namespace game
 		}
 
 		Update_Unit* unit = up->add_units();
-		unit->set_uuid(uuid::write(target->get_uuid()));
+		set_unit_id(unit, target);
 		Update_UnitStats* uus = new Update_UnitStats();
 		uus->set_health(target->get_health());
-		unit->set_allocated_stats(uus);
+		attach_stats(unit, target, uus);
 		if(uai) {
 			unit->set_allocated_attack_info(uai);
 		}
@@ -596,7 +910,9 @@ namespace game
 		// XXX If we were doing a retalitory strike we could add code here.
 		// Might pay to pass in the aggressor Update_Unit* pointer.
 
+		toggle_hash(aggressor);
 		aggressor->dec_attacks_this_turn();
+		toggle_hash(aggressor);
 		Update_UnitStats* agg_uus = nullptr;
 		if(agg_uu->has_stats()) {
 			agg_uus = agg_uu->mutable_stats();
@@ -605,6 +921,7 @@ namespace game
 			agg_uu->set_allocated_stats(agg_uus);
 		}
 		agg_uus->set_attacks_this_turn(aggressor->get_attacks_this_turn());
+		handles_.record(aggressor, *agg_uus);
 
 		// Remove either unit if health is below zero.
 		if(target->get_health() <= 0) {
@@ -614,6 +931,7 @@ namespace game
 
 	void state::set_unit_stats(unit_ptr u, const Update_UnitStats& stats)
 	{
+		toggle_hash(u);
 		if(stats.has_armour()) {
 			u->set_armour(stats.armour());
 		}
@@ -641,26 +959,348 @@ namespace game
 		if(stats.has_attacks_this_turn()) {
 			u->set_attacks_this_turn(stats.attacks_this_turn());
 		}
+		toggle_hash(u);
 	}
 
 	team_ptr state::create_team_instance(const std::string& name)
 	{
 		auto t = std::make_shared<team>(name);
-		teams_[t->id()] = t;
+		teams_.set(t->id(), t);
 		return t;
 	}
 
 	team_ptr state::get_team_from_id(const uuid::uuid& id)
 	{
-		auto it = teams_.find(id);
-		ASSERT_LOG(it != teams_.end(), "Couldn't find team for id: " << uuid::write(id));
-		return it->second;
+		auto t = teams_.get(id);
+		ASSERT_LOG(t != nullptr, "Couldn't find team for id: " << uuid::write(id));
+		return *t;
 	}
 
 	const player_ptr& state::get_player_by_uuid(const uuid::uuid& id) const
 	{
-		auto it = players_.find(id);
-		ASSERT_LOG(it != players_.end(), "Couldn't find player with id: " << uuid::write(id));
-		return it->second;
+		auto p = players_.get(id);
+		ASSERT_LOG(p != nullptr, "Couldn't find player with id: " << uuid::write(id));
+		return *p;
+	}
+}
+
+UNIT_TEST(initiative_order)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+	node_builder mb;
+	mb.add("width", 4);
+	for(int n = 0; n != 16; ++n) {
+		mb.add("tiles", "flat");
+	}
+
+	node_builder idle;
+	idle.add("image", "none.png");
+	for(int n = 0; n != 4; ++n) {
+		idle.add("area", n / 2);
+	}
+	node_builder anims;
+	anims.add("idle", idle.build());
+	// Steps of 5 and 10 initiative a turn, which keeps giving ties.
+	creature::const_creature_ptr types[2];
+	for(int n = 0; n != 2; ++n) {
+		types[n] = std::make_shared<creature::creature>(node_builder()
+			.add("name", "c")
+			.add("stats", node_builder().add("health", 10).add("attack", 1).add("initiative", n == 0 ? 20 : 10).build())
+			.add("animations", anims.build()).build());
 	}
+
+	game::state server;
+	server.set_map(hex::logical::map::factory(mb.build()));
+	auto p1 = std::make_shared<player>(server.create_team_instance("a"), PlayerType::NORMAL, "p1");
+	server.add_player(p1);
+	// Units with the same initiative keep the order they were added in.
+	const float initiatives[] = { 3.0f, 1.0f, 3.0f, 2.0f, 1.0f };
+	std::vector<game::unit_ptr> added;
+	for(int n = 0; n != 5; ++n) {
+		auto u = std::make_shared<game::unit>("u", types[n % 2], p1);
+		u->set_position(n % 4, n / 4);
+		u->set_initiative(initiatives[n]);
+		server.add_unit(u);
+		added.emplace_back(u);
+	}
+	std::vector<game::unit_ptr> expected = added;
+	std::stable_sort(expected.begin(), expected.end(), game::initiative_compare);
+	for(size_t n = 0; n != expected.size(); ++n) {
+		CHECK_EQ(server.get_entities()[n].get(), expected[n].get());
+	}
+
+	// The client follows the order from the moves sent at the end of each turn.
+	game::state client(server);
+	for(int turn = 0; turn != 12; ++turn) {
+		std::unique_ptr<game::Update> up(client.create_update());
+		client.end_turn(up.get());
+		std::unique_ptr<game::Update> reply(server.validate_and_apply(up.get()));
+		CHECK_EQ(reply != nullptr, true);
+		CHECK_EQ(reply->ordering_handles_size(), 0);
+		CHECK_EQ(reply->ordering_moves_size(), 2);
+		client.apply(reply.get());
+		for(size_t n = 0; n != server.get_entities().size(); ++n) {
+			CHECK_EQ(client.get_entities()[n]->get_handle(), server.get_entities()[n]->get_handle());
+		}
+		// Which is the same as sorting after the unit had its turn.
+		std::stable_sort(expected.begin(), expected.end(), game::initiative_compare);
+		for(size_t n = 0; n != expected.size(); ++n) {
+			CHECK_EQ(server.get_entities()[n].get(), expected[n].get());
+		}
+	}
+}
+
+UNIT_TEST(full_state)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+	node_builder mb;
+	mb.add("width", 4);
+	for(int n = 0; n != 16; ++n) {
+		mb.add("tiles", "flat");
+	}
+	const node map_def = mb.build();
+
+	node_builder idle;
+	idle.add("image", "none.png");
+	for(int n = 0; n != 4; ++n) {
+		idle.add("area", n / 2);
+	}
+	node_builder anims;
+	anims.add("idle", idle.build());
+	auto type = std::make_shared<creature::creature>(node_builder()
+		.add("name", "c")
+		.add("stats", node_builder().add("health", 10).add("attack", 1).add("initiative", 10).build())
+		.add("animations", anims.build()).build());
+
+	game::state server;
+	server.set_map(hex::logical::map::factory(map_def));
+	server.set_random_seed(3);
+	server.get_random().next();
+	auto p1 = std::make_shared<player>(server.create_team_instance("a"), PlayerType::NORMAL, "p1");
+	auto p2 = std::make_shared<player>(server.create_team_instance("b"), PlayerType::NORMAL, "p2");
+	server.add_player(p1);
+	server.add_player(p2);
+	for(int n = 0; n != 6; ++n) {
+		auto u = std::make_shared<game::unit>("u", type, n % 2 ? p2 : p1);
+		u->set_position(n % 4, n / 4);
+		u->set_initiative(1.0f + n * 0.25f);
+		server.add_unit(u);
+	}
+	// A dead unit, whose handle must still be known.
+	server.remove_unit(server.get_entities().back());
+	p2->set_gold(40);
+
+	// The client falls behind while the server plays on without it.
+	game::state client(server);
+	for(int turn = 0; turn != 5; ++turn) {
+		game::state other(server);
+		std::unique_ptr<game::Update> up(other.create_update());
+		other.end_turn(up.get());
+		std::unique_ptr<game::Update> reply(server.validate_and_apply(up.get()));
+		CHECK_EQ(reply != nullptr && !reply->full_state(), true);
+	}
+	CHECK_NE(client.get_hash(), server.get_hash());
+
+	std::unique_ptr<game::Update> up(client.create_update());
+	client.end_turn(up.get());
+	std::unique_ptr<game::Update> reply(server.validate_and_apply(up.get()));
+	CHECK_EQ(reply != nullptr && reply->full_state() && reply->has_compressed_state(), true);
+	// The client isn't told the random stream, or it could predict the server's rolls.
+	game::Update decompressed;
+	CHECK_EQ(game::decompress_update(*reply, &decompressed), true);
+	CHECK_EQ(decompressed.has_random_seed() || decompressed.has_random_position(), false);
+	client.set_random_seed(99);
+	const generator::stream client_rng = client.get_random();
+	client.apply(reply.get());
+	CHECK_EQ(client.get_hash(), server.get_hash());
+	CHECK_EQ(client.get_hash(), client.compute_hash());
+	CHECK_EQ(client.get_entities().size(), server.get_entities().size());
+	for(size_t n = 0; n != server.get_entities().size(); ++n) {
+		CHECK_EQ(client.get_entities()[n]->get_handle(), server.get_entities()[n]->get_handle());
+		CHECK_EQ(client.get_entities()[n]->get_uuid(), server.get_entities()[n]->get_uuid());
+	}
+	CHECK_EQ(client.get_player(p2->get_uuid())->get_gold(), 40);
+	CHECK_EQ(client.get_initiative_counter(), server.get_initiative_counter());
+	CHECK_EQ(client.get_random().get_key(), client_rng.get_key());
+	CHECK_EQ(client.get_random().get_position(), client_rng.get_position());
+
+	// After which the client carries on as normal.
+	std::unique_ptr<game::Update> next(client.create_update());
+	client.end_turn(next.get());
+	std::unique_ptr<game::Update> next_reply(server.validate_and_apply(next.get()));
+	CHECK_EQ(next_reply != nullptr && !next_reply->full_state(), true);
+	client.apply(next_reply.get());
+	CHECK_EQ(client.get_hash(), server.get_hash());
+
+	// The same state uncompressed, loaded into an empty game.
+	game::Update full;
+	server.write_full_state(&full, false);
+	CHECK_EQ(full.has_random_seed(), false);
+	CHECK_GT(full.ByteSize(), reply->ByteSize());
+	game::state fresh;
+	fresh.set_map(hex::logical::map::factory(map_def));
+	fresh.apply(&full);
+	CHECK_EQ(fresh.get_hash(), server.get_hash());
+	CHECK_EQ(fresh.get_player_count(), 2);
+	CHECK_EQ(fresh.get_current_player()->get_uuid(), server.get_current_player()->get_uuid());
+}
+
+UNIT_TEST(turn_stats_after_refused_action)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+	node_builder mb;
+	mb.add("width", 4);
+	for(int n = 0; n != 16; ++n) {
+		mb.add("tiles", "flat");
+	}
+
+	node_builder idle;
+	idle.add("image", "none.png");
+	for(int n = 0; n != 4; ++n) {
+		idle.add("area", n / 2);
+	}
+	node_builder anims;
+	anims.add("idle", idle.build());
+	auto type = std::make_shared<creature::creature>(node_builder()
+		.add("name", "c")
+		.add("stats", node_builder().add("health", 10).add("attack", 5).add("initiative", 10).build())
+		.add("animations", anims.build()).build());
+
+	game::state server;
+	server.set_map(hex::logical::map::factory(mb.build()));
+	auto p1 = std::make_shared<player>(server.create_team_instance("a"), PlayerType::NORMAL, "p1");
+	auto p2 = std::make_shared<player>(server.create_team_instance("b"), PlayerType::NORMAL, "p2");
+	server.add_player(p1);
+	server.add_player(p2);
+	auto u1 = std::make_shared<game::unit>("u", type, p1);
+	u1->set_position(0, 0);
+	u1->set_initiative(1.0f);
+	server.add_unit(u1);
+	auto u2 = std::make_shared<game::unit>("u", type, p2);
+	u2->set_position(3, 3);
+	u2->set_initiative(2.0f);
+	server.add_unit(u2);
+
+	// The client takes its attack off straight away, but the target is out of range so the
+	// server quietly ignores it.
+	game::state client(server);
+	auto cu1 = client.get_entities().front();
+	const int attacks = cu1->get_attacks_this_turn();
+	std::unique_ptr<game::Update> up(client.create_update());
+	client.unit_attack(up.get(), cu1, client.get_entities());
+	CHECK_EQ(cu1->get_attacks_this_turn(), attacks - 1);
+	std::unique_ptr<game::Update> reply(server.validate_and_apply(up.get()));
+	CHECK_EQ(reply != nullptr, true);
+	client.apply(reply.get());
+	CHECK_NE(client.compute_hash(), server.get_hash());
+
+	// The attacks reset at the end of the turn are the same as the server last sent, but are
+	// sent anyway to put the client right.
+	std::unique_ptr<game::Update> end(client.create_update());
+	client.end_turn(end.get());
+	std::unique_ptr<game::Update> end_reply(server.validate_and_apply(end.get()));
+	CHECK_EQ(end_reply != nullptr && !end_reply->full_state(), true);
+	client.apply(end_reply.get());
+	CHECK_EQ(cu1->get_attacks_this_turn(), attacks);
+	CHECK_EQ(cu1->get_move(), u1->get_move());
+	CHECK_EQ(client.compute_hash(), server.get_hash());
+}
+
+UNIT_TEST(malformed_updates)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+	node_builder mb;
+	mb.add("width", 4);
+	for(int n = 0; n != 16; ++n) {
+		mb.add("tiles", "flat");
+	}
+
+	node_builder idle;
+	idle.add("image", "none.png");
+	for(int n = 0; n != 4; ++n) {
+		idle.add("area", n / 2);
+	}
+	node_builder anims;
+	anims.add("idle", idle.build());
+	auto type = std::make_shared<creature::creature>(node_builder()
+		.add("name", "c")
+		.add("stats", node_builder().add("health", 10).add("attack", 5).add("initiative", 10).build())
+		.add("animations", anims.build()).build());
+
+	game::state server;
+	server.set_map(hex::logical::map::factory(mb.build()));
+	auto p1 = std::make_shared<player>(server.create_team_instance("a"), PlayerType::NORMAL, "p1");
+	auto p2 = std::make_shared<player>(server.create_team_instance("b"), PlayerType::NORMAL, "p2");
+	server.add_player(p1);
+	server.add_player(p2);
+	auto u1 = std::make_shared<game::unit>("u", type, p1);
+	u1->set_position(0, 0);
+	u1->set_move(5.0f);
+	u1->set_initiative(1.0f);
+	server.add_unit(u1);
+	auto u2 = std::make_shared<game::unit>("u", type, p2);
+	u2->set_position(1, 0);
+	u2->set_initiative(2.0f);
+	server.add_unit(u2);
+	const uint64_t start_hash = server.get_hash();
+
+	// Each of these is refused with the full state, rather than taking the server down.
+	std::vector<void(*)(game::Update_Unit*)> bad_units = {
+		// An odd number of path values.
+		[](game::Update_Unit* uu) { uu->set_type(game::Update_Unit_MessageType_MOVE); uu->add_packed_path(0); uu->add_packed_path(0); uu->add_packed_path(1); },
+		// Off the map.
+		[](game::Update_Unit* uu) { uu->set_type(game::Update_Unit_MessageType_MOVE); uu->add_packed_path(0); uu->add_packed_path(0); uu->add_packed_path(-1); uu->add_packed_path(0); },
+		// Jumping over tiles.
+		[](game::Update_Unit* uu) { uu->set_type(game::Update_Unit_MessageType_MOVE); uu->add_packed_path(0); uu->add_packed_path(0); uu->add_packed_path(0); uu->add_packed_path(3); },
+		// Not starting where the unit is.
+		[](game::Update_Unit* uu) { uu->set_type(game::Update_Unit_MessageType_MOVE); uu->add_packed_path(0); uu->add_packed_path(1); uu->add_packed_path(0); uu->add_packed_path(1); },
+		// No such unit.
+		[](game::Update_Unit* uu) { uu->set_type(game::Update_Unit_MessageType_MOVE); uu->set_handle(99); uu->add_packed_path(0); uu->add_packed_path(0); },
+		[](game::Update_Unit* uu) { uu->set_type(game::Update_Unit_MessageType_MOVE); uu->clear_handle(); uu->set_uuid("not a uuid"); },
+		// No such target.
+		[](game::Update_Unit* uu) { uu->set_type(game::Update_Unit_MessageType_ATTACK); uu->add_target_handles(99); },
+		[](game::Update_Unit* uu) { uu->set_type(game::Update_Unit_MessageType_ATTACK); uu->add_target_uuids("zz"); },
+		// Only the server sends the state.
+		[](game::Update_Unit* uu) { uu->set_type(game::Update_Unit_MessageType_CANONICAL_STATE); },
+	};
+	int id = 0;
+	for(auto& make_bad : bad_units) {
+		game::Update up;
+		up.set_id(++id * 10);
+		game::Update_Unit* uu = up.add_units();
+		uu->set_handle(u1->get_handle());
+		make_bad(uu);
+		std::unique_ptr<game::Update> reply(server.validate_and_apply(&up));
+		CHECK_EQ(reply != nullptr && reply->full_state(), true);
+		CHECK_EQ(server.get_hash(), start_hash);
+	}
+
+	// The attack is made by the current unit only.
+	game::Update up;
+	up.set_id(++id * 10);
+	game::Update_Unit* uu = up.add_units();
+	uu->set_type(game::Update_Unit_MessageType_ATTACK);
+	uu->set_handle(u2->get_handle());
+	uu->add_target_handles(u1->get_handle());
+	std::unique_ptr<game::Update> reply(server.validate_and_apply(&up));
+	CHECK_EQ(reply != nullptr && reply->full_state(), true);
+	CHECK_EQ(server.get_hash(), start_hash);
+
+	// A client update about a player who isn't in the game is ignored.
+	game::state client(server);
+	game::Update pup;
+	pup.set_id(++id * 10);
+	game::Update_Player* upp = pup.add_player();
+	upp->set_uuid("0123");
+	upp->set_action(game::Update_Player_Action_UPDATE);
+	client.apply(&pup);
+	CHECK_EQ(client.get_hash(), start_hash);
 }
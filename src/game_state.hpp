@@ -16,17 +16,23 @@
 
 #pragma once
 
-#include <map>
+#include <cstdint>
 
 #include "geometry.hpp"
 #include "hex_logical_fwd.hpp"
 #include "message_format.pb.h"
+#include "occupancy.hpp"
 #include "player.hpp"
+#include "random.hpp"
+#include "registry.hpp"
 #include "units_fwd.hpp"
+#include "update_codec.hpp"
 #include "uuid.hpp"
 
 namespace game
 {
+	class snapshot;
+
 	// Contains the current game state.
 	// Logical representation of the game map
 	// Locations and stats for units.
@@ -45,8 +51,24 @@ namespace game
 		void add_unit(unit_ptr e);
 		void remove_unit(unit_ptr e);
 
+		// Index of unit locations and zones of control, for fast per-tile lookups.
+		const occupancy& get_occupancy() const { return occupancy_; }
+
 		float get_initiative_counter() const { return initiative_counter_; }
 
+		// Random numbers for the game, such as critical strikes and the stats of new units.
+		// Each game has its own stream from the seed, so a game can be replayed from the seed
+		// and the updates, and games on different threads share nothing.
+		void set_random_seed(uint64_t seed) { rng_ = generator::stream(seed); }
+		generator::stream& get_random() { return rng_; }
+		const generator::stream& get_random() const { return rng_; }
+
+		// Zobrist hash of the units positions and stats, kept up to date as they change.
+		// Equal states have equal hashes, so this doubles as a cheap check for desyncs.
+		uint64_t get_hash() const { return hash_; }
+		// Works the hash out from scratch, which should always match get_hash().
+		uint64_t compute_hash() const;
+
 		// Players are abstract and not entities in this case, since we need special handling.
 		void add_player(player_ptr p);
 		void remove_player(player_ptr p);
@@ -84,24 +106,71 @@ namespace game
 
 		const player_ptr& get_player_by_uuid(const uuid::uuid& id) const;
 
+		// Finds the unit referred to by a message, by handle or uuid. The unit must exist.
+		unit_ptr get_unit(const Update_Unit& uu);
+		// uuid of the unit referred to by a message, this works for units which have since
+		// been removed.
+		uuid::uuid get_unit_uuid(const Update_Unit& uu) const;
+		// Adds the table of unit handles to the update, for the game start.
+		void write_unit_handles(Update* up) const;
+
+		// Writes the whole of the state other than the map to the update: players with their
+		// teams and gold, every unit with all its stats, in initiative order, and the handles
+		// of units living and dead. The random stream is only written if with_random is set,
+		// i.e. for the match journal, since a client knowing it could predict every roll.
+		void write_canonical_state(Update* up, bool with_random=false) const;
+		// Replaces the players, units and initiative order with those from an update made by
+		// write_canonical_state(), and the random stream if the update has it. Players which
+		// already exist are kept, so their types are unchanged, new ones are human players.
+		// The map must already be set.
+		void load_canonical_state(const Update& up);
+		// Makes the update a full state update, which brings a client that has fallen behind
+		// or reconnected back in step in one go. See full_state in message_format.proto. If
+		// not compressed the update mustn't already have any units or players.
+		void write_full_state(Update* up, bool compress=true) const;
+
 	private:
+		// Writes itself back to the state.
+		friend class snapshot;
+
 		float initiative_counter_;
 		mutable int update_counter_;
+		// Mutable since the client side functions change units.
+		mutable uint64_t hash_;
+		generator::stream rng_;
 		hex::logical::map_ptr map_;
 		// List of game entities with stats tag. Sorted by intiative.
 		unit_list units_;
-		std::map<uuid::uuid, player_ptr> players_;
+		// Kept in sync with the positions of units_. Mutable since the client side
+		// functions move units.
+		mutable occupancy occupancy_;
+		registry::table<player_ptr> players_;
 		// Used to synchronise state with the server.
 		std::string fail_reason_;
-		std::map<uuid::uuid, team_ptr> teams_;
+		registry::table<team_ptr> teams_;
+		// Numeric ids of units for use in messages, along with the stats last sent.
+		unit_handles handles_;
+
+		// Called before and after changing a unit, to take out the hash of the old values and
+		// put in the hash of the new ones.
+		void toggle_hash(const unit_ptr& u) const;
+		// Moves the unit to the given position in the initiative order.
+		void move_in_order(const unit_ptr& u, int pos);
 
 		unit_ptr get_unit_by_uuid(const uuid::uuid& id);
+		// Like get_unit(), but for messages from clients, nullptr if there is no such unit.
+		unit_ptr find_unit(const Update_Unit& uu) const;
+		// Attach stats to the message, leaving out any that haven't changed.
+		void attach_stats(Update_Unit* uu, const unit_ptr& u, Update_UnitStats* stats);
+		// Attach all the stats set at the end or start of a turn. The client may have changed
+		// these itself for an action the server refused, so they are sent even if unchanged.
+		void attach_turn_stats(Update_Unit* uu, const unit_ptr& u, Update_UnitStats* stats);
 		void set_validation_fail_reason(const std::string& reason);
 
 		void combat(Update* up, Update_Unit* agg_uu, unit_ptr aggressor, unit_ptr target);
 
 		void set_unit_stats(unit_ptr e, const Update_UnitStats& stats);
 
-		bool validate_move(const unit_ptr& u, const ::google::protobuf::RepeatedPtrField<Update_Location>& path);
+		bool validate_move(const unit_ptr& u, const std::vector<point>& path);
 	};
 }
@@ -37,12 +37,7 @@ namespace process
 	void gui::update(engine& eng, double t, const entity_list& elist)
 	{
 		using namespace component;
-		static component_id gui_mask = genmask(Component::GUI);
-		
-		for(auto& e : elist) {
-			if((e->mask & gui_mask) == gui_mask) {
-
-			}
-		}
+		eng.for_each<Component::GUI>([](const component_set_ptr& e, gui_component& g) {
+		});
 	}
 }
@@ -0,0 +1,260 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdlib>
+#include <iterator>
+#include <vector>
+
+#include "asserts.hpp"
+#include "geometry.hpp"
+#include "hex_logical_fwd.hpp"
+
+// Hex topology for the odd-q layout used by the maps, that is columns of hexes where the odd
+// columns are shoved down half a hex. All the neighbour/ring/range functions here are table 
+// driven and don't allocate.
+namespace hex
+{
+	// Neighbour offsets, indexed by column parity (x & 1) then direction.
+	static const int oddq_offsets[2][6][2] = {
+		{ { 0, -1 }, { 1, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 }, { -1, -1 } },
+		{ { 0, -1 }, { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 } },
+	};
+	// The same directions in cube co-ordinates.
+	static const int cube_directions[6][3] = {
+		{ 0, 1, -1 }, { 1, 0, -1 }, { 1, -1, 0 }, { 0, -1, 1 }, { -1, 0, 1 }, { -1, 1, 0 },
+	};
+
+	struct cube
+	{
+		cube() : x(0), y(0), z(0) {}
+		cube(int xx, int yy, int zz) : x(xx), y(yy), z(zz) {}
+		int x, y, z;
+	};
+
+	inline cube to_cube(const point& p)
+	{
+		const int z = p.y - (p.x - (p.x & 1)) / 2;
+		return cube(p.x, -(p.x + z), z);
+	}
+
+	inline point from_cube(const cube& c)
+	{
+		return point(c.x, c.z + (c.x - (c.x & 1)) / 2);
+	}
+
+	inline cube neighbour(const cube& c, direction d, int scale=1)
+	{
+		return cube(c.x + cube_directions[d][0] * scale, c.y + cube_directions[d][1] * scale, c.z + cube_directions[d][2] * scale);
+	}
+
+	inline point neighbour(const point& p, direction d)
+	{
+		const int* o = oddq_offsets[p.x & 1][d];
+		return point(p.x + o[0], p.y + o[1]);
+	}
+
+	inline int distance(const cube& a, const cube& b)
+	{
+		return (std::abs(a.x - b.x) + std::abs(a.y - b.y) + std::abs(a.z - b.z)) / 2;
+	}
+
+	// The six neighbours of a tile, in direction order. Use as 
+	//   for(auto& n : hex::neighbours(p)) { ... }
+	class neighbour_range
+	{
+	public:
+		class iterator : public std::iterator<std::forward_iterator_tag, point>
+		{
+		public:
+			iterator(const point& p, int dir) : p_(p), dir_(dir) {}
+			point operator*() const { return neighbour(p_, static_cast<direction>(dir_)); }
+			iterator& operator++() { ++dir_; return *this; }
+			bool operator==(const iterator& o) const { return dir_ == o.dir_; }
+			bool operator!=(const iterator& o) const { return dir_ != o.dir_; }
+		private:
+			point p_;
+			int dir_;
+		};
+		explicit neighbour_range(const point& p) : p_(p) {}
+		iterator begin() const { return iterator(p_, 0); }
+		iterator end() const { return iterator(p_, 6); }
+	private:
+		point p_;
+	};
+
+	inline neighbour_range neighbours(const point& p) { return neighbour_range(p); }
+
+	// Tiles at exactly radius steps from centre, going clockwise from the south west corner.
+	// With include_inner set the rings from 0 up to radius are returned, i.e. a spiral covering
+	// every tile within radius steps.
+	class ring_range
+	{
+	public:
+		class iterator : public std::iterator<std::forward_iterator_tag, point>
+		{
+		public:
+			iterator(const cube& centre, int radius) 
+				: centre_(centre), radius_(radius), side_(0), step_(0) 
+			{
+				start_ring();
+			}
+			point operator*() const { return from_cube(current_); }
+			iterator& operator++() {
+				if(radius_ != 0) {
+					current_ = neighbour(current_, static_cast<direction>(side_));
+					if(++step_ != radius_) {
+						return *this;
+					}
+					step_ = 0;
+					if(++side_ != 6) {
+						return *this;
+					}
+					side_ = 0;
+				}
+				++radius_;
+				start_ring();
+				return *this;
+			}
+			bool operator==(const iterator& o) const { return radius_ == o.radius_ && side_ == o.side_ && step_ == o.step_; }
+			bool operator!=(const iterator& o) const { return !operator==(o); }
+		private:
+			void start_ring() { current_ = neighbour(centre_, SOUTH_WEST, radius_); }
+			cube centre_;
+			cube current_;
+			int radius_;
+			int side_;
+			int step_;
+		};
+		ring_range(const point& centre, int radius, bool include_inner) 
+			: centre_(to_cube(centre)), 
+			  first_(include_inner ? 0 : radius), 
+			  radius_(radius) 
+		{
+			ASSERT_LOG(radius >= 0, "Negative radius for hex ring: " << radius);
+		}
+		iterator begin() const { return iterator(centre_, first_); }
+		iterator end() const { return iterator(centre_, radius_ + 1); }
+	private:
+		cube centre_;
+		int first_;
+		int radius_;
+	};
+
+	inline ring_range ring(const point& centre, int radius) { return ring_range(centre, radius, false); }
+	inline ring_range spiral(const point& centre, int radius) { return ring_range(centre, radius, true); }
+
+	// Dense storage of a T for every tile in a rectangular area of the map, in row-major order.
+	// Tiles can be accessed either by location or by index, and the neighbour/ring/spiral ranges
+	// of a grid only visit tiles that are inside it.
+	template<typename T>
+	class hex_grid
+	{
+	public:
+		typedef typename std::vector<T>::iterator iterator;
+		typedef typename std::vector<T>::const_iterator const_iterator;
+		typedef typename std::vector<T>::reference reference;
+		typedef typename std::vector<T>::const_reference const_reference;
+
+		hex_grid() {}
+		explicit hex_grid(const rect& area, const T& value=T()) : area_(area), data_(area.w() * area.h(), value) {}
+		// Takes the tiles, which should be in row-major order, from data.
+		hex_grid(const rect& area, std::vector<T>&& data) : area_(area), data_(std::move(data)) {
+			ASSERT_LOG(static_cast<int>(data_.size()) == area_.w() * area_.h(), 
+				"Size of data for hex grid doesn't match area: " << data_.size() << " != " << area_.w() << "*" << area_.h());
+		}
+
+		void reset(const rect& area, const T& value=T()) {
+			area_ = area;
+			data_.assign(area.w() * area.h(), value);
+		}
+
+		const rect& area() const { return area_; }
+		int x() const { return area_.x(); }
+		int y() const { return area_.y(); }
+		int width() const { return area_.w(); }
+		int height() const { return area_.h(); }
+		size_t size() const { return data_.size(); }
+		bool empty() const { return data_.empty(); }
+
+		bool contains(const point& p) const {
+			return p.x >= area_.x() && p.y >= area_.y() && p.x < area_.x2() && p.y < area_.y2();
+		}
+		bool contains(int xx, int yy) const { return contains(point(xx, yy)); }
+		int index(const point& p) const { return (p.y - area_.y()) * area_.w() + (p.x - area_.x()); }
+		point location(int ndx) const { return point(area_.x() + ndx % area_.w(), area_.y() + ndx / area_.w()); }
+
+		reference operator[](int ndx) { return data_[ndx]; }
+		const_reference operator[](int ndx) const { return data_[ndx]; }
+		reference operator[](const point& p) { return data_[index(p)]; }
+		const_reference operator[](const point& p) const { return data_[index(p)]; }
+		reference at(const point& p) {
+			ASSERT_LOG(contains(p), "Point " << p << " outside hex grid " << area_);
+			return data_[index(p)];
+		}
+		const_reference at(const point& p) const {
+			ASSERT_LOG(contains(p), "Point " << p << " outside hex grid " << area_);
+			return data_[index(p)];
+		}
+
+		iterator begin() { return data_.begin(); }
+		iterator end() { return data_.end(); }
+		const_iterator begin() const { return data_.begin(); }
+		const_iterator end() const { return data_.end(); }
+
+		// Wraps one of the ranges above, skipping the tiles that aren't in the grid.
+		template<typename R>
+		class clipped_range
+		{
+		public:
+			typedef typename R::iterator base_iterator;
+			class iterator : public std::iterator<std::forward_iterator_tag, point>
+			{
+			public:
+				iterator(const hex_grid* g, base_iterator it, base_iterator end) : g_(g), it_(it), end_(end) { skip(); }
+				point operator*() const { return *it_; }
+				iterator& operator++() { ++it_; skip(); return *this; }
+				bool operator==(const iterator& o) const { return it_ == o.it_; }
+				bool operator!=(const iterator& o) const { return it_ != o.it_; }
+			private:
+				void skip() { while(it_ != end_ && !g_->contains(*it_)) { ++it_; } }
+				const hex_grid* g_;
+				base_iterator it_;
+				base_iterator end_;
+			};
+			clipped_range(const hex_grid* g, const R& r) : g_(g), r_(r) {}
+			iterator begin() const { return iterator(g_, r_.begin(), r_.end()); }
+			iterator end() const { return iterator(g_, r_.end(), r_.end()); }
+		private:
+			const hex_grid* g_;
+			R r_;
+		};
+
+		clipped_range<neighbour_range> neighbours(const point& p) const { return clipped_range<neighbour_range>(this, hex::neighbours(p)); }
+		clipped_range<ring_range> ring(const point& p, int radius) const { return clipped_range<ring_range>(this, hex::ring(p, radius)); }
+		clipped_range<ring_range> spiral(const point& p, int radius) const { return clipped_range<ring_range>(this, hex::spiral(p, radius)); }
+
+		// Location of the tile in direction d from p, if it's in the grid. 
+		bool neighbour(const point& p, direction d, point* res) const {
+			*res = hex::neighbour(p, d);
+			return contains(*res);
+		}
+	private:
+		rect area_;
+		std::vector<T> data_;
+	};
+}
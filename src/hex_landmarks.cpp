@@ -0,0 +1,208 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <thread>
+
+#include "asserts.hpp"
+#include "hex_landmarks.hpp"
+#include "hex_pathfinding.hpp"
+#include "node_utils.hpp"
+#include "unit_test.hpp"
+
+namespace hex
+{
+	namespace
+	{
+		// The tile n steps clockwise around the edge of area, starting from the top left.
+		point perimeter_point(const rect& area, int n)
+		{
+			if(n < area.w()) {
+				return point(area.x() + n, area.y());
+			}
+			n -= area.w();
+			if(n < area.h() - 1) {
+				return point(area.x2() - 1, area.y() + 1 + n);
+			}
+			n -= area.h() - 1;
+			if(n < area.w() - 1) {
+				return point(area.x2() - 2 - n, area.y2() - 1);
+			}
+			n -= area.w() - 1;
+			return point(area.x(), area.y2() - 2 - n);
+		}
+	}
+
+	landmarks::landmarks(const hex_grid<logical::fixed_cost>& costs, int count)
+		: costs_(costs)
+	{
+		ASSERT_LOG(count > 0, "Must have at least one landmark: " << count);
+		if(costs_.empty()) {
+			return;
+		}
+
+		const rect& area = costs_.area();
+		const int perimeter = area.w() == 1 || area.h() == 1 ? area.w() * area.h() : 2 * (area.w() + area.h()) - 4;
+		for(int k = 0; k != count; ++k) {
+			const point p = perimeter_point(area, k * perimeter / count);
+			if(std::find(locations_.begin(), locations_.end(), p) == locations_.end()) {
+				locations_.emplace_back(p);
+			}
+		}
+		fields_.resize(costs_.size() * locations_.size());
+
+		// The fields are independent of each other, so are shared out between threads.
+		const int num_threads = std::min(get_count(), std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+		std::vector<std::thread> threads;
+		for(int t = 1; t < num_threads; ++t) {
+			threads.emplace_back([this, t, num_threads]() {
+				for(int k = t; k < get_count(); k += num_threads) {
+					build_field(k);
+				}
+			});
+		}
+		for(int k = 0; k < get_count(); k += num_threads) {
+			build_field(k);
+		}
+		for(auto& t : threads) {
+			t.join();
+		}
+	}
+
+	void landmarks::build_field(int k)
+	{
+		const int size = static_cast<int>(costs_.size());
+		const int count = get_count();
+		std::vector<uint32_t> distance(size, std::numeric_limits<uint32_t>::max());
+		std::vector<std::pair<uint32_t, int>> open;
+		auto cmp = std::greater<std::pair<uint32_t, int>>();
+
+		const int src = costs_.index(locations_[k]);
+		distance[src] = 0;
+		open.emplace_back(0, src);
+		while(!open.empty()) {
+			std::pop_heap(open.begin(), open.end(), cmp);
+			const auto top = open.back();
+			open.pop_back();
+			if(top.first > distance[top.second]) {
+				// stale entry.
+				continue;
+			}
+			for(auto n : costs_.neighbours(costs_.location(top.second))) {
+				const int v = costs_.index(n);
+				const uint32_t d = top.first + costs_[v];
+				if(d < distance[v]) {
+					distance[v] = d;
+					open.emplace_back(d, v);
+					std::push_heap(open.begin(), open.end(), cmp);
+				}
+			}
+		}
+
+		for(int ndx = 0; ndx != size; ++ndx) {
+			fields_[ndx * count + k] = distance[ndx];
+		}
+	}
+
+	uint32_t landmarks::lower_bound(const point& a, const point& b) const
+	{
+		const int count = get_count();
+		const uint32_t* fa = &fields_[costs_.index(a) * count];
+		const uint32_t* fb = &fields_[costs_.index(b) * count];
+		const int64_t wa = costs_[a];
+		const int64_t wb = costs_[b];
+		int64_t res = 0;
+		for(int k = 0; k != count; ++k) {
+			const int64_t da = fa[k];
+			const int64_t db = fb[k];
+			// d(L,b) <= d(L,a) + d(a,b)
+			res = std::max(res, db - da);
+			// d(a,L) <= d(a,b) + d(b,L). The cost of a path is the cost of the tiles entered,
+			// so the cost to L is the cost from it less the cost of the tile left plus that of L,
+			// which cancels out here.
+			res = std::max(res, da - db + wb - wa);
+		}
+		return static_cast<uint32_t>(res);
+	}
+
+	uint32_t landmarks::upper_bound(const point& a, const point& b) const
+	{
+		if(a == b) {
+			return 0;
+		}
+		const int count = get_count();
+		const uint32_t* fa = &fields_[costs_.index(a) * count];
+		const uint32_t* fb = &fields_[costs_.index(b) * count];
+		int64_t res = std::numeric_limits<int64_t>::max();
+		for(int k = 0; k != count; ++k) {
+			// d(a,L) + d(L,b)
+			const int64_t via = static_cast<int64_t>(fa[k]) + costs_[locations_[k]] - costs_[a] + fb[k];
+			res = std::min(res, via);
+		}
+		return static_cast<uint32_t>(res);
+	}
+}
+
+UNIT_TEST(hex_landmarks)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	tiles.add("road", node_builder().add("name", "Road").add("cost", 0.5).build());
+	tiles.add("mountain", node_builder().add("name", "Mountain").add("cost", 5.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+
+	const int width = 30, height = 24;
+	node_builder mb;
+	mb.add("width", width);
+	for(int y = 0; y != height; ++y) {
+		for(int x = 0; x != width; ++x) {
+			mb.add("tiles", y == 12 ? "road" : (x * 5 + y * 3) % 7 == 0 ? "mountain" : "flat");
+		}
+	}
+	auto m = hex::logical::map::factory(mb.build());
+	game::state gs;
+	gs.set_map(m);
+	auto g = hex::create_graph(gs, gs.create_team_instance("a"), creature::MovementType::NORMAL);
+	auto& costs = m->get_cost_grid(creature::MovementType::NORMAL);
+	auto lm = m->get_landmarks(creature::MovementType::NORMAL);
+	CHECK_EQ(lm->get_count(), hex::default_landmark_count);
+
+	const point pts[] = { point(0, 0), point(29, 23), point(3, 11), point(15, 12), point(27, 2), point(8, 20), point(16, 5) };
+	for(auto& a : pts) {
+		CHECK_EQ(lm->lower_bound(a, a), 0u);
+		CHECK_EQ(lm->upper_bound(a, a), 0u);
+		for(auto& b : pts) {
+			uint32_t exact = 0;
+			auto path = hex::find_path(g, a, b);
+			for(size_t n = 1; n < path.size(); ++n) {
+				exact += costs[path[n]];
+			}
+			CHECK_LE(lm->lower_bound(a, b), exact);
+			CHECK_GE(lm->upper_bound(a, b), exact);
+		}
+	}
+	// Much better than assuming every tile is a road.
+	const uint32_t naive = hex::logical::distance(point(0, 0), point(29, 23)) * costs[point(0, 12)];
+	CHECK_GT(lm->lower_bound(point(0, 0), point(29, 23)), naive * 3 / 2);
+
+	// Making a tile more expensive leaves the bounds valid, cheaper means rebuilding them.
+	m->set_tile_at(point(5, 5), hex::logical::tile::factory("mountain"));
+	CHECK_EQ(m->get_landmarks(creature::MovementType::NORMAL), lm);
+	m->set_tile_at(point(5, 5), hex::logical::tile::factory("road"));
+	CHECK_NE(m->get_landmarks(creature::MovementType::NORMAL), lm);
+}
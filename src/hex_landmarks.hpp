@@ -0,0 +1,65 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.hpp"
+#include "hex_grid.hpp"
+#include "hex_logical_tiles.hpp"
+
+namespace hex
+{
+	const int default_landmark_count = 8;
+
+	// Distance oracle for a maps terrain, using landmarks (the "ALT" technique).
+	//
+	// The cost of the cheapest path from each of a few landmark tiles to every other tile is
+	// found up front. By the triangle inequality, comparing the costs from a landmark to two
+	// tiles gives a lower bound on the cost between them, which takes terrain into account
+	// so makes a much better A* heuristic than hex distance does. Going via a landmark gives
+	// an upper bound. Units are ignored, so both bounds are for the terrain only.
+	//
+	// Costs are in the same fixed point units as the maps cost grids.
+	class landmarks
+	{
+	public:
+		// The landmarks are spread around the edge of the map, their fields are built in
+		// parallel.
+		explicit landmarks(const hex_grid<logical::fixed_cost>& costs, int count=default_landmark_count);
+
+		int get_count() const { return static_cast<int>(locations_.size()); }
+		const std::vector<point>& get_locations() const { return locations_; }
+
+		// Neither a nor b may be off the map.
+		uint32_t lower_bound(const point& a, const point& b) const;
+		uint32_t upper_bound(const point& a, const point& b) const;
+		// Cheap estimate of the cost of moving from a to b, in movement points. This is the
+		// lower bound, which is close to the true cost unless there's a big obstacle between
+		// a and b that isn't between them and any of the landmarks.
+		float approximate_cost(const point& a, const point& b) const { return static_cast<float>(lower_bound(a, b)) / logical::cost_scale; }
+	private:
+		void build_field(int k);
+
+		// Only the area and costs are used, so the maps grid isn't needed once built.
+		hex_grid<logical::fixed_cost> costs_;
+		std::vector<point> locations_;
+		// Cost from each landmark to each tile, all the landmarks for a tile are together.
+		std::vector<uint32_t> fields_;
+	};
+}
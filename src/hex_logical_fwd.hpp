@@ -46,4 +46,7 @@ namespace hex
 	struct graph_t;
 	typedef std::shared_ptr<graph_t> hex_graph_ptr;
 
+	class landmarks;
+	typedef std::shared_ptr<const landmarks> const_landmarks_ptr;
+
 }
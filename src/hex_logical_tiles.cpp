@@ -14,10 +14,16 @@
 	limitations under the License.
 */
 
+#include <cstdlib>
+#include <limits>
+#include <set>
 #include <tuple>
 
 #include "asserts.hpp"
+#include "creature.hpp"
+#include "hex_landmarks.hpp"
 #include "hex_logical_tiles.hpp"
+#include "unit_test.hpp"
 
 namespace hex 
 {
@@ -40,18 +46,28 @@ namespace hex
 			auto& tiles = n["tiles"];
 			for(auto& p : tiles.as_map()) {
 				std::string id = p.first.as_string();
-				float cost = p.second["cost"].as_float(1.0f);
+				// 'cost' is the cost for every movement type that isn't given in 'costs'.
+				std::vector<float> costs(static_cast<int>(creature::MovementType::MAX_MOVEMENT_TYPES), p.second["cost"].as_float(1.0f));
+				if(p.second.has_key("costs")) {
+					for(auto& mc : p.second["costs"].as_map()) {
+						costs[static_cast<int>(creature::get_movement_type(mc.first.as_string()))] = mc.second.as_float();
+					}
+				}
+				for(int n = 0; n != static_cast<int>(costs.size()); ++n) {
+					ASSERT_LOG(costs[n] >= 0 && costs[n] * cost_scale <= std::numeric_limits<fixed_cost>::max(), 
+						"Cost of tile '" << id << "' for movement type " << creature::get_movement_type_name(static_cast<creature::MovementType>(n)) << " is out of range: " << costs[n]);
+				}
 				float height = p.second["height"].as_float(1.0f);
 				std::string name = p.second["name"].as_string();
-				get_loaded_tiles()[id] = std::make_shared<tile>(id, name, cost, height);
+				get_loaded_tiles()[id] = std::make_shared<tile>(id, name, costs, height);
 			}
 		}
 
-		tile::tile(const std::string& id, const std::string& name, float cost, float height) 
+		tile::tile(const std::string& id, const std::string& name, const std::vector<float>& costs, float height) 
 			: name_(name),
 			  id_(id), 
-			  cost_(cost), 
-			  height_(height)
+			  height_(height),
+			  costs_(costs)
 		{
 		}
 
@@ -68,104 +84,75 @@ namespace hex
 		}
 
 		map::map(const node& n)
-			: x_(n["x"].as_int32(0)),
-		      y_(n["y"].as_int32(0)),
-			  width_(n["width"].as_int32()), 
-			  height_(0)
 		{
-			tiles_.reserve(width_ * width_);	// approximation
+			const int width = n["width"].as_int32();
+			std::vector<tile_ptr> tiles;
+			tiles.reserve(width * width);	// approximation
 			for (auto& tile_str : n["tiles"].as_list_strings()) {
-				tiles_.emplace_back(tile::factory(tile_str));
+				tiles.emplace_back(tile::factory(tile_str));
 			}
-			height_ = tiles_.size() / width_;
+			const int height = static_cast<int>(tiles.size()) / width;
+			// Any tiles making up a partial row are dropped.
+			tiles.resize(width * height);
+			tiles_ = hex_grid<tile_ptr>(rect(n["x"].as_int32(0), n["y"].as_int32(0), width, height), std::move(tiles));
+			build_cost_grids();
 		}
 
 		map::map(const map& m)
-			: x_(m.x_),
-			  y_(m.y_),
-			  width_(m.width_),
-			  height_(m.height_),
-			  tiles_(m.tiles_)
+			: tiles_(m.tiles_),
+			  costs_(m.costs_),
+			  landmarks_(m.landmarks_)
 		{
 			// XX if we ever have a case where we need to modify tiles differently between the
 			// internal server and here then we need to clone all the elements in m.tiles_.
 		}
 
-		const_tile_ptr map::get_hex_tile(direction d, int xx, int yy) const
+		void map::build_cost_grids()
 		{
-			int ox = xx;
-			int oy = yy;
-			ASSERT_LOG(x() == 0 && y() == 0, "x/y values not zero (" << x() << "," << y() << ")");
-			xx -= x();
-			yy -= y();
-			if(d == NORTH) {
-				yy -= 1;
-			} else if(d == SOUTH) {
-				yy += 1;
-			} else if(d == NORTH_WEST) {
-				yy -= (abs(ox)%2==0) ? 1 : 0;
-				xx -= 1;
-			} else if(d == NORTH_EAST) {
-				yy -= (abs(ox)%2==0) ? 1 : 0;
-				xx += 1;
-			} else if(d == SOUTH_WEST) {
-				yy += (abs(ox)%2) ? 1 : 0;
-				xx -= 1;
-			} else if(d == SOUTH_EAST) {
-				yy += (abs(ox)%2) ? 1 : 0;
-				xx += 1;
-			} else {
-				ASSERT_LOG(false, "Unrecognised direction: " << d);
+			const int num_types = static_cast<int>(creature::MovementType::MAX_MOVEMENT_TYPES);
+			costs_.assign(num_types, hex_grid<fixed_cost>(tiles_.area()));
+			for(int ndx = 0; ndx != static_cast<int>(tiles_.size()); ++ndx) {
+				for(int mt = 0; mt != num_types; ++mt) {
+					costs_[mt][ndx] = to_fixed_cost(tiles_[ndx]->get_cost(static_cast<creature::MovementType>(mt)));
+				}
 			}
-			if (xx < 0 || yy < 0 || yy >= height() || xx >= width()) {
-				return nullptr;
+			landmarks_.clear();
+			for(int mt = 0; mt != num_types; ++mt) {
+				landmarks_.emplace_back(std::make_shared<landmarks>(costs_[mt]));
 			}
+		}
 
-			const int index = yy * width() + xx;
-			ASSERT_LOG(index >= 0 && index < static_cast<int>(tiles_.size()), "Index out of bounds." << index << " >= " << tiles_.size());
-			return tiles_[index];
+		void map::set_tile_at(const point& p, const tile_ptr& t)
+		{
+			ASSERT_LOG(tiles_.contains(p), "Point " << p << " isn't on the map.");
+			tiles_[p] = t;
+			for(int mt = 0; mt != static_cast<int>(costs_.size()); ++mt) {
+				const fixed_cost c = to_fixed_cost(t->get_cost(static_cast<creature::MovementType>(mt)));
+				// The bounds given by the landmarks are still valid if costs only go up.
+				const bool cheaper = c < costs_[mt][p];
+				costs_[mt][p] = c;
+				if(cheaper) {
+					landmarks_[mt] = std::make_shared<landmarks>(costs_[mt]);
+				}
+			}
+		}
+
+		const_tile_ptr map::get_hex_tile(direction d, int xx, int yy) const
+		{
+			point p;
+			return tiles_.neighbour(point(xx, yy), d, &p) ? tiles_[p] : nullptr;
 		}
 
 		point map::get_coordinates_in_dir(direction d, int xx, int yy) const
 		{
-			int ox = xx;
-			int oy = yy;
-			xx -= x();
-			yy -= y();
-			switch (d) {
-				case NORTH:			yy -= 1; break;
-				case NORTH_EAST:
-					yy -= (abs(ox)%2==0) ? 1 : 0;
-					xx += 1;
-					break;
-				case SOUTH_EAST:
-					yy += (abs(ox)%2) ? 1 : 0;
-					xx += 1;
-					break;
-				case SOUTH:			yy += 1; break;
-				case SOUTH_WEST:
-					yy += (abs(ox)%2) ? 1 : 0;
-					xx -= 1;
-					break;
-				case NORTH_WEST:
-					yy -= (abs(ox)%2==0) ? 1 : 0;
-					xx -= 1;
-					break;
-				default:
-					ASSERT_LOG(false, "Unrecognised direction: " << d);
-					break;
-			}
-			return point(xx, yy) + point(x(), y());
+			return hex::neighbour(point(xx, yy), d);
 		}
 
 		std::vector<const_tile_ptr> map::get_surrounding_tiles(int x, int y) const
 		{
 			std::vector<const_tile_ptr> res;
-			for(auto dir : { NORTH, NORTH_EAST, SOUTH_EAST, SOUTH, SOUTH_WEST, NORTH_WEST }) {
-				auto hp = get_hex_tile(dir, x, y);
-				if(hp != nullptr) {
-					res.emplace_back(hp);
-				}
+			for(auto p : tiles_.neighbours(point(x, y))) {
+				res.emplace_back(tiles_[p]);
 			}
 			return res;
 		}
@@ -173,11 +160,8 @@ namespace hex
 		std::vector<point> map::get_surrounding_positions(int xx, int yy) const
 		{
 			std::vector<point> res;
-			for(auto dir : { NORTH, NORTH_EAST, SOUTH_EAST, SOUTH, SOUTH_WEST, NORTH_WEST }) {
-				auto p = get_coordinates_in_dir(dir, xx, yy);
-				if(p.x >= 0 && p.x >= 0 && p.x < width() && p.y < height()) {
-					res.emplace_back(p);
-				}
+			for(auto p : tiles_.neighbours(point(xx, yy))) {
+				res.emplace_back(p);
 			}
 			return res;
 		}
@@ -189,15 +173,8 @@ namespace hex
 
 		const_tile_ptr map::get_tile_at(int xx, int yy) const
 		{
-			xx -= x();
-			yy -= y();
-			if (xx < 0 || yy < 0 || yy >= height() || xx >= width()) {
-				return nullptr;
-			}
-
-			const int index = yy * width() + xx;
-			ASSERT_LOG(index >= 0 && index < static_cast<int>(tiles_.size()), "");
-			return tiles_[index];
+			const point p(xx, yy);
+			return tiles_.contains(p) ? tiles_[p] : nullptr;
 		}
 
 		const_tile_ptr map::get_tile_at(const point& p) const
@@ -212,10 +189,8 @@ namespace hex
 
 		std::tuple<int,int,int> oddq_to_cube_coords(const point& p)
 		{
-			int x1 = p.x;
-			int z1 = p.y - (p.x - (p.x & 1)) / 2;
-			int y1 = -(x1 + z1);
-			return std::make_tuple(x1,y1,z1);
+			const cube c = to_cube(p);
+			return std::make_tuple(c.x, c.y, c.z);
 		}
 
 		int distance(int x1, int y1, int z1, int x2, int y2, int z2)
@@ -225,57 +200,128 @@ namespace hex
 
 		int distance(const point& p1, const point& p2)
 		{
-			int x1, y1, z1;
-			std::tie(x1,y1,z1) = oddq_to_cube_coords(p1);
-			int x2, y2, z2;
-			std::tie(x2,y2,z2) = oddq_to_cube_coords(p2);
-			return distance(x1, y1, z1, x2, y2, z2);
+			return hex::distance(to_cube(p1), to_cube(p2));
 		}
 
-		std::tuple<int,int,int> hex_round(float x, float y, float z) 
+		namespace
 		{
-			int rx = static_cast<int>(std::round(x));
-			int ry = static_cast<int>(std::round(y));
-			int rz = static_cast<int>(std::round(z));
-
-			float x_diff = std::abs(rx - x);
-			float y_diff = std::abs(ry - y);
-			float z_diff = std::abs(rz - z);
-
-			if(x_diff > y_diff && x_diff > z_diff) {
-				rx = -(ry+rz);
-			} else if(y_diff > z_diff) {
-				ry = -(rx+rz);
-			} else {
-				rz = -(rx+ry);
+			// Scale that cube coordinates are multiplied by along with the line length when
+			// finding the points on a line, leaving room for the nudge below.
+			const int64_t line_scale = 1024;
+
+			// Division rounded towards negative infinity, den must be positive.
+			int64_t floor_div(int64_t num, int64_t den)
+			{
+				return num >= 0 ? num / den : -((-num + den - 1) / den);
 			}
-			return std::make_tuple(rx, ry, rz);
-		}
 
-		point cube_to_oddq_coords(const std::tuple<int,int,int>& xyz)
-		{
-			return point(std::get<0>(xyz), std::get<2>(xyz) + (std::get<0>(xyz) - (std::get<0>(xyz) & 1)) / 2);
+			// The hex nearest to the point i/n of the way from a to b. Points are kept as integers
+			// scaled by n*line_scale. Each coordinate is nudged by a fraction of a hex in a different
+			// direction, so that points lying exactly between two hexes are always rounded the same
+			// way and no rounding is ever a tie.
+			cube line_point(const cube& a, const cube& b, int n, int i)
+			{
+				const int64_t d = static_cast<int64_t>(n) * line_scale;
+				const int64_t x = (static_cast<int64_t>(a.x) * (n - i) + static_cast<int64_t>(b.x) * i) * line_scale + 1;
+				const int64_t y = (static_cast<int64_t>(a.y) * (n - i) + static_cast<int64_t>(b.y) * i) * line_scale + 1;
+				const int64_t z = (static_cast<int64_t>(a.z) * (n - i) + static_cast<int64_t>(b.z) * i) * line_scale - 2;
+
+				int64_t rx = floor_div(2 * x + d, 2 * d);
+				int64_t ry = floor_div(2 * y + d, 2 * d);
+				int64_t rz = floor_div(2 * z + d, 2 * d);
+				const int64_t x_diff = std::abs(x - rx * d);
+				const int64_t y_diff = std::abs(y - ry * d);
+				const int64_t z_diff = std::abs(z - rz * d);
+
+				// Fix up the coordinate furthest from where it should be, so that x+y+z == 0.
+				if(x_diff > y_diff && x_diff > z_diff) {
+					rx = -(ry + rz);
+				} else if(y_diff > z_diff) {
+					ry = -(rx + rz);
+				} else {
+					rz = -(rx + ry);
+				}
+				return cube(static_cast<int>(rx), static_cast<int>(ry), static_cast<int>(rz));
+			}
+
+			// Lines are the same wherever they start in cube coordinates, so in odd-q coordinates
+			// they only depend on the difference between the ends and whether the line starts in
+			// an odd or even column. This holds the tiles between the ends of all the lines up to
+			// line_table_range long, relative to the start of the line.
+			class line_table
+			{
+			public:
+				line_table() {
+					const int size = 2 * line_table_range + 1;
+					for(int parity = 0; parity != 2; ++parity) {
+						entries_[parity].resize(size * size, std::make_pair(0, 0));
+						const point origin(parity, 0);
+						const cube a = to_cube(origin);
+						for(int dx = -line_table_range; dx <= line_table_range; ++dx) {
+							for(int dz = -line_table_range; dz <= line_table_range; ++dz) {
+								const cube b(a.x + dx, a.y - dx - dz, a.z + dz);
+								const int n = hex::distance(a, b);
+								if(n > line_table_range) {
+									continue;
+								}
+								entries_[parity][index(dx, dz)] = std::make_pair(static_cast<int>(offsets_[parity].size()), std::max(0, n - 1));
+								for(int i = 1; i < n; ++i) {
+									const point p = from_cube(line_point(a, b, n, i));
+									offsets_[parity].emplace_back(p.x - origin.x, p.y - origin.y);
+								}
+							}
+						}
+					}
+				}
+
+				const point* get(const point& p1, const point& p2, int* count) const {
+					const cube a = to_cube(p1);
+					const cube b = to_cube(p2);
+					if(hex::distance(a, b) > line_table_range) {
+						return nullptr;
+					}
+					const int parity = p1.x & 1;
+					const auto& e = entries_[parity][index(b.x - a.x, b.z - a.z)];
+					*count = e.second;
+					return offsets_[parity].data() + e.first;
+				}
+			private:
+				static int index(int dx, int dz) {
+					return (dx + line_table_range) * (2 * line_table_range + 1) + (dz + line_table_range);
+				}
+				// Indexed by the parity of the column the line starts in. For each difference in
+				// cube coordinates between the ends, the first offset and the number of them.
+				std::vector<std::pair<int, int>> entries_[2];
+				std::vector<point> offsets_[2];
+			};
+
+			// Built before main() runs, so there's no need to lock it.
+			const line_table cached_lines;
 		}
 
 		std::vector<point> line(const point& p1, const point& p2)
 		{
+			const cube a = to_cube(p1);
+			const cube b = to_cube(p2);
+			const int n = hex::distance(a, b);
 			std::vector<point> res;
-			int n = distance(p1, p2);
-			int x1, y1, z1;
-			std::tie(x1,y1,z1) = oddq_to_cube_coords(p1);
-			int x2, y2, z2;
-			std::tie(x2,y2,z2) = oddq_to_cube_coords(p2);
-			for(int i = 0; i <= n; ++i) {
-				const float i_over_n  = static_cast<float>(i)/n;
-				const float xt = x1 * (1.0f - i_over_n) + x2 * i_over_n + 1e-6f;
-				const float yt = y1 * (1.0f - i_over_n) + y2 * i_over_n + 1e-6f;
-				const float zt = z1 * (1.0f - i_over_n) + z2 * i_over_n - 2e-6f;
-				res.emplace_back(cube_to_oddq_coords(hex_round(xt, yt, zt)));
+			res.reserve(n + 1);
+			res.emplace_back(p1);
+			for(int i = 1; i < n; ++i) {
+				res.emplace_back(from_cube(line_point(a, b, n, i)));
+			}
+			if(n > 0) {
+				res.emplace_back(p2);
 			}
-
 			return res;
 		}
 
+		const point* get_line_offsets(const point& p1, const point& p2, int* count)
+		{
+			ASSERT_LOG(count != nullptr, "No count given.");
+			return cached_lines.get(p1, p2, count);
+		}
+
 		float rotation_between(const point& p1, const point& p2)
 		{
 			// hack it somewhat to just work for p1 and p2 being adjacent.
@@ -296,3 +342,89 @@ namespace hex
 		}
 	}
 }
+
+UNIT_TEST(hex_grid)
+{
+	using namespace hex;
+	for(int r = 0; r != 4; ++r) {
+		std::set<point> seen;
+		for(auto p : ring(point(5, 4), r)) {
+			CHECK_EQ(logical::distance(point(5, 4), p), r);
+			seen.insert(p);
+		}
+		CHECK_EQ(seen.size(), r == 0 ? 1u : static_cast<size_t>(6 * r));
+	}
+	std::set<point> seen;
+	for(auto p : spiral(point(-3, 2), 3)) {
+		CHECK_LE(logical::distance(point(-3, 2), p), 3);
+		seen.insert(p);
+	}
+	CHECK_EQ(seen.size(), 37u);
+
+	for(auto p : { point(2, 2), point(3, 2), point(-1, -4) }) {
+		int dir = 0;
+		for(auto n : neighbours(p)) {
+			CHECK_EQ(logical::distance(p, n), 1);
+			CHECK_EQ(from_cube(neighbour(to_cube(p), static_cast<direction>(dir))), n);
+			++dir;
+		}
+		CHECK_EQ(dir, 6);
+	}
+
+	hex_grid<int> g(rect(0, 0, 5, 5), 7);
+	int count = 0;
+	for(auto n : g.neighbours(point(0, 0))) {
+		CHECK_EQ(g[n], 7);
+		++count;
+	}
+	CHECK_EQ(count, 2);
+	count = 0;
+	for(auto n : g.spiral(point(4, 4), 2)) {
+		CHECK_EQ(g.contains(n), true);
+		++count;
+	}
+	// Only the part of the spiral on the grid is visited.
+	int expected = 0;
+	for(int ndx = 0; ndx != static_cast<int>(g.size()); ++ndx) {
+		expected += logical::distance(point(4, 4), g.location(ndx)) <= 2 ? 1 : 0;
+	}
+	CHECK_EQ(count, expected);
+}
+
+UNIT_TEST(hex_line)
+{
+	using namespace hex;
+	for(auto& p1 : { point(0, 0), point(3, -2), point(-5, 7) }) {
+		for(int dx = -20; dx <= 20; ++dx) {
+			for(int dy = -20; dy <= 20; ++dy) {
+				const point p2(p1.x + dx, p1.y + dy);
+				auto l = logical::line(p1, p2);
+				const int n = logical::distance(p1, p2);
+				CHECK_EQ(l.size(), static_cast<size_t>(n + 1));
+				CHECK_EQ(l.front(), p1);
+				CHECK_EQ(l.back(), p2);
+				for(size_t i = 1; i < l.size(); ++i) {
+					CHECK_EQ(logical::distance(l[i - 1], l[i]), 1);
+				}
+
+				// The table gives the same tiles, for lines short enough to be in it.
+				std::vector<point> between;
+				logical::for_each_between(p1, p2, [&between](const point& p) {
+					between.emplace_back(p);
+					return true;
+				});
+				CHECK_EQ(between.size(), static_cast<size_t>(std::max(0, n - 1)));
+				CHECK_EQ(std::equal(between.begin(), between.end(), l.begin() + 1), true);
+				int count = 0;
+				CHECK_EQ(logical::get_line_offsets(p1, p2, &count) != nullptr, n <= logical::line_table_range);
+			}
+		}
+	}
+
+	// Stops at the first tile fn returns false for.
+	int visited = 0;
+	CHECK_EQ(logical::for_each_between(point(0, 0), point(6, 0), [&visited](const point& p) {
+		return ++visited != 2;
+	}), false);
+	CHECK_EQ(visited, 2);
+}
@@ -16,10 +16,13 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "creature_fwd.hpp"
 #include "geometry.hpp"
+#include "hex_grid.hpp"
 #include "hex_logical_fwd.hpp"
 #include "node.hpp"
 
@@ -30,38 +33,80 @@ namespace hex
 		std::tuple<int,int,int> oddq_to_cube_coords(const point& p);
 		int distance(int x1, int y1, int z1, int x2, int y2, int z2);
 		int distance(const point& p1, const point& p2);
+		// Lines up to this many tiles long are looked up in a table that is built at start up.
+		const int line_table_range = 16;
+		// The tiles on the line from p1 to p2, including both ends. Only integer arithmetic is
+		// used, so lines are the same everywhere.
 		std::vector<point> line(const point& p1, const point& p2);
+		// The tiles strictly between p1 and p2 on the line joining them, as offsets from p1,
+		// read from the line table. Returns nullptr if the line is longer than line_table_range.
+		const point* get_line_offsets(const point& p1, const point& p2, int* count);
+		// Calls fn with each tile strictly between p1 and p2 on the line joining them, in order,
+		// until it returns false. Returns false if fn did. Only allocates for lines longer than
+		// line_table_range.
+		template<typename F>
+		bool for_each_between(const point& p1, const point& p2, F fn)
+		{
+			int count = 0;
+			const point* offsets = get_line_offsets(p1, p2, &count);
+			if(offsets == nullptr) {
+				const std::vector<point> l = line(p1, p2);
+				for(size_t n = 1; n + 1 < l.size(); ++n) {
+					if(!fn(l[n])) {
+						return false;
+					}
+				}
+				return true;
+			}
+			for(int n = 0; n != count; ++n) {
+				if(!fn(point(p1.x + offsets[n].x, p1.y + offsets[n].y))) {
+					return false;
+				}
+			}
+			return true;
+		}
 		float rotation_between(const point& p1, const point& p2);
 
+		// Movement costs are kept in the maps cost grids as fixed point values, in units of
+		// 1/cost_scale movement points.
+		typedef uint16_t fixed_cost;
+		const int cost_scale = 100;
+		inline float to_cost(fixed_cost c) { return static_cast<float>(c) / cost_scale; }
+		inline fixed_cost to_fixed_cost(float c) { return static_cast<fixed_cost>(c * cost_scale + 0.5f); }
+
 		class tile
 		{
 		public:
-			explicit tile(const std::string& id, const std::string& name, float cost, float height);
+			// costs is indexed by creature::MovementType.
+			explicit tile(const std::string& id, const std::string& name, const std::vector<float>& costs, float height);
 			const std::string& name() const { return name_; }
 			const std::string& id() const { return id_; }
-			float get_cost() const { return cost_; }
+			float get_cost() const { return costs_[static_cast<int>(creature::MovementType::NORMAL)]; }
+			float get_cost(creature::MovementType mt) const { return costs_[static_cast<int>(mt)]; }
 			float get_height() const { return height_; }
 			static tile_ptr factory(const std::string& name);
 		private:
 			std::string name_;
 			std::string id_;
 			float height_;
-			float cost_;
+			std::vector<float> costs_;
 		};
 	
 		class map
 		{
 		public:
-			typedef std::vector<tile_ptr>::iterator iterator;
-			typedef std::vector<tile_ptr>::const_iterator const_iterator;
+			typedef hex_grid<tile_ptr>::iterator iterator;
+			typedef hex_grid<tile_ptr>::const_iterator const_iterator;
+			typedef hex_grid<tile_ptr>::clipped_range<hex::neighbour_range> neighbour_list;
 
 			explicit map(const node& n);
 			map_ptr clone();
 
-			int x() const { return x_; }
-			int y() const { return y_; }
-			int width() const { return width_; }
-			int height() const { return height_; }
+			int x() const { return tiles_.x(); }
+			int y() const { return tiles_.y(); }
+			int width() const { return tiles_.width(); }
+			int height() const { return tiles_.height(); }
+			const hex_grid<tile_ptr>& get_tiles() const { return tiles_; }
 
 			// Range based for loop support.
 			iterator begin() { return tiles_.begin(); }
@@ -70,6 +115,10 @@ namespace hex
 			const_iterator end() const { return tiles_.end(); }
 			std::size_t size() { return tiles_.size(); }
 
+			bool contains(const point& p) const { return tiles_.contains(p); }
+			// The positions of the tiles surrounding p that are on the map, doesn't allocate.
+			neighbour_list neighbours(const point& p) const { return tiles_.neighbours(p); }
+
 			const_tile_ptr get_hex_tile(direction d, int x, int y) const;
 			std::vector<const_tile_ptr> get_surrounding_tiles(int x, int y) const;
 			// Get the positions of the valid tiles surrounding the tile at (x,y)
@@ -79,14 +128,25 @@ namespace hex
 			const_tile_ptr get_tile_at(const point& p) const;
 			point get_coordinates_in_dir(direction d, int x, int y) const;
 
+			// Cost of moving into each tile for the given movement type. The grids are built when
+			// the map is loaded and cover the same area as get_tiles(), so a tile index is valid
+			// for all of them.
+			const hex_grid<fixed_cost>& get_cost_grid(creature::MovementType mt) const { return costs_[static_cast<int>(mt)]; }
+			// Landmark distances for the terrain for the given movement type, built along with
+			// the cost grids. Clones of the map share them.
+			const const_landmarks_ptr& get_landmarks(creature::MovementType mt) const { return landmarks_[static_cast<int>(mt)]; }
+			// Change the terrain at p, the cost grids are updated to match. If the tile is cheaper
+			// to enter than the old one the landmarks are rebuilt, which is slow on large maps.
+			void set_tile_at(const point& p, const tile_ptr& t);
+
 			static map_ptr factory(const node& n);
 		private:
-			int x_;
-			int y_;
-			int width_;
-			int height_;
+			void build_cost_grids();
 
-			std::vector<tile_ptr> tiles_;
+			hex_grid<tile_ptr> tiles_;
+			// Both indexed by creature::MovementType.
+			std::vector<hex_grid<fixed_cost>> costs_;
+			std::vector<const_landmarks_ptr> landmarks_;
 			map(const map&);
 		};
 
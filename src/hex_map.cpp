@@ -46,13 +46,15 @@ namespace hex
 		hex_map_ptr p = std::make_shared<hex_map>(n);
 		p->map_ = m;
 		int index = 0;
-		p->tiles_.reserve(p->map_->size());
+		std::vector<hex_object> tiles;
+		tiles.reserve(p->map_->size());
 		for(auto& t : *p->map_) {
 			const int x = index % p->map_->width();
 			const int y = index / p->map_->width();
-			p->tiles_.emplace_back(t->id(), x, y, p);
+			tiles.emplace_back(t->id(), x, y, p);
 			++index;
 		}
+		p->tiles_ = hex_grid<hex_object>(p->map_->get_tiles().area(), std::move(tiles));
 		
 		for(auto& t : p->tiles_) {
 			t.init_neighbors();
@@ -91,48 +93,16 @@ namespace hex
 	std::vector<const hex_object*> hex_map::get_surrounding_tiles(int x, int y) const
 	{
 		std::vector<const hex_object*> res;
-		for(auto dir : { NORTH, NORTH_EAST, SOUTH_EAST, SOUTH, SOUTH_WEST, NORTH_WEST }) {
-			auto hp = get_hex_tile(dir, x, y);
-			if(hp != nullptr) {
-				res.emplace_back(hp);
-			}
+		for(auto p : tiles_.neighbours(point(x, y))) {
+			res.emplace_back(&tiles_[p]);
 		}
 		return res;
 	}
 
 	const hex_object* hex_map::get_hex_tile(direction d, int x, int y) const
 	{
-		int ox = x;
-		int oy = y;
-		assert(map_->x() == 0 && map_->y() == 0);
-		x -= map_->x();
-		y -= map_->y();
-		if(d == NORTH) {
-			y -= 1;
-		} else if(d == SOUTH) {
-			y += 1;
-		} else if(d == NORTH_WEST) {
-			y -= (abs(ox)%2==0) ? 1 : 0;
-			x -= 1;
-		} else if(d == NORTH_EAST) {
-			y -= (abs(ox)%2==0) ? 1 : 0;
-			x += 1;
-		} else if(d == SOUTH_WEST) {
-			y += (abs(ox)%2) ? 1 : 0;
-			x -= 1;
-		} else if(d == SOUTH_EAST) {
-			y += (abs(ox)%2) ? 1 : 0;
-			x += 1;
-		} else {
-			ASSERT_LOG(false, "Unrecognised direction: " << d);
-		}
-		if (x < 0 || y < 0 || y >= map_->height() || x >= map_->width()) {
-			return nullptr;
-		}
-
-		const int index = y * map_->width() + x;
-		assert(index >= 0 && index < static_cast<int>(tiles_.size()));
-		return &tiles_[index];
+		point p;
+		return tiles_.neighbour(point(x, y), d, &p) ? &tiles_[p] : nullptr;
 	}
 
 	point hex_map::get_tile_pos_from_pixel_pos(int mx, int my)
@@ -197,27 +167,18 @@ namespace hex
 
 	const hex_object* hex_map::get_tile_at(int x, int y) const
 	{
-		x -= map_->x();
-		y -= map_->y();
-		if (x < 0 || y < 0 || y >= map_->height() || x >= map_->width()) {
-			return nullptr;
-		}
-
-		const int index = y * map_->width() + x;
-		assert(index >= 0 && index < static_cast<int>(tiles_.size()));
-		return &tiles_[index];
+		const point p(x, y);
+		return tiles_.contains(p) ? &tiles_[p] : nullptr;
 	}
 
 	bool hex_map::set_tile(int xx, int yy, const std::string& tile)
 	{
-		if(xx < 0 || yy < 0 || xx >= map_->width() || yy >= map_->height()) {
+		const point p(xx, yy);
+		if(!tiles_.contains(p)) {
 			return false;
 		}
 
-		const int index = yy * map_->width() + xx;
-		assert(index >= 0 && index < static_cast<int>(tiles_.size()));
-
-		tiles_[index] = hex_object(tile, xx, yy, shared_from_this());
+		tiles_[p] = hex_object(tile, xx, yy, shared_from_this());
 		for(auto t : tiles_) {
 			t.neighbors_changed();
 		}
@@ -226,28 +187,7 @@ namespace hex
 
 	point hex_map::loc_in_dir(int x, int y, direction d)
 	{
-		int ox = x;
-		int oy = y;
-		if(d == NORTH) {
-			y -= 1;
-		} else if(d == SOUTH) {
-			y += 1;
-		} else if(d == NORTH_WEST) {
-			y -= (abs(ox)%2==0) ? 1 : 0;
-			x -= 1;
-		} else if(d == NORTH_EAST) {
-			y -= (abs(ox)%2==0) ? 1 : 0;
-			x += 1;
-		} else if(d == SOUTH_WEST) {
-			y += (abs(ox)%2) ? 1 : 0;
-			x -= 1;
-		} else if(d == SOUTH_EAST) {
-			y += (abs(ox)%2) ? 1 : 0;
-			x += 1;
-		} else {
-			ASSERT_LOG(false, "Unrecognised direction: " << d);
-		}
-		return point(x, y);
+		return hex::neighbour(point(x, y), d);
 	}
 
 	point hex_map::loc_in_dir(int x, int y, const std::string& s)
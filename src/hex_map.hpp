@@ -21,6 +21,7 @@
 #include "castles.hpp"
 #include "geometry.hpp"
 #include "hex_fwd.hpp"
+#include "hex_grid.hpp"
 #include "hex_logical_tiles.hpp"
 #include "hex_object.hpp"
 #include "node.hpp"
@@ -68,7 +69,7 @@ namespace hex
 		int border_;
 		rectf screen_area_;
 		std::vector<castle::castle_ptr> castles_;
-		std::vector<hex_object> tiles_;
+		hex_grid<hex_object> tiles_;
 
 		hex_map(const hex_map&);
 		void operator=(const hex_map&);
@@ -0,0 +1,487 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+
+#include "asserts.hpp"
+#include "hex_landmarks.hpp"
+#include "hex_path_hierarchy.hpp"
+#include "node_utils.hpp"
+#include "unit_test.hpp"
+
+namespace hex
+{
+	namespace
+	{
+		template<typename T>
+		void push_open(std::vector<std::pair<T, int>>& open, T c, int n)
+		{
+			open.emplace_back(c, n);
+			std::push_heap(open.begin(), open.end(), std::greater<std::pair<T, int>>());
+		}
+
+		template<typename T>
+		std::pair<T, int> pop_open(std::vector<std::pair<T, int>>& open)
+		{
+			std::pop_heap(open.begin(), open.end(), std::greater<std::pair<T, int>>());
+			auto top = open.back();
+			open.pop_back();
+			return top;
+		}
+	}
+
+	void path_hierarchy::workspace::begin(size_t size)
+	{
+		distance.resize(size);
+		predecessor.resize(size);
+		visited.resize(size, 0);
+		if(++generation == 0) {
+			// generation counter wrapped, so the stamps need to be cleared.
+			std::fill(visited.begin(), visited.end(), 0);
+			generation = 1;
+		}
+		open.clear();
+	}
+
+	path_hierarchy::path_hierarchy(const logical::map_ptr& map, creature::MovementType mt, int cluster_size)
+		: map_(map),
+		  movement_type_(mt),
+		  cluster_size_(cluster_size),
+		  clusters_wide_(0),
+		  min_cost_(0)
+	{
+		ASSERT_LOG(map_ != nullptr, "No map given for the path hierarchy.");
+		ASSERT_LOG(cluster_size_ >= 2, "Cluster size for the path hierarchy must be at least 2: " << cluster_size_);
+
+		auto& costs = get_costs();
+		clusters_wide_ = (costs.width() + cluster_size_ - 1) / cluster_size_;
+		const int clusters_high = (costs.height() + cluster_size_ - 1) / cluster_size_;
+		for(int cy = 0; cy != clusters_high; ++cy) {
+			for(int cx = 0; cx != clusters_wide_; ++cx) {
+				const int x = cx * cluster_size_;
+				const int y = cy * cluster_size_;
+				clusters_.emplace_back(rect(costs.x() + x, costs.y() + y, 
+					std::min(cluster_size_, costs.width() - x), 
+					std::min(cluster_size_, costs.height() - y)));
+			}
+		}
+
+		update_min_cost();
+		build_entrances();
+		for(int c = 0; c != static_cast<int>(clusters_.size()); ++c) {
+			build_cluster_edges(c);
+		}
+	}
+
+	int path_hierarchy::get_cluster(const point& p) const
+	{
+		auto& costs = get_costs();
+		return ((p.y - costs.y()) / cluster_size_) * clusters_wide_ + (p.x - costs.x()) / cluster_size_;
+	}
+
+	int path_hierarchy::local_index(int c, const point& p) const
+	{
+		const rect& area = clusters_[c].area;
+		return (p.y - area.y()) * area.w() + (p.x - area.x());
+	}
+
+	int path_hierarchy::get_node(const point& p, int cluster)
+	{
+		const int ndx = get_costs().index(p);
+		auto it = node_at_.find(ndx);
+		if(it != node_at_.end()) {
+			return it->second;
+		}
+		const int n = static_cast<int>(nodes_.size());
+		nodes_.emplace_back(p, cluster);
+		clusters_[cluster].nodes.emplace_back(n);
+		node_at_[ndx] = n;
+		return n;
+	}
+
+	void path_hierarchy::build_entrances()
+	{
+		// The edges crossing between each pair of clusters, from the cluster with the lower
+		// index. Tiles are visited in row major order, so the edges are in order along the border.
+		std::map<std::pair<int, int>, std::vector<std::pair<point, point>>> borders;
+		auto& costs = get_costs();
+		for(int ndx = 0; ndx != static_cast<int>(costs.size()); ++ndx) {
+			const point p = costs.location(ndx);
+			const int c = get_cluster(p);
+			for(auto n : costs.neighbours(p)) {
+				const int nc = get_cluster(n);
+				if(nc > c) {
+					borders[std::make_pair(c, nc)].emplace_back(p, n);
+				}
+			}
+		}
+
+		// Borders are split into entrances of up to cluster_size_ edges and the middle edge of
+		// each entrance joins the clusters. No terrain is impassable, so the entrances only
+		// depend on the layout of the clusters and never need to be moved by repair().
+		for(auto& b : borders) {
+			auto& edges = b.second;
+			for(size_t start = 0; start < edges.size(); start += cluster_size_) {
+				const size_t end = std::min(edges.size(), start + cluster_size_);
+				const auto& e = edges[(start + end) / 2];
+				const int n1 = get_node(e.first, b.first.first);
+				const int n2 = get_node(e.second, b.first.second);
+				nodes_[n1].inter.emplace_back(n2);
+				nodes_[n2].inter.emplace_back(n1);
+			}
+		}
+	}
+
+	void path_hierarchy::build_cluster_edges(int c)
+	{
+		auto& cluster = clusters_[c];
+		for(int a : cluster.nodes) {
+			nodes_[a].intra.clear();
+			search_cluster(c, nodes_[a].p, false, nullptr);
+			for(int b : cluster.nodes) {
+				const int ndx = local_index(c, nodes_[b].p);
+				if(b != a && local_.visited[ndx] == local_.generation) {
+					nodes_[a].intra.emplace_back(b, local_.distance[ndx]);
+				}
+			}
+		}
+	}
+
+	void path_hierarchy::update_min_cost()
+	{
+		auto& costs = get_costs();
+		min_cost_ = costs.empty() ? logical::cost_scale : *std::min_element(costs.begin(), costs.end());
+	}
+
+	void path_hierarchy::search_cluster(int c, const point& src, bool reverse, const point* dst)
+	{
+		auto& costs = get_costs();
+		const rect& area = clusters_[c].area;
+		ASSERT_LOG(geometry::pointInRect(src, area), "Search source " << src << " isn't in cluster " << area);
+		local_.begin(area.w() * area.h());
+
+		auto heuristic = [this, dst](const point& p) {
+			return dst != nullptr ? static_cast<path_cost>(logical::distance(p, *dst)) * min_cost_ : 0;
+		};
+
+		const int src_ndx = local_index(c, src);
+		const int dst_ndx = dst != nullptr ? local_index(c, *dst) : -1;
+		local_.distance[src_ndx] = 0;
+		local_.predecessor[src_ndx] = src_ndx;
+		local_.visited[src_ndx] = local_.generation;
+		push_open(local_.open, heuristic(src), src_ndx);
+
+		while(!local_.open.empty()) {
+			auto top = pop_open(local_.open);
+			const int u = top.second;
+			if(u == dst_ndx) {
+				break;
+			}
+			const point p(area.x() + u % area.w(), area.y() + u / area.w());
+			if(top.first > local_.distance[u] + heuristic(p)) {
+				// stale entry.
+				continue;
+			}
+			for(auto n : neighbours(p)) {
+				if(!geometry::pointInRect(n, area)) {
+					continue;
+				}
+				const int v = local_index(c, n);
+				// Moving from one tile to another costs the same as entering the second one.
+				const path_cost d = local_.distance[u] + (reverse ? costs[p] : costs[n]);
+				if(local_.visited[v] != local_.generation || d < local_.distance[v]) {
+					local_.visited[v] = local_.generation;
+					local_.distance[v] = d;
+					local_.predecessor[v] = u;
+					push_open(local_.open, d + heuristic(n), v);
+				}
+			}
+		}
+	}
+
+	result_path path_hierarchy::find_waypoints(const point& src, const point& dst, float* total_cost)
+	{
+		auto& costs = get_costs();
+		ASSERT_LOG(costs.contains(src), "source node " << src << " not on the map.");
+		ASSERT_LOG(costs.contains(dst), "destination node " << dst << " not on the map.");
+		if(total_cost != nullptr) {
+			*total_cost = 0;
+		}
+		result_path res;
+		if(src == dst) {
+			res.emplace_back(src);
+			return res;
+		}
+
+		// The source and destination are joined to the nodes in their clusters for the
+		// duration of the search, through the cheapest paths inside those clusters.
+		const int src_cluster = get_cluster(src);
+		const int dst_cluster = get_cluster(dst);
+		const path_cost no_path = std::numeric_limits<path_cost>::max();
+		std::vector<std::pair<int, path_cost>> from_src;
+		path_cost direct = no_path;
+		search_cluster(src_cluster, src, false, nullptr);
+		for(int n : clusters_[src_cluster].nodes) {
+			const int ndx = local_index(src_cluster, nodes_[n].p);
+			if(local_.visited[ndx] == local_.generation) {
+				from_src.emplace_back(n, local_.distance[ndx]);
+			}
+		}
+		if(src_cluster == dst_cluster && local_.visited[local_index(src_cluster, dst)] == local_.generation) {
+			direct = local_.distance[local_index(src_cluster, dst)];
+		}
+		std::vector<std::pair<int, path_cost>> to_dst;
+		search_cluster(dst_cluster, dst, true, nullptr);
+		for(int n : clusters_[dst_cluster].nodes) {
+			const int ndx = local_index(dst_cluster, nodes_[n].p);
+			if(local_.visited[ndx] == local_.generation) {
+				to_dst.emplace_back(n, local_.distance[ndx]);
+			}
+		}
+
+		// A* over the abstract graph, with two extra nodes for the source and destination.
+		const int src_node = static_cast<int>(nodes_.size());
+		const int dst_node = src_node + 1;
+		auto& ws = abstract_;
+		ws.begin(nodes_.size() + 2);
+
+		auto location = [&](int n) -> const point& {
+			return n == src_node ? src : n == dst_node ? dst : nodes_[n].p;
+		};
+		const landmarks* lm = map_->get_landmarks(movement_type_).get();
+		auto heuristic = [&](int n) {
+			const path_cost h = static_cast<path_cost>(logical::distance(location(n), dst)) * min_cost_;
+			return lm != nullptr ? std::max(h, lm->lower_bound(location(n), dst)) : h;
+		};
+		auto relax = [&](int u, int v, path_cost d) {
+			if(ws.visited[v] != ws.generation || d < ws.distance[v]) {
+				ws.visited[v] = ws.generation;
+				ws.distance[v] = d;
+				ws.predecessor[v] = u;
+				push_open(ws.open, d + heuristic(v), v);
+			}
+		};
+
+		ws.distance[src_node] = 0;
+		ws.predecessor[src_node] = src_node;
+		ws.visited[src_node] = ws.generation;
+		push_open(ws.open, heuristic(src_node), src_node);
+
+		while(!ws.open.empty()) {
+			auto top = pop_open(ws.open);
+			const int u = top.second;
+			if(u == dst_node) {
+				break;
+			}
+			if(top.first > ws.distance[u] + heuristic(u)) {
+				// stale entry.
+				continue;
+			}
+			const path_cost du = ws.distance[u];
+			if(u == src_node) {
+				for(auto& e : from_src) {
+					relax(u, e.first, du + e.second);
+				}
+				if(direct != no_path) {
+					relax(u, dst_node, du + direct);
+				}
+				continue;
+			}
+			const node_t& nu = nodes_[u];
+			for(auto& e : nu.intra) {
+				relax(u, e.first, du + e.second);
+			}
+			for(int v : nu.inter) {
+				relax(u, v, du + costs[nodes_[v].p]);
+			}
+			if(nu.cluster == dst_cluster) {
+				for(auto& e : to_dst) {
+					if(e.first == u) {
+						relax(u, dst_node, du + e.second);
+					}
+				}
+			}
+		}
+
+		if(ws.visited[dst_node] != ws.generation) {
+			return res;
+		}
+		for(int v = dst_node;; v = ws.predecessor[v]) {
+			// Where the source or destination is on a node it would appear twice.
+			if(res.empty() || res.back() != location(v)) {
+				res.emplace_back(location(v));
+			}
+			if(v == src_node) {
+				break;
+			}
+		}
+		std::reverse(res.begin(), res.end());
+		if(total_cost != nullptr) {
+			*total_cost = static_cast<float>(ws.distance[dst_node]) / logical::cost_scale;
+		}
+		return res;
+	}
+
+	result_path path_hierarchy::refine(const point& from, const point& to)
+	{
+		result_path res;
+		if(from == to) {
+			return res;
+		}
+		// Entering to costs the same whichever way it is done, so a step can't be beaten.
+		if(logical::distance(from, to) == 1) {
+			res.emplace_back(to);
+			return res;
+		}
+		const int c = get_cluster(from);
+		ASSERT_LOG(get_cluster(to) == c, "Path legs must be inside one cluster: " << from << " to " << to);
+		search_cluster(c, from, false, &to);
+
+		const rect& area = clusters_[c].area;
+		const int from_ndx = local_index(c, from);
+		const int to_ndx = local_index(c, to);
+		ASSERT_LOG(local_.visited[to_ndx] == local_.generation, "No path from " << from << " to " << to << " inside cluster " << area);
+		for(int v = to_ndx; v != from_ndx; v = local_.predecessor[v]) {
+			res.emplace_back(area.x() + v % area.w(), area.y() + v / area.w());
+		}
+		std::reverse(res.begin(), res.end());
+		return res;
+	}
+
+	result_path path_hierarchy::find_path(const point& src, const point& dst, float* total_cost)
+	{
+		const result_path waypoints = find_waypoints(src, dst, total_cost);
+		result_path res;
+		if(waypoints.empty()) {
+			return res;
+		}
+		res.emplace_back(waypoints.front());
+		for(size_t n = 1; n < waypoints.size(); ++n) {
+			const result_path leg = refine(waypoints[n - 1], waypoints[n]);
+			res.insert(res.end(), leg.begin(), leg.end());
+		}
+		return res;
+	}
+
+	void path_hierarchy::repair(const rect& area)
+	{
+		// Only lowering the minimum is needed, leaving it lower than it could be keeps the
+		// heuristics admissible.
+		auto& costs = get_costs();
+		const rect r = geometry::intersection_rect(area, costs.area());
+		for(int y = r.y(); y < r.y2(); ++y) {
+			for(int x = r.x(); x < r.x2(); ++x) {
+				min_cost_ = std::min(min_cost_, costs[point(x, y)]);
+			}
+		}
+		for(int c = 0; c != static_cast<int>(clusters_.size()); ++c) {
+			if(geometry::rects_intersect(clusters_[c].area, r)) {
+				build_cluster_edges(c);
+			}
+		}
+	}
+}
+
+namespace
+{
+	float path_cost(const hex::logical::map_ptr& m, const hex::result_path& path)
+	{
+		float res = 0;
+		for(size_t n = 1; n < path.size(); ++n) {
+			res += m->get_tile_at(path[n])->get_cost();
+		}
+		return res;
+	}
+}
+
+UNIT_TEST(hex_path_hierarchy)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	tiles.add("hill", node_builder().add("name", "Hill").add("cost", 3.0).build());
+	tiles.add("mountain", node_builder().add("name", "Mountain").add("cost", 20.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+
+	// A wall of mountains with a gap in it, plus some scattered hills.
+	const int width = 45, height = 38;
+	node_builder mb;
+	mb.add("x", 2);
+	mb.add("y", -3);
+	mb.add("width", width);
+	for(int y = 0; y != height; ++y) {
+		for(int x = 0; x != width; ++x) {
+			const bool wall = x == 20 && y != 30;
+			mb.add("tiles", wall ? "mountain" : (x * 7 + y * 13) % 11 == 0 ? "hill" : "flat");
+		}
+	}
+	auto m = hex::logical::map::factory(mb.build());
+	game::state gs;
+	gs.set_map(m);
+	auto g = hex::create_graph(gs, gs.create_team_instance("a"), creature::MovementType::NORMAL, m->x(), m->y(), m->width(), m->height());
+
+	hex::path_hierarchy hpa(m, creature::MovementType::NORMAL, 8);
+	CHECK_EQ(hpa.get_cluster_count(), 6 * 5);
+
+	const std::pair<point, point> queries[] = {
+		std::make_pair(point(2, -3), point(46, 34)),
+		std::make_pair(point(10, 0), point(40, 1)),
+		std::make_pair(point(44, 30), point(3, 2)),
+		std::make_pair(point(5, 5), point(8, 7)),
+		std::make_pair(point(9, 4), point(9, 4)),
+	};
+	for(auto& q : queries) {
+		float total = -1.0f;
+		auto path = hpa.find_path(q.first, q.second, &total);
+		CHECK_EQ(path.front(), q.first);
+		CHECK_EQ(path.back(), q.second);
+		for(size_t n = 1; n < path.size(); ++n) {
+			CHECK_EQ(hex::logical::distance(path[n - 1], path[n]), 1);
+			CHECK_EQ(m->contains(path[n]), true);
+		}
+		CHECK_EQ(path_cost(m, path), total);
+		// Not always the cheapest path, but never far off it.
+		const float best = path_cost(m, hex::find_path(g, q.first, q.second));
+		CHECK_GE(total, best);
+		CHECK_LE(total, best * 1.25f);
+
+		// Refining the waypoints one at a time gives the same path.
+		auto waypoints = hpa.find_waypoints(q.first, q.second);
+		hex::result_path refined(1, waypoints.front());
+		for(size_t n = 1; n < waypoints.size(); ++n) {
+			auto leg = hpa.refine(waypoints[n - 1], waypoints[n]);
+			refined.insert(refined.end(), leg.begin(), leg.end());
+		}
+		CHECK_EQ(refined.size(), path.size());
+	}
+
+	// Paths through the gap in the wall have to go over the mountains once it's filled in.
+	float before = 0;
+	auto path = hpa.find_path(point(10, 20), point(40, 22), &before);
+	CHECK_EQ(std::find(path.begin(), path.end(), point(22, 27)) != path.end(), true);
+	m->set_tile_at(point(22, 27), hex::logical::tile::factory("mountain"));
+	hpa.repair(rect(22, 27, 1, 1));
+	float after = 0;
+	path = hpa.find_path(point(10, 20), point(40, 22), &after);
+	CHECK_EQ(std::find(path.begin(), path.end(), point(22, 27)) == path.end(), true);
+	CHECK_GT(after, before);
+	hex::path_hierarchy rebuilt(m, creature::MovementType::NORMAL, 8);
+	float expected = 0;
+	rebuilt.find_path(point(10, 20), point(40, 22), &expected);
+	CHECK_EQ(after, expected);
+}
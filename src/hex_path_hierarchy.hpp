@@ -0,0 +1,133 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "creature_fwd.hpp"
+#include "geometry.hpp"
+#include "hex_grid.hpp"
+#include "hex_logical_tiles.hpp"
+#include "hex_pathfinding.hpp"
+
+namespace hex
+{
+	const int default_cluster_size = 16;
+
+	// Hierarchical path finding (HPA*) over a whole map, for paths that are too long to
+	// search for tile by tile, e.g. across the larger maps.
+	//
+	// The map is cut into square clusters of tiles. Where two clusters meet the crossing
+	// edges are split into entrances, each of which has a pair of tiles (one either side)
+	// which are nodes in an abstract graph. Nodes in the same cluster are joined by the cost
+	// of the cheapest path between them that stays inside the cluster, so a long path is
+	// found by searching the abstract graph and then only the legs of it that are needed
+	// have to be refined into tiles, by searches confined to a single cluster.
+	//
+	// Paths only depend on the terrain, units are ignored. The paths found aren't guaranteed
+	// to be the cheapest, but are usually close to it. None of the methods are thread safe,
+	// since the search workspace is kept with the hierarchy.
+	class path_hierarchy
+	{
+	public:
+		path_hierarchy(const logical::map_ptr& map, creature::MovementType mt, int cluster_size=default_cluster_size);
+
+		creature::MovementType get_movement_type() const { return movement_type_; }
+		int get_cluster_size() const { return cluster_size_; }
+		int get_cluster_count() const { return static_cast<int>(clusters_.size()); }
+		int get_node_count() const { return static_cast<int>(nodes_.size()); }
+
+		// Path of tiles from src to dst, including both. If total_cost is given it is set
+		// to the cost of the path.
+		result_path find_path(const point& src, const point& dst, float* total_cost=nullptr);
+		// The abstract path from src to dst, that is src, the entrance tiles passed through
+		// and dst. Refining each leg in turn gives the same path as find_path(), so the tiles
+		// only need to be found for as much of the path as is going to be used.
+		result_path find_waypoints(const point& src, const point& dst, float* total_cost=nullptr);
+		// The tiles for one leg of the path returned by find_waypoints(), not including from.
+		result_path refine(const point& from, const point& to);
+
+		// Call when the terrain in area has changed (i.e. logical::map::set_tile_at() has
+		// been used). Only the clusters overlapping area are updated.
+		void repair(const rect& area);
+	private:
+		typedef uint32_t path_cost;
+
+		struct node_t
+		{
+			node_t(const point& pp, int c) : p(pp), cluster(c) {}
+			point p;
+			int cluster;
+			// Other nodes in the same cluster and the cost of the cheapest path to them
+			// which stays inside the cluster.
+			std::vector<std::pair<int, path_cost>> intra;
+			// Adjacent nodes in neighbouring clusters, the cost of the edge is the cost of
+			// entering the tile so is read from the cost grid.
+			std::vector<int> inter;
+		};
+
+		struct cluster_t
+		{
+			explicit cluster_t(const rect& r) : area(r) {}
+			rect area;
+			std::vector<int> nodes;
+		};
+
+		// Search workspace, entries are only valid where visited[n] == generation.
+		struct workspace
+		{
+			workspace() : generation(0) {}
+			void begin(size_t size);
+			std::vector<path_cost> distance;
+			std::vector<int> predecessor;
+			std::vector<uint32_t> visited;
+			uint32_t generation;
+			std::vector<std::pair<path_cost, int>> open;
+		};
+
+		const hex_grid<logical::fixed_cost>& get_costs() const { return map_->get_cost_grid(movement_type_); }
+		int get_cluster(const point& p) const;
+		int get_node(const point& p, int cluster);
+		void build_entrances();
+		void build_cluster_edges(int c);
+		void update_min_cost();
+		// Cheapest paths inside cluster c starting from src. If reverse is set the paths
+		// end at src instead. If dst is given the search stops once it has been reached.
+		void search_cluster(int c, const point& src, bool reverse, const point* dst);
+		int local_index(int c, const point& p) const;
+
+		logical::map_ptr map_;
+		creature::MovementType movement_type_;
+		int cluster_size_;
+		int clusters_wide_;
+		std::vector<cluster_t> clusters_;
+		std::vector<node_t> nodes_;
+		// Maps the index of a tile in the cost grid to the node on it.
+		std::unordered_map<int, int> node_at_;
+		// Cheapest tile, used to keep the heuristics admissible.
+		logical::fixed_cost min_cost_;
+
+		workspace local_;
+		workspace abstract_;
+
+		path_hierarchy(const path_hierarchy&) = delete;
+		void operator=(const path_hierarchy&) = delete;
+	};
+}
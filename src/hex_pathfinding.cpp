@@ -14,26 +14,133 @@
 	limitations under the License.
 */
 
-#include <boost/graph/dijkstra_shortest_paths.hpp>
-#include <boost/graph/graph_traits.hpp>
-#include <boost/property_map/property_map.hpp>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <mutex>
 
+#include "asserts.hpp"
+#include "hex_landmarks.hpp"
 #include "hex_logical_tiles.hpp"
 #include "hex_pathfinding.hpp"
+#include "node_utils.hpp"
 #include "profile_timer.hpp"
+#include "unit_test.hpp"
 #include "units.hpp"
 
 namespace hex
 {
-	// XXX Modify these to work with hex::logical::map
+	namespace
+	{
+		// Upper bound on the number of idle graphs we hold on to.
+		const size_t max_pooled_graphs = 8;
+
+		hex_graph_ptr get_pooled_graph()
+		{
+			static std::mutex pool_mutex;
+			static std::vector<hex_graph_ptr> pool;
+
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			// A graph with a use count of one is only referenced by the pool, so free to hand out.
+			for(auto& g : pool) {
+				if(g.use_count() == 1) {
+					return g;
+				}
+			}
+			auto g = std::make_shared<graph_t>();
+			if(pool.size() < max_pooled_graphs) {
+				pool.emplace_back(g);
+			}
+			return g;
+		}
+
+		void begin_search(graph_t& g)
+		{
+			g.distance.resize(g.weights.size());
+			g.predecessor.resize(g.weights.size());
+			g.visited.resize(g.weights.size(), 0);
+			if(++g.generation == 0) {
+				// generation counter wrapped, so the stamps need to be cleared.
+				std::fill(g.visited.begin(), g.visited.end(), 0);
+				g.generation = 1;
+			}
+			g.open.clear();
+		}
+
+		void push_open(graph_t& g, int ndx, cost c)
+		{
+			g.open.emplace_back(c, ndx);
+			std::push_heap(g.open.begin(), g.open.end(), std::greater<std::pair<cost, int>>());
+		}
+
+		std::pair<cost, int> pop_open(graph_t& g)
+		{
+			std::pop_heap(g.open.begin(), g.open.end(), std::greater<std::pair<cost, int>>());
+			auto res = g.open.back();
+			g.open.pop_back();
+			return res;
+		}
+
+		// Calls fn(neighbour_index) for each tile that can be moved to from the tile at ndx.
+		template<typename F>
+		void for_each_edge(const graph_t& g, int ndx, F fn)
+		{
+			const bool src_zoc = (g.flags[ndx] & TILE_ZOC) != 0;
+			for(auto n : g.weights.neighbours(g.location(ndx))) {
+				const int nndx = g.index(n);
+				const uint8_t f = g.flags[nndx];
+				if((f & TILE_ENEMY) || (src_zoc && (f & TILE_ZOC))) {
+					continue;
+				}
+				fn(nndx);
+			}
+		}
+
+		void check_source(const graph_t& g, const point& src)
+		{
+			ASSERT_LOG(g.contains(src), "source node " << src << " not in graph.");
+			ASSERT_LOG((g.flags[g.index(src)] & TILE_ENEMY) == 0, "source node " << src << " is occupied by an enemy.");
+		}
+	}
+
+	graph_t::graph_t()
+		: movement_type(creature::MovementType::NORMAL),
+		  min_weight(1.0f),
+		  generation(0),
+		  tree_generation(0),
+		  tree_max_cost(0)
+	{
+	}
+
 	hex_graph_ptr create_graph(const game::state& gs, int x, int y, int w, int h)
 	{
-		//profile::manager pman("create_graph");
-		
-		std::vector<point> vertices;
-		std::vector<edge> edges;
-		std::vector<cost> weights;
+		auto& u = gs.get_entities().front();
+		return create_graph(gs, u->get_owner()->team(), u->get_movement_type(), x, y, w, h);
+	}
+
+	void set_movement_type(hex_graph_ptr graph, creature::MovementType mt)
+	{
+		graph_t& g = *graph;
+		g.movement_type = mt;
+		g.min_weight = std::numeric_limits<cost>::max();
+		// Any move tree left in the workspace was found with the old costs.
+		g.tree_generation = 0;
+
+		const int size = static_cast<int>(g.weights.size());
+		auto& costs = g.map->get_cost_grid(mt);
+		for(int ndx = 0; ndx != size; ++ndx) {
+			const cost c = logical::to_cost(costs[g.location(ndx)]);
+			g.weights[ndx] = c;
+			g.min_weight = std::min(g.min_weight, c);
+		}
+		if(size == 0) {
+			g.min_weight = 1.0f;
+		}
+	}
 
+	hex_graph_ptr create_graph(const game::state& gs, const team_ptr& team_current, creature::MovementType mt, int x, int y, int w, int h)
+	{
+		//profile::manager pman("create_graph");
 		auto& map = gs.get_map();
 
 		if(w == 0) {
@@ -42,83 +149,32 @@ namespace hex
 		if(h == 0) {
 			h = map->height();
 		}
+		// Clip the requested area to the map.
+		const int x1 = std::max(x, map->x());
+		const int y1 = std::max(y, map->y());
+		const int x2 = std::min(x + w, map->x() + map->width());
+		const int y2 = std::min(y + h, map->y() + map->height());
 
-		// Scan through enemy entities add to dictionary keyed on position.
-		// For each valid surrounding position of the enemy entity add this to a set of positions.
-		// enemies on a tile make that tile unavailable as a desitination.
-		// surrounding positions have no edges from them to other nodes. other nodes may
-		// have edges to them.
-		// XXX todo.
-
-		//std::set<point> friendly_units;
-		std::map<point, game::unit_ptr> enemy_units;
-		std::set<point> surrounding_positions;
-		auto cp = gs.get_entities().front()->get_owner();
-		for(auto& u : gs.get_entities()) {
-			auto owner = u->get_owner();
-			auto& pos = u->get_position();
-			if(cp->team() != owner->team()) {
-				enemy_units[pos] = u;
-				auto surrounds = map->get_surrounding_positions(pos.x, pos.y);
-				for(auto& t : surrounds) {
-					surrounding_positions.emplace(t);
-				}
-			} else {
-				//friendly_units.emplace(pos);
-			}
-		}
-		// remove enemy entities from surrounding positions
-		auto team_current = gs.get_entities().front()->get_owner()->team();
-		for(auto& e : gs.get_entities()) {
-			auto e_team = e->get_owner()->team();
-			if(e_team != team_current) {
-				auto it = surrounding_positions.find(e->get_position());
-				if(it != surrounding_positions.end()) {
-					surrounding_positions.erase(it);
-				}
-			}
-		}
+		hex_graph_ptr graph = get_pooled_graph();
+		graph->map = map;
+		const rect area(x1, y1, std::max(0, x2 - x1), std::max(0, y2 - y1));
+		graph->weights.reset(area);
+		graph->flags.reset(area, 0);
+		set_movement_type(graph, mt);
 
-		std::map<point, int> reverse_map;
-
-		// find vertices and edges to construct the graph.
-		vertices.reserve(w*h);
-		for(int m = y; m != y+h; ++m) {
-			for(int n = x; n != x+w; ++n) {
-				point n1(n, m);
-				auto surrounds = map->get_surrounding_positions(n1);
-				// scan through entities for units at t
-				auto it = enemy_units.find(n1);
-				if(it == enemy_units.end()) {
-					vertices.emplace_back(n1);
-					reverse_map[n1] = vertices.size()-1;
-					for(auto& n2 : surrounds) {
-						if(n2.x >= x && n2.x < x+w 
-							&& n2.y >= y && n2.y < y+h
-							&& enemy_units.find(n2) == enemy_units.end()) {
-							const bool src_node_zoc = surrounding_positions.find(n1) != surrounding_positions.end();
-							const bool dst_node_zoc = surrounding_positions.find(n2) != surrounding_positions.end();
-							if(!src_node_zoc || !dst_node_zoc) {
-								//std::cerr << "Adding edge from " << n1 << " to " << n2 << "\n";
-								edges.emplace_back(n1, n2);
-								weights.emplace_back(map->get_tile_at(n2)->get_cost());
-							}
-						}
-					}
-				}
-			}
-		}
+		const int size = static_cast<int>(graph->weights.size());
 
-		hex_graph_ptr graph = std::make_shared<graph_t>(vertices.size());
-		graph->reverse_map.swap(reverse_map);
-		graph->vertices.swap(vertices);
-		WeightMap weightmap = boost::get(boost::edge_weight, graph->graph);
-		size_t n = 0;
-		for(auto& ep : edges) {
-			edge_descriptor e;
-			bool inserted;
-			boost::tie(e, inserted) = boost::add_edge(graph->reverse_map[ep.first], graph->reverse_map[ep.second], graph->graph);
-			weightmap[e] = map->get_tile_at(graph->vertices[e.m_target])->get_cost();//weights[n++];
+		// Enemies on a tile make that tile unavailable as a destination. Tiles surrounding
+		// an enemy are under its zone of control, moving from one such tile to another isn't
+		// allowed, though other tiles may have edges to them.
+		auto& occ = gs.get_occupancy();
+		for(int ndx = 0; ndx != size; ++ndx) {
+			const point p = graph->location(ndx);
+			if(occ.is_enemy_at(p, team_current)) {
+				graph->flags[ndx] = TILE_ENEMY;
+			} else if(occ.is_enemy_zoc(p, team_current)) {
+				graph->flags[ndx] = TILE_ZOC;
+			}
 		}
 
 		return graph;
@@ -153,95 +209,215 @@ namespace hex
 	result_list find_available_moves(hex_graph_ptr graph, const point& src, float max_cost)
 	{
 		//profile::manager pman("find_available_moves");
-		
-		result_list res;
+		graph_t& g = *graph;
+		check_source(g, src);
+		begin_search(g);
 
-		std::vector<cost> d(boost::num_vertices(graph->graph));
-		std::vector<vertex> p(boost::num_vertices(graph->graph));
-		boost::dijkstra_shortest_paths(graph->graph, graph->reverse_map[src],
-			boost::predecessor_map(boost::make_iterator_property_map(p.begin(), boost::get(boost::vertex_index, graph->graph)))
-				.distance_map(boost::make_iterator_property_map(d.begin(), boost::get(boost::vertex_index, graph->graph))));
-		
-		boost::graph_traits<hex_graph>::vertex_iterator vi, vend;
-		for (boost::tie(vi, vend) = boost::vertices(graph->graph); vi != vend; ++vi) {
-			if(d[*vi] < max_cost) {
-				res.emplace_back(graph->vertices[*vi], d[*vi]);
+		const int src_ndx = g.index(src);
+		g.distance[src_ndx] = 0;
+		g.predecessor[src_ndx] = src_ndx;
+		g.visited[src_ndx] = g.generation;
+		push_open(g, src_ndx, 0);
+
+		while(!g.open.empty()) {
+			auto top = pop_open(g);
+			if(top.first > g.distance[top.second]) {
+				// stale entry.
+				continue;
+			}
+			if(top.first >= max_cost) {
+				// Everything left in the open list is out of range.
+				break;
 			}
+			for_each_edge(g, top.second, [&g, &top](int n) {
+				const cost d = top.first + g.weights[n];
+				if(g.visited[n] != g.generation || d < g.distance[n]) {
+					g.visited[n] = g.generation;
+					g.distance[n] = d;
+					g.predecessor[n] = top.second;
+					push_open(g, n, d);
+				}
+			});
 		}
 
-		// remove tiles that have friendly entities on them, from the results.
-		/*res.erase(std::remove_if(res.begin(), res.end(), [&friendly_units](const hex_object* t){ 
-			return friendly_units.find(point(t->x(), t->y())) != friendly_units.end();
-		}), res.end());*/
+		g.tree_generation = g.generation;
+		g.tree_source = src;
+		g.tree_max_cost = max_cost;
 
+		result_list res;
+		for(int n = 0; n != static_cast<int>(g.visited.size()); ++n) {
+			if(g.visited[n] == g.generation && g.distance[n] < max_cost) {
+				res.emplace_back(g.location(n), g.distance[n]);
+			}
+		}
 		return res;
 	}
 
+	result_path find_path(hex_graph_ptr graph, const point& src, const point& dst)
+	{
+		//profile::manager pman("find_path");
+		graph_t& g = *graph;
+		check_source(g, src);
+		ASSERT_LOG(g.contains(dst), "destination node " << dst << " not in graph.");
+		begin_search(g);
+
+		// Hex distance multiplied by the cheapest tile cost never over-estimates, nor do the
+		// landmark bounds, which are usually much closer since they allow for the terrain.
+		const landmarks* lm = g.map->get_landmarks(g.movement_type).get();
+		auto heuristic = [&g, &dst, lm](int n) {
+			const point p = g.location(n);
+			const cost h = static_cast<cost>(logical::distance(p, dst)) * g.min_weight;
+			return lm != nullptr ? std::max(h, static_cast<cost>(lm->lower_bound(p, dst)) / logical::cost_scale) : h;
+		};
 
-	struct found_goal {}; // exception for termination
+		const int src_ndx = g.index(src);
+		const int dst_ndx = g.index(dst);
+		g.distance[src_ndx] = 0;
+		g.predecessor[src_ndx] = src_ndx;
+		g.visited[src_ndx] = g.generation;
+		push_open(g, src_ndx, heuristic(src_ndx));
 
-	// visitor that terminates when we find the goal
-	template<typename Vertex>
-	class astar_goal_visitor : public boost::default_astar_visitor
-	{
-	public:
-		astar_goal_visitor(Vertex goal) : goal_(goal) {}
-		template<typename Graph> void examine_vertex(Vertex u, Graph& g) {
-			if(u == goal_) {
-				throw found_goal();
+		while(!g.open.empty()) {
+			auto top = pop_open(g);
+			const int u = top.second;
+			if(u == dst_ndx) {
+				result_path shortest_path;
+				for(int v = dst_ndx;; v = g.predecessor[v]) {
+					shortest_path.emplace_back(g.location(v));
+					if(g.predecessor[v] == v) {
+						std::reverse(shortest_path.begin(), shortest_path.end());
+						return shortest_path;
+					}
+				}
+			}
+			if(top.first > g.distance[u] + heuristic(u)) {
+				// stale entry.
+				continue;
 			}
+			for_each_edge(g, u, [&](int n) {
+				const cost d = g.distance[u] + g.weights[n];
+				if(g.visited[n] != g.generation || d < g.distance[n]) {
+					g.visited[n] = g.generation;
+					g.distance[n] = d;
+					g.predecessor[n] = u;
+					push_open(g, n, d + heuristic(n));
+				}
+			});
 		}
-	private:
-		Vertex goal_;
-	};
+		return result_path();
+	}
 
-	template <class Graph, class CostType>
-	class astar_heuristic : public std::unary_function<typename boost::graph_traits<Graph>::vertex_descriptor, CostType>
+	result_path find_path_in_moves(hex_graph_ptr graph, const point& src, const point& dst)
 	{
-	public:
-		typedef typename boost::graph_traits<Graph>::vertex_descriptor Vertex;
-		astar_heuristic(Vertex goal, const std::vector<point>& vertices) 
-			: goal_x_(vertices[goal].x), 
-			  goal_y_(vertices[goal].y), 
-			  vertices_(vertices) {}
-		CostType operator()(Vertex u) 
-		{ 
-			const auto u_x = vertices_[u].x;
-			const auto u_y = vertices_[u].y;
-			return static_cast<CostType>((abs(u_x - goal_x_) + abs(u_y - goal_y_) + abs(u_x + u_y - goal_x_ - goal_y_)) / 2.0f);
-		}
-	private:
-		int goal_x_;
-		int goal_y_;
-		const std::vector<point>& vertices_;
-	};
+		graph_t& g = *graph;
+		if(g.generation == 0 || g.tree_generation != g.generation || g.tree_source != src) {
+			return find_path(graph, src, dst);
+		}
+		if(!g.contains(dst)) {
+			return result_path();
+		}
+		const int dst_ndx = g.index(dst);
+		if(g.visited[dst_ndx] != g.generation || g.distance[dst_ndx] >= g.tree_max_cost) {
+			return result_path();
+		}
+		result_path shortest_path;
+		for(int v = dst_ndx;; v = g.predecessor[v]) {
+			shortest_path.emplace_back(g.location(v));
+			if(g.predecessor[v] == v) {
+				break;
+			}
+		}
+		std::reverse(shortest_path.begin(), shortest_path.end());
+		return shortest_path;
+	}
 
-	result_path find_path(hex_graph_ptr graph, const point& src, const point& dst)
+	std::vector<int> find_distance_field(hex_graph_ptr graph, const std::vector<point>& sources)
 	{
-		//profile::manager pman("find_path");
-
-		auto src_it = graph->reverse_map.find(src);
-		ASSERT_LOG(src_it != graph->reverse_map.end(), "source node not in graph.");
-		auto dst_it = graph->reverse_map.find(dst);
-		ASSERT_LOG(dst_it != graph->reverse_map.end(), "destination node not in graph.");
-
-		std::vector<vertex> p(boost::num_vertices(graph->graph));
-		std::vector<cost> d(boost::num_vertices(graph->graph));
-		try {
-			boost::astar_search_tree(graph->graph, src_it->second, astar_heuristic<hex_graph, cost>(dst_it->second, graph->vertices), 
-				boost::predecessor_map(boost::make_iterator_property_map(p.begin(), boost::get(boost::vertex_index, graph->graph))).
-				distance_map(boost::make_iterator_property_map(d.begin(), boost::get(boost::vertex_index, graph->graph))).
-				visitor(astar_goal_visitor<vertex>(dst_it->second)));
-		} catch(found_goal /*fg*/) {
-			result_path shortest_path;
-			for(vertex v = dst_it->second;; v = p[v]) {
-				shortest_path.emplace_back(graph->vertices[v]);
-				if(p[v] == v) {
-					std::reverse(shortest_path.begin(), shortest_path.end());
-					return shortest_path;
+		const graph_t& g = *graph;
+		std::vector<int> field(g.weights.size(), std::numeric_limits<int>::max());
+		// Breadth first, so the field doubles as the visited set and the queue never needs
+		// more than one slot per tile.
+		std::vector<int> queue;
+		queue.reserve(g.weights.size());
+		for(auto& src : sources) {
+			if(g.contains(src) && field[g.index(src)] != 0) {
+				field[g.index(src)] = 0;
+				queue.emplace_back(g.index(src));
+			}
+		}
+		for(size_t head = 0; head != queue.size(); ++head) {
+			const int ndx = queue[head];
+			for(auto n : g.weights.neighbours(g.location(ndx))) {
+				if(field[g.index(n)] == std::numeric_limits<int>::max()) {
+					field[g.index(n)] = field[ndx] + 1;
+					queue.emplace_back(g.index(n));
 				}
 			}
 		}
-		return result_path();
+		return field;
+	}
+}
+
+UNIT_TEST(hex_pathfinding)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	tiles.add("hill", node_builder().add("name", "Hill").add("cost", 3.0).add("costs", node_builder().add("flying", 1.0).build()).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+
+	node_builder mb;
+	mb.add("width", 5);
+	for(int n = 0; n != 25; ++n) {
+		mb.add("tiles", n == 7 ? "hill" : "flat");
 	}
+
+	game::state gs;
+	gs.set_map(hex::logical::map::factory(mb.build()));
+	auto p1 = std::make_shared<player>(gs.create_team_instance("a"), PlayerType::NORMAL, "p1");
+	auto p2 = std::make_shared<player>(gs.create_team_instance("b"), PlayerType::NORMAL, "p2");
+	gs.add_player(p1);
+	gs.add_player(p2);
+	auto u1 = std::make_shared<game::unit>("u1", nullptr, p1);
+	u1->set_position(0, 0);
+	u1->set_initiative(1.0f);
+	gs.add_unit(u1);
+	auto u2 = std::make_shared<game::unit>("u2", nullptr, p2);
+	u2->set_position(4, 4);
+	gs.add_unit(u2);
+
+	auto g = hex::create_graph(gs);
+	auto moves = hex::find_available_moves(g, point(0, 0), 3.5f);
+	for(auto& mc : moves) {
+		CHECK_GE(mc.path_cost, static_cast<float>(hex::logical::distance(point(0, 0), mc.loc)));
+		CHECK_NE(mc.loc, point(2, 1));
+		CHECK_NE(mc.loc, point(4, 4));
+	}
+	CHECK_EQ(moves.size(), 10);
+
+	// Path around the hill is cheaper than going over it.
+	auto path = hex::find_path(g, point(0, 0), point(3, 1));
+	CHECK_EQ(path.front(), point(0, 0));
+	CHECK_EQ(path.back(), point(3, 1));
+	CHECK_EQ(path.size(), 5);
+	CHECK_EQ(std::find(path.begin(), path.end(), point(2, 1)) == path.end(), true);
+
+	// The path read back from the move tree costs the same as the searched one.
+	moves = hex::find_available_moves(g, point(0, 0), 6.0f);
+	auto tree_path = hex::find_path_in_moves(g, point(0, 0), point(3, 1));
+	CHECK_EQ(tree_path.front(), point(0, 0));
+	CHECK_EQ(tree_path.back(), point(3, 1));
+	CHECK_EQ(tree_path.size(), path.size());
+	CHECK_EQ(hex::find_path_in_moves(g, point(0, 0), point(4, 4)).empty(), true);
+
+	// Tiles holding enemies can't be reached.
+	CHECK_EQ(hex::find_path(g, point(0, 0), point(4, 4)).empty(), true);
+
+	// Flyers go straight over the hill.
+	auto& flying_costs = gs.get_map()->get_cost_grid(creature::MovementType::FLYING);
+	CHECK_EQ(flying_costs[point(2, 1)], hex::logical::cost_scale);
+	CHECK_EQ(gs.get_map()->get_cost_grid(creature::MovementType::NORMAL)[point(2, 1)], 3 * hex::logical::cost_scale);
+	hex::set_movement_type(g, creature::MovementType::FLYING);
+	CHECK_EQ(hex::find_path_in_moves(g, point(0, 0), point(3, 1)).size(), 4);
+	moves = hex::find_available_moves(g, point(0, 0), 3.5f);
+	CHECK_EQ(std::find_if(moves.begin(), moves.end(), [](const hex::move_cost& mc) { return mc.loc == point(2, 1); }) != moves.end(), true);
 }
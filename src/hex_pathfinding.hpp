@@ -16,37 +16,86 @@
 
 #pragma once
 
-#include <tuple>
-#include <boost/graph/astar_search.hpp>
-#include <boost/graph/adjacency_list.hpp>
+#include <cstdint>
+#include <vector>
 
+#include "creature_fwd.hpp"
 #include "geometry.hpp"
 #include "game_state.hpp"
+#include "hex_grid.hpp"
 #include "hex_logical_fwd.hpp"
 
 namespace hex
 {
 	typedef float cost;
-	typedef point node_type;
-	typedef boost::adjacency_list<boost::listS, boost::vecS, boost::undirectedS, boost::no_property, boost::property<boost::edge_weight_t, cost>> hex_graph;
-	typedef boost::property_map<hex_graph, boost::edge_weight_t>::type WeightMap;
-	typedef hex_graph::vertex_descriptor vertex;
-	typedef hex_graph::edge_descriptor edge_descriptor;
-	typedef std::pair<point, point> edge;
 
+	enum TileFlags
+	{
+		// Tile has an enemy unit on it, it can't be entered.
+		TILE_ENEMY		= 1 << 0,
+		// Tile is adjacent to an enemy unit. Moving between two such tiles isn't allowed.
+		TILE_ZOC		= 1 << 1,
+	};
+
+	// The graph is implicit. Tiles inside the area are stored densely in hex grids and neighbours
+	// are generated from the odd-q offsets, so building a graph only means copying the tile costs
+	// for one movement type out of the maps cost grid and marking the occupied/ZoC tiles. The
+	// search scratch space lives with the graph and graphs are pooled, so repeated queries don't
+	// allocate.
 	struct graph_t
 	{
-		graph_t(size_t size) : graph(size) {}
-		hex_graph graph;
-		std::map<point, int> reverse_map;
-		std::vector<point> vertices;
+		graph_t();
+
+		int index(const point& p) const { return weights.index(p); }
+		point location(int ndx) const { return weights.location(ndx); }
+		bool contains(const point& p) const { return weights.contains(p); }
+		// Area of the map covered by the graph.
+		const rect& area() const { return weights.area(); }
+
+		logical::map_ptr map;
+		creature::MovementType movement_type;
+		// Cost of moving into each tile for movement_type.
+		hex_grid<cost> weights;
+		// TileFlags for each tile.
+		hex_grid<uint8_t> flags;
+		// Smallest value in weights, used to keep the A* heuristic admissible.
+		cost min_weight;
+
+		// Search workspace. Entries are only valid where visited[n] == generation.
+		std::vector<cost> distance;
+		std::vector<int> predecessor;
+		std::vector<uint32_t> visited;
+		uint32_t generation;
+		std::vector<std::pair<cost, int>> open;
+
+		// Set by find_available_moves, the workspace holds its shortest path tree for as long
+		// as generation == tree_generation, i.e. until the next search on the graph.
+		uint32_t tree_generation;
+		point tree_source;
+		cost tree_max_cost;
 	};
-	typedef std::shared_ptr<graph_t> hex_graph_ptr;
 
 	typedef std::vector<point> result_path;
 
+	// Graphs created from the game state alone are for the unit whose turn it is, both for its
+	// team and its movement type.
 	hex_graph_ptr create_cost_graph(const game::state& gs, const point& src, float max_cost);
 	hex_graph_ptr create_graph(const game::state& gs, int x=0, int y=0, int w=0, int h=0);
+	// As above, but enemies and zones of control are relative to the given team rather than
+	// the team of the unit whose turn it is.
+	hex_graph_ptr create_graph(const game::state& gs, const team_ptr& team, creature::MovementType mt, int x=0, int y=0, int w=0, int h=0);
+	// Changes the tile costs of the graph to those of another movement type, keeping the rest
+	// of the graph. Only the weights are copied, so it is much cheaper than building a new one.
+	void set_movement_type(hex_graph_ptr graph, creature::MovementType mt);
 	result_list find_available_moves(hex_graph_ptr graph, const point& src, float max_cost);
 	result_path find_path(hex_graph_ptr graph, const point& src, const point& dst);
+	// Path from src to dst read back from the shortest path tree left by the last call of
+	// find_available_moves on the graph, in O(path length). Falls back to find_path if the
+	// graph has been searched since, or the tree was for a different source. Returns an empty
+	// path if dst isn't reachable within the max_cost the moves were found with.
+	result_path find_path_in_moves(hex_graph_ptr graph, const point& src, const point& dst);
+	// Number of steps from every tile in the graph to the nearest of the sources, ignoring
+	// terrain and units. Indexed the same as graph_t::weights, tiles that can't be reached
+	// are std::numeric_limits<int>::max().
+	std::vector<int> find_distance_field(hex_graph_ptr graph, const std::vector<point>& sources);
 }
@@ -61,9 +61,8 @@ namespace process
 		}
 	}
 
-	void input::generate_attack_targets(engine& eng, const entity_list& elist)
+	void input::generate_attack_targets(engine& eng)
 	{
-		static component_id mask = genmask(Component::POSITION) | genmask(Component::STATS) | genmask(Component::INPUT);
 		aggressor_ = eng.get_game_state().get_entities().front();
 		// XXX This assert may need to be a user error.
 		ASSERT_LOG(aggressor_ != nullptr, "No unit on list with which to attack with.");
@@ -71,14 +70,12 @@ namespace process
 			// Scan through list of enemy entities and select ones which are in 
 			// range for being attacked.
 			bool opponent_in_range = false;
-			for(auto& e2 : elist) {
-				if((e2->mask & mask) == mask) {
-					if(eng.get_game_state().is_attackable(aggressor_, e2->stat)) {
-						e2->inp->is_attack_target = true;
-						opponent_in_range = true;
-					}
+			eng.for_each<Component::POSITION, Component::STATS, Component::INPUT>([&](const component_set_ptr& e2, point& pos, game::unit& stat, component::input& inp) {
+				if(eng.get_game_state().is_attackable(aggressor_, e2->stat)) {
+					inp.is_attack_target = true;
+					opponent_in_range = true;
 				}
-			}
+			});
 			if(opponent_in_range) {
 				state_ = State::SELECT_OPPONENTS;
 				max_opponent_count_ = 1; // XXX attacking_unit->stat->max_attack_opponents
@@ -91,37 +88,34 @@ namespace process
 		static component_id input_mask = genmask(Component::INPUT);
 		static component_id pos_mask = genmask(Component::POSITION) | genmask(Component::STATS);
 
-		for(auto& e : elist) {
-			if((e->mask & pos_mask) == pos_mask && (e->mask & input_mask) == input_mask) {
-				auto& pos = e->stat->get_position();
-				auto& inp = e->inp;
-
-				if(inp->clear_selection) {
-					inp->clear();
-				}
-				if(inp->gen_moves) {
-					inp->gen_moves = false;	
-					inp->graph = hex::create_cost_graph(eng.get_game_state(), pos, e->stat->get_move());
-					inp->possible_moves = hex::find_available_moves(inp->graph, pos, e->stat->get_move());
-					// remove tiles that have friendly entities on them, from the results.
-					// XXX this needs to be incorporated into hex::find_available_moves somehow.
-					inp->possible_moves.erase(std::remove_if(inp->possible_moves.begin(), inp->possible_moves.end(), [&elist](const hex::move_cost& mc) {
-						for(auto& e : elist) {
-							if(e->stat && e->stat->get_position() == mc.loc) {
-								return true;
-							}
+		eng.for_each<Component::POSITION, Component::STATS, Component::INPUT>([&](const component_set_ptr& e, point&, game::unit& stat, component::input& inp) {
+			auto& pos = stat.get_position();
+			if(inp.clear_selection) {
+				inp.clear();
+			}
+			if(inp.gen_moves) {
+				inp.gen_moves = false;	
+				inp.graph = hex::create_cost_graph(eng.get_game_state(), pos, stat.get_move());
+				inp.possible_moves = hex::find_available_moves(inp.graph, pos, stat.get_move());
+				// remove tiles that have friendly entities on them, from the results.
+				// XXX this needs to be incorporated into hex::find_available_moves somehow.
+				inp.possible_moves.erase(std::remove_if(inp.possible_moves.begin(), inp.possible_moves.end(), [&elist](const hex::move_cost& mc) {
+					for(auto& e : elist) {
+						if(e->stat && e->stat->get_position() == mc.loc) {
+							return true;
 						}
-						return false;
-					}), inp->possible_moves.end());
+					}
+					return false;
+				}), inp.possible_moves.end());
 
-					inp->arrow_path.clear();
-				}
+				inp.arrow_path.clear();
+				inp.tile_path.clear();
 			}
-		}
+		});
 
 		if(do_attack_default_) {
 			do_attack_default_ = false;
-			generate_attack_targets(eng, elist);
+			generate_attack_targets(eng);
 		}
 
 		// Process keystrokes
@@ -131,7 +125,7 @@ namespace process
 			if(key == SDL_SCANCODE_E) {
 				eng.end_turn();
 			} else if(key == SDL_SCANCODE_1) {
-				generate_attack_targets(eng, elist);
+				generate_attack_targets(eng);
 			}
 		}
 
@@ -141,60 +135,58 @@ namespace process
 			bool mouse_in_entity = false;
 			bool mouse_up_event = false;
 
-			for(auto& e : elist) {
-				if((e->mask & pos_mask) == pos_mask && (e->mask & input_mask) == input_mask) {
-					auto& stats = e->stat;
-					auto& pos = stats->get_position();
-					auto& inp = e->inp;
-
-					auto pp = hex::hex_map::get_pixel_pos_from_tile_pos(pos.x, pos.y);
-					if(button.button == SDL_BUTTON_LEFT 
-						&& button.type == SDL_MOUSEBUTTONUP) {
-						mouse_up_event = true;
-						bool mouse_in_area = geometry::pointInRect(point(button.x, button.y), inp->mouse_area + pp);
-						mouse_in_entity = mouse_in_area || mouse_in_entity;
-						if(state_ == State::SELECT_OPPONENTS) {
-							if(max_opponent_count_ != 0 
-								&& mouse_in_area 
-								&& inp->is_attack_target) {
-								targets_.emplace_back(e->stat);
-								if(--max_opponent_count_ == 0) {
-									do_attack_message(eng);
-									// XXX Start playing attack animation.
-									state_ = State::IDLE;
-									aggressor_ = nullptr;
-									targets_.clear();
-									for(auto& en : elist) {
-										if((en->mask & genmask(Component::INPUT)) == genmask(Component::INPUT)) {
-											en->inp->is_attack_target = false;
-										}
-									}
-								}
-							}
-							continue;
+			if(button.button == SDL_BUTTON_LEFT && button.type == SDL_MOUSEBUTTONUP) {
+				mouse_up_event = true;
+				auto picked = eng.entity_at(point(button.x, button.y), pos_mask | input_mask);
+				mouse_in_entity = picked != nullptr;
+				if(state_ == State::SELECT_OPPONENTS) {
+					if(max_opponent_count_ != 0 
+						&& picked != nullptr 
+						&& picked->inp->is_attack_target) {
+						targets_.emplace_back(picked->stat);
+						if(--max_opponent_count_ == 0) {
+							do_attack_message(eng);
+							// XXX Start playing attack animation.
+							state_ = State::IDLE;
+							aggressor_ = nullptr;
+							targets_.clear();
+							eng.for_each<Component::INPUT>([](const component_set_ptr&, component::input& inp) {
+								inp.is_attack_target = false;
+							});
 						}
+					}
+				} else {
+					if(picked != nullptr) {
+						// Clear old selections.
+						eng.for_each<Component::INPUT>([](const component_set_ptr&, component::input& inp) {
+							inp.selected = false;
+						});
+						picked->inp->selected = true;
+					}
 
-						if(mouse_in_area) {
-							// Clear old selections.
-							for(auto& e : eng.get_entities()) {
-								if((e->mask & genmask(Component::INPUT)) == genmask(Component::INPUT)) {
-									e->inp->selected = false;
-								}
-							}
-							inp->selected = true;
-						} else {
+					// Only the unit whose turn it is can move, so that is the only entity we need to look at.
+					auto& gs_entities = eng.get_game_state().get_entities();
+					if(!gs_entities.empty()) {
+						auto& stats = gs_entities.front();
+						auto e = eng.get_entity_for_unit_uuid(stats->get_uuid());
+						if(e != picked && (e->mask & input_mask) == input_mask) {
 							// Test whether point is in inp->possible_moves(...) and is players turn, then we animate moving the entity to
 							// that position, clear the moves and decrement the units movement allowance.
-							auto owner = e->stat->get_owner();
+							auto& inp = e->inp;
+							auto owner = stats->get_owner();
 							auto tp = hex::hex_map::get_tile_pos_from_pixel_pos(button.x, button.y);
 							auto it = std::find_if(inp->possible_moves.begin(), inp->possible_moves.end(), [&tp](hex::move_cost const& mc){
 								return tp == mc.loc;
 							});
-							if(eng.get_active_player() == owner && eng.get_game_state().get_entities().front() == stats && stats->get_move() > FLT_EPSILON && it != inp->possible_moves.end()) {
+							if(eng.get_active_player() == owner && stats->get_move() > FLT_EPSILON && it != inp->possible_moves.end()) {
+								// The path is normally already there from hovering over the tile.
+								if(inp->tile_path.empty() || inp->tile_path.back() != tp) {
+									inp->tile_path = hex::find_path_in_moves(inp->graph, stats->get_position(), tp);
+								}
 								ASSERT_LOG(!inp->tile_path.empty(), "tile path was empty.");
 								for(auto& t : inp->tile_path) {
 									auto tile = eng.get_map()->get_tile_at(t.x, t.y);
-									ASSERT_LOG(tile != nullptr, "No tile exists at point: " << pp);
+									ASSERT_LOG(tile != nullptr, "No tile exists at point: " << t);
 									LOG_DEBUG("tile" << t << ": " << tile->tile()->id() << " : " << tile->tile()->get_cost());
 								}
 								// Generate an update move message.
@@ -205,11 +197,11 @@ namespace process
 								ASSERT_LOG(netclient != nullptr, "Network client has gone away.");
 								netclient->write_send_queue(up);
 
-								/*auto old_pos = e->pos;
+								/*auto old_pos = e->pos();
 								eng.add_animated_property("unit", std::make_shared<property::animate<double, point>>(
 									[old_pos, tp](double t, double d){ return easing::between::linear_tween(t, old_pos, tp, d); }, 
-									[e](const point& v){ e->pos = v; }, 2.5));*/
-								e->pos = stats->get_position();
+									[e](const point& v){ e->pos() = v; }, 2.5));*/
+								e->pos() = stats->get_position();
 
 								// re-generate moves if there is still some movement left.
 								if(stats->get_move() > FLT_EPSILON) {
@@ -226,11 +218,9 @@ namespace process
 				state_ = State::IDLE;
 				aggressor_ = nullptr;
 				targets_.clear();
-				for(auto& en : elist) {
-					if((en->mask & genmask(Component::INPUT)) == genmask(Component::INPUT)) {
-						en->inp->is_attack_target = false;
-					}
-				}
+				eng.for_each<Component::INPUT>([](const component_set_ptr&, component::input& inp) {
+					inp.is_attack_target = false;
+				});
 			}
 		}
 
@@ -239,30 +229,31 @@ namespace process
 			int x = 0;
 			int y = 0;
 			SDL_GetMouseState(&x, &y);
-			for(auto& e : elist) {
-				if((e->mask & pos_mask) == pos_mask && (e->mask & input_mask) == input_mask) {
-					auto& stats = e->stat;
-					auto& pos = stats->get_position();
-					auto& inp = e->inp;
-					if(!inp->possible_moves.empty() && inp->graph != nullptr) {
-						auto destination_pt = eng.get_map()->get_tile_pos_from_pixel_pos(x, y);
-						if(eng.get_map()->get_tile_at(destination_pt.x, destination_pt.y)) {
-							auto it = std::find_if(inp->possible_moves.begin(), inp->possible_moves.end(), [&destination_pt](hex::move_cost const& mc){
-								return destination_pt == mc.loc;
-							});
+			eng.for_each<Component::POSITION, Component::STATS, Component::INPUT>([&](const component_set_ptr& e, point&, game::unit& stat, component::input& inp) {
+				auto& pos = stat.get_position();
+				if(!inp.possible_moves.empty() && inp.graph != nullptr) {
+					auto destination_pt = eng.get_map()->get_tile_pos_from_pixel_pos(x, y);
+					// Nothing to do unless the mouse moved to a different hex.
+					if(!inp.tile_path.empty() && inp.tile_path.back() == destination_pt) {
+						return;
+					}
+					if(eng.get_map()->get_tile_at(destination_pt.x, destination_pt.y)) {
+						auto it = std::find_if(inp.possible_moves.begin(), inp.possible_moves.end(), [&destination_pt](hex::move_cost const& mc){
+							return destination_pt == mc.loc;
+						});
 
-							if(it != inp->possible_moves.end()) {
-								inp->tile_path = std::move(hex::find_path(inp->graph, pos, destination_pt));
-								inp->arrow_path.clear();
-								for(auto& t : inp->tile_path) {
-									auto p = hex::hex_map::get_pixel_pos_from_tile_pos(t.x, t.y) + point(eng.get_tile_size().x/2, eng.get_tile_size().y/2);
-									inp->arrow_path.emplace_back(p);
-								}
+						if(it != inp.possible_moves.end()) {
+							// The moves were generated from a shortest path tree, which the path can be read from.
+							inp.tile_path = hex::find_path_in_moves(inp.graph, pos, destination_pt);
+							inp.arrow_path.clear();
+							for(auto& t : inp.tile_path) {
+								auto p = hex::hex_map::get_pixel_pos_from_tile_pos(t.x, t.y) + point(eng.get_tile_size().x/2, eng.get_tile_size().y/2);
+								inp.arrow_path.emplace_back(p);
 							}
 						}
 					}
 				}
-			}
+			});
 		}
 	}
 
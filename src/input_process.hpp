@@ -38,7 +38,7 @@ namespace process
 		bool mouse_motion_detected_;
 		bool handle_event(const SDL_Event& evt);
 		void do_attack_message(engine& eng);
-		void generate_attack_targets(engine& eng, const entity_list& elist);
+		void generate_attack_targets(engine& eng);
 		// XXX Not sure I like all these queues of events here.
 		// Need to work out if there is a better abstration to use.
 		std::queue<SDL_Scancode> keys_pressed_;
@@ -36,9 +36,12 @@ namespace network
 			// into it's receive queue from our send queue.
 			auto peer = server_.lock();
 			ASSERT_LOG(peer != nullptr, "No server peer set in network::internal::client");
-			game::Update* up;
-			while((up = read_send_queue()) != nullptr) {
-				peer->write_recv_queue(up);
+			game::Update* ups[32];
+			size_t count;
+			while((count = read_send_queue(ups, 32)) != 0) {
+				for(size_t n = 0; n != count; ++n) {
+					peer->write_recv_queue(ups[n]);
+				}
 			}
 		}
 	}
@@ -36,15 +36,20 @@ namespace network
 			clients_.erase(std::remove_if(clients_.begin(), clients_.end(), [](std::weak_ptr<base> p){ return p.lock() == nullptr; }), clients_.end());
 
 			// Take messages from our send queue and send them to each connected client.
-			game::Update* up = nullptr;
-			while((up = read_send_queue()) != nullptr) {
+			game::Update* ups[32];
+			size_t count;
+			while((count = read_send_queue(ups, 32)) != 0) {
 				for(auto& c : clients_) {
-					LOG_DEBUG("Writing message(" << up->id() << ") to client");
 					auto peer = c.lock();
 					ASSERT_LOG(peer != nullptr, "client has gone away, peer == nullptr");
-					peer->write_recv_queue(new game::Update(*up));
+					for(size_t n = 0; n != count; ++n) {
+						LOG_DEBUG("Writing message(" << ups[n]->id() << ") to client");
+						peer->write_recv_queue(new game::Update(*ups[n]));
+					}
+				}
+				for(size_t n = 0; n != count; ++n) {
+					delete ups[n];
 				}
-				delete up;
 			}
 		}
 	}
@@ -153,17 +153,7 @@ void load_scenario(engine& eng, const std::string& name)
 				// Add unit to game state
 				gs.add_unit(u);
 				// Create component from unit and add to engine.
-				component_set_ptr cs = std::make_shared<component::component_set>(10);
-				cs->mask = genmask(Component::POSITION) | genmask(Component::SPRITE) | genmask(Component::STATS) | genmask(Component::INPUT);
-				cs->stat = u;
-				cs->pos = u->get_position();
-				// XXX If we get around to putting some animations in, then this would be a good place 
-				// to transform the creature::AnimationInfo into something nicer to go into cs->spr.
-				auto& ai = u->get_type()->get_animation_info("idle");
-				cs->spr = std::make_shared<component::sprite>(ai.image_, ai.area_);
-				cs->inp = std::make_shared<component::input>();
-				cs->inp->mouse_area = ai.area_;
-				eng.add_entity(cs);
+				eng.add_unit_entity(u);
 			}
 			++it;
 		}
@@ -277,6 +267,7 @@ int main(int argc, char* argv[])
 		}
 
 		game::state gs;
+		gs.set_random_seed(generator::get_seed());
 		// XX engine should take the renderer as a parameter, expose it as a get function, then pass itself
 		// to the update function.
 		engine e(gs, wm);
@@ -0,0 +1,203 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "asserts.hpp"
+#include "bot.hpp"
+#include "hex_logical_tiles.hpp"
+#include "json.hpp"
+#include "match.hpp"
+#include "node_utils.hpp"
+#include "random.hpp"
+#include "server_code.hpp"
+
+namespace game
+{
+	void load_scenario(state& gs, const node& scen, const std::vector<player_ptr>& players)
+	{
+		ASSERT_LOG(scen.is_map(), "Scenario must be a map, got: " << scen.type_as_string());
+		ASSERT_LOG(scen.has_key("name") && scen.has_key("map") && scen.has_key("starting_units"),
+			"Scenario file must have 'name', 'map' and 'starting_units' attributes.");
+		try {
+			gs.set_map(hex::logical::map::factory(json::parse_from_file("data/" + scen["map"].as_string())));
+		} catch(json::parse_error& pe) {
+			ASSERT_LOG(false, "Error parsing data/" << scen["map"].as_string() << ": " << pe.what());
+		}
+
+		auto it = players.begin();
+		for(auto& player_units : scen["starting_units"].as_list()) {
+			if(it == players.end()) {
+				break;
+			}
+			for(auto c : player_units.as_list()) {
+				ASSERT_LOG(c.has_key("name"), "In 'starting_units' list, you must provide a 'name' attribute.");
+				ASSERT_LOG(c.has_key("location"), "In 'starting_units' list, you must provide a 'location' attribute.");
+				gs.add_unit(gs.create_unit_instance(c["name"].as_string(), *it, node_to_point(c["location"])));
+			}
+			++it;
+		}
+	}
+
+	match::match(int id, const node& scenario, uint64_t seed)
+		: id_(id),
+		  seed_(seed),
+		  scenario_(scenario),
+		  max_players_(scenario.has_key("max_players") ? scenario["max_players"].as_int() : 2),
+		  started_(false),
+		  finished_(false)
+	{
+		gs_.set_random_seed(seed_);
+	}
+
+	bool match::join(const Update_Player& p)
+	{
+		if(started_ || is_full()) {
+			return false;
+		}
+		const uuid::uuid id = uuid::read(p.uuid());
+		for(auto& pp : players_) {
+			if(pp->get_uuid() == id) {
+				LOG_WARN("Player " << p.uuid() << " has already joined match " << id_);
+				return false;
+			}
+		}
+
+		// Players without a team name are on a team by themselves.
+		const std::string& team_name = p.has_team_name() ? p.team_name() : p.uuid();
+		auto it = teams_.find(team_name);
+		if(it == teams_.end()) {
+			it = teams_.insert(std::make_pair(team_name, gs_.create_team_instance(team_name))).first;
+		}
+
+		add_player(std::make_shared<player>(it->second, PlayerType::NORMAL, p.has_name() ? p.name() : p.uuid(), id));
+		return true;
+	}
+
+	bool match::add_bot(const std::string& name, const ai::search_limits& limits)
+	{
+		if(started_ || is_full()) {
+			return false;
+		}
+		auto b = std::make_shared<ai::bot>(gs_.create_team_instance(name), name);
+		ai::search_limits l = limits;
+		if(l.seed == 0) {
+			l.seed = static_cast<unsigned>(generator::derive_seed(seed_, players_.size() + 1));
+		}
+		b->set_search_limits(l);
+		teams_[b->team()->get_team_name()] = b->team();
+		add_player(b);
+		return true;
+	}
+
+	void match::add_player(const player_ptr& p)
+	{
+		players_.emplace_back(p);
+		gs_.add_player(p);
+		LOG_INFO("Player " << p->name() << " joined match " << id_ << " (" << players_.size() << "/" << max_players_ << ")");
+	}
+
+	bool match::leave(const uuid::uuid& id)
+	{
+		auto it = std::find_if(players_.begin(), players_.end(), [&id](const player_ptr& p) {
+			return p->get_uuid() == id;
+		});
+		if(it == players_.end()) {
+			return false;
+		}
+		// XXX Once the match has started the players units should be removed or handed
+		// to a bot. For now the match just ends.
+		if(started_) {
+			finished_ = true;
+		} else {
+			gs_.remove_player(*it);
+		}
+		players_.erase(it);
+		return true;
+	}
+
+	void match::start(std::vector<Update*>* out)
+	{
+		ASSERT_LOG(!started_, "Match " << id_ << " was already started.");
+		load_scenario(gs_, scenario_, players_);
+		started_ = true;
+		if(!journal_path_.empty()) {
+			journal_.reset(new journal::writer(journal_path_, id_, seed_, scenario_));
+			journal_->append_snapshot(gs_);
+		}
+		send(create_game_start_update(gs_), out);
+		run_bots(out);
+	}
+
+	void match::process(const uuid::uuid& sender, Update* up, std::vector<Update*>* out)
+	{
+		if(!started_ || finished_) {
+			LOG_WARN("Match " << id_ << " isn't in progress, ignoring update " << up->id());
+			return;
+		}
+		const bool wants_full_state = up->has_full_state() && up->full_state();
+		if(!wants_full_state && (gs_.get_entities().empty() || gs_.get_current_player()->get_uuid() != sender)) {
+			LOG_WARN("Player " << sender << " sent update " << up->id() << " to match " << id_ << " when it isn't their turn.");
+			// They may have acted on their copy of the state already, so put it back.
+			Update* nup = gs_.create_update();
+			gs_.write_full_state(nup);
+			send(nup, out);
+			return;
+		}
+		Update* nup = gs_.validate_and_apply(up);
+		if(nup != nullptr) {
+			send(nup, out);
+		}
+		run_bots(out);
+	}
+
+	void match::run_bots(std::vector<Update*>* out)
+	{
+		// Keep taking turns for bots until it's the turn of a remote player.
+		while(started_ && !finished_ && !gs_.get_entities().empty()) {
+			auto current = gs_.get_current_player();
+			if(!current->is_ai()) {
+				break;
+			}
+			// The bot gets its own copy of the state, the same as a bot running as a client would.
+			state scratch(gs_);
+			std::unique_ptr<Update> up(scratch.get_player(current->get_uuid())->process(scratch, 0));
+			if(up == nullptr) {
+				break;
+			}
+			Update* nup = gs_.validate_and_apply(up.get());
+			if(nup == nullptr) {
+				break;
+			}
+			send(nup, out);
+		}
+	}
+
+	void match::send(Update* up, std::vector<Update*>* out)
+	{
+		up->set_match_id(id_);
+		if(up->game_win_state() != Update_GameWinState_IN_PROGRESS) {
+			finished_ = true;
+		}
+		if(journal_ != nullptr) {
+			journal_->append(*up, gs_);
+			if(finished_) {
+				journal_->flush();
+			}
+		}
+		out->emplace_back(up);
+	}
+}
@@ -0,0 +1,100 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bot_search.hpp"
+#include "game_state.hpp"
+#include "match_journal.hpp"
+#include "node.hpp"
+
+namespace game
+{
+	// Loads the map and starting units from a scenario into the game state. The lists of
+	// starting units are given to players in the order they appear in players.
+	void load_scenario(state& gs, const node& scenario, const std::vector<player_ptr>& players);
+
+	// A single game hosted by the dedicated server. It owns the authoritative game state,
+	// the players fill the match up by joining it and once it is full it can be started.
+	// After that updates from the players are validated against the state and the replies
+	// are to be sent to every player in the match.
+	class match
+	{
+	public:
+		// Everything random in the match comes from the seed, so with the same seed and the
+		// same updates from the players it plays out the same way.
+		match(int id, const node& scenario, uint64_t seed);
+
+		int id() const { return id_; }
+		uint64_t seed() const { return seed_; }
+		bool is_full() const { return static_cast<int>(players_.size()) >= max_players_; }
+		bool is_started() const { return started_; }
+		bool is_finished() const { return finished_; }
+		int get_player_count() const { return static_cast<int>(players_.size()); }
+		int get_max_players() const { return max_players_; }
+
+		// Add the player described in a player join message. Returns false if the player
+		// can't be added, because the match is full or has already started.
+		bool join(const Update_Player& p);
+		// Add a server controlled player, on a team of its own, which searches for its moves
+		// within the given limits. Bots without a search seed get one from the match seed.
+		bool add_bot(const std::string& name, const ai::search_limits& limits);
+		// Remove a player, returns false if there was no such player.
+		bool leave(const uuid::uuid& id);
+		// Record the match to a journal at the given path once it starts, see
+		// match_journal.hpp.
+		void set_journal_path(const std::string& path) { journal_path_ = path; }
+
+		// Loads the scenario and adds the game start update to out, followed by the updates
+		// for any turns taken by bots.
+		void start(std::vector<Update*>* out);
+		// Validate and apply an update from the player sender. The updates to send to all
+		// players are added to out, that is the reply to up followed by the updates for any
+		// turns taken by bots. Updates from a player whose turn it isn't are refused, with
+		// the full state as the reply, other than requests for the full state.
+		void process(const uuid::uuid& sender, Update* up, std::vector<Update*>* out);
+
+		const state& get_state() const { return gs_; }
+	private:
+		void add_player(const player_ptr& p);
+		void run_bots(std::vector<Update*>* out);
+		// Adds an update, which has been applied to the state, to those to be sent.
+		void send(Update* up, std::vector<Update*>* out);
+
+		int id_;
+		uint64_t seed_;
+		node scenario_;
+		int max_players_;
+		bool started_;
+		bool finished_;
+		state gs_;
+		// Players in the order they joined.
+		std::vector<player_ptr> players_;
+		std::map<std::string, team_ptr> teams_;
+		std::string journal_path_;
+		std::unique_ptr<journal::writer> journal_;
+
+		match(const match&) = delete;
+		void operator=(const match&) = delete;
+	};
+
+	typedef std::shared_ptr<match> match_ptr;
+}
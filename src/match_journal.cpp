@@ -0,0 +1,552 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include "asserts.hpp"
+#include "creature.hpp"
+#include "hex_logical_tiles.hpp"
+#include "json.hpp"
+#include "match_journal.hpp"
+#include "node_utils.hpp"
+#include "unit_test.hpp"
+#include "units.hpp"
+
+namespace game
+{
+	namespace journal
+	{
+		namespace
+		{
+			const char journal_magic[] = { 'H', 'W', 'J', 'N' };
+			const char index_magic[] = { 'H', 'W', 'J', 'I' };
+			const uint32_t journal_version = 1;
+			// Type, turn and length.
+			const uint64_t record_header_size = 9;
+			const uint64_t index_entry_size = 12;
+			// Anything bigger is taken to be a corrupt record.
+			const uint32_t max_record_size = 64 * 1024 * 1024;
+			// Buffered records are handed over to be written once there is this much.
+			const size_t chunk_size = 64 * 1024;
+
+			void put_u8(std::string* s, uint8_t v)
+			{
+				s->push_back(static_cast<char>(v));
+			}
+
+			void put_u32(std::string* s, uint32_t v)
+			{
+				for(int n = 0; n != 4; ++n) {
+					s->push_back(static_cast<char>((v >> (n * 8)) & 0xff));
+				}
+			}
+
+			void put_u64(std::string* s, uint64_t v)
+			{
+				put_u32(s, static_cast<uint32_t>(v));
+				put_u32(s, static_cast<uint32_t>(v >> 32));
+			}
+
+			bool get_u8(std::istream& is, uint8_t* v)
+			{
+				char c;
+				if(!is.get(c)) {
+					return false;
+				}
+				*v = static_cast<uint8_t>(c);
+				return true;
+			}
+
+			bool get_u32(std::istream& is, uint32_t* v)
+			{
+				unsigned char buf[4];
+				if(!is.read(reinterpret_cast<char*>(buf), sizeof(buf))) {
+					return false;
+				}
+				*v = buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<uint32_t>(buf[3]) << 24);
+				return true;
+			}
+
+			bool get_u64(std::istream& is, uint64_t* v)
+			{
+				uint32_t lo, hi;
+				if(!get_u32(is, &lo) || !get_u32(is, &hi)) {
+					return false;
+				}
+				*v = lo | (static_cast<uint64_t>(hi) << 32);
+				return true;
+			}
+
+			void put_index_entry(std::string* s, uint32_t turn, uint64_t offset)
+			{
+				put_u32(s, turn);
+				put_u64(s, offset);
+			}
+		}
+
+		struct sink
+		{
+			explicit sink(const std::string& path)
+				: file(path, std::ios_base::binary | std::ios_base::trunc),
+				  index(get_index_path(path), std::ios_base::binary | std::ios_base::trunc),
+				  pending(0)
+			{
+			}
+			std::ofstream file;
+			std::ofstream index;
+			// Chunks not yet written, protected by the io thread's guard.
+			int pending;
+		};
+
+		namespace
+		{
+			struct chunk
+			{
+				std::shared_ptr<sink> s;
+				std::string data;
+				// Written after the data, so the index never points past the end of the journal.
+				std::string index;
+			};
+
+			// The one thread that does the writing for all the journals. It is started when
+			// it's first needed.
+			class io_thread
+			{
+			public:
+				io_thread() : running_(false), stopping_(false) {}
+				~io_thread()
+				{
+					{
+						std::lock_guard<std::mutex> lock(guard_);
+						stopping_ = true;
+					}
+					work_cv_.notify_all();
+					if(thread_.joinable()) {
+						thread_.join();
+					}
+				}
+
+				void post(chunk* c)
+				{
+					std::lock_guard<std::mutex> lock(guard_);
+					if(!running_) {
+						running_ = true;
+						thread_ = std::thread(&io_thread::run, this);
+					}
+					++c->s->pending;
+					chunks_.emplace_back();
+					std::swap(chunks_.back(), *c);
+					work_cv_.notify_all();
+				}
+
+				void wait(const sink& s)
+				{
+					std::unique_lock<std::mutex> lock(guard_);
+					done_cv_.wait(lock, [&s]() { return s.pending == 0; });
+				}
+			private:
+				void run()
+				{
+					std::unique_lock<std::mutex> lock(guard_);
+					while(true) {
+						work_cv_.wait(lock, [this]() { return stopping_ || !chunks_.empty(); });
+						if(chunks_.empty()) {
+							// Only gets here once stopping and everything has been written.
+							return;
+						}
+						chunk c;
+						std::swap(c, chunks_.front());
+						chunks_.pop_front();
+						lock.unlock();
+
+						c.s->file.write(c.data.data(), c.data.size());
+						c.s->file.flush();
+						if(!c.index.empty()) {
+							c.s->index.write(c.index.data(), c.index.size());
+							c.s->index.flush();
+						}
+						if(!c.s->file || !c.s->index) {
+							LOG_ERROR("Failed writing " << c.data.size() << " bytes to a match journal.");
+						}
+
+						lock.lock();
+						--c.s->pending;
+						done_cv_.notify_all();
+					}
+				}
+
+				std::mutex guard_;
+				std::condition_variable work_cv_;
+				std::condition_variable done_cv_;
+				std::deque<chunk> chunks_;
+				bool running_;
+				bool stopping_;
+				std::thread thread_;
+			};
+
+			io_thread writer_thread;
+		}
+
+		std::string get_index_path(const std::string& journal_path)
+		{
+			return journal_path + ".idx";
+		}
+
+		writer::writer(const std::string& path, int match_id, uint64_t seed, const node& scenario, int snapshot_interval)
+			: snapshot_interval_(snapshot_interval),
+			  turn_(0),
+			  offset_(0)
+		{
+			const boost::filesystem::path dir = boost::filesystem::path(path).parent_path();
+			if(!dir.empty()) {
+				boost::filesystem::create_directories(dir);
+			}
+			sink_ = std::make_shared<sink>(path);
+			ASSERT_LOG(sink_->file && sink_->index, "Couldn't open match journal: " << path);
+
+			const std::string scenario_json = scenario.write_json(false);
+			buffer_.append(journal_magic, sizeof(journal_magic));
+			put_u32(&buffer_, journal_version);
+			put_u32(&buffer_, static_cast<uint32_t>(match_id));
+			put_u64(&buffer_, seed);
+			put_u32(&buffer_, static_cast<uint32_t>(scenario_json.size()));
+			buffer_ += scenario_json;
+			offset_ = buffer_.size();
+			index_buffer_.append(index_magic, sizeof(index_magic));
+		}
+
+		writer::~writer()
+		{
+			flush();
+			writer_thread.wait(*sink_);
+		}
+
+		void writer::append_record(RecordType type, const Update& up)
+		{
+			const int size = up.ByteSize();
+			put_u8(&buffer_, static_cast<uint8_t>(type));
+			put_u32(&buffer_, turn_);
+			put_u32(&buffer_, static_cast<uint32_t>(size));
+			up.AppendToString(&buffer_);
+			offset_ += record_header_size + size;
+		}
+
+		void writer::append(const Update& up, const state& gs)
+		{
+			append_record(RecordType::UPDATE, up);
+			if(up.end_turn()) {
+				++turn_;
+				if(snapshot_interval_ > 0 && turn_ % snapshot_interval_ == 0) {
+					append_snapshot(gs);
+				}
+			}
+			if(buffer_.size() >= chunk_size) {
+				flush();
+			}
+		}
+
+		void writer::append_snapshot(const state& gs)
+		{
+			Update up;
+			gs.write_canonical_state(&up, true);
+			put_index_entry(&index_buffer_, turn_, offset_);
+			append_record(RecordType::SNAPSHOT, up);
+			// Snapshots are the points a reader can start from, so they go straight out.
+			flush();
+		}
+
+		void writer::flush()
+		{
+			if(buffer_.empty() && index_buffer_.empty()) {
+				return;
+			}
+			chunk c;
+			c.s = sink_;
+			std::swap(c.data, buffer_);
+			std::swap(c.index, index_buffer_);
+			writer_thread.post(&c);
+		}
+
+		reader::reader(const std::string& path)
+			: file_(path, std::ios_base::binary),
+			  match_id_(-1),
+			  seed_(0),
+			  data_offset_(0)
+		{
+			ASSERT_LOG(file_, "Couldn't open match journal: " << path);
+			char magic[sizeof(journal_magic)];
+			uint32_t version = 0, match_id = 0, scenario_size = 0;
+			const bool ok = file_.read(magic, sizeof(magic))
+				&& std::equal(magic, magic + sizeof(magic), journal_magic)
+				&& get_u32(file_, &version)
+				&& get_u32(file_, &match_id)
+				&& get_u64(file_, &seed_)
+				&& get_u32(file_, &scenario_size);
+			ASSERT_LOG(ok, "Not a match journal: " << path);
+			ASSERT_LOG(version == journal_version, "Unsupported match journal version " << version << " in " << path);
+			std::string scenario_json(scenario_size, '\0');
+			ASSERT_LOG(scenario_size == 0 || file_.read(&scenario_json[0], scenario_size), "Match journal truncated: " << path);
+			match_id_ = static_cast<int>(match_id);
+			scenario_ = json::parse(scenario_json);
+			data_offset_ = static_cast<uint64_t>(file_.tellg());
+			build_index(get_index_path(path));
+		}
+
+		void reader::build_index(const std::string& index_path)
+		{
+			file_.seekg(0, std::ios_base::end);
+			const uint64_t file_size = static_cast<uint64_t>(file_.tellg());
+
+			std::ifstream is(index_path, std::ios_base::binary);
+			char magic[sizeof(index_magic)];
+			if(is && is.read(magic, sizeof(magic)) && std::equal(magic, magic + sizeof(magic), index_magic)) {
+				index_entry e;
+				while(get_u32(is, &e.turn) && get_u64(is, &e.offset)) {
+					if(e.offset + record_header_size > file_size) {
+						break;
+					}
+					index_.emplace_back(e);
+				}
+			}
+
+			// The index is written after the journal, so it may be missing the last snapshots.
+			// Pick them up by reading through the records after the last one it has.
+			file_.clear();
+			file_.seekg(index_.empty() ? data_offset_ : index_.back().offset);
+			if(!index_.empty()) {
+				index_.pop_back();
+			}
+			while(true) {
+				index_entry e;
+				e.offset = static_cast<uint64_t>(file_.tellg());
+				uint8_t type;
+				uint32_t size;
+				if(!get_u8(file_, &type) || !get_u32(file_, &e.turn) || !get_u32(file_, &size)
+					|| size > max_record_size || e.offset + record_header_size + size > file_size) {
+					break;
+				}
+				if(type == static_cast<uint8_t>(RecordType::SNAPSHOT)) {
+					index_.emplace_back(e);
+				}
+				file_.seekg(size, std::ios_base::cur);
+			}
+			file_.clear();
+			file_.seekg(data_offset_);
+		}
+
+		bool reader::read_record(RecordType* type, uint32_t* turn, std::string* payload)
+		{
+			uint8_t t;
+			uint32_t size;
+			if(!get_u8(file_, &t) || !get_u32(file_, turn) || !get_u32(file_, &size) || size > max_record_size) {
+				return false;
+			}
+			payload->resize(size);
+			if(size > 0 && !file_.read(&(*payload)[0], size)) {
+				// A record cut short by the server stopping part way through writing it.
+				return false;
+			}
+			*type = static_cast<RecordType>(t);
+			return true;
+		}
+
+		bool reader::next(Update* up, uint32_t* turn)
+		{
+			RecordType type;
+			uint32_t record_turn;
+			std::string payload;
+			while(read_record(&type, &record_turn, &payload)) {
+				if(type != RecordType::UPDATE) {
+					continue;
+				}
+				if(!up->ParseFromString(payload)) {
+					LOG_WARN("Bad update in match journal, turn " << record_turn);
+					return false;
+				}
+				if(turn != nullptr) {
+					*turn = record_turn;
+				}
+				return true;
+			}
+			return false;
+		}
+
+		bool reader::seek(uint32_t turn, state* gs)
+		{
+			if(gs->get_map() == nullptr) {
+				gs->set_map(hex::logical::map::factory(json::parse_from_file("data/" + scenario_["map"].as_string())));
+			}
+			auto it = std::upper_bound(index_.begin(), index_.end(), turn, [](uint32_t t, const index_entry& e) {
+				return t < e.turn;
+			});
+			if(it == index_.begin()) {
+				LOG_WARN("No snapshot in the match journal at or before turn " << turn);
+				return false;
+			}
+			--it;
+
+			file_.clear();
+			file_.seekg(it->offset);
+			RecordType type;
+			uint32_t record_turn;
+			std::string payload;
+			Update up;
+			if(!read_record(&type, &record_turn, &payload) || type != RecordType::SNAPSHOT || !up.ParseFromString(payload)) {
+				LOG_WARN("Bad snapshot in match journal at offset " << it->offset);
+				return false;
+			}
+			gs->load_canonical_state(up);
+
+			// Replay the updates from the snapshot up to the turn.
+			uint32_t reached = record_turn;
+			while(true) {
+				const std::streampos pos = file_.tellg();
+				if(!read_record(&type, &record_turn, &payload)) {
+					break;
+				}
+				if(record_turn >= turn) {
+					file_.seekg(pos);
+					return true;
+				}
+				if(type != RecordType::UPDATE) {
+					continue;
+				}
+				if(!up.ParseFromString(payload)) {
+					LOG_WARN("Bad update in match journal, turn " << record_turn);
+					return false;
+				}
+				gs->apply(&up);
+				if(up.end_turn()) {
+					reached = record_turn + 1;
+				}
+			}
+			// Leave things so next() finds the end of the journal.
+			file_.clear();
+			file_.seekg(0, std::ios_base::end);
+			return reached >= turn;
+		}
+	}
+}
+
+UNIT_TEST(match_journal)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+	node_builder mb;
+	mb.add("width", 4);
+	for(int n = 0; n != 16; ++n) {
+		mb.add("tiles", "flat");
+	}
+	const node map_def = mb.build();
+
+	node_builder idle;
+	idle.add("image", "none.png");
+	for(int n = 0; n != 4; ++n) {
+		idle.add("area", n / 2);
+	}
+	node_builder anims;
+	anims.add("idle", idle.build());
+	auto type = std::make_shared<creature::creature>(node_builder()
+		.add("name", "c")
+		.add("stats", node_builder().add("health", 10).add("attack", 1).add("initiative", 10).build())
+		.add("animations", anims.build()).build());
+
+	game::state server;
+	server.set_map(hex::logical::map::factory(map_def));
+	server.set_random_seed(7);
+	auto p1 = std::make_shared<player>(server.create_team_instance("a"), PlayerType::NORMAL, "p1");
+	auto p2 = std::make_shared<player>(server.create_team_instance("b"), PlayerType::NORMAL, "p2");
+	server.add_player(p1);
+	server.add_player(p2);
+	for(int n = 0; n != 4; ++n) {
+		auto u = std::make_shared<game::unit>("u", type, n % 2 ? p2 : p1);
+		u->set_position(n, n % 2 ? 3 : 0);
+		u->set_move(2.0f);
+		u->set_initiative(1.0f + n * 0.5f);
+		server.add_unit(u);
+	}
+	p1->set_gold(25);
+
+	const std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("hexwarfare-%%%%-%%%%.journal")).string();
+	const uint32_t turns = 23;
+	std::vector<uint64_t> hashes;
+	{
+		game::journal::writer w(path, 3, 99, node_builder().add("name", "test").build(), 5);
+		w.append_snapshot(server);
+		for(uint32_t turn = 0; turn != turns; ++turn) {
+			hashes.emplace_back(server.get_hash());
+			game::state client(server);
+			std::unique_ptr<game::Update> up(client.create_update());
+			// Move the unit forward a step on the first few turns.
+			auto u = client.get_entities().front();
+			const point next(u->get_position().x, u->get_position().y == 0 ? 1 : 2);
+			if(turn < 4 && !client.get_occupancy().is_occupied(next)) {
+				client.unit_move(up.get(), u, std::vector<point>{ u->get_position(), next });
+			}
+			client.end_turn(up.get());
+			std::unique_ptr<game::Update> reply(server.validate_and_apply(up.get()));
+			CHECK_EQ(reply != nullptr, true);
+			w.append(*reply, server);
+		}
+		hashes.emplace_back(server.get_hash());
+		CHECK_EQ(w.get_turn(), turns);
+	}
+
+	for(int pass = 0; pass != 2; ++pass) {
+		game::journal::reader r(path);
+		CHECK_EQ(r.get_match_id(), 3);
+		CHECK_EQ(r.get_seed(), 99U);
+		CHECK_EQ(r.get_scenario()["name"].as_string(), "test");
+		// Turns 0, 5, 10, 15 and 20.
+		CHECK_EQ(r.get_index().size(), 5U);
+		for(uint32_t turn : { 0U, 1U, 4U, 5U, 12U, turns }) {
+			game::state gs;
+			gs.set_map(hex::logical::map::factory(map_def));
+			CHECK_EQ(r.seek(turn, &gs), true);
+			CHECK_EQ(gs.get_hash(), hashes[turn]);
+			CHECK_EQ(gs.get_hash(), gs.compute_hash());
+			// Unlike a full state sent to a client, the journal keeps the random stream.
+			CHECK_EQ(gs.get_random().get_key(), server.get_random().get_key());
+			CHECK_EQ(gs.get_player(p1->get_uuid())->get_gold(), 25);
+			CHECK_EQ(gs.get_entities().size(), server.get_entities().size());
+		}
+		// Stepping on from a turn is the same as seeking to the next.
+		game::state gs;
+		gs.set_map(hex::logical::map::factory(map_def));
+		CHECK_EQ(r.seek(7, &gs), true);
+		game::Update up;
+		uint32_t turn = 0;
+		CHECK_EQ(r.next(&up, &turn), true);
+		CHECK_EQ(turn, 7U);
+		gs.apply(&up);
+		CHECK_EQ(gs.get_hash(), hashes[8]);
+		game::state past_end;
+		past_end.set_map(hex::logical::map::factory(map_def));
+		CHECK_EQ(r.seek(turns + 1, &past_end), false);
+
+		// Without the index it is rebuilt from the journal.
+		boost::filesystem::remove(game::journal::get_index_path(path));
+	}
+	boost::filesystem::remove(path);
+}
@@ -0,0 +1,131 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game_state.hpp"
+#include "node.hpp"
+
+namespace game
+{
+	// Record of a match as it's played, for looking at and re-running matches after the fact.
+	//
+	// The journal is a header, giving the match id, seed and scenario, followed by records
+	// which are only ever appended. Each record is a type, the turn it was made in and the
+	// length of the serialized Update which follows. Update records are the validated
+	// updates sent out by the server, snapshot records are the full state of the game (see
+	// state::write_canonical_state) at the start of a turn. All numbers are little endian.
+	//
+	// Alongside is an index file of the turn and offset of each snapshot, so a reader can get
+	// to any turn by loading the nearest snapshot before it and replaying the updates from
+	// there, instead of replaying the whole match.
+	namespace journal
+	{
+		enum class RecordType : uint8_t
+		{
+			UPDATE = 1,
+			SNAPSHOT = 2,
+		};
+
+		// Turns are counted by the end turn updates, so the first turn is turn 0.
+		struct index_entry
+		{
+			uint32_t turn;
+			uint64_t offset;
+		};
+
+		std::string get_index_path(const std::string& journal_path);
+
+		// The open files of a writer, shared with the background thread. Defined in
+		// match_journal.cpp.
+		struct sink;
+
+		// Records are buffered and written out in chunks on a background thread shared by
+		// all the journals, so the game thread never waits on the disk.
+		class writer
+		{
+		public:
+			// A snapshot is written at the start of every snapshot_interval'th turn.
+			writer(const std::string& path, int match_id, uint64_t seed, const node& scenario, int snapshot_interval=10);
+			// Waits for everything to be written.
+			~writer();
+
+			// Appends an update which has been applied to gs, adding a snapshot of gs
+			// afterwards if a turn ended with it and a snapshot is due.
+			void append(const Update& up, const state& gs);
+			void append_snapshot(const state& gs);
+			// Hands what's buffered to the background thread.
+			void flush();
+
+			uint32_t get_turn() const { return turn_; }
+		private:
+			std::shared_ptr<sink> sink_;
+			int snapshot_interval_;
+			uint32_t turn_;
+			// Offset in the file of the end of the buffer.
+			uint64_t offset_;
+			std::string buffer_;
+			std::string index_buffer_;
+
+			void append_record(RecordType type, const Update& up);
+
+			writer(const writer&) = delete;
+			void operator=(const writer&) = delete;
+		};
+
+		class reader
+		{
+		public:
+			// Asserts if the file isn't a journal. A missing or out of date index is rebuilt by
+			// reading through the record headers.
+			explicit reader(const std::string& path);
+
+			int get_match_id() const { return match_id_; }
+			uint64_t get_seed() const { return seed_; }
+			const node& get_scenario() const { return scenario_; }
+			const std::vector<index_entry>& get_index() const { return index_; }
+
+			// Sets gs to the state at the start of the given turn, loading the map from the
+			// scenario if gs doesn't have one. Afterwards next() carries on from the turn.
+			// Returns false if the journal ends before the turn, in which case gs is left at
+			// the end of the journal.
+			bool seek(uint32_t turn, state* gs);
+			// Reads the next update, skipping snapshots. Returns false at the end of the
+			// journal.
+			bool next(Update* up, uint32_t* turn=nullptr);
+		private:
+			std::ifstream file_;
+			int match_id_;
+			uint64_t seed_;
+			node scenario_;
+			uint64_t data_offset_;
+			std::vector<index_entry> index_;
+
+			bool read_record(RecordType* type, uint32_t* turn, std::string* payload);
+			void build_index(const std::string& index_path);
+
+			reader(const reader&) = delete;
+			void operator=(const reader&) = delete;
+		};
+	}
+}
@@ -0,0 +1,360 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+
+#include "asserts.hpp"
+#include "match_scheduler.hpp"
+#include "node_utils.hpp"
+#include "unit_test.hpp"
+
+namespace game
+{
+	namespace
+	{
+		// Maximum number of jobs run for a match before it goes to the back of the queue
+		// to give the other matches a turn.
+		const int max_jobs_per_run = 8;
+	}
+
+	match_scheduler::match_scheduler(int num_workers, const std::function<void()>& on_result)
+		: ready_count_(0),
+		  running_(true),
+		  in_flight_(0),
+		  on_result_(on_result)
+	{
+		if(num_workers <= 0) {
+			num_workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+		}
+		for(int n = 0; n != num_workers; ++n) {
+			workers_.emplace_back(new worker());
+		}
+		// Threads are only started once all the workers exist, since they look at each other.
+		for(int n = 0; n != num_workers; ++n) {
+			workers_[n]->thread = std::thread(&match_scheduler::worker_thread, this, n);
+		}
+		LOG_INFO("Started match scheduler with " << num_workers << " workers.");
+	}
+
+	match_scheduler::~match_scheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleep_guard_);
+			running_ = false;
+		}
+		sleep_cv_.notify_all();
+		for(auto& w : workers_) {
+			w->thread.join();
+		}
+		result r;
+		while(read_result(&r)) {
+			delete r.up;
+		}
+	}
+
+	void match_scheduler::add_match(const match_ptr& m)
+	{
+		std::lock_guard<std::mutex> lock(entries_guard_);
+		ASSERT_LOG(entries_.find(m->id()) == entries_.end(), "Match " << m->id() << " was already added to the scheduler.");
+		entries_[m->id()] = std::make_shared<entry>(m, m->id() % static_cast<int>(workers_.size()));
+	}
+
+	void match_scheduler::remove_match(int match_id)
+	{
+		entry_ptr e;
+		{
+			std::lock_guard<std::mutex> lock(entries_guard_);
+			auto it = entries_.find(match_id);
+			if(it == entries_.end()) {
+				return;
+			}
+			e = it->second;
+			entries_.erase(it);
+		}
+		std::lock_guard<std::mutex> lock(e->guard);
+		e->removed = true;
+		in_flight_ -= static_cast<int>(e->jobs.size());
+		e->jobs.clear();
+	}
+
+	void match_scheduler::post(int match_id, const job& j)
+	{
+		entry_ptr e;
+		{
+			std::lock_guard<std::mutex> lock(entries_guard_);
+			auto it = entries_.find(match_id);
+			if(it == entries_.end()) {
+				LOG_WARN("Job posted for match " << match_id << " which doesn't exist.");
+				return;
+			}
+			e = it->second;
+		}
+		bool needs_scheduling = false;
+		{
+			std::lock_guard<std::mutex> lock(e->guard);
+			if(e->removed) {
+				return;
+			}
+			++in_flight_;
+			e->jobs.emplace_back(j);
+			if(!e->scheduled) {
+				e->scheduled = true;
+				needs_scheduling = true;
+			}
+		}
+		if(needs_scheduling) {
+			schedule(e);
+		}
+	}
+
+	void match_scheduler::post_update(int match_id, const uuid::uuid& sender, Update* up)
+	{
+		post_update(match_id, sender, std::shared_ptr<Update>(up));
+	}
+
+	void match_scheduler::post_update(int match_id, const uuid::uuid& sender, const std::shared_ptr<Update>& up)
+	{
+		post(match_id, [sender, up](match& m, std::vector<Update*>* out) {
+			m.process(sender, up.get(), out);
+		});
+	}
+
+	bool match_scheduler::read_result(result* r)
+	{
+		return results_.try_pop(*r);
+	}
+
+	void match_scheduler::schedule(const entry_ptr& e)
+	{
+		auto& w = *workers_[e->home];
+		{
+			std::lock_guard<std::mutex> lock(w.guard);
+			w.ready.emplace_back(e);
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleep_guard_);
+			++ready_count_;
+		}
+		sleep_cv_.notify_one();
+	}
+
+	match_scheduler::entry_ptr match_scheduler::next_entry(int worker_id)
+	{
+		entry_ptr e;
+		{
+			auto& w = *workers_[worker_id];
+			std::lock_guard<std::mutex> lock(w.guard);
+			if(!w.ready.empty()) {
+				e = w.ready.front();
+				w.ready.pop_front();
+				return e;
+			}
+		}
+		// Nothing of our own to do, so steal from the back of another workers queue.
+		const int num_workers = static_cast<int>(workers_.size());
+		for(int n = 1; n != num_workers; ++n) {
+			auto& w = *workers_[(worker_id + n) % num_workers];
+			std::lock_guard<std::mutex> lock(w.guard);
+			if(!w.ready.empty()) {
+				e = w.ready.back();
+				w.ready.pop_back();
+				return e;
+			}
+		}
+		return e;
+	}
+
+	void match_scheduler::run_entry(const entry_ptr& e)
+	{
+		std::vector<Update*> out;
+		for(int n = 0; n != max_jobs_per_run; ++n) {
+			job j;
+			{
+				std::lock_guard<std::mutex> lock(e->guard);
+				if(e->removed || e->jobs.empty()) {
+					e->scheduled = false;
+					return;
+				}
+				j = e->jobs.front();
+				e->jobs.pop_front();
+			}
+			j(*e->m, &out);
+			for(auto up : out) {
+				result r = { e->m->id(), up };
+				results_.push(r);
+			}
+			--in_flight_;
+			if(!out.empty() && on_result_) {
+				on_result_();
+			}
+			out.clear();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(e->guard);
+			if(e->removed || e->jobs.empty()) {
+				e->scheduled = false;
+				return;
+			}
+		}
+		// Still more to do, go to the back of the queue.
+		schedule(e);
+	}
+
+	void match_scheduler::worker_thread(int worker_id)
+	{
+		while(true) {
+			{
+				std::unique_lock<std::mutex> lock(sleep_guard_);
+				sleep_cv_.wait(lock, [this]() { return !running_ || ready_count_ > 0; });
+				if(!running_) {
+					return;
+				}
+				// Claim one of the ready matches. It's guaranteed to be in one of the queues,
+				// though another worker may take it first, in which case there's another.
+				--ready_count_;
+			}
+			entry_ptr e;
+			while((e = next_entry(worker_id)) == nullptr) {
+				std::this_thread::yield();
+			}
+			run_entry(e);
+		}
+	}
+}
+
+namespace
+{
+	// Waits up to a few seconds for pred to become true.
+	template<typename F>
+	bool wait_for(F pred)
+	{
+		for(int n = 0; n != 5000 && !pred(); ++n) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return pred();
+	}
+}
+
+UNIT_TEST(match_scheduler)
+{
+	const int num_workers = 4;
+	const int num_matches = 6;
+	const int jobs_per_match = 50;
+	game::match_scheduler sched(num_workers);
+	// Every match has the same home worker, so the other workers only get work by stealing.
+	for(int n = 0; n != num_matches; ++n) {
+		sched.add_match(std::make_shared<game::match>(n * num_workers, node_builder().build(), n));
+	}
+
+	struct match_log
+	{
+		match_log() : running(0) {}
+		std::atomic<int> running;
+		std::mutex guard;
+		std::vector<int> order;
+		std::vector<std::thread::id> threads;
+	};
+	std::vector<std::unique_ptr<match_log>> logs;
+	for(int n = 0; n != num_matches; ++n) {
+		logs.emplace_back(new match_log());
+	}
+	std::atomic<int> overlaps(0);
+
+	// Hold the home worker on the first match until a job for the second has run, which
+	// can only happen if another worker steals the second match.
+	std::atomic<bool> stolen(false);
+	sched.post(0, [&](game::match& m, std::vector<game::Update*>* out) {
+		wait_for([&]() { return stolen.load(); });
+	});
+	sched.post(num_workers, [&](game::match& m, std::vector<game::Update*>* out) {
+		stolen = true;
+	});
+
+	for(int j = 0; j != jobs_per_match; ++j) {
+		for(int n = 0; n != num_matches; ++n) {
+			match_log* log = logs[n].get();
+			sched.post(n * num_workers, [&overlaps, log, j](game::match& m, std::vector<game::Update*>* out) {
+				if(log->running.fetch_add(1) != 0) {
+					++overlaps;
+				}
+				std::this_thread::yield();
+				{
+					std::lock_guard<std::mutex> lock(log->guard);
+					log->order.emplace_back(j);
+					log->threads.emplace_back(std::this_thread::get_id());
+				}
+				--log->running;
+			});
+		}
+	}
+	CHECK_EQ(wait_for([&]() { return sched.jobs_in_flight() == 0; }), true);
+	CHECK_EQ(stolen.load(), true);
+	CHECK_EQ(overlaps.load(), 0);
+	std::set<std::thread::id> threads;
+	for(auto& log : logs) {
+		CHECK_EQ(static_cast<int>(log->order.size()), jobs_per_match);
+		for(int j = 0; j != static_cast<int>(log->order.size()); ++j) {
+			CHECK_EQ(log->order[j], j);
+		}
+		threads.insert(log->threads.begin(), log->threads.end());
+	}
+	CHECK_GT(threads.size(), 1u);
+
+	// Jobs still queued for a removed match are dropped.
+	std::atomic<bool> started(false);
+	std::atomic<bool> release(false);
+	std::atomic<int> ran(0);
+	sched.post(0, [&](game::match& m, std::vector<game::Update*>* out) {
+		started = true;
+		wait_for([&]() { return release.load(); });
+		++ran;
+	});
+	for(int j = 0; j != 10; ++j) {
+		sched.post(0, [&](game::match& m, std::vector<game::Update*>* out) {
+			++ran;
+		});
+	}
+	CHECK_EQ(wait_for([&]() { return started.load(); }), true);
+	CHECK_EQ(sched.jobs_in_flight(), 11);
+	sched.remove_match(0);
+	CHECK_EQ(sched.jobs_in_flight(), 1);
+	release = true;
+	CHECK_EQ(wait_for([&]() { return sched.jobs_in_flight() == 0; }), true);
+	CHECK_EQ(ran.load(), 1);
+	sched.post(0, [&](game::match& m, std::vector<game::Update*>* out) {
+		++ran;
+	});
+	CHECK_EQ(sched.jobs_in_flight(), 0);
+
+	// The reader is told once results are waiting, and only then.
+	std::atomic<int> notified(0);
+	game::match_scheduler notifying(2, [&]() { ++notified; });
+	notifying.add_match(std::make_shared<game::match>(1, node_builder().build(), 1));
+	notifying.post(1, [](game::match& m, std::vector<game::Update*>* out) {});
+	CHECK_EQ(wait_for([&]() { return notifying.jobs_in_flight() == 0; }), true);
+	CHECK_EQ(notified.load(), 0);
+	notifying.post(1, [](game::match& m, std::vector<game::Update*>* out) {
+		out->emplace_back(new game::Update());
+	});
+	CHECK_EQ(wait_for([&]() { return notified.load() == 1; }), true);
+	game::match_scheduler::result r;
+	CHECK_EQ(notifying.read_result(&r), true);
+	CHECK_EQ(r.match_id, 1);
+	delete r.up;
+}
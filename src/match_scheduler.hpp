@@ -0,0 +1,123 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "match.hpp"
+#include "queue.hpp"
+
+namespace game
+{
+	// Runs matches on a fixed size pool of worker threads.
+	//
+	// Work for a match is queued on the match and a match is only ever run by one worker at
+	// a time, so the game code doesn't need any locking. Each match has a home worker that it
+	// is queued on when there is work for it, workers that run out of matches of their own
+	// steal them from the back of the other workers queues, so busy (e.g. bot heavy) matches
+	// don't hold up the matches that share a worker with them.
+	class match_scheduler
+	{
+	public:
+		// A job is run on a worker with exclusive access to the match. Updates to be sent
+		// to the players of the match are added to out.
+		typedef std::function<void(match& m, std::vector<Update*>* out)> job;
+
+		struct result
+		{
+			int match_id;
+			Update* up;
+		};
+
+		// on_result, if given, is called on a worker each time it has queued results, for
+		// instance to wake the thread that reads them.
+		explicit match_scheduler(int num_workers, const std::function<void()>& on_result=std::function<void()>());
+		~match_scheduler();
+
+		void add_match(const match_ptr& m);
+		// The match is dropped once any job running on it has finished, jobs still queued
+		// for it are discarded.
+		void remove_match(int match_id);
+
+		// Queue a job for the given match. Jobs for a match run in the order they were posted.
+		void post(int match_id, const job& j);
+		// Convenience for queuing an update from a player, see match::process(). Takes
+		// ownership of up.
+		void post_update(int match_id, const uuid::uuid& sender, Update* up);
+		void post_update(int match_id, const uuid::uuid& sender, const std::shared_ptr<Update>& up);
+
+		// Fetches the next update produced by a job, returns false if there are none waiting.
+		// The caller takes ownership of the update.
+		bool read_result(result* r);
+
+		// Number of jobs that are queued or running.
+		int jobs_in_flight() const { return in_flight_; }
+		int num_workers() const { return static_cast<int>(workers_.size()); }
+	private:
+		struct entry
+		{
+			explicit entry(const match_ptr& mm, int h) : m(mm), home(h), scheduled(false), removed(false) {}
+			match_ptr m;
+			int home;
+			std::mutex guard;
+			// Following are protected by guard.
+			std::deque<job> jobs;
+			// Set while the match is in a workers ready queue or being run by a worker.
+			bool scheduled;
+			bool removed;
+		};
+		typedef std::shared_ptr<entry> entry_ptr;
+
+		struct worker
+		{
+			std::thread thread;
+			std::mutex guard;
+			std::deque<entry_ptr> ready;
+		};
+
+		void schedule(const entry_ptr& e);
+		entry_ptr next_entry(int worker_id);
+		void run_entry(const entry_ptr& e);
+		void worker_thread(int worker_id);
+
+		std::vector<std::unique_ptr<worker>> workers_;
+
+		std::mutex entries_guard_;
+		std::map<int, entry_ptr> entries_;
+
+		// Workers sleep on this when there are no ready matches.
+		std::mutex sleep_guard_;
+		std::condition_variable sleep_cv_;
+		int ready_count_;
+		bool running_;
+
+		std::atomic<int> in_flight_;
+		queue::mpsc_queue<result> results_;
+		std::function<void()> on_result_;
+
+		match_scheduler(const match_scheduler&) = delete;
+		void operator=(const match_scheduler&) = delete;
+	};
+}
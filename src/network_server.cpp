@@ -15,7 +15,11 @@
 */
 
 
+#include <thread>
+#include <vector>
+
 #include "network_server.hpp"
+#include "unit_test.hpp"
 
 namespace network
 {
@@ -46,6 +50,15 @@ namespace network
 		return nullptr;
 	}
 
+	game::Update* base::wait_recv_queue(int64_t timeout)
+	{
+		game::Update* up = nullptr;
+		if(rcv_q_.wait_and_pop(up, timeout)) {
+			return up;
+		}
+		return nullptr;
+	}
+
 	game::Update* base::read_send_queue()
 	{
 		game::Update* up = nullptr;
@@ -55,8 +68,60 @@ namespace network
 		return nullptr;
 	}
 
+	size_t base::read_send_queue(game::Update** ups, size_t max_count)
+	{
+		return snd_q_.try_pop_n(ups, max_count);
+	}
+
 	void base::write_recv_queue(game::Update* up)
 	{
 		rcv_q_.push(up);
 	}
 }
+
+UNIT_TEST(message_queues)
+{
+	// Wraps around a small ring a few times.
+	queue::spsc_queue<int> sq(4);
+	int out[4];
+	for(int n = 0; n != 10; ++n) {
+		CHECK(sq.try_push(n * 3), "push failed");
+		CHECK(sq.try_push(n * 3 + 1), "push failed");
+		CHECK(sq.try_push(n * 3 + 2), "push failed");
+		CHECK_EQ(sq.try_pop_n(out, 4), 3);
+		CHECK_EQ(out[0], n * 3);
+		CHECK_EQ(out[2], n * 3 + 2);
+	}
+	CHECK(sq.empty(), "queue should be empty");
+
+	queue::mpsc_queue<int> mq(8);
+	for(int n = 0; n != 8; ++n) {
+		CHECK(mq.try_push(n), "push failed");
+	}
+	CHECK(!mq.try_push(8), "push to a full queue should fail");
+	CHECK_EQ(mq.try_pop_n(out, 4), 4);
+	CHECK_EQ(out[3], 3);
+
+	// Items from each producer arrive in the order that producer pushed them.
+	mq.try_pop_n(out, 4);
+	const int per_thread = 1000;
+	std::vector<std::thread> producers;
+	for(int t = 0; t != 3; ++t) {
+		producers.emplace_back([&mq, t, per_thread]() {
+			for(int n = 0; n != per_thread; ++n) {
+				mq.push(t * per_thread + n);
+			}
+		});
+	}
+	std::vector<int> last(3, -1);
+	for(int received = 0; received != 3 * per_thread; ++received) {
+		int v;
+		CHECK(mq.wait_and_pop(v, 1000), "timed out waiting for producers");
+		CHECK_GT(v % per_thread, last[v / per_thread]);
+		last[v / per_thread] = v % per_thread;
+	}
+	for(auto& t : producers) {
+		t.join();
+	}
+	CHECK(mq.empty(), "queue should be empty");
+}
@@ -33,14 +33,21 @@ namespace network
 
 		void write_send_queue(game::Update*);
 		game::Update* read_recv_queue();
+		// Blocks until an update is received or timeout milliseconds have passed, returning
+		// nullptr on timeout. A timeout of 0 waits indefinitely.
+		game::Update* wait_recv_queue(int64_t timeout=0);
 
 		void write_recv_queue(game::Update* up);
 		game::Update* read_send_queue();
+		// Reads up to max_count updates into ups, returning the number read.
+		size_t read_send_queue(game::Update** ups, size_t max_count);
 
 		virtual void add_peer(std::weak_ptr<base> peer) = 0;
 	private:
-		queue::queue<game::Update*> snd_q_;
-		queue::queue<game::Update*> rcv_q_;
+		// Only the owner of this end writes to the send queue, while any number of
+		// peers may write to the receive queue.
+		queue::spsc_queue<game::Update*> snd_q_;
+		queue::mpsc_queue<game::Update*> rcv_q_;
 
 		virtual void handle_process() = 0;
 
@@ -0,0 +1,336 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <algorithm>
+#include <limits>
+
+#include "asserts.hpp"
+#include "creature.hpp"
+#include "game_state.hpp"
+#include "hex_logical_tiles.hpp"
+#include "node_utils.hpp"
+#include "occupancy.hpp"
+#include "unit_test.hpp"
+#include "units.hpp"
+
+namespace game
+{
+	occupancy::occupancy()
+		: x_(0),
+		  y_(0),
+		  width_(0),
+		  height_(0)
+	{
+	}
+
+	void occupancy::clear()
+	{
+		x_ = y_ = width_ = height_ = 0;
+		teams_.clear();
+		tile_units_.clear();
+		tile_count_.clear();
+		tile_team_.clear();
+		stacked_.clear();
+		zoc_total_.clear();
+		zoc_.clear();
+	}
+
+	void occupancy::reset(const hex::logical::map_ptr& map, const unit_list& units)
+	{
+		clear();
+		if(map == nullptr) {
+			return;
+		}
+		x_ = map->x();
+		y_ = map->y();
+		width_ = map->width();
+		height_ = map->height();
+		const int size = width_ * height_;
+		tile_units_.resize(size);
+		tile_count_.resize(size, 0);
+		tile_team_.resize(size, -1);
+		zoc_total_.resize(size, 0);
+		for(auto& u : units) {
+			add(u);
+		}
+	}
+
+	int occupancy::find_team(const team_ptr& t) const
+	{
+		for(int n = 0; n != static_cast<int>(teams_.size()); ++n) {
+			if(teams_[n] == t->id()) {
+				return n;
+			}
+		}
+		return -1;
+	}
+
+	int occupancy::get_team_index(const team_ptr& t)
+	{
+		int ndx = find_team(t);
+		if(ndx < 0) {
+			ASSERT_LOG(teams_.size() < static_cast<size_t>(std::numeric_limits<int8_t>::max()), "Too many teams.");
+			ndx = static_cast<int>(teams_.size());
+			teams_.emplace_back(t->id());
+			zoc_.emplace_back(zoc_total_.size(), 0);
+		}
+		return ndx;
+	}
+
+	void occupancy::change_zoc(const point& p, int team_ndx, int delta)
+	{
+		for(auto n : hex::neighbours(p)) {
+			if(contains(n)) {
+				const int ndx = index(n);
+				zoc_total_[ndx] += delta;
+				zoc_[team_ndx][ndx] += delta;
+			}
+		}
+	}
+
+	void occupancy::add_at(const unit_ptr& u, const point& p, int team_ndx)
+	{
+		if(!contains(p)) {
+			return;
+		}
+		const int ndx = index(p);
+		if(tile_count_[ndx] == 0) {
+			tile_units_[ndx] = u;
+			tile_team_[ndx] = static_cast<int8_t>(team_ndx);
+		} else {
+			stacked_.emplace_back(ndx, u);
+		}
+		++tile_count_[ndx];
+		change_zoc(p, team_ndx, 1);
+	}
+
+	void occupancy::remove_at(const unit_ptr& u, const point& p, int team_ndx)
+	{
+		if(!contains(p)) {
+			return;
+		}
+		const int ndx = index(p);
+		ASSERT_LOG(tile_count_[ndx] > 0, "Removing unit " << u << " from empty tile " << p);
+		if(tile_units_[ndx].get() == u.get()) {
+			tile_units_[ndx].reset();
+			// promote a unit sharing the tile, if there is one.
+			auto it = std::find_if(stacked_.begin(), stacked_.end(), [ndx](const std::pair<int, unit_ptr>& s) {
+				return s.first == ndx;
+			});
+			if(it != stacked_.end()) {
+				tile_units_[ndx] = it->second;
+				stacked_.erase(it);
+			}
+		} else {
+			auto it = std::find_if(stacked_.begin(), stacked_.end(), [ndx, &u](const std::pair<int, unit_ptr>& s) {
+				return s.first == ndx && s.second.get() == u.get();
+			});
+			ASSERT_LOG(it != stacked_.end(), "Unit " << u << " wasn't found at " << p);
+			stacked_.erase(it);
+		}
+		if(--tile_count_[ndx] == 0) {
+			tile_team_[ndx] = -1;
+		}
+		change_zoc(p, team_ndx, -1);
+	}
+
+	void occupancy::add(const unit_ptr& u)
+	{
+		if(tile_units_.empty()) {
+			return;
+		}
+		add_at(u, u->get_position(), get_team_index(u->get_owner()->team()));
+	}
+
+	void occupancy::remove(const unit_ptr& u)
+	{
+		if(tile_units_.empty()) {
+			return;
+		}
+		remove_at(u, u->get_position(), get_team_index(u->get_owner()->team()));
+	}
+
+	void occupancy::move(const unit_ptr& u, const point& from, const point& to)
+	{
+		if(tile_units_.empty() || from == to) {
+			return;
+		}
+		const int team_ndx = get_team_index(u->get_owner()->team());
+		remove_at(u, from, team_ndx);
+		add_at(u, to, team_ndx);
+	}
+
+	unit_ptr occupancy::unit_at(const point& p) const
+	{
+		if(tile_units_.empty() || !contains(p)) {
+			return unit_ptr();
+		}
+		return tile_units_[index(p)];
+	}
+
+	bool occupancy::is_occupied(const point& p) const
+	{
+		if(tile_units_.empty() || !contains(p)) {
+			return false;
+		}
+		return tile_count_[index(p)] > 0;
+	}
+
+	bool occupancy::is_enemy_at(const point& p, const team_ptr& t) const
+	{
+		if(tile_units_.empty() || !contains(p)) {
+			return false;
+		}
+		const int ndx = index(p);
+		return tile_team_[ndx] >= 0 && tile_team_[ndx] != find_team(t);
+	}
+
+	bool occupancy::is_enemy_zoc(const point& p, const team_ptr& t) const
+	{
+		if(tile_units_.empty() || !contains(p)) {
+			return false;
+		}
+		const int ndx = index(p);
+		const int team_ndx = find_team(t);
+		const int own = team_ndx >= 0 ? zoc_[team_ndx][ndx] : 0;
+		return zoc_total_[ndx] > own && !is_enemy_at(p, t);
+	}
+}
+
+UNIT_TEST(occupancy)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+	node_builder mb;
+	mb.add("width", 6);
+	for(int n = 0; n != 36; ++n) {
+		mb.add("tiles", "flat");
+	}
+	auto map = hex::logical::map::factory(mb.build());
+
+	node_builder idle;
+	idle.add("image", "none.png");
+	for(int n = 0; n != 4; ++n) {
+		idle.add("area", n / 2);
+	}
+	node_builder anims;
+	anims.add("idle", idle.build());
+	auto type = std::make_shared<creature::creature>(node_builder()
+		.add("name", "c")
+		.add("stats", node_builder().add("health", 10).add("attack", 1).build())
+		.add("animations", anims.build()).build());
+
+	game::state gs;
+	std::vector<player_ptr> players;
+	for(auto name : { "a", "b", "c" }) {
+		players.emplace_back(std::make_shared<player>(gs.create_team_instance(name), PlayerType::NORMAL, name));
+	}
+	game::unit_list units;
+	auto make_unit = [&](int owner, int x, int y) {
+		auto u = std::make_shared<game::unit>("u", type, players[owner]);
+		u->set_position(x, y);
+		units.emplace_back(u);
+		return u;
+	};
+	make_unit(0, 1, 1);
+	make_unit(1, 3, 1);
+	make_unit(2, 2, 4);
+	game::occupancy occ;
+	occ.reset(map, units);
+
+	// Checks every query against a search of the units.
+	auto check_all = [&]() {
+		for(int y = 0; y != 6; ++y) {
+			for(int x = 0; x != 6; ++x) {
+				const point p(x, y);
+				std::vector<game::unit_ptr> here;
+				for(auto& u : units) {
+					if(u->get_position() == p) {
+						here.emplace_back(u);
+					}
+				}
+				CHECK_EQ(occ.is_occupied(p), !here.empty());
+				CHECK_EQ(occ.unit_at(p) == nullptr ? here.empty() 
+					: std::find(here.begin(), here.end(), occ.unit_at(p)) != here.end(), true);
+				for(auto& pl : players) {
+					bool enemy_at = false;
+					for(auto& u : here) {
+						enemy_at |= u->get_owner()->team() != pl->team();
+					}
+					bool enemy_adjacent = false;
+					for(auto& u : units) {
+						enemy_adjacent |= u->get_owner()->team() != pl->team() && hex::logical::distance(u->get_position(), p) == 1;
+					}
+					CHECK_EQ(occ.is_enemy_at(p, pl->team()), enemy_at);
+					CHECK_EQ(occ.is_enemy_zoc(p, pl->team()), enemy_adjacent && !enemy_at);
+				}
+			}
+		}
+	};
+	check_all();
+
+	// A tile next to units of two other teams stays under ZoC until both have gone.
+	const point between(2, 1);
+	CHECK_EQ(occ.is_enemy_zoc(between, players[2]->team()), true);
+	CHECK_EQ(occ.is_enemy_zoc(between, players[0]->team()), true);
+	auto b = units[1];
+	occ.move(b, b->get_position(), point(5, 5));
+	b->set_position(5, 5);
+	CHECK_EQ(occ.is_enemy_zoc(between, players[2]->team()), true);
+	CHECK_EQ(occ.is_enemy_zoc(between, players[0]->team()), false);
+	check_all();
+
+	// A tile holding an enemy isn't under its ZoC, even with enemies next to it.
+	auto c = make_unit(2, 2, 1);
+	occ.add(c);
+	CHECK_EQ(occ.is_enemy_at(between, players[0]->team()), true);
+	CHECK_EQ(occ.is_enemy_zoc(between, players[0]->team()), false);
+	for(auto n : hex::neighbours(between)) {
+		if(n.x >= 0 && n.y >= 0 && n.x < 6 && n.y < 6 && !occ.is_occupied(n)) {
+			CHECK_EQ(occ.is_enemy_zoc(n, players[0]->team()), true);
+		}
+	}
+	check_all();
+
+	// Units of the same team stacked on a tile.
+	auto a2 = make_unit(0, 1, 1);
+	occ.add(a2);
+	auto a3 = make_unit(0, 1, 1);
+	occ.add(a3);
+	check_all();
+	auto first = occ.unit_at(point(1, 1));
+	occ.remove(first);
+	units.erase(std::find(units.begin(), units.end(), first));
+	CHECK_EQ(occ.is_occupied(point(1, 1)), true);
+	CHECK_NE(occ.unit_at(point(1, 1)).get(), first.get());
+	check_all();
+	for(auto u : units) {
+		if(u->get_position() == point(1, 1)) {
+			occ.move(u, u->get_position(), point(0, 5));
+			u->set_position(0, 5);
+		}
+	}
+	CHECK_EQ(occ.is_occupied(point(1, 1)), false);
+	CHECK_EQ(occ.is_enemy_zoc(point(1, 1), players[1]->team()), true);
+	check_all();
+
+	for(auto& u : units) {
+		occ.remove(u);
+	}
+	units.clear();
+	check_all();
+}
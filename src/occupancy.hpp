@@ -0,0 +1,87 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.hpp"
+#include "hex_logical_fwd.hpp"
+#include "player.hpp"
+#include "units_fwd.hpp"
+#include "uuid.hpp"
+
+namespace game
+{
+	// Per-tile index of which unit stands where and which teams exert a zone of control
+	// over each tile. It's kept up to date by game::state as units are added, moved and
+	// removed so that the queries below are constant time rather than a scan of all units.
+	class occupancy
+	{
+	public:
+		occupancy();
+
+		// Resize to cover the given map and rebuild from the list of units.
+		void reset(const hex::logical::map_ptr& map, const unit_list& units);
+		void clear();
+
+		// N.B. These use the units current position and owner, so call remove() before
+		// changing either and add() afterwards, or use move().
+		void add(const unit_ptr& u);
+		void remove(const unit_ptr& u);
+		void move(const unit_ptr& u, const point& from, const point& to);
+
+		// Returns a unit on the tile or nullptr if the tile is empty.
+		unit_ptr unit_at(const point& p) const;
+		bool is_occupied(const point& p) const;
+		// Is there a unit not belonging to team t on the tile.
+		bool is_enemy_at(const point& p, const team_ptr& t) const;
+		// Is the tile adjacent to a unit not belonging to team t. Tiles holding such a unit
+		// aren't considered to be under ZoC.
+		bool is_enemy_zoc(const point& p, const team_ptr& t) const;
+	private:
+		bool contains(const point& p) const {
+			return p.x >= x_ && p.y >= y_ && p.x < x_ + width_ && p.y < y_ + height_;
+		}
+		int index(const point& p) const { return (p.y - y_) * width_ + (p.x - x_); }
+		int find_team(const team_ptr& t) const;
+		int get_team_index(const team_ptr& t);
+		void add_at(const unit_ptr& u, const point& p, int team_ndx);
+		void remove_at(const unit_ptr& u, const point& p, int team_ndx);
+		void change_zoc(const point& p, int team_ndx, int delta);
+
+		int x_;
+		int y_;
+		int width_;
+		int height_;
+
+		// Teams seen so far, the position in this list is the team index used below.
+		std::vector<uuid::uuid> teams_;
+		// Unit standing on each tile.
+		std::vector<unit_ptr> tile_units_;
+		// Number of units on each tile. Normally zero or one, units on the same team can
+		// end up sharing a tile though.
+		std::vector<uint8_t> tile_count_;
+		// Index of the team the units on the tile belong to, -1 for an empty tile.
+		std::vector<int8_t> tile_team_;
+		// Units past the first on a shared tile, with the tile index they're on.
+		std::vector<std::pair<int, unit_ptr>> stacked_;
+		// Number of units adjacent to each tile, in total and per team.
+		std::vector<uint16_t> zoc_total_;
+		std::vector<std::vector<uint16_t>> zoc_;
+	};
+}
@@ -24,7 +24,7 @@ template<typename T, typename R=int, unsigned MAX_OBJECTS=10, unsigned MAX_LEVEL
 class quadtree
 {
 public:
-	explicit quadtree(int level, const geometry::Rect<R>& bounds) 
+	explicit quadtree(unsigned level, const geometry::Rect<R>& bounds) 
 		: level_(level), 
 		  bounding_rect_(bounds) 
 	{
@@ -75,6 +75,18 @@ public:
 			}
 		}
 	}
+	// Remove an object that was inserted with the area r.
+	void remove(const T& obj, const geometry::Rect<R>& r) {
+		if(!nodes_.empty()) {
+			int index = get_index(r);
+			if(index != -1) {
+				nodes_[index].remove(obj, r);
+				return;
+			}
+		}
+		objects_.erase(std::make_pair(obj, r));
+	}
+	// Remove an object when the area it was inserted with isn't known, this looks at every node.
 	void remove(const T& obj) {
 		auto it = objects_.begin();
 		while(it != objects_.end()) {
@@ -84,24 +96,38 @@ public:
 				++it;
 			}
 		}
-	}
-	void get_collidable(std::vector<T>& res, const geometry::Rect<R>& r) {
-		int index = get_index(r);
-		if(index == -1 && !nodes_.empty()) {
-			nodes_[index].get_collidable(res, r);
+		for(auto& n : nodes_) {
+			n.remove(obj);
 		}
+	}
+	// Adds every object whose area intersects r to res.
+	void get_collidable(std::vector<T>& res, const geometry::Rect<R>& r) const {
 		for(auto& obj : objects_) {
-			res.emplace_back(obj.first);
+			if(geometry::rects_intersect(obj.second, r)) {
+				res.emplace_back(obj.first);
+			}
+		}
+		for(auto& n : nodes_) {
+			if(geometry::rects_intersect(n.bounding_rect_, r)) {
+				n.get_collidable(res, r);
+			}
 		}
 	}
+	const geometry::Rect<R>& get_bounds() const { return bounding_rect_; }
 private:
-	int level_;
+	unsigned level_;
 	geometry::Rect<R> bounding_rect_;
 	std::set<std::pair<T,geometry::Rect<R>>> objects_;
 	std::vector<quadtree<T, R, MAX_OBJECTS, MAX_LEVELS>> nodes_;
 
-	int get_index(const geometry::Rect<R> r) {
+	// Returns the child node that r fits entirely inside, or -1 if it doesn't fit in any of them.
+	int get_index(const geometry::Rect<R>& r) const {
 		int index = -1;
+		// Objects outside our bounds stay at this level, otherwise queries would never find them.
+		if(r.x() < bounding_rect_.x() || r.y() < bounding_rect_.y() 
+			|| r.x2() > bounding_rect_.x2() || r.y2() > bounding_rect_.y2()) {
+			return index;
+		}
 		bool tq = r.y() < bounding_rect_.mid_y() && r.y2() < bounding_rect_.mid_y();
 		bool bq = r.y() > bounding_rect_.mid_y();
 		if(r.x() < bounding_rect_.mid_x() && r.x2() < bounding_rect_.mid_x()) {
@@ -16,72 +16,289 @@
 
 #pragma once
 
-#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
-#include <queue>
-#include <thread>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
-#include <chrono>
+#include <thread>
 
+// Lock-free bounded queues for passing messages between threads.
+//
+// spsc_queue has a single producer and a single consumer, mpsc_queue allows any number
+// of producers and a single consumer. Both are ring buffers whose capacity is rounded up
+// to a power of two. push() yields while the queue is full, try_push() fails instead.
+// Only the consumer may call the pop functions, wait_and_pop() or empty().
 namespace queue 
 {
+	namespace detail
+	{
+		// Typical cache line size, used to keep the producer and consumer ends of a queue
+		// from sharing a line.
+		const size_t cache_line_size = 64;
+
+		inline size_t round_up_pow2(size_t n)
+		{
+			size_t res = 1;
+			while(res < n) {
+				res <<= 1;
+			}
+			return res;
+		}
+
+		// Lets the consumer sleep while a queue is empty. Producers only take the lock when
+		// the consumer is actually asleep, so pushing to a queue that is being polled is
+		// just a fence and a load.
+		class waiter
+		{
+		public:
+			waiter() : sleepers_(0) {}
+
+			void notify()
+			{
+				// Pairs with the fence in wait(). Either the consumer sees the item that was
+				// just published, or we see that it's waiting.
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if(sleepers_.load(std::memory_order_relaxed) > 0) {
+					std::lock_guard<std::mutex> lock(guard_);
+					cv_.notify_one();
+				}
+			}
+
+			// Wait until ready() returns true or timeout milliseconds have passed, a timeout
+			// of 0 waits indefinitely. Returns the last value of ready().
+			template<typename Pred>
+			bool wait(Pred ready, int64_t timeout)
+			{
+				std::unique_lock<std::mutex> lock(guard_);
+				sleepers_.fetch_add(1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				bool res = true;
+				if(timeout > 0) {
+					res = cv_.wait_for(lock, std::chrono::milliseconds(timeout), ready);
+				} else {
+					cv_.wait(lock, ready);
+				}
+				sleepers_.fetch_sub(1, std::memory_order_relaxed);
+				return res;
+			}
+		private:
+			std::atomic<int> sleepers_;
+			std::mutex guard_;
+			std::condition_variable cv_;
+		};
+	}
+
 	template<class T>
-	class queue
+	class spsc_queue
 	{
 	public:
-		queue()
-		{}
-		void push(T const& data)
-		{
-			std::unique_lock<std::mutex> lock(guard_);
-			q_.push(data);
-			lock.unlock();
-			cv_.notify_one();
+		explicit spsc_queue(size_t capacity=1024)
+			: capacity_(detail::round_up_pow2(capacity)),
+			  mask_(capacity_ - 1),
+			  buffer_(new T[capacity_]),
+			  head_(0),
+			  cached_tail_(0),
+			  tail_(0),
+			  cached_head_(0)
+		{
 		}
 
-		bool empty() const
+		bool try_push(const T& data)
 		{
-			std::unique_lock<std::mutex> lock(guard_);
-			return q_.empty();
+			const size_t tail = tail_.load(std::memory_order_relaxed);
+			if(tail - cached_head_ == capacity_) {
+				cached_head_ = head_.load(std::memory_order_acquire);
+				if(tail - cached_head_ == capacity_) {
+					return false;
+				}
+			}
+			buffer_[tail & mask_] = data;
+			tail_.store(tail + 1, std::memory_order_release);
+			waiter_.notify();
+			return true;
+		}
+
+		void push(const T& data)
+		{
+			while(!try_push(data)) {
+				std::this_thread::yield();
+			}
 		}
 
 		bool try_pop(T& popped_value)
 		{
-			std::unique_lock<std::mutex> lock(guard_);
-			if(q_.empty()) {
-				return false;
+			return try_pop_n(&popped_value, 1) == 1;
+		}
+
+		// Pops up to n items into out, returning the number popped.
+		size_t try_pop_n(T* out, size_t n)
+		{
+			const size_t head = head_.load(std::memory_order_relaxed);
+			if(cached_tail_ - head < n) {
+				cached_tail_ = tail_.load(std::memory_order_acquire);
 			}
-        
-			popped_value = q_.front();
-			q_.pop();
-			return true;
+			const size_t count = std::min(n, cached_tail_ - head);
+			for(size_t i = 0; i != count; ++i) {
+				out[i] = buffer_[(head + i) & mask_];
+			}
+			if(count != 0) {
+				head_.store(head + count, std::memory_order_release);
+			}
+			return count;
+		}
+
+		// Blocks until there is an item to pop or timeout milliseconds have passed, in
+		// which case false is returned. A timeout of 0 waits indefinitely.
+		bool wait_and_pop(T& popped_value, int64_t timeout=0)
+		{
+			if(try_pop(popped_value)) {
+				return true;
+			}
+			waiter_.wait([this]() { return !empty(); }, timeout);
+			return try_pop(popped_value);
 		}
 
-		bool wait_and_pop(T& popped_value, int64_t interval = 0)
+		bool empty() const
 		{
-			using namespace std::chrono;
-			std::unique_lock<std::mutex> lock(guard_);
-			system_clock::time_point time_limit = system_clock::now() + milliseconds(interval);
-			while(q_.empty()) {
-				if(interval) {
-					if(cv_.wait_until<system_clock, system_clock::duration>(lock, time_limit) == std::cv_status::timeout) {
-						return false;
+			return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+		}
+	private:
+		const size_t capacity_;
+		const size_t mask_;
+		std::unique_ptr<T[]> buffer_;
+
+		// Consumer end.
+		char pad0_[detail::cache_line_size];
+		std::atomic<size_t> head_;
+		size_t cached_tail_;
+
+		// Producer end.
+		char pad1_[detail::cache_line_size];
+		std::atomic<size_t> tail_;
+		size_t cached_head_;
+		char pad2_[detail::cache_line_size];
+
+		detail::waiter waiter_;
+
+		spsc_queue(const spsc_queue&) = delete;
+		void operator=(const spsc_queue&) = delete;
+	};
+
+	// Bounded multi-producer queue, after Dmitry Vyukov's. Each slot carries a sequence
+	// number which says whether it is free for the producer claiming that position or
+	// holds an item for the consumer.
+	template<class T>
+	class mpsc_queue
+	{
+	public:
+		explicit mpsc_queue(size_t capacity=1024)
+			: capacity_(detail::round_up_pow2(capacity)),
+			  mask_(capacity_ - 1),
+			  cells_(new cell[capacity_]),
+			  head_(0),
+			  tail_(0)
+		{
+			for(size_t n = 0; n != capacity_; ++n) {
+				cells_[n].sequence.store(n, std::memory_order_relaxed);
+			}
+		}
+
+		bool try_push(const T& data)
+		{
+			size_t pos = tail_.load(std::memory_order_relaxed);
+			cell* c = nullptr;
+			while(true) {
+				c = &cells_[pos & mask_];
+				const size_t seq = c->sequence.load(std::memory_order_acquire);
+				const ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+				if(diff == 0) {
+					if(tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						break;
 					}
+				} else if(diff < 0) {
+					// The consumer hasn't freed this slot yet, so the queue is full.
+					return false;
 				} else {
-					cv_.wait(lock);
+					pos = tail_.load(std::memory_order_relaxed);
 				}
 			}
-        
-			popped_value = q_.front();
-			q_.pop();
+			c->data = data;
+			c->sequence.store(pos + 1, std::memory_order_release);
+			waiter_.notify();
 			return true;
 		}
 
+		void push(const T& data)
+		{
+			while(!try_push(data)) {
+				std::this_thread::yield();
+			}
+		}
+
+		bool try_pop(T& popped_value)
+		{
+			return try_pop_n(&popped_value, 1) == 1;
+		}
+
+		// Pops up to n items into out, returning the number popped.
+		size_t try_pop_n(T* out, size_t n)
+		{
+			size_t head = head_.load(std::memory_order_relaxed);
+			size_t count = 0;
+			for(; count != n; ++count, ++head) {
+				cell& c = cells_[head & mask_];
+				if(c.sequence.load(std::memory_order_acquire) != head + 1) {
+					break;
+				}
+				out[count] = c.data;
+				c.sequence.store(head + capacity_, std::memory_order_release);
+			}
+			head_.store(head, std::memory_order_relaxed);
+			return count;
+		}
+
+		// Blocks until there is an item to pop or timeout milliseconds have passed, in
+		// which case false is returned. A timeout of 0 waits indefinitely.
+		bool wait_and_pop(T& popped_value, int64_t timeout=0)
+		{
+			if(try_pop(popped_value)) {
+				return true;
+			}
+			waiter_.wait([this]() { return !empty(); }, timeout);
+			return try_pop(popped_value);
+		}
+
+		bool empty() const
+		{
+			const size_t head = head_.load(std::memory_order_relaxed);
+			return cells_[head & mask_].sequence.load(std::memory_order_acquire) != head + 1;
+		}
 	private:
-		std::queue<T> q_;
-		mutable std::mutex guard_;
-		std::condition_variable cv_;
-		queue(const queue&) = delete;
-		void operator=(const queue&) = delete;
+		struct cell
+		{
+			std::atomic<size_t> sequence;
+			T data;
+		};
+
+		const size_t capacity_;
+		const size_t mask_;
+		std::unique_ptr<cell[]> cells_;
+
+		// Only touched by the consumer.
+		char pad0_[detail::cache_line_size];
+		std::atomic<size_t> head_;
+
+		char pad1_[detail::cache_line_size];
+		std::atomic<size_t> tail_;
+		char pad2_[detail::cache_line_size];
+
+		detail::waiter waiter_;
+
+		mpsc_queue(const mpsc_queue&) = delete;
+		void operator=(const mpsc_queue&) = delete;
 	};
 }
@@ -16,6 +16,7 @@
 
 #include "asserts.hpp"
 #include "random.hpp"
+#include "unit_test.hpp"
 
 namespace generator
 {
@@ -32,6 +33,12 @@ namespace generator
 		return random_engine;
 	}
 
+	std::mutex& get_random_mutex()
+	{
+		static std::mutex res;
+		return res;
+	}
+
 	std::size_t get_seed()
 	{
 		return seed_internal;
@@ -45,8 +52,132 @@ namespace generator
 
 	std::size_t generate_seed()
 	{
-		seed_internal = std::default_random_engine()();
+		seed_internal = std::random_device()();
 		seed_set = true;
 		return seed_internal;
 	}
+
+	namespace
+	{
+		const uint32_t philox_m0 = 0xd2511f53;
+		const uint32_t philox_m1 = 0xcd9e8d57;
+		const uint32_t philox_w0 = 0x9e3779b9;
+		const uint32_t philox_w1 = 0xbb67ae85;
+	}
+
+	stream::stream(uint64_t key, uint64_t id)
+		: key_(key),
+		  id_(id),
+		  position_(0)
+	{
+	}
+
+	void stream::block(uint64_t key, uint64_t id, uint64_t counter, uint32_t out[4])
+	{
+		uint32_t c0 = static_cast<uint32_t>(counter);
+		uint32_t c1 = static_cast<uint32_t>(counter >> 32);
+		uint32_t c2 = static_cast<uint32_t>(id);
+		uint32_t c3 = static_cast<uint32_t>(id >> 32);
+		uint32_t k0 = static_cast<uint32_t>(key);
+		uint32_t k1 = static_cast<uint32_t>(key >> 32);
+		for(int round = 0; round != 10; ++round) {
+			const uint64_t p0 = static_cast<uint64_t>(philox_m0) * c0;
+			const uint64_t p1 = static_cast<uint64_t>(philox_m1) * c2;
+			const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+			const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+			c1 = static_cast<uint32_t>(p1);
+			c3 = static_cast<uint32_t>(p0);
+			c0 = n0;
+			c2 = n2;
+			k0 += philox_w0;
+			k1 += philox_w1;
+		}
+		out[0] = c0;
+		out[1] = c1;
+		out[2] = c2;
+		out[3] = c3;
+	}
+
+	uint32_t stream::next()
+	{
+		const int word = static_cast<int>(position_ & 3);
+		if(word == 0) {
+			block(key_, id_, position_ >> 2, buffer_);
+		}
+		++position_;
+		return buffer_[word];
+	}
+
+	void stream::set_position(uint64_t position)
+	{
+		position_ = position;
+		if((position_ & 3) != 0) {
+			block(key_, id_, position_ >> 2, buffer_);
+		}
+	}
+
+	int stream::uniform_int(int mn, int mx)
+	{
+		ASSERT_LOG(mn <= mx, "Bad range for a random number: " << mn << " to " << mx);
+		const uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(mx) - mn) + 1;
+		if(range > 0xffffffffULL) {
+			return static_cast<int>(next());
+		}
+		// Values below this would make some results more likely than others.
+		const uint32_t threshold = static_cast<uint32_t>((0x100000000ULL - range) % range);
+		uint32_t r;
+		do {
+			r = next();
+		} while(r < threshold);
+		return static_cast<int>(mn + static_cast<int64_t>(r % range));
+	}
+
+	float stream::uniform_real(float mn, float mx)
+	{
+		// 24 bits, all that fit in a float's mantissa.
+		return mn + (mx - mn) * (static_cast<float>(next() >> 8) * (1.0f / 16777216.0f));
+	}
+
+	uint64_t derive_seed(uint64_t seed, uint64_t n)
+	{
+		uint32_t out[4];
+		stream::block(seed, n, 0, out);
+		return (static_cast<uint64_t>(out[1]) << 32) | out[0];
+	}
+}
+
+UNIT_TEST(random_stream)
+{
+	// Known answer from the Random123 Philox4x32-10 test vectors.
+	uint32_t out[4];
+	generator::stream::block(0, 0, 0, out);
+	CHECK_EQ(out[0], 0x6627e8d5u);
+	CHECK_EQ(out[1], 0xe169c58du);
+	CHECK_EQ(out[2], 0xbc57ac4cu);
+	CHECK_EQ(out[3], 0x9b00dbd8u);
+
+	// Restarting from a position gives the same values as carrying on.
+	generator::stream a(42, 7);
+	for(int n = 0; n != 5; ++n) {
+		a.next();
+	}
+	generator::stream b(42, 7);
+	b.set_position(5);
+	for(int n = 0; n != 10; ++n) {
+		CHECK_EQ(a.next(), b.next());
+	}
+	CHECK_EQ(a.get_position(), 15u);
+	// Different streams from the same key differ.
+	generator::stream c(42, 8);
+	c.set_position(15);
+	CHECK_NE(a.next(), c.next());
+
+	for(int n = 0; n != 1000; ++n) {
+		const int i = a.uniform_int(-3, 3);
+		CHECK_GE(i, -3);
+		CHECK_LE(i, 3);
+		const float f = a.uniform_real(1.0f, 2.0f);
+		CHECK_GE(f, 1.0f);
+		CHECK_LT(f, 2.0f);
+	}
 }
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <mutex>
 #include <random>
 
 namespace generator
@@ -24,11 +26,53 @@ namespace generator
 	void set_seed(std::size_t seed);
 	std::size_t generate_seed();
 
+	// Process wide engine, for things that don't affect the game such as particle effects.
+	// Anything that does uses a stream belonging to the game, see game::state.
 	std::mt19937& get_random_engine();
+	// The engine is shared between threads, this must be held while using it.
+	std::mutex& get_random_mutex();
+
+	// Counter based random numbers (Philox4x32-10, from Salmon et al., "Parallel random
+	// numbers: as easy as 1, 2, 3"). Each value is a function of just the key, the stream id
+	// and the position in the stream, so a game can hand out as many independent streams as
+	// it likes from one seed, nothing is shared between them, and a stream can be restarted
+	// from any position to replay it.
+	//
+	// The uniform_*() functions give the same results on every platform, which the standard
+	// distributions don't promise, so they are used for anything that must be reproducible.
+	class stream
+	{
+	public:
+		explicit stream(uint64_t key = 0, uint64_t id = 0);
+
+		uint32_t next();
+		// In [mn, mx].
+		int uniform_int(int mn, int mx);
+		// In [mn, mx).
+		float uniform_real(float mn, float mx);
+
+		uint64_t get_key() const { return key_; }
+		uint64_t get_id() const { return id_; }
+		// Number of values drawn so far.
+		uint64_t get_position() const { return position_; }
+		void set_position(uint64_t position);
+
+		// The four values at counter in the stream.
+		static void block(uint64_t key, uint64_t id, uint64_t counter, uint32_t out[4]);
+	private:
+		uint64_t key_;
+		uint64_t id_;
+		uint64_t position_;
+		uint32_t buffer_[4];
+	};
+
+	// Key for the n'th of the things seeded from seed, e.g. the matches run by a server.
+	uint64_t derive_seed(uint64_t seed, uint64_t n);
 
 	template<typename T>
 	T get_uniform_int(T mn, T mx)
 	{
+		std::lock_guard<std::mutex> lock(get_random_mutex());
 		auto& re = get_random_engine();
 		std::uniform_int_distribution<T> uniform_dist(mn, mx);
 		return uniform_dist(re);
@@ -37,6 +81,7 @@ namespace generator
 	template<typename T>
 	T get_uniform_real(T mn, T mx)
 	{
+		std::lock_guard<std::mutex> lock(get_random_mutex());
 		auto& re = get_random_engine();
 		std::uniform_real_distribution<T> uniform_dist(mn, mx);
 		return uniform_dist(re);
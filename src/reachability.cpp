@@ -0,0 +1,243 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <iterator>
+#include <limits>
+
+#include "asserts.hpp"
+#include "creature.hpp"
+#include "hex_logical_tiles.hpp"
+#include "node_utils.hpp"
+#include "reachability.hpp"
+#include "unit_test.hpp"
+#include "units.hpp"
+
+namespace ai
+{
+	reachability::reachability(const game::state& gs)
+		: gs_(gs)
+	{
+	}
+
+	reachability::team_info& reachability::get_team_info(const team_ptr& t)
+	{
+		auto it = teams_.find(t->id());
+		if(it != teams_.end()) {
+			return it->second;
+		}
+		team_info& ti = teams_[t->id()];
+		ti.graph = hex::create_graph(gs_, t, creature::MovementType::NORMAL);
+		std::vector<point> enemies;
+		for(auto& u : gs_.get_entities()) {
+			if(u->get_owner()->team() != t) {
+				enemies.emplace_back(u->get_position());
+			}
+		}
+		ti.enemy_field = hex::find_distance_field(ti.graph, enemies);
+		return ti;
+	}
+
+	reachability::team_info& reachability::get_team_info(const game::unit_ptr& u)
+	{
+		auto& ti = get_team_info(u->get_owner()->team());
+		if(ti.graph->movement_type != u->get_movement_type()) {
+			hex::set_movement_type(ti.graph, u->get_movement_type());
+		}
+		return ti;
+	}
+
+	int reachability::enemy_distance(const team_ptr& t, const point& p)
+	{
+		auto& ti = get_team_info(t);
+		if(!ti.graph->contains(p)) {
+			return std::numeric_limits<int>::max();
+		}
+		return ti.enemy_field[ti.graph->index(p)];
+	}
+
+	const hex::result_list& reachability::get_moves(const game::unit_ptr& u)
+	{
+		auto it = moves_.find(u->get_uuid());
+		if(it != moves_.end()) {
+			return it->second;
+		}
+		auto& ti = get_team_info(u);
+		return moves_[u->get_uuid()] = hex::find_available_moves(ti.graph, u->get_position(), u->get_move());
+	}
+
+	bool reachability::find_closest_to_enemy(const game::unit_ptr& u, point* dest)
+	{
+		ASSERT_LOG(dest != nullptr, "No destination given.");
+		auto& ti = get_team_info(u->get_owner()->team());
+		auto& occ = gs_.get_occupancy();
+		const point& pos = u->get_position();
+
+		int best_d = enemy_distance(u->get_owner()->team(), pos);
+		float best_cost = 0;
+		bool found = false;
+		for(auto& mc : get_moves(u)) {
+			if(mc.loc == pos || occ.is_occupied(mc.loc)) {
+				continue;
+			}
+			const int d = ti.enemy_field[ti.graph->index(mc.loc)];
+			if(d < best_d || (found && d == best_d && mc.path_cost < best_cost)) {
+				best_d = d;
+				best_cost = mc.path_cost;
+				*dest = mc.loc;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	hex::result_path reachability::find_path(const game::unit_ptr& u, const point& dest)
+	{
+		return hex::find_path(get_team_info(u).graph, u->get_position(), dest);
+	}
+}
+
+namespace
+{
+	// Cheapest cost of every tile reachable for less than max_cost, found by trying every path.
+	void brute_force_moves(const game::state& gs, const team_ptr& t, const point& p, float cost, float max_cost, std::map<point, float>* best)
+	{
+		auto it = best->find(p);
+		if(it != best->end() && it->second <= cost) {
+			return;
+		}
+		(*best)[p] = cost;
+		if(cost >= max_cost) {
+			return;
+		}
+		auto& map = gs.get_map();
+		auto is_enemy_at = [&](const point& q) {
+			for(auto& u : gs.get_entities()) {
+				if(u->get_position() == q && u->get_owner()->team() != t) {
+					return true;
+				}
+			}
+			return false;
+		};
+		auto is_zoc = [&](const point& q) {
+			for(auto& u : gs.get_entities()) {
+				if(u->get_owner()->team() != t && hex::logical::distance(u->get_position(), q) == 1) {
+					return !is_enemy_at(q);
+				}
+			}
+			return false;
+		};
+		for(int y = map->y(); y != map->y() + map->height(); ++y) {
+			for(int x = map->x(); x != map->x() + map->width(); ++x) {
+				const point n(x, y);
+				if(hex::logical::distance(p, n) != 1 || is_enemy_at(n) || (is_zoc(p) && is_zoc(n))) {
+					continue;
+				}
+				const float c = cost + hex::logical::to_cost(map->get_cost_grid(creature::MovementType::NORMAL)[n]);
+				if(c < max_cost) {
+					brute_force_moves(gs, t, n, c, max_cost, best);
+				}
+			}
+		}
+	}
+}
+
+UNIT_TEST(reachability)
+{
+	node_builder tiles;
+	tiles.add("flat", node_builder().add("name", "Flat").add("cost", 1.0).build());
+	tiles.add("hill", node_builder().add("name", "Hill").add("cost", 2.0).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+
+	node_builder mb;
+	mb.add("width", 6);
+	for(int n = 0; n != 36; ++n) {
+		mb.add("tiles", n % 7 == 3 ? "hill" : "flat");
+	}
+
+	game::state gs;
+	gs.set_map(hex::logical::map::factory(mb.build()));
+	auto p1 = std::make_shared<player>(gs.create_team_instance("a"), PlayerType::NORMAL, "p1");
+	auto p2 = std::make_shared<player>(gs.create_team_instance("b"), PlayerType::NORMAL, "p2");
+	gs.add_player(p1);
+	gs.add_player(p2);
+	const point positions[] = { point(0, 0), point(2, 0), point(3, 2), point(1, 4), point(5, 5) };
+	for(int n = 0; n != 5; ++n) {
+		auto u = std::make_shared<game::unit>("u", nullptr, n < 2 ? p1 : p2);
+		u->set_position(positions[n]);
+		u->set_initiative(1.0f + n);
+		gs.add_unit(u);
+	}
+
+	for(float move = 0.5f; move < 7.0f; move += 1.5f) {
+		ai::reachability reach(gs);
+		for(auto& u : gs.get_entities()) {
+			u->set_move(move);
+			std::map<point, float> expected;
+			brute_force_moves(gs, u->get_owner()->team(), u->get_position(), 0, move, &expected);
+			for(auto it = expected.begin(); it != expected.end();) {
+				it = it->second < move ? std::next(it) : expected.erase(it);
+			}
+
+			auto& moves = reach.get_moves(u);
+			CHECK_EQ(moves.size(), expected.size());
+			for(auto& mc : moves) {
+				auto it = expected.find(mc.loc);
+				CHECK_EQ(it != expected.end(), true);
+				if(it != expected.end()) {
+					CHECK_EQ(mc.path_cost, it->second);
+				}
+			}
+		}
+	}
+
+	// Paths are found with the units own costs. Here a wall of peaks can be flown straight
+	// over, but is a long way round on foot.
+	tiles.add("peak", node_builder().add("name", "Peak").add("cost", 10.0).add("costs", node_builder().add("flying", 1.0).build()).build());
+	hex::logical::loader(node_builder().add("tiles", tiles.build()).build());
+	node_builder wb;
+	wb.add("width", 5);
+	for(int n = 0; n != 25; ++n) {
+		wb.add("tiles", n % 5 == 2 && n != 2 ? "peak" : "flat");
+	}
+	node_builder idle;
+	idle.add("image", "none.png");
+	for(int n = 0; n != 4; ++n) {
+		idle.add("area", n / 2);
+	}
+	auto flying = std::make_shared<creature::creature>(node_builder()
+		.add("name", "f")
+		.add("stats", node_builder().add("health", 10).add("attack", 1).add("movement_type", "flying").build())
+		.add("animations", node_builder().add("idle", idle.build()).build()).build());
+	game::state walled;
+	walled.set_map(hex::logical::map::factory(wb.build()));
+	walled.add_player(p1);
+	auto walker = std::make_shared<game::unit>("w", nullptr, p1);
+	walker->set_position(0, 0);
+	walker->set_initiative(1.0f);
+	walled.add_unit(walker);
+	auto flyer = std::make_shared<game::unit>("f", flying, p1);
+	flyer->set_position(0, 4);
+	flyer->set_initiative(2.0f);
+	walled.add_unit(flyer);
+	CHECK_EQ(flyer->get_movement_type() == creature::MovementType::FLYING, true);
+
+	ai::reachability reach(walled);
+	reach.get_moves(walker);
+	const auto walk = reach.find_path(walker, point(4, 4));
+	CHECK_GT(walk.size(), 5u);
+	const auto fly = reach.find_path(flyer, point(4, 4));
+	CHECK_EQ(fly.size(), 5u);
+}
@@ -0,0 +1,59 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "game_state.hpp"
+#include "hex_pathfinding.hpp"
+
+namespace ai
+{
+	// Movement information for one snapshot of the game state. The graph and the distance
+	// field to the nearest enemy are built once per team, the moves available to a unit once
+	// per unit, after which questions about where to go are answered by table lookups.
+	// N.B. The game state must not change while this exists.
+	class reachability
+	{
+	public:
+		explicit reachability(const game::state& gs);
+
+		// Hex distance from p to the nearest unit not on team t.
+		// std::numeric_limits<int>::max() if there are no such units.
+		int enemy_distance(const team_ptr& t, const point& p);
+		// Tiles that u can move to this turn, including the one it is on.
+		const hex::result_list& get_moves(const game::unit_ptr& u);
+		// Find the unoccupied tile that u can move to which is closest to an enemy, with ties
+		// broken by lowest movement cost. Returns false if there isn't one closer than where u is.
+		bool find_closest_to_enemy(const game::unit_ptr& u, point* dest);
+		hex::result_path find_path(const game::unit_ptr& u, const point& dest);
+	private:
+		struct team_info
+		{
+			hex::hex_graph_ptr graph;
+			std::vector<int> enemy_field;
+		};
+		team_info& get_team_info(const team_ptr& t);
+		// As above for the units team, with the graph set to the units movement type.
+		team_info& get_team_info(const game::unit_ptr& u);
+
+		const game::state& gs_;
+		std::map<uuid::uuid, team_info> teams_;
+		std::map<uuid::uuid, hex::result_list> moves_;
+	};
+}
@@ -0,0 +1,176 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "asserts.hpp"
+#include "uuid.hpp"
+
+namespace registry
+{
+	// Handles are the index of a slot in the low 16 bits and the generation of the slot in
+	// the high 16 bits. The generation changes each time a slot is freed, so a handle kept
+	// after the thing it refers to was removed doesn't find whatever took its place.
+	typedef uint32_t handle;
+	// Slot generations start at one, so this is never handed out.
+	const handle invalid_handle = 0;
+	// Most entries a table can hold.
+	const size_t max_table_size = 0x10000;
+
+	// Things identified by a uuid, stored densely with O(1) lookup both by uuid and by handle.
+	// Freed slots are reused, iterating goes in slot order.
+	template<typename T>
+	class table
+	{
+	public:
+		table() : count_(0) {}
+
+		// Adds the value, or replaces the one already there for the uuid, keeping its handle.
+		handle set(const uuid::uuid& id, const T& value) {
+			auto it = lookup_.find(id);
+			if(it != lookup_.end()) {
+				slots_[it->second].value = value;
+				return make_handle(it->second);
+			}
+			uint32_t index;
+			if(!free_.empty()) {
+				index = free_.back();
+				free_.pop_back();
+			} else {
+				ASSERT_LOG(slots_.size() < max_table_size, "Registry is full, " << max_table_size << " entries.");
+				index = static_cast<uint32_t>(slots_.size());
+				slots_.emplace_back();
+			}
+			slot& s = slots_[index];
+			s.id = id;
+			s.value = value;
+			s.used = true;
+			lookup_[id] = index;
+			++count_;
+			return make_handle(index);
+		}
+
+		// Returns false if there was nothing to remove.
+		bool erase(const uuid::uuid& id) {
+			auto it = lookup_.find(id);
+			if(it == lookup_.end()) {
+				return false;
+			}
+			release(it->second);
+			return true;
+		}
+		bool erase(handle h) {
+			const slot* s = get_slot(h);
+			if(s == nullptr) {
+				return false;
+			}
+			release(h & 0xffff);
+			return true;
+		}
+
+		void clear() {
+			for(uint32_t n = 0; n != slots_.size(); ++n) {
+				if(slots_[n].used) {
+					release(n);
+				}
+			}
+		}
+
+		// invalid_handle if there is nothing with the uuid.
+		handle find(const uuid::uuid& id) const {
+			auto it = lookup_.find(id);
+			return it == lookup_.end() ? invalid_handle : make_handle(it->second);
+		}
+
+		// nullptr if there's nothing with the uuid, or the handle is out of date.
+		T* get(const uuid::uuid& id) {
+			auto it = lookup_.find(id);
+			return it == lookup_.end() ? nullptr : &slots_[it->second].value;
+		}
+		const T* get(const uuid::uuid& id) const {
+			auto it = lookup_.find(id);
+			return it == lookup_.end() ? nullptr : &slots_[it->second].value;
+		}
+		T* get(handle h) {
+			slot* s = get_slot(h);
+			return s == nullptr ? nullptr : &s->value;
+		}
+		const T* get(handle h) const {
+			const slot* s = get_slot(h);
+			return s == nullptr ? nullptr : &s->value;
+		}
+
+		size_t size() const { return count_; }
+		bool empty() const { return count_ == 0; }
+
+		// Calls fn(id, value) for everything in the table.
+		template<typename F>
+		void for_each(F fn) const {
+			for(auto& s : slots_) {
+				if(s.used) {
+					fn(s.id, s.value);
+				}
+			}
+		}
+	private:
+		struct slot
+		{
+			slot() : generation(1), used(false) {}
+			uuid::uuid id;
+			T value;
+			uint16_t generation;
+			bool used;
+		};
+
+		handle make_handle(uint32_t index) const {
+			return (static_cast<handle>(slots_[index].generation) << 16) | index;
+		}
+
+		slot* get_slot(handle h) {
+			return const_cast<slot*>(static_cast<const table*>(this)->get_slot(h));
+		}
+		const slot* get_slot(handle h) const {
+			const uint32_t index = h & 0xffff;
+			if(index >= slots_.size()) {
+				return nullptr;
+			}
+			const slot& s = slots_[index];
+			return s.used && s.generation == (h >> 16) ? &s : nullptr;
+		}
+
+		void release(uint32_t index) {
+			slot& s = slots_[index];
+			lookup_.erase(s.id);
+			s.value = T();
+			s.used = false;
+			// Skip zero when wrapping so handles are never invalid_handle.
+			if(++s.generation == 0) {
+				s.generation = 1;
+			}
+			free_.emplace_back(index);
+			--count_;
+		}
+
+		std::vector<slot> slots_;
+		std::vector<uint32_t> free_;
+		std::unordered_map<uuid::uuid, uint32_t, uuid::hash> lookup_;
+		size_t count_;
+	};
+}
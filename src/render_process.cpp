@@ -51,7 +51,6 @@ namespace process
 	{
 		using namespace component;
 		static component_id sprite_mask = genmask(Component::POSITION)  | genmask(Component::SPRITE);
-		static component_id gui_mask = genmask(Component::GUI);
 		static component_id inp_mask = genmask(Component::INPUT);
 		
 		const point& cam = eng.get_camera();
@@ -66,9 +65,14 @@ namespace process
 			game_map->draw(rect(0, 0, eng.get_window().width(), eng.get_window().height()), cam);
 		}
 
-		for(auto& e : elist) {
+		// Only entities that are on screen need to be drawn.
+		entity_list visible;
+		eng.entities_in_area(rect(cam.x, cam.y, 
+			static_cast<int>(eng.get_window().width() / zoom), 
+			static_cast<int>(eng.get_window().height() / zoom)), &visible);
+		for(auto& e : visible) {
 			if((e->mask & sprite_mask) == sprite_mask && (e->mask & inp_mask) == inp_mask) {
-				auto& pos = e->pos;
+				auto& pos = e->pos();
 				auto& inp = e->inp;
 				if(e->inp->selected) {
 					static auto ellipse = graphics::texture("images/misc/ellipse-1.png", graphics::TextureFlags::NONE);
@@ -129,17 +133,9 @@ namespace process
 				}
 			}
 
-			if((e->mask & gui_mask) == gui_mask) {
-				auto& g = e->gui;
-				SDL_RenderSetScale(eng.get_renderer(), 1.0f, 1.0f);
-				for(auto& w : g->widgets) {
-					w->draw(rect(), 0.0f, 1.0f);
-				}
-				SDL_RenderSetScale(eng.get_renderer(), zoom, zoom);
-			}  
 			if((e->mask & sprite_mask) == sprite_mask) {
 				auto& spr = e->spr;
-				auto& pos = e->pos;
+				auto& pos = e->pos();
 				auto& inp = e->inp;
 				if(inp && inp->is_attack_target) {
 					spr->tex.set_color(graphics::color(255,0,0));
@@ -172,6 +168,15 @@ namespace process
 			}
 		}
 
+		// gui entities have no position, so aren't in the spatial index.
+		SDL_RenderSetScale(eng.get_renderer(), 1.0f, 1.0f);
+		eng.for_each<Component::GUI>([](const component_set_ptr& e, gui_component& g) {
+			for(auto& w : g.widgets) {
+				w->draw(rect(), 0.0f, 1.0f);
+			}
+		});
+		SDL_RenderSetScale(eng.get_renderer(), zoom, zoom);
+
 		// draw cursor, aligned to hexes. -- should do this better.
 		if(game_map) {
 			int x, y;
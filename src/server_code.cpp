@@ -18,14 +18,11 @@
 
 namespace game
 {
-	void local_server_code(state gs, network::server_ptr server)
+	Update* create_game_start_update(state& gs)
 	{
-		Update* up;
-		bool running = true;
-
-		// create and send a start game packet.
-		up = gs.create_update();
+		Update* up = gs.create_update();
 		up->set_game_start(true);
+		gs.write_unit_handles(up);
 		// Set starting gold for all players, with player update messages.
 		for(auto& p : gs.get_players()) {
 			Update_Player* upp = up->add_player();
@@ -33,21 +30,32 @@ namespace game
 			upp->set_action(Update_Player_Action_UPDATE);
 			Update_PlayerInfo* pi = new Update_PlayerInfo();
 			// XXX starting gold per player -- should load from scenario.
-			pi->set_gold(50);
+			p->set_gold(50);
+			pi->set_gold(p->get_gold());
 			upp->set_allocated_player_info(pi);
 		}
-		server->write_send_queue(up);
+		return up;
+	}
+
+	void local_server_code(state gs, network::server_ptr server)
+	{
+		Update* up;
+		bool running = true;
+
+		// create and send a start game packet.
+		server->write_send_queue(create_game_start_update(gs));
 		server->process();
 
 		while(running) {
-			if((up = server->read_recv_queue()) != nullptr) {
+			// Sleep until a client sends something, rather than spinning on the queue.
+			if((up = server->wait_recv_queue()) != nullptr) {
 				std::cerr << "local_server_code: Got message: " << up->id() << "\n";
 				// XXX do more processing here.
-				LOG_DEBUG("SERVER: received packet of " << up->SerializeAsString().size() << " bytes");
+				LOG_DEBUG("SERVER: received packet of " << up->ByteSize() << " bytes");
 				Update* nup = gs.validate_and_apply(up);
 				// add some information debugging
 				if(nup) {
-					LOG_DEBUG("SERVER: Sending packet of " << nup->SerializeAsString().size() << " bytes");
+					LOG_DEBUG("SERVER: Sending packet of " << nup->ByteSize() << " bytes");
 					server->write_send_queue(nup);
 				}
 				if(up->has_quit() && up->quit() && up->id() == -1) {
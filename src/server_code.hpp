@@ -21,5 +21,8 @@
 
 namespace game
 {
+	// Creates the update sent to all players when a game begins.
+	Update* create_game_start_update(state& gs);
+
 	void local_server_code(state gs, network::server_ptr server);
 }
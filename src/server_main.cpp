@@ -16,22 +16,18 @@
 
 #ifdef SERVER_BUILD
 
+#include <string>
 #include <vector>
-#include <cstdarg>
 
-#include "lua.hpp"
-#include <LuaBridge.h>
+#include <boost/lexical_cast.hpp>
 
-#include "bot.hpp"
+#include "asserts.hpp"
 #include "creature.hpp"
 #include "enet_server.hpp"
-#include "game_state.hpp"
-#include "internal_server.hpp"
-#include "internal_client.hpp"
-#include "network_server.hpp"
-
-//	enet::server enet_server(9000);
-//	enet_server.run();
+#include "hex_logical_tiles.hpp"
+#include "json.hpp"
+#include "random.hpp"
+#include "unit_test.hpp"
 
 int main(int argc, char* argv[])
 {
@@ -39,6 +35,77 @@ int main(int argc, char* argv[])
 	for(int i = 0; i < argc; ++i) {
 		args.push_back(argv[i]);
 	}
+
+	std::string scenario_file("data/scenario/scenario1.cfg");
+	int port = 9000;
+	int max_peers = 256;
+	// Zero means one worker per hardware thread.
+	int num_workers = 0;
+	int num_bots = 0;
+	// Seconds bots get to think about each turn, zero for them to play greedily.
+	double bot_time = ai::default_time_budget;
+	// Threads each bot searches with, from a pool shared by all the matches.
+	int bot_threads = 1;
+	// Seed the match seeds are made from, zero for a random one.
+	size_t seed = 0;
+	// Directory to record match journals in, none are kept if empty.
+	std::string journal_dir;
+	for(auto it = args.begin(); it != args.end(); ++it) {
+		size_t sep = it->find('=');
+		std::string arg_name = *it;
+		std::string arg_value;
+		if(sep != std::string::npos) {
+			arg_name = it->substr(0, sep);
+			arg_value = it->substr(sep + 1);
+		}
+
+		if(arg_name == "--port") {
+			port = boost::lexical_cast<int>(arg_value);
+		} else if(arg_name == "--max-peers") {
+			max_peers = boost::lexical_cast<int>(arg_value);
+		} else if(arg_name == "--scenario") {
+			scenario_file = "data/scenario/" + arg_value + ".cfg";
+		} else if(arg_name == "--workers") {
+			num_workers = boost::lexical_cast<int>(arg_value);
+		} else if(arg_name == "--bots") {
+			num_bots = boost::lexical_cast<int>(arg_value);
+		} else if(arg_name == "--bot-time") {
+			bot_time = boost::lexical_cast<double>(arg_value);
+		} else if(arg_name == "--bot-threads") {
+			bot_threads = boost::lexical_cast<int>(arg_value);
+		} else if(arg_name == "--seed") {
+			seed = boost::lexical_cast<size_t>(arg_value);
+		} else if(arg_name == "--journal-dir") {
+			journal_dir = arg_value;
+		}
+	}
+
+	if(!test::run_tests()) {
+		// Just exit if some tests failed.
+		exit(1);
+	}
+
+	if(seed != 0) {
+		generator::set_seed(seed);
+	} else {
+		seed = generator::generate_seed();
+	}
+	// Matches can be replayed given this and the updates sent to them.
+	LOG_INFO("Seed: " << seed);
+
+	node scenario;
+	try {
+		creature::loader(json::parse_from_file("data/units.cfg"));
+		hex::logical::loader(json::parse_from_file("data/hex_tiles.cfg"));
+		scenario = json::parse_from_file(scenario_file);
+	} catch(json::parse_error& pe) {
+		ASSERT_LOG(false, "Error parsing data files: " << pe.what());
+	}
+
+	LOG_INFO("Starting server on port " << port << " with scenario " << scenario_file);
+	enet::server server(port, scenario, max_peers, num_workers, num_bots, bot_time, bot_threads, journal_dir);
+	server.run();
+	return 0;
 }
 
 #endif
@@ -0,0 +1,309 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "asserts.hpp"
+#include "component.hpp"
+#include "hex_map.hpp"
+#include "spatial_index.hpp"
+#include "unit_test.hpp"
+
+namespace
+{
+	// Calls fn for every tile that could hold an entity overlapping the pixel area r. Entities 
+	// can hang over the edge of their tile a little, so there's a one tile margin.
+	template<typename F>
+	void for_each_tile(const rect& r, F fn)
+	{
+		const point tl = hex::hex_map::get_tile_pos_from_pixel_pos(r.x(), r.y());
+		const point br = hex::hex_map::get_tile_pos_from_pixel_pos(r.x2(), r.y2());
+		for(int x = tl.x - 1; x <= br.x + 1; ++x) {
+			for(int y = tl.y - 1; y <= br.y + 1; ++y) {
+				fn(point(x, y));
+			}
+		}
+	}
+}
+
+spatial_index::spatial_index(const rect& bounds, const point& tile_size)
+	: bounds_(bounds),
+	  tile_size_(tile_size),
+	  next_order_(0),
+	  pixels_(0, bounds)
+{
+}
+
+void spatial_index::set_bounds(const rect& bounds)
+{
+	bounds_ = bounds;
+	reindex();
+}
+
+void spatial_index::set_tile_size(const point& tile_size)
+{
+	tile_size_ = tile_size;
+	reindex();
+}
+
+bool spatial_index::is_indexed(const component_set_ptr& e)
+{
+	static component_id pos_mask = genmask(Component::POSITION);
+	return (e->mask & pos_mask) == pos_mask;
+}
+
+bool spatial_index::is_tile_aligned(const component_set_ptr& e)
+{
+	static component_id inp_mask = genmask(Component::INPUT);
+	return (e->mask & inp_mask) == inp_mask;
+}
+
+uint64_t spatial_index::tile_key(const point& p)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(p.x)) << 32) | static_cast<uint32_t>(p.y);
+}
+
+rect spatial_index::get_area(const component_set_ptr& e) const
+{
+	if(is_tile_aligned(e)) {
+		const point pp = hex::hex_map::get_pixel_pos_from_tile_pos(e->pos());
+		return rect(pp.x, pp.y, tile_size_.x, tile_size_.y);
+	}
+	if(e->spr != nullptr && e->spr->tex.is_valid()) {
+		return rect(e->pos().x, e->pos().y, e->spr->tex.width(), e->spr->tex.height());
+	}
+	return rect(e->pos().x, e->pos().y, 1, 1);
+}
+
+void spatial_index::add(const component_set_ptr& e)
+{
+	if(!is_indexed(e)) {
+		return;
+	}
+	ASSERT_LOG(entries_.find(e.get()) == entries_.end(), "Entity was already added to the spatial index: " << e);
+	entry& ent = entries_[e.get()];
+	ent.e = e;
+	ent.order = next_order_++;
+	insert(ent);
+}
+
+void spatial_index::remove(const component_set_ptr& e)
+{
+	auto it = entries_.find(e.get());
+	if(it == entries_.end()) {
+		return;
+	}
+	erase(it->second);
+	entries_.erase(it);
+}
+
+void spatial_index::clear()
+{
+	entries_.clear();
+	tiles_.clear();
+	pixels_.clear();
+}
+
+void spatial_index::insert(entry& ent)
+{
+	ent.pos = ent.e->pos();
+	ent.area = get_area(ent.e);
+	ent.tile_aligned = is_tile_aligned(ent.e);
+	if(ent.tile_aligned) {
+		tiles_[tile_key(ent.pos)].emplace_back(ent.e.get());
+	} else {
+		pixels_.insert(ent.e.get(), ent.area);
+	}
+}
+
+void spatial_index::erase(const entry& ent)
+{
+	if(ent.tile_aligned) {
+		auto it = tiles_.find(tile_key(ent.pos));
+		ASSERT_LOG(it != tiles_.end(), "No tile bucket for indexed entity at " << ent.pos);
+		auto& bucket = it->second;
+		bucket.erase(std::remove(bucket.begin(), bucket.end(), ent.e.get()), bucket.end());
+		if(bucket.empty()) {
+			tiles_.erase(it);
+		}
+	} else {
+		pixels_.remove(ent.e.get(), ent.area);
+	}
+}
+
+void spatial_index::reindex()
+{
+	tiles_.clear();
+	pixels_ = quadtree<component::component_set*>(0, bounds_);
+	for(auto& ent : entries_) {
+		insert(ent.second);
+	}
+}
+
+void spatial_index::refresh()
+{
+	for(auto& ent : entries_) {
+		entry& e = ent.second;
+		if(e.e->pos() != e.pos || get_area(e.e) != e.area) {
+			erase(e);
+			insert(e);
+		}
+	}
+}
+
+bool spatial_index::is_below(const entry& a, const entry& b)
+{
+	return a.e->zorder == b.e->zorder ? a.order < b.order : a.e->zorder < b.e->zorder;
+}
+
+void spatial_index::entities_in_area(const rect& r, entity_list* res) const
+{
+	std::vector<const entry*> found;
+	auto add_bucket = [&](const std::vector<component::component_set*>& bucket) {
+		for(auto e : bucket) {
+			auto& ent = entries_.find(e)->second;
+			if(geometry::rects_intersect(ent.area, r)) {
+				found.emplace_back(&ent);
+			}
+		}
+	};
+	// For large areas it's cheaper just to look at every occupied tile.
+	const point tl = hex::hex_map::get_tile_pos_from_pixel_pos(r.x(), r.y());
+	const point br = hex::hex_map::get_tile_pos_from_pixel_pos(r.x2(), r.y2());
+	const uint64_t ntiles = static_cast<uint64_t>(br.x - tl.x + 3) * static_cast<uint64_t>(br.y - tl.y + 3);
+	if(ntiles > tiles_.size()) {
+		for(auto& bucket : tiles_) {
+			add_bucket(bucket.second);
+		}
+	} else {
+		for_each_tile(r, [&](const point& p) {
+			auto it = tiles_.find(tile_key(p));
+			if(it != tiles_.end()) {
+				add_bucket(it->second);
+			}
+		});
+	}
+
+	std::vector<component::component_set*> pixels;
+	pixels_.get_collidable(pixels, r);
+	for(auto e : pixels) {
+		found.emplace_back(&entries_.find(e)->second);
+	}
+	// The buckets are visited in no particular order, so entities with the same zorder are
+	// kept in the order they were added, which doesn't change from frame to frame.
+	std::sort(found.begin(), found.end(), [](const entry* a, const entry* b) { return is_below(*a, *b); });
+	res->reserve(res->size() + found.size());
+	for(auto ent : found) {
+		res->emplace_back(ent->e);
+	}
+}
+
+component_set_ptr spatial_index::entity_at(const point& p, const component_id& mask) const
+{
+	const entry* res = nullptr;
+	auto test = [&](const entry& ent, const rect& area) {
+		if((ent.e->mask & mask) == mask 
+			&& geometry::pointInRect(p, area) 
+			&& (res == nullptr || is_below(*res, ent))) {
+			res = &ent;
+		}
+	};
+
+	for_each_tile(rect(p.x, p.y, 1, 1), [&](const point& tp) {
+		auto it = tiles_.find(tile_key(tp));
+		if(it == tiles_.end()) {
+			return;
+		}
+		for(auto e : it->second) {
+			auto& ent = entries_.find(e)->second;
+			const auto& inp = ent.e->inp;
+			test(ent, inp != nullptr && !inp->mouse_area.empty() 
+				? inp->mouse_area + hex::hex_map::get_pixel_pos_from_tile_pos(ent.pos) 
+				: ent.area);
+		}
+	});
+
+	std::vector<component::component_set*> pixels;
+	pixels_.get_collidable(pixels, rect(p.x, p.y, 1, 1));
+	for(auto e : pixels) {
+		auto& ent = entries_.find(e)->second;
+		test(ent, ent.area);
+	}
+	return res != nullptr ? res->e : component_set_ptr();
+}
+
+UNIT_TEST(spatial_index)
+{
+	spatial_index index(rect(0, 0, 1024, 1024), point(72, 72));
+	std::vector<component_set_ptr> msgs;
+	for(int n = 0; n != 100; ++n) {
+		auto e = std::make_shared<component::component_set>(n % 3);
+		e->mask = genmask(Component::POSITION);
+		e->pos() = point((n % 10) * 100, (n / 10) * 100);
+		index.add(e);
+		msgs.emplace_back(e);
+	}
+	auto unit = std::make_shared<component::component_set>(10);
+	unit->mask = genmask(Component::POSITION) | genmask(Component::INPUT);
+	unit->inp = std::make_shared<component::input>();
+	unit->inp->mouse_area = rect(0, 0, 72, 72);
+	unit->pos() = point(2, 3);
+	index.add(unit);
+	CHECK_EQ(index.size(), 101u);
+
+	// (2,3) is at pixel (108,216)
+	CHECK_EQ(index.entity_at(point(110, 260), genmask(Component::POSITION)).get(), unit.get());
+	CHECK_EQ(index.entity_at(point(200, 300), genmask(Component::POSITION)).get(), msgs[32].get());
+	CHECK(index.entity_at(point(250, 250), genmask(Component::POSITION)) == nullptr, "Found an entity in an empty area");
+
+	entity_list res;
+	index.entities_in_area(rect(150, 150, 200, 200), &res);
+	// 4 of the 1x1 entities plus the unit.
+	CHECK_EQ(res.size(), 5u);
+	CHECK(std::is_sorted(res.begin(), res.end(), [](const component_set_ptr& a, const component_set_ptr& b) {
+		return a->zorder < b->zorder;
+	}), "Entities not returned in z-order");
+
+	unit->pos() = point(8, 8);
+	msgs[22]->pos() = point(950, 950);
+	index.refresh();
+	res.clear();
+	index.entities_in_area(rect(150, 150, 200, 200), &res);
+	CHECK_EQ(res.size(), 3u);
+	CHECK_EQ(index.entity_at(point(950, 950), genmask(Component::POSITION)).get(), msgs[22].get());
+
+	index.remove(unit);
+	index.remove(msgs[22]);
+	CHECK_EQ(index.size(), 99u);
+	CHECK(index.entity_at(point(950, 950), genmask(Component::POSITION)) == nullptr, "Removed entity was found");
+
+	// Entities with the same zorder come back in the order they were added.
+	std::vector<component_set_ptr> stacked;
+	for(int n = 0; n != 8; ++n) {
+		auto e = std::make_shared<component::component_set>(7);
+		e->mask = genmask(Component::POSITION);
+		e->pos() = point(955, 955);
+		index.add(e);
+		stacked.emplace_back(e);
+	}
+	res.clear();
+	index.entities_in_area(rect(950, 950, 10, 10), &res);
+	CHECK_EQ(res.size(), stacked.size());
+	for(size_t n = 0; n != stacked.size(); ++n) {
+		CHECK_EQ(res[n].get(), stacked[n].get());
+	}
+	CHECK_EQ(index.entity_at(point(955, 955), genmask(Component::POSITION)).get(), stacked.back().get());
+}
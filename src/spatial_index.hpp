@@ -0,0 +1,90 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "engine_fwd.hpp"
+#include "geometry.hpp"
+#include "quadtree.hpp"
+
+// Keeps track of where entities are so the engine can answer area and point queries without
+// looking at every entity. Entities aligned to hex tiles (those with an input component, whose
+// pos is a tile position) are bucketed by the tile they are on, every other entity with a
+// position is kept in a quadtree by its pixel area. Entities without a position (i.e. gui
+// entities) aren't indexed.
+class spatial_index
+{
+public:
+	// bounds is the pixel area covered by the quadtree, entities outside it are still found,
+	// just not as quickly.
+	spatial_index(const rect& bounds, const point& tile_size);
+
+	// Changing these re-indexes every entity.
+	void set_bounds(const rect& bounds);
+	void set_tile_size(const point& tile_size);
+
+	void add(const component_set_ptr& e);
+	void remove(const component_set_ptr& e);
+	void clear();
+	// Re-index any entities that have moved, or changed size, since they were last indexed.
+	void refresh();
+
+	// Adds the entities whose pixel area intersects r to res, in z-order.
+	void entities_in_area(const rect& r, entity_list* res) const;
+	// Returns the top-most entity containing p that has all the components in mask, tile
+	// aligned entities are tested against their mouse area. Returns nullptr if there is none.
+	component_set_ptr entity_at(const point& p, const component_id& mask) const;
+
+	// The pixel area an entity covers.
+	rect get_area(const component_set_ptr& e) const;
+
+	size_t size() const { return entries_.size(); }
+private:
+	struct entry
+	{
+		component_set_ptr e;
+		// Position and area the entity was indexed with.
+		point pos;
+		rect area;
+		bool tile_aligned;
+		// When the entity was added, which orders entities with the same zorder.
+		uint64_t order;
+	};
+
+	static bool is_indexed(const component_set_ptr& e);
+	static bool is_tile_aligned(const component_set_ptr& e);
+	static uint64_t tile_key(const point& p);
+
+	void insert(entry& ent);
+	void erase(const entry& ent);
+	void reindex();
+	// Whether a is drawn below b.
+	static bool is_below(const entry& a, const entry& b);
+
+	rect bounds_;
+	point tile_size_;
+	uint64_t next_order_;
+	std::unordered_map<component::component_set*, entry> entries_;
+	std::unordered_map<uint64_t, std::vector<component::component_set*>> tiles_;
+	quadtree<component::component_set*> pixels_;
+
+	spatial_index(const spatial_index&) = delete;
+	void operator=(const spatial_index&) = delete;
+};
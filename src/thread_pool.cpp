@@ -0,0 +1,114 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <algorithm>
+#include <memory>
+
+#include "asserts.hpp"
+#include "thread_pool.hpp"
+
+namespace threading
+{
+	namespace
+	{
+		std::mutex shared_pool_guard;
+		std::unique_ptr<pool> shared_pool;
+	}
+
+	pool::pool(int num_threads)
+		: running_(true)
+	{
+		if(num_threads <= 0) {
+			num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+		}
+		for(int n = 0; n != num_threads; ++n) {
+			threads_.emplace_back(&pool::worker_thread, this);
+		}
+	}
+
+	pool::~pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(guard_);
+			running_ = false;
+		}
+		work_cv_.notify_all();
+		for(auto& t : threads_) {
+			t.join();
+		}
+	}
+
+	void pool::run(const std::vector<job>& jobs)
+	{
+		if(jobs.empty()) {
+			return;
+		}
+		batch b;
+		std::unique_lock<std::mutex> lock(guard_);
+		b.remaining = static_cast<int>(jobs.size());
+		for(auto& j : jobs) {
+			task t = { &j, &b };
+			tasks_.emplace_back(t);
+		}
+		work_cv_.notify_all();
+
+		// Help out with our own jobs, then wait for any the workers are still running.
+		while(b.remaining > 0) {
+			auto it = std::find_if(tasks_.begin(), tasks_.end(), [&b](const task& t) { return t.owner == &b; });
+			if(it == tasks_.end()) {
+				b.done.wait(lock);
+				continue;
+			}
+			const task t = *it;
+			tasks_.erase(it);
+			run_task(lock, t);
+		}
+	}
+
+	void pool::run_task(std::unique_lock<std::mutex>& lock, const task& t)
+	{
+		lock.unlock();
+		(*t.fn)();
+		lock.lock();
+		if(--t.owner->remaining == 0) {
+			t.owner->done.notify_all();
+		}
+	}
+
+	void pool::worker_thread()
+	{
+		std::unique_lock<std::mutex> lock(guard_);
+		while(true) {
+			work_cv_.wait(lock, [this]() { return !running_ || !tasks_.empty(); });
+			if(!running_) {
+				return;
+			}
+			const task t = tasks_.front();
+			tasks_.pop_front();
+			run_task(lock, t);
+		}
+	}
+
+	pool& get_shared_pool()
+	{
+		std::lock_guard<std::mutex> lock(shared_pool_guard);
+		if(shared_pool == nullptr) {
+			shared_pool.reset(new pool(0));
+			LOG_INFO("Started shared thread pool with " << shared_pool->size() << " threads.");
+		}
+		return *shared_pool;
+	}
+}
@@ -0,0 +1,75 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace threading
+{
+	// Fixed set of worker threads for running short, independent jobs in parallel, such as
+	// the separate trees of a bot search.
+	class pool
+	{
+	public:
+		typedef std::function<void()> job;
+
+		// Zero means one thread per hardware thread.
+		explicit pool(int num_threads);
+		~pool();
+
+		int size() const { return static_cast<int>(threads_.size()); }
+
+		// Runs the jobs and returns once they have all finished. The calling thread runs
+		// jobs as well rather than just waiting, so this finishes even if every worker is
+		// busy with other callers jobs.
+		void run(const std::vector<job>& jobs);
+	private:
+		struct batch
+		{
+			batch() : remaining(0) {}
+			int remaining;
+			std::condition_variable done;
+		};
+
+		struct task
+		{
+			const job* fn;
+			batch* owner;
+		};
+
+		void worker_thread();
+		void run_task(std::unique_lock<std::mutex>& lock, const task& t);
+
+		std::vector<std::thread> threads_;
+		std::mutex guard_;
+		std::condition_variable work_cv_;
+		// Following are protected by guard_.
+		std::deque<task> tasks_;
+		bool running_;
+
+		pool(const pool&) = delete;
+		void operator=(const pool&) = delete;
+	};
+
+	// The pool shared by everything in the process, made the first time it's asked for.
+	pool& get_shared_pool();
+}
@@ -0,0 +1,81 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "asserts.hpp"
+#include "transposition_table.hpp"
+#include "unit_test.hpp"
+
+namespace ai
+{
+	transposition_table::transposition_table(size_t size)
+		: mask_(1)
+	{
+		ASSERT_LOG(size > 0, "Transposition table must have at least one entry.");
+		while(mask_ < size) {
+			mask_ <<= 1;
+		}
+		entries_.reset(new entry[mask_]);
+		--mask_;
+		clear();
+	}
+
+	void transposition_table::clear()
+	{
+		for(size_t n = 0; n <= mask_; ++n) {
+			entries_[n].check.store(0, std::memory_order_relaxed);
+			entries_[n].data.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	bool transposition_table::probe(uint64_t hash, uint64_t* data) const
+	{
+		const entry& e = entries_[hash & mask_];
+		const uint64_t d = e.data.load(std::memory_order_relaxed);
+		const uint64_t c = e.check.load(std::memory_order_relaxed);
+		// An empty entry would otherwise match a hash of zero.
+		if((c ^ d) != hash || (c == 0 && d == 0)) {
+			return false;
+		}
+		*data = d;
+		return true;
+	}
+
+	void transposition_table::store(uint64_t hash, uint64_t data)
+	{
+		entry& e = entries_[hash & mask_];
+		e.data.store(data, std::memory_order_relaxed);
+		e.check.store(hash ^ data, std::memory_order_relaxed);
+	}
+}
+
+UNIT_TEST(transposition_table)
+{
+	ai::transposition_table tt(1000);
+	CHECK_EQ(tt.size(), 1024u);
+	uint64_t data = 0;
+	CHECK_EQ(tt.probe(0x1234, &data), false);
+	tt.store(0x1234, 42);
+	CHECK_EQ(tt.probe(0x1234, &data), true);
+	CHECK_EQ(data, 42u);
+	// Same slot, different position.
+	CHECK_EQ(tt.probe(0x1234 + 1024, &data), false);
+	tt.store(0x1234 + 1024, 7);
+	CHECK_EQ(tt.probe(0x1234, &data), false);
+	CHECK_EQ(tt.probe(0x1234 + 1024, &data), true);
+	CHECK_EQ(data, 7u);
+	tt.clear();
+	CHECK_EQ(tt.probe(0x1234 + 1024, &data), false);
+}
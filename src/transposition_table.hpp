@@ -0,0 +1,57 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace ai
+{
+	// Fixed size hash table from position hashes to 64 bits of data, which any number of
+	// threads can probe and store to at the same time without locking.
+	//
+	// Each entry is the data and the data exclusive-or'd with the hash, written separately.
+	// A reader only accepts an entry if the two still give the hash it's looking for, so an
+	// entry torn by a write from another thread reads as a miss rather than as the wrong
+	// data. Entries are simply overwritten when another position hashes to the same slot.
+	class transposition_table
+	{
+	public:
+		// Size is rounded up to a power of two entries.
+		explicit transposition_table(size_t size);
+
+		size_t size() const { return mask_ + 1; }
+		void clear();
+
+		// Returns false if there's no entry for the hash.
+		bool probe(uint64_t hash, uint64_t* data) const;
+		void store(uint64_t hash, uint64_t data);
+	private:
+		struct entry
+		{
+			std::atomic<uint64_t> check;
+			std::atomic<uint64_t> data;
+		};
+
+		std::unique_ptr<entry[]> entries_;
+		size_t mask_;
+
+		transposition_table(const transposition_table&) = delete;
+		void operator=(const transposition_table&) = delete;
+	};
+}
@@ -1,11 +1,14 @@
 #include "creature.hpp"
 #include "units.hpp"
+#include "zobrist.hpp"
 
 namespace game
 {
 	unit::unit(const std::string& name, const creature::const_creature_ptr& cp, const player_ptr& owner, const uuid::uuid& id)
 		: pos_(),
 		  uuid_(id),
+		  hash_key_(zobrist::unit_key(id)),
+		  handle_(-1),
 		  owner_(owner),
 		  health_(1),
 		  attack_(1),
@@ -40,6 +43,16 @@ namespace game
 		return os;
 	}
 
+	uint64_t unit::get_hash() const
+	{
+		return zobrist::unit_hash(hash_key_, pos_, health_, move_, initiative_, attacks_this_turn_);
+	}
+
+	creature::MovementType unit::get_movement_type() const
+	{
+		return type_ != nullptr ? type_->get_movement_type() : creature::MovementType::NORMAL;
+	}
+
 	void unit::start_turn(Update_UnitStats* uus)
 	{
 		// This could be things like healing at the start of the turn
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 #include "creature_fwd.hpp"
@@ -38,6 +39,10 @@ namespace game
 		void set_position(int x, int y) { pos_.x = x; pos_.y = y; }
 
 		const uuid::uuid& get_uuid() const { return uuid_; }
+		// Numeric id used in network messages, assigned when the unit is added to a
+		// game::state. -1 until then.
+		int get_handle() const { return handle_; }
+		void set_handle(int h) { handle_ = h; }
 
 		int get_health() const { return health_; }
 		void set_health(int h) { health_ = h; }
@@ -68,7 +73,12 @@ namespace game
 		// such as resetting movement counts, initiative, etc.
 		void complete_turn(Update_UnitStats* uus);
 
+		// Zobrist hash of the units position and stats, see zobrist.hpp.
+		uint64_t get_hash() const;
+
 		const creature::const_creature_ptr& get_type() const { return type_; }
+		// Movement type of the creature, units without a creature move normally.
+		creature::MovementType get_movement_type() const;
 
 		unit_ptr clone(const player_ptr& new_owner);
 	private:
@@ -76,6 +86,9 @@ namespace game
 		point pos_;
 		// Units unique identifier
 		uuid::uuid uuid_;
+		// Made from the uuid, for hashing.
+		uint64_t hash_key_;
+		int handle_;
 		// player that owns this unit.
 		player_weak_ptr owner_;
 
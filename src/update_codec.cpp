@@ -0,0 +1,282 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <zlib.h>
+
+#include "asserts.hpp"
+#include "update_codec.hpp"
+#include "units.hpp"
+
+namespace game
+{
+	namespace
+	{
+		// Anything claiming to be bigger than this when uncompressed is taken to be corrupt.
+		const uLong max_uncompressed_size = 64 * 1024 * 1024;
+	}
+
+	unit_handles::unit_handles()
+	{
+	}
+
+	void unit_handles::bind(const unit_ptr& u)
+	{
+		const int h = u->get_handle();
+		if(h >= 0 && h < size() && entries_[h].id == u->get_uuid()) {
+			entries_[h].u = u;
+			return;
+		}
+		bind(u, size());
+	}
+
+	void unit_handles::bind(const unit_ptr& u, int handle)
+	{
+		ASSERT_LOG(handle >= 0, "Invalid unit handle: " << handle);
+		if(handle >= size()) {
+			entries_.resize(handle + 1);
+		}
+		entry& e = entries_[handle];
+		// The handle may have belonged to another unit before.
+		auto it = by_uuid_.find(e.id);
+		if(it != by_uuid_.end() && it->second == handle) {
+			by_uuid_.erase(it);
+		}
+		e.u = u;
+		e.id = u->get_uuid();
+		by_uuid_[e.id] = handle;
+		read_stats(u, &e.sent);
+		u->set_handle(handle);
+	}
+
+	void unit_handles::unbind(const unit_ptr& u)
+	{
+		const int h = u->get_handle();
+		if(h >= 0 && h < size() && entries_[h].u.get() == u.get()) {
+			entries_[h].u.reset();
+		}
+	}
+
+	void unit_handles::reserve(int handle, const uuid::uuid& id)
+	{
+		ASSERT_LOG(handle >= 0, "Invalid unit handle: " << handle);
+		if(handle >= size()) {
+			entries_.resize(handle + 1);
+		}
+		entry& e = entries_[handle];
+		auto it = by_uuid_.find(e.id);
+		if(it != by_uuid_.end() && it->second == handle) {
+			by_uuid_.erase(it);
+		}
+		e.u.reset();
+		e.id = id;
+		by_uuid_[id] = handle;
+	}
+
+	void unit_handles::relink(const unit_list& units)
+	{
+		for(auto& e : entries_) {
+			e.u.reset();
+		}
+		for(auto& u : units) {
+			const int h = u->get_handle();
+			if(h >= 0 && h < size()) {
+				entries_[h].u = u;
+			}
+		}
+	}
+
+	void unit_handles::clear()
+	{
+		entries_.clear();
+		by_uuid_.clear();
+	}
+
+	unit_ptr unit_handles::get_unit(int handle) const
+	{
+		if(handle < 0 || handle >= size()) {
+			return nullptr;
+		}
+		return entries_[handle].u;
+	}
+
+	const uuid::uuid& unit_handles::get_uuid(int handle) const
+	{
+		ASSERT_LOG(handle >= 0 && handle < size(), "No unit with handle " << handle);
+		return entries_[handle].id;
+	}
+
+	unit_ptr unit_handles::find(const uuid::uuid& id) const
+	{
+		auto it = by_uuid_.find(id);
+		return it == by_uuid_.end() ? nullptr : entries_[it->second].u;
+	}
+
+	unit_handles::entry& unit_handles::get_entry(const unit_ptr& u)
+	{
+		const int h = u->get_handle();
+		ASSERT_LOG(h >= 0 && h < size(), "Unit " << u << " has no handle.");
+		return entries_[h];
+	}
+
+	void unit_handles::read_stats(const unit_ptr& u, unit_stats* s)
+	{
+		s->health = u->get_health();
+		s->attack = u->get_attack();
+		s->armour = u->get_armour();
+		s->move = u->get_move();
+		s->initiative = u->get_initiative();
+		s->name = u->get_name();
+		s->range = u->get_range();
+		s->critical_strike = u->get_critical_strike();
+		s->attacks_this_turn = u->get_attacks_this_turn();
+	}
+
+	void unit_handles::strip_unchanged(const unit_ptr& u, Update_UnitStats* stats)
+	{
+		const unit_stats& s = get_entry(u).sent;
+		if(stats->has_health() && stats->health() == s.health) {
+			stats->clear_health();
+		}
+		if(stats->has_attack() && stats->attack() == s.attack) {
+			stats->clear_attack();
+		}
+		if(stats->has_armour() && stats->armour() == s.armour) {
+			stats->clear_armour();
+		}
+		if(stats->has_move() && stats->move() == s.move) {
+			stats->clear_move();
+		}
+		if(stats->has_initiative() && stats->initiative() == s.initiative) {
+			stats->clear_initiative();
+		}
+		if(stats->has_name() && stats->name() == s.name) {
+			stats->clear_name();
+		}
+		if(stats->has_range() && stats->range() == s.range) {
+			stats->clear_range();
+		}
+		if(stats->has_critical_strike() && stats->critical_strike() == s.critical_strike) {
+			stats->clear_critical_strike();
+		}
+		if(stats->has_attacks_this_turn() && stats->attacks_this_turn() == s.attacks_this_turn) {
+			stats->clear_attacks_this_turn();
+		}
+		record(u, *stats);
+	}
+
+	void unit_handles::record(const unit_ptr& u, const Update_UnitStats& stats)
+	{
+		unit_stats& s = get_entry(u).sent;
+		if(stats.has_health()) {
+			s.health = stats.health();
+		}
+		if(stats.has_attack()) {
+			s.attack = stats.attack();
+		}
+		if(stats.has_armour()) {
+			s.armour = stats.armour();
+		}
+		if(stats.has_move()) {
+			s.move = stats.move();
+		}
+		if(stats.has_initiative()) {
+			s.initiative = stats.initiative();
+		}
+		if(stats.has_name()) {
+			s.name = stats.name();
+		}
+		if(stats.has_range()) {
+			s.range = stats.range();
+		}
+		if(stats.has_critical_strike()) {
+			s.critical_strike = stats.critical_strike();
+		}
+		if(stats.has_attacks_this_turn()) {
+			s.attacks_this_turn = stats.attacks_this_turn();
+		}
+	}
+
+	void set_unit_id(Update_Unit* uu, const unit_ptr& u)
+	{
+		ASSERT_LOG(u->get_handle() >= 0, "Unit " << u << " has no handle, it hasn't been added to the game state.");
+		uu->set_handle(u->get_handle());
+	}
+
+	void write_path(Update_Unit* uu, const std::vector<point>& path)
+	{
+		auto pp = uu->mutable_packed_path();
+		pp->Reserve(static_cast<int>(path.size()) * 2);
+		point last;
+		for(auto& p : path) {
+			pp->AddAlreadyReserved(p.x - last.x);
+			pp->AddAlreadyReserved(p.y - last.y);
+			last = p;
+		}
+	}
+
+	std::vector<point> read_path(const Update_Unit& uu)
+	{
+		std::vector<point> path;
+		if(uu.packed_path_size() > 0) {
+			if(uu.packed_path_size() % 2 != 0) {
+				LOG_WARN("Packed path has an odd number of values: " << uu.packed_path_size());
+				return path;
+			}
+			path.reserve(uu.packed_path_size() / 2);
+			point last;
+			for(int n = 0; n < uu.packed_path_size(); n += 2) {
+				last.x += uu.packed_path(n);
+				last.y += uu.packed_path(n + 1);
+				path.emplace_back(last);
+			}
+		} else {
+			path.reserve(uu.path_size());
+			for(auto& p : uu.path()) {
+				path.emplace_back(p.x(), p.y());
+			}
+		}
+		return path;
+	}
+
+	void compress_update(const Update& up, Update* out)
+	{
+		const std::string data = up.SerializeAsString();
+		uLongf size = compressBound(static_cast<uLong>(data.size()));
+		std::string* compressed = out->mutable_compressed_state();
+		compressed->resize(size);
+		const int res = compress2(reinterpret_cast<Bytef*>(&(*compressed)[0]), &size,
+			reinterpret_cast<const Bytef*>(data.data()), static_cast<uLong>(data.size()), Z_DEFAULT_COMPRESSION);
+		ASSERT_LOG(res == Z_OK, "Compressing update " << up.id() << " failed: " << res);
+		compressed->resize(size);
+		out->set_compressed_state_size(static_cast<uint32_t>(data.size()));
+	}
+
+	bool decompress_update(const Update& up, Update* out)
+	{
+		if(!up.has_compressed_state() || up.compressed_state_size() > max_uncompressed_size) {
+			return false;
+		}
+		uLongf size = up.compressed_state_size();
+		std::string data(size, '\0');
+		const int res = uncompress(reinterpret_cast<Bytef*>(&data[0]), &size,
+			reinterpret_cast<const Bytef*>(up.compressed_state().data()), static_cast<uLong>(up.compressed_state().size()));
+		if(res != Z_OK || size != up.compressed_state_size()) {
+			LOG_WARN("Couldn't decompress update " << up.id() << ": " << res);
+			return false;
+		}
+		return out->ParseFromString(data);
+	}
+}
@@ -0,0 +1,106 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "geometry.hpp"
+#include "message_format.pb.h"
+#include "units_fwd.hpp"
+#include "uuid.hpp"
+
+namespace game
+{
+	// Table of the numeric handles used to refer to units in updates, in place of their
+	// uuids. Handles are handed out in the order units are added to the game state and
+	// are never reused, so they also index the uuid of units which have since died.
+	//
+	// It also remembers the stats last sent for each unit, so that only the stats which
+	// have changed need to be sent. Updates go over a reliable, ordered channel so what
+	// was last sent is what the other end has.
+	class unit_handles
+	{
+	public:
+		unit_handles();
+
+		// Gives the unit a handle if it doesn't have one, or one of another unit.
+		void bind(const unit_ptr& u);
+		// Gives the unit the given handle, for instance as sent by the server.
+		void bind(const unit_ptr& u, int handle);
+		void unbind(const unit_ptr& u);
+		// Gives the handle to a unit that has since been removed, so that the uuid can
+		// still be looked up, for instance when loading a full state.
+		void reserve(int handle, const uuid::uuid& id);
+		// Point the handles at the given units, used after copying units.
+		void relink(const unit_list& units);
+		void clear();
+
+		// nullptr if there is no such unit or it has been removed.
+		unit_ptr get_unit(int handle) const;
+		// Asserts if there was never a unit with the handle.
+		const uuid::uuid& get_uuid(int handle) const;
+		// nullptr if there is no such unit or it has been removed.
+		unit_ptr find(const uuid::uuid& id) const;
+		int size() const { return static_cast<int>(entries_.size()); }
+
+		// Removes any stats that are the same as the ones last sent for the unit and
+		// records the rest as sent.
+		void strip_unchanged(const unit_ptr& u, Update_UnitStats* stats);
+		// Records the stats as sent.
+		void record(const unit_ptr& u, const Update_UnitStats& stats);
+	private:
+		struct unit_stats
+		{
+			int health;
+			int attack;
+			int armour;
+			float move;
+			float initiative;
+			std::string name;
+			int range;
+			float critical_strike;
+			int attacks_this_turn;
+		};
+
+		struct entry
+		{
+			unit_ptr u;
+			uuid::uuid id;
+			unit_stats sent;
+		};
+		std::vector<entry> entries_;
+		// Handle for each uuid in entries_.
+		std::unordered_map<uuid::uuid, int, uuid::hash> by_uuid_;
+
+		entry& get_entry(const unit_ptr& u);
+		static void read_stats(const unit_ptr& u, unit_stats* s);
+	};
+
+	// Set the identity of the unit in the message.
+	void set_unit_id(Update_Unit* uu, const unit_ptr& u);
+	void write_path(Update_Unit* uu, const std::vector<point>& path);
+	// Reads either the packed or older form of the path. A malformed path reads as empty.
+	std::vector<point> read_path(const Update_Unit& uu);
+
+	// Puts the update into the compressed_state of out, compressed with zlib.
+	void compress_update(const Update& up, Update* out);
+	// Reads the update back out of the compressed_state of up. Returns false if there is
+	// none or it is corrupt.
+	bool decompress_update(const Update& up, Update* out);
+}
@@ -0,0 +1,70 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+
+#include "message_format.pb.h"
+#include "queue.hpp"
+
+namespace network
+{
+	// Recycles game::Update objects. A cleared message keeps the memory of its strings and
+	// sub-messages, so reusing them saves most of the allocations of parsing the next one.
+	// Updates may be released from any thread, only one thread may acquire them.
+	class update_pool
+	{
+	public:
+		explicit update_pool(size_t capacity=256) : free_(capacity) {}
+		~update_pool()
+		{
+			game::Update* up;
+			while(free_.try_pop(up)) {
+				delete up;
+			}
+		}
+
+		game::Update* acquire()
+		{
+			game::Update* up;
+			if(free_.try_pop(up)) {
+				return up;
+			}
+			return new game::Update();
+		}
+
+		void release(game::Update* up)
+		{
+			up->Clear();
+			if(!free_.try_push(up)) {
+				delete up;
+			}
+		}
+
+		// Wrap an update from the pool so that it's released back to the pool when the
+		// last reference goes away. The pool must outlive the pointer.
+		std::shared_ptr<game::Update> make_shared(game::Update* up)
+		{
+			return std::shared_ptr<game::Update>(up, [this](game::Update* u) { release(u); });
+		}
+	private:
+		queue::mpsc_queue<game::Update*> free_;
+
+		update_pool(const update_pool&) = delete;
+		void operator=(const update_pool&) = delete;
+	};
+}
@@ -15,58 +15,100 @@
 */
 
 #include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/random/mersenne_twister.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream> 
-#include <sstream>
+#include <random>
 
 #include "asserts.hpp"
+#include "random.hpp"
+#include "registry.hpp"
+#include "unit_test.hpp"
 #include "uuid.hpp"
 
 namespace uuid
 {
 	namespace 
 	{
-		boost::mt19937* twister_rng() 
+		// uuids are the values of a random stream, with a key that should be different for
+		// every process. Taking the next position in the stream is the only shared state, so
+		// the server worker threads can make uuids without locking.
+		uint64_t make_key()
 		{
-			static boost::mt19937 ran;
-			ran.seed(static_cast<unsigned>(boost::posix_time::microsec_clock::local_time().time_of_day().total_milliseconds()));
-			return &ran;
+			std::random_device rd;
+			const uint64_t t = static_cast<uint64_t>(boost::posix_time::microsec_clock::local_time().time_of_day().total_microseconds());
+			return ((static_cast<uint64_t>(rd()) << 32) | rd()) ^ t;
 		}
+		const uint64_t uuid_key = make_key();
+		std::atomic<uint64_t> uuid_counter(0);
+
+		const char hex_digits[] = "0123456789abcdef";
+
+		// Value of each hex digit by character, -1 for anything that isn't one.
+		struct hex_table
+		{
+			hex_table() {
+				std::fill(values, values + 256, static_cast<int8_t>(-1));
+				for(int n = 0; n != 10; ++n) {
+					values['0' + n] = static_cast<int8_t>(n);
+				}
+				for(int n = 0; n != 6; ++n) {
+					values['a' + n] = values['A' + n] = static_cast<int8_t>(10 + n);
+				}
+			}
+			int8_t values[256];
+		};
+		const hex_table hex_values;
 	}
 
 	boost::uuids::uuid generate() 
 	{
-		static boost::uuids::basic_random_generator<boost::mt19937> gen(twister_rng());
-		return gen();
+		uint32_t words[4];
+		generator::stream::block(uuid_key, 0, uuid_counter++, words);
+		boost::uuids::uuid result;
+		static_assert(sizeof(words) == sizeof(result), "uuid isn't 16 bytes.");
+		std::memcpy(&*result.begin(), words, sizeof(words));
+		// Mark it as a random (version 4, variant 1) uuid.
+		result.data[6] = (result.data[6] & 0x0f) | 0x40;
+		result.data[8] = (result.data[8] & 0x3f) | 0x80;
+		return result;
 	}
 
 	std::string write(const boost::uuids::uuid& id) 
 	{
-		std::stringstream str;
+		std::string str(id.size() * 2, '0');
+		size_t n = 0;
 		for(auto num : id) {
-			str << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(num);
+			str[n++] = hex_digits[num >> 4];
+			str[n++] = hex_digits[num & 0x0f];
 		}
-		return str.str();
+		return str;
 	}
 
 	boost::uuids::uuid read(const std::string& s) 
 	{
 		boost::uuids::uuid result;
+		const bool ok = read(s, &result);
+		ASSERT_LOG(ok, "Trying to deserialize bad UUID: " << s);
+		return result;
+	}
 
-		const std::string& nums = s;
-		const char* ptr = nums.c_str();
-		ASSERT_LOG(nums.size() == 32, "Trying to deserialize bad UUID: " << nums);
-		for(auto itor = result.begin(); itor != result.end(); ++itor) {
-			char buf[3];
-			buf[0] = *ptr++;
-			buf[1] = *ptr++;
-			buf[2] = 0;
-
-			*itor = static_cast<uint8_t>(strtol(buf, NULL, 16));
+	bool read(const std::string& s, boost::uuids::uuid* out)
+	{
+		if(s.size() != 32) {
+			return false;
 		}
-
-		return result;
+		const unsigned char* ptr = reinterpret_cast<const unsigned char*>(s.c_str());
+		for(auto itor = out->begin(); itor != out->end(); ++itor) {
+			const int hi = hex_values.values[*ptr++];
+			const int lo = hex_values.values[*ptr++];
+			if(hi < 0 || lo < 0) {
+				return false;
+			}
+			*itor = static_cast<uint8_t>((hi << 4) | lo);
+		}
+		return true;
 	}
 }
 
@@ -75,3 +117,52 @@ std::ostream& operator<<(std::ostream& os, const uuid::uuid& uid)
 	os << uuid::write(uid);
 	return os;
 }
+
+UNIT_TEST(uuid)
+{
+	const uuid::uuid id = uuid::generate();
+	const std::string s = uuid::write(id);
+	CHECK_EQ(s.size(), 32u);
+	CHECK_EQ(uuid::read(s) == id, true);
+	CHECK_EQ(uuid::write(uuid::read("00ff10ABcdef0123456789abcdefFEDC")), "00ff10abcdef0123456789abcdeffedc");
+	CHECK_EQ(uuid::hash()(uuid::read(s)), uuid::hash()(id));
+	uuid::uuid parsed;
+	CHECK_EQ(uuid::read(s, &parsed) && parsed == id, true);
+	CHECK_EQ(uuid::read("00ff10ABcdef0123456789abcdefFED", &parsed), false);
+	CHECK_EQ(uuid::read("00ff10ABcdef0123456789abcdefFEDG", &parsed), false);
+	CHECK_EQ(uuid::generate() == id, false);
+	CHECK_EQ(id.version(), boost::uuids::uuid::version_random_number_based);
+}
+
+UNIT_TEST(registry)
+{
+	registry::table<int> t;
+	const uuid::uuid a = uuid::read("000102030405060708090a0b0c0d0e0f");
+	const uuid::uuid b = uuid::read("f00102030405060708090a0b0c0d0e0f");
+	const uuid::uuid c = uuid::read("0f0102030405060708090a0b0c0d0e0f");
+	const registry::handle ha = t.set(a, 1);
+	const registry::handle hb = t.set(b, 2);
+	CHECK_NE(ha, registry::invalid_handle);
+	CHECK_EQ(t.set(a, 3), ha);
+	CHECK_EQ(*t.get(ha), 3);
+	CHECK_EQ(*t.get(b), 2);
+	CHECK_EQ(t.find(b), hb);
+	CHECK_EQ(t.size(), 2u);
+
+	// A removed entries slot is reused, but the old handle doesn't find the new entry.
+	CHECK_EQ(t.erase(ha), true);
+	CHECK_EQ(t.erase(ha), false);
+	CHECK_EQ(t.get(a) == nullptr, true);
+	const registry::handle hc = t.set(c, 4);
+	CHECK_EQ(hc & 0xffff, ha & 0xffff);
+	CHECK_EQ(t.get(ha) == nullptr, true);
+	CHECK_EQ(*t.get(hc), 4);
+	CHECK_EQ(t.find(a), registry::invalid_handle);
+
+	int sum = 0;
+	t.for_each([&sum](const uuid::uuid& id, int v) { sum += v; });
+	CHECK_EQ(sum, 6);
+	t.clear();
+	CHECK_EQ(t.empty(), true);
+	CHECK_EQ(t.get(hb) == nullptr, true);
+}
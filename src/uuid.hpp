@@ -14,6 +14,10 @@
    limitations under the License.
 */
 
+#pragma once
+
+#include <cstdint>
+#include <cstring>
 #include <boost/uuid/uuid_generators.hpp>
 
 namespace uuid
@@ -21,8 +25,24 @@ namespace uuid
 	typedef boost::uuids::uuid uuid;
 
 	uuid generate();
+	// As 32 lower case hex digits.
 	std::string write(const uuid& uid);
+	// Asserts if s isn't a uuid.
 	uuid read(const std::string& s);
+	// Returns false if s isn't a uuid, for uuids from the network.
+	bool read(const std::string& s, uuid* out);
+
+	// For unordered containers keyed by uuid. The generated uuids are random, so folding the
+	// two halves together is enough.
+	struct hash
+	{
+		size_t operator()(const uuid& id) const {
+			uint64_t words[2];
+			static_assert(sizeof(words) == sizeof(uuid), "uuid isn't 16 bytes.");
+			std::memcpy(words, &*id.begin(), sizeof(words));
+			return static_cast<size_t>(words[0] ^ (words[1] * 0x9e3779b97f4a7c15ULL));
+		}
+	};
 }
 
 std::ostream& operator<<(std::ostream& os, const uuid::uuid& uid);
@@ -0,0 +1,82 @@
+/*
+	Copyright 2014 Kristina Simpson <sweet.kristas@gmail.com>
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "geometry.hpp"
+#include "uuid.hpp"
+
+// Zobrist style hashing of game positions. The hash of a position is the exclusive-or of a
+// key for each property of each unit, so when a property changes the hash is updated by
+// xoring out the key for the old value and xoring in the key for the new one. Rather than
+// tables of random numbers the keys are made by mixing the unit, property and value, which
+// works for any map size and number of units.
+//
+// game::state and game::snapshot give the same hash for the same position.
+namespace zobrist
+{
+	enum class property : uint32_t
+	{
+		POSITION = 1,
+		HEALTH,
+		MOVE,
+		INITIATIVE,
+		ATTACKS,
+	};
+
+	// Finalizer from splitmix64, every bit of the input affects every bit of the output.
+	inline uint64_t mix(uint64_t x)
+	{
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	// Key identifying a unit, from which the keys for its properties are made.
+	inline uint64_t unit_key(const uuid::uuid& id)
+	{
+		uint64_t words[2];
+		static_assert(sizeof(words) == sizeof(uuid::uuid), "uuid isn't 16 bytes.");
+		std::memcpy(words, &*id.begin(), sizeof(words));
+		return mix(words[0] ^ mix(words[1]));
+	}
+
+	inline uint64_t key(uint64_t unit, property p, uint32_t value)
+	{
+		return mix(unit ^ ((static_cast<uint64_t>(p) << 32) | value));
+	}
+
+	inline uint32_t float_bits(float f)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		return bits;
+	}
+
+	// Hash of everything about one unit that changes in play.
+	inline uint64_t unit_hash(uint64_t unit, const point& pos, int health, float move, float initiative, int attacks)
+	{
+		return unit
+			^ key(unit, property::POSITION, (static_cast<uint32_t>(pos.x) & 0xffff) | (static_cast<uint32_t>(pos.y) << 16))
+			^ key(unit, property::HEALTH, static_cast<uint32_t>(health))
+			^ key(unit, property::MOVE, float_bits(move))
+			^ key(unit, property::INITIATIVE, float_bits(initiative))
+			^ key(unit, property::ATTACKS, static_cast<uint32_t>(attacks));
+	}
+}